@@ -119,6 +119,8 @@ void InitializeAgenda(
 
    AgendaData(theEnv)->Strategy = DEFAULT_STRATEGY;
 
+   AgendaData(theEnv)->AgendaIndexing = DEFAULT_AGENDA_INDEXING;
+
    AddClearFunction(theEnv,"agenda",AgendaClearFunction,0,NULL);
 #if DEBUGGING_FUNCTIONS
    AddWatchItem(theEnv,"activations",1,&AgendaData(theEnv)->WatchActivations,40,DefruleWatchAccess,DefruleWatchPrint);
@@ -176,6 +178,7 @@ void AddActivation(
    newActivation->randomID = genrand();
    newActivation->prev = NULL;
    newActivation->next = NULL;
+   newActivation->indexNode = NULL;
 
    AgendaData(theEnv)->NumberOfActivations++;
 
@@ -221,6 +224,7 @@ static struct salienceGroup *ReuseOrCreateSalienceGroup(
   int salience)
   {
    struct salienceGroup *theGroup, *lastGroup, *newGroup;
+   int i;
 
    for (lastGroup = NULL, theGroup = theRuleModule->groupings;
         theGroup != NULL;
@@ -239,6 +243,8 @@ static struct salienceGroup *ReuseOrCreateSalienceGroup(
    newGroup->last = NULL;
    newGroup->next = theGroup;
    newGroup->prev = lastGroup;
+   for (i = 0; i < AGENDA_INDEX_LEVELS; i++)
+     { newGroup->index[i] = NULL; }
 
    if (newGroup->next != NULL)
      { newGroup->next->prev = newGroup; }
@@ -466,6 +472,13 @@ bool MoveActivationToTop(
 
    if (theActivation == theModuleItem->agenda) return false;
 
+   /*=================================================*/
+   /* The activation no longer belongs to its group   */
+   /* since it is placed ahead of every other one.    */
+   /*=================================================*/
+
+   RemoveActivationFromGroup(theEnv,theActivation,theModuleItem);
+
    /*=================================================*/
    /* Update the pointers of the activation preceding */
    /* and following the activation being moved.       */
@@ -714,6 +727,7 @@ void RemoveActivation(
 
    AgendaData(theEnv)->NumberOfActivations--;
 
+   RemoveActivationIndex(theEnv,theActivation);
    rtn_struct(theEnv,activation,theActivation);
   }
 
@@ -727,6 +741,8 @@ static void RemoveActivationFromGroup(
   {
    struct salienceGroup *theGroup;
 
+   RemoveActivationIndex(theEnv,theActivation);
+
    theGroup = FindSalienceGroup(theRuleModule,theActivation->salience);
    if (theGroup == NULL) return;
 
@@ -896,6 +912,7 @@ void ReorderAgenda(
       tempPtr = theActivation->next;
       theActivation->next = NULL;
       theActivation->prev = NULL;
+      ReturnActivationIndex(theEnv,theActivation);
       theGroup = ReuseOrCreateSalienceGroup(theEnv,theModuleItem,theActivation->salience);
       PlaceActivation(theEnv,&(theModuleItem->agenda),theActivation,theGroup);
       theActivation = tempPtr;
@@ -974,6 +991,8 @@ void Refresh(
       /* satisfies the LHS of the rule. */
       /*================================*/
 
+      CompleteBetaMemoryRehash(theEnv,rulePtr->lastJoin->leftMemory);
+
       for (b = 0; b < rulePtr->lastJoin->leftMemory->size; b++)
         {
          for (listOfMatches = rulePtr->lastJoin->leftMemory->beta[b];
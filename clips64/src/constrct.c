@@ -568,6 +568,14 @@ void Reset(
    
    CallPeriodicTasks(theEnv);
 
+   /*==============================================*/
+   /* Return the slabs emptied by the retractions  */
+   /* of the reset. A clear ends with a reset, so  */
+   /* its slabs are released here as well.         */
+   /*==============================================*/
+
+   ReleaseSlabs(theEnv);
+
    /*===================================*/
    /* A reset is no longer in progress. */
    /*===================================*/
@@ -11,7 +11,8 @@
 /*   placed on the agenda based on the current conflict      */
 /*   resolution strategy (depth, breadth, mea, lex,          */
 /*   simplicity, or complexity). Also provides the           */
-/*   set-strategy and get-strategy commands.                 */
+/*   set-strategy and get-strategy commands, and the         */
+/*   set-agenda-indexing and get-agenda-indexing commands.   */
 /*                                                           */
 /* Principal Programmer(s):                                  */
 /*      Gary D. Riley                                        */
@@ -72,6 +73,26 @@
 #define GetMatchingItem(x,i) ((x->basis->binds[i].gm.theMatch != NULL) ? \
                               (x->basis->binds[i].gm.theMatch->matchingItem) : NULL)
 
+/**************************************************************/
+/* agendaIndexNode: The node of an activation in the skip     */
+/*   list indexing its salience group. The node has one link  */
+/*   in each direction per level, and caches the sort keys of */
+/*   the activation so the strategy ordering is computed once */
+/*   per activation rather than once per comparison.          */
+/**************************************************************/
+struct agendaIndexNode
+  {
+   Activation *theActivation;
+   struct salienceGroup *theGroup;
+   unsigned long long whoset;
+   unsigned short height;
+   unsigned short keyCount;
+   size_t size;
+   unsigned long long *key;
+   struct agendaIndexNode **next;
+   struct agendaIndexNode **prev;
+  };
+
 /***************************************/
 /* LOCAL INTERNAL FUNCTION DEFINITIONS */
 /***************************************/
@@ -83,6 +104,13 @@
    static Activation             *PlaceComplexityActivation(Activation *,struct salienceGroup *);
    static Activation             *PlaceSimplicityActivation(Activation *,struct salienceGroup *);
    static Activation             *PlaceRandomActivation(Activation *,struct salienceGroup *);
+   static Activation             *PlaceIndexedActivation(Environment *,Activation *,struct salienceGroup *);
+   static bool                    IndexedStrategy(StrategyType);
+   static struct agendaIndexNode *CreateIndexNode(Environment *,Activation *,struct salienceGroup *);
+   static unsigned short          IndexNodeHeight(unsigned long long);
+   static bool                    IndexNodePrecedes(StrategyType,struct agendaIndexNode *,struct agendaIndexNode *);
+   static int                     CompareIndexKeys(struct agendaIndexNode *,struct agendaIndexNode *);
+   static void                    SortTimetags(struct partialMatch *,unsigned long long *);
    static int                     ComparePartialMatches(Environment *,Activation *,Activation *);
    static const char             *GetStrategyName(StrategyType);
    static unsigned long long     *SortPartialMatch(Environment *,struct partialMatch *);
@@ -112,7 +140,10 @@ void PlaceActivation(
    /* current conflict resolution strategy.       */
    /*==============================================*/
 
-   if (*whichAgenda != NULL)
+   if (AgendaData(theEnv)->AgendaIndexing &&
+       IndexedStrategy(AgendaData(theEnv)->Strategy))
+     { placeAfter = PlaceIndexedActivation(theEnv,newActivation,theGroup); }
+   else if (*whichAgenda != NULL)
      {
       switch (AgendaData(theEnv)->Strategy)
         {
@@ -797,6 +828,330 @@ static Activation *PlaceRandomActivation(
    return(lastAct);
   }
 
+/*******************************************************************/
+/* PlaceIndexedActivation: Determines the location in the agenda   */
+/*    where a new activation should be placed for the lex, mea,    */
+/*    complexity, simplicity, and random strategies when agenda    */
+/*    indexing is enabled. The activations of each salience group  */
+/*    are indexed by a skip list kept in the strategy's order, so  */
+/*    the insertion point is found in logarithmic rather than      */
+/*    linear time. Returns a pointer to the activation after which */
+/*    the new activation should be placed (or NULL if the          */
+/*    activation should be placed at the beginning of the agenda). */
+/*******************************************************************/
+static Activation *PlaceIndexedActivation(
+  Environment *theEnv,
+  Activation *newActivation,
+  struct salienceGroup *theGroup)
+  {
+   struct agendaIndexNode *newNode, *lastNode = NULL, *nextNode;
+   struct agendaIndexNode *update[AGENDA_INDEX_LEVELS];
+   StrategyType strategy = AgendaData(theEnv)->Strategy;
+   Activation *lastAct;
+   int level;
+
+   newNode = CreateIndexNode(theEnv,newActivation,theGroup);
+
+   /*=========================================================*/
+   /* Find the last activation of the group placed before the */
+   /* new activation, descending from the sparsest level of   */
+   /* the skip list. The nodes preceding the insertion point  */
+   /* at each level are remembered to link the new node.      */
+   /*=========================================================*/
+
+   for (level = AGENDA_INDEX_LEVELS - 1; level >= 0; level--)
+     {
+      if (lastNode == NULL)
+        { nextNode = theGroup->index[level]; }
+      else
+        { nextNode = lastNode->next[level]; }
+
+      while ((nextNode != NULL) && IndexNodePrecedes(strategy,nextNode,newNode))
+        {
+         lastNode = nextNode;
+         nextNode = nextNode->next[level];
+        }
+
+      update[level] = lastNode;
+     }
+
+   /*==================================*/
+   /* Link the new node at each level. */
+   /*==================================*/
+
+   for (level = 0; level < newNode->height; level++)
+     {
+      newNode->prev[level] = update[level];
+      if (update[level] == NULL)
+        {
+         newNode->next[level] = theGroup->index[level];
+         theGroup->index[level] = newNode;
+        }
+      else
+        {
+         newNode->next[level] = update[level]->next[level];
+         update[level]->next[level] = newNode;
+        }
+
+      if (newNode->next[level] != NULL)
+        { newNode->next[level]->prev[level] = newNode; }
+     }
+
+   newActivation->indexNode = newNode;
+
+   /*=========================================================*/
+   /* If no activation of the group precedes the new one, it  */
+   /* is placed after the activations of higher salience.     */
+   /*=========================================================*/
+
+   if (lastNode != NULL)
+     { lastAct = lastNode->theActivation; }
+   else if (theGroup->prev == NULL)
+     { lastAct = NULL; }
+   else
+     { lastAct = theGroup->prev->last; }
+
+   /*========================================*/
+   /* Update the salience group information. */
+   /*========================================*/
+
+   if ((lastAct == NULL) ||
+       ((theGroup->prev != NULL) && (theGroup->prev->last == lastAct)))
+     { theGroup->first = newActivation; }
+
+   if ((theGroup->last == NULL) || (theGroup->last == lastAct))
+     { theGroup->last = newActivation; }
+
+   /*===========================================*/
+   /* Return the insertion point in the agenda. */
+   /*===========================================*/
+
+   return lastAct;
+  }
+
+/************************************************************/
+/* IndexedStrategy: Returns true if activations are indexed */
+/*   when placed using the specified strategy. The depth    */
+/*   and breadth strategies place new activations at either */
+/*   end of their group, so they don't need an index.       */
+/************************************************************/
+static bool IndexedStrategy(
+  StrategyType strategy)
+  {
+   switch (strategy)
+     {
+      case LEX_STRATEGY:
+      case MEA_STRATEGY:
+      case COMPLEXITY_STRATEGY:
+      case SIMPLICITY_STRATEGY:
+      case RANDOM_STRATEGY:
+        return true;
+
+      default:
+        return false;
+     }
+  }
+
+/***************************************************************/
+/* CreateIndexNode: Creates the index node of an activation.   */
+/*   The links and the sorted timetags used by the lex and mea */
+/*   strategies are allocated along with the node.             */
+/***************************************************************/
+static struct agendaIndexNode *CreateIndexNode(
+  Environment *theEnv,
+  Activation *theActivation,
+  struct salienceGroup *theGroup)
+  {
+   struct agendaIndexNode *theNode;
+   unsigned short height, keyCount = 0;
+   size_t size;
+
+   height = IndexNodeHeight(theActivation->timetag);
+   if ((AgendaData(theEnv)->Strategy == LEX_STRATEGY) ||
+       (AgendaData(theEnv)->Strategy == MEA_STRATEGY))
+     { keyCount = theActivation->basis->bcount; }
+
+   size = sizeof(struct agendaIndexNode) +
+          (sizeof(struct agendaIndexNode *) * 2 * height) +
+          (sizeof(unsigned long long) * keyCount);
+
+   theNode = (struct agendaIndexNode *) get_mem(theEnv,size);
+   theNode->theActivation = theActivation;
+   theNode->theGroup = theGroup;
+   theNode->height = height;
+   theNode->keyCount = keyCount;
+   theNode->size = size;
+   theNode->next = (struct agendaIndexNode **) (theNode + 1);
+   theNode->prev = theNode->next + height;
+   theNode->key = (unsigned long long *) (theNode->prev + height);
+   theNode->whoset = 0;
+
+   if ((AgendaData(theEnv)->Strategy == MEA_STRATEGY) &&
+       (GetMatchingItem(theActivation,0) != NULL))
+     { theNode->whoset = GetMatchingItem(theActivation,0)->timeTag; }
+
+   if (keyCount > 0)
+     { SortTimetags(theActivation->basis,theNode->key); }
+
+   return theNode;
+  }
+
+/****************************************************************/
+/* IndexNodeHeight: Determines the number of levels of an index */
+/*   node, one more for each quarter of the nodes. The height   */
+/*   is derived from the timetag of the activation so random    */
+/*   numbers used by the random strategy are left untouched.    */
+/****************************************************************/
+static unsigned short IndexNodeHeight(
+  unsigned long long timetag)
+  {
+   unsigned long long hash;
+   unsigned short height = 1;
+
+   hash = timetag + 0x9E3779B97F4A7C15ULL;
+   hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+   hash = hash ^ (hash >> 31);
+
+   while ((height < AGENDA_INDEX_LEVELS) && ((hash & 0x3) == 0))
+     {
+      height++;
+      hash >>= 2;
+     }
+
+   return height;
+  }
+
+/*******************************************************************/
+/* IndexNodePrecedes: Returns true if the activation of actNode is */
+/*   placed before that of newNode. Mirrors the comparisons made   */
+/*   by the placement functions of each strategy.                  */
+/*******************************************************************/
+static bool IndexNodePrecedes(
+  StrategyType strategy,
+  struct agendaIndexNode *actNode,
+  struct agendaIndexNode *newNode)
+  {
+   Activation *actPtr = actNode->theActivation;
+   Activation *newActivation = newNode->theActivation;
+   int flag;
+
+   switch (strategy)
+     {
+      case MEA_STRATEGY:
+        if (actNode->whoset != newNode->whoset)
+          { return (actNode->whoset > newNode->whoset); }
+        /* Fall through to the lex comparison. */
+
+      case LEX_STRATEGY:
+        flag = CompareIndexKeys(actNode,newNode);
+        if (flag == LESS_THAN) return true;
+        else if (flag == GREATER_THAN) return false;
+        break;
+
+      case COMPLEXITY_STRATEGY:
+        if (newActivation->theRule->complexity < actPtr->theRule->complexity)
+          { return true; }
+        else if (newActivation->theRule->complexity > actPtr->theRule->complexity)
+          { return false; }
+        break;
+
+      case SIMPLICITY_STRATEGY:
+        if (newActivation->theRule->complexity > actPtr->theRule->complexity)
+          { return true; }
+        else if (newActivation->theRule->complexity < actPtr->theRule->complexity)
+          { return false; }
+        break;
+
+      case RANDOM_STRATEGY:
+        if (newActivation->randomID > actPtr->randomID)
+          { return true; }
+        else if (newActivation->randomID < actPtr->randomID)
+          { return false; }
+        break;
+
+      default:
+        break;
+     }
+
+   return (newActivation->timetag > actPtr->timetag);
+  }
+
+/******************************************************************/
+/* CompareIndexKeys: Compares two activations using the lex       */
+/*   conflict resolution strategy like ComparePartialMatches, but */
+/*   using the sorted timetags cached in their index nodes.       */
+/******************************************************************/
+static int CompareIndexKeys(
+  struct agendaIndexNode *actNode,
+  struct agendaIndexNode *newNode)
+  {
+   unsigned short mCount, i;
+
+   if (actNode->keyCount > newNode->keyCount) mCount = newNode->keyCount;
+   else mCount = actNode->keyCount;
+
+   for (i = 0 ; i < mCount ; i++)
+     {
+      if (newNode->key[i] < actNode->key[i])
+        { return(LESS_THAN); }
+      else if (newNode->key[i] > actNode->key[i])
+        { return(GREATER_THAN); }
+     }
+
+   if (newNode->keyCount < actNode->keyCount) return(LESS_THAN);
+   else if (newNode->keyCount > actNode->keyCount) return(GREATER_THAN);
+
+   if (newNode->theActivation->theRule->complexity < actNode->theActivation->theRule->complexity)
+     { return(LESS_THAN); }
+   else if (newNode->theActivation->theRule->complexity > actNode->theActivation->theRule->complexity)
+     { return(GREATER_THAN); }
+
+   return(EQUAL);
+  }
+
+/*******************************************************/
+/* RemoveActivationIndex: Unlinks an activation from   */
+/*   the index of its salience group, if it is indexed. */
+/*******************************************************/
+void RemoveActivationIndex(
+  Environment *theEnv,
+  Activation *theActivation)
+  {
+   struct agendaIndexNode *theNode = theActivation->indexNode;
+   unsigned short level;
+
+   if (theNode == NULL) return;
+
+   for (level = 0; level < theNode->height; level++)
+     {
+      if (theNode->prev[level] == NULL)
+        { theNode->theGroup->index[level] = theNode->next[level]; }
+      else
+        { theNode->prev[level]->next[level] = theNode->next[level]; }
+
+      if (theNode->next[level] != NULL)
+        { theNode->next[level]->prev[level] = theNode->prev[level]; }
+     }
+
+   ReturnActivationIndex(theEnv,theActivation);
+  }
+
+/*************************************************************/
+/* ReturnActivationIndex: Returns the index node of an       */
+/*   activation to the memory manager without unlinking it.  */
+/*   Used when its salience group is being discarded as well. */
+/*************************************************************/
+void ReturnActivationIndex(
+  Environment *theEnv,
+  Activation *theActivation)
+  {
+   if (theActivation->indexNode == NULL) return;
+
+   rtn_mem(theEnv,theActivation->indexNode->size,theActivation->indexNode);
+   theActivation->indexNode = NULL;
+  }
+
 /*********************************************************/
 /* SortPartialMatch: Creates an array of sorted timetags */
 /*    in ascending order from a partial match.           */
@@ -806,6 +1161,21 @@ static unsigned long long *SortPartialMatch(
   struct partialMatch *binds)
   {
    unsigned long long *nbinds;
+
+   nbinds = (unsigned long long *) get_mem(theEnv,sizeof(long long) * binds->bcount);
+   SortTimetags(binds,nbinds);
+
+   return nbinds;
+  }
+
+/*********************************************************/
+/* SortTimetags: Fills an array with the sorted timetags */
+/*    of a partial match.                                */
+/*********************************************************/
+static void SortTimetags(
+  struct partialMatch *binds,
+  unsigned long long *nbinds)
+  {
    unsigned long long temp;
    bool flag;
    unsigned short j, k;
@@ -816,8 +1186,6 @@ static unsigned long long *SortPartialMatch(
    /* should have timetags greater than 0.               */
    /*====================================================*/
 
-   nbinds = (unsigned long long *) get_mem(theEnv,sizeof(long long) * binds->bcount);
-
    for (j = 0; j < binds->bcount; j++)
      {
       if ((binds->binds[j].gm.theMatch != NULL) &&
@@ -847,12 +1215,6 @@ static unsigned long long *SortPartialMatch(
            }
         }
      }
-
-   /*===================*/
-   /* Return the array. */
-   /*===================*/
-
-   return nbinds;
   }
 
 /**************************************************************************/
@@ -977,6 +1339,39 @@ StrategyType GetStrategy(
    return AgendaData(theEnv)->Strategy;
   }
 
+/********************************************/
+/* SetAgendaIndexing: C access routine for  */
+/*   the set-agenda-indexing command. When  */
+/*   enabled, the activations of the lex,   */
+/*   mea, complexity, simplicity, and       */
+/*   random strategies are placed using an  */
+/*   index instead of a linear search.      */
+/********************************************/
+bool SetAgendaIndexing(
+  Environment *theEnv,
+  bool value)
+  {
+   bool oldValue;
+
+   oldValue = AgendaData(theEnv)->AgendaIndexing;
+   AgendaData(theEnv)->AgendaIndexing = value;
+
+   if (oldValue != value)
+     { ReorderAllAgendas(theEnv); }
+
+   return oldValue;
+  }
+
+/********************************************/
+/* GetAgendaIndexing: C access routine for  */
+/*   the get-agenda-indexing command.       */
+/********************************************/
+bool GetAgendaIndexing(
+  Environment *theEnv)
+  {
+   return AgendaData(theEnv)->AgendaIndexing;
+  }
+
 /********************************************/
 /* GetStrategyCommand: H/L access routine   */
 /*   for the get-strategy command.          */
@@ -1043,6 +1438,37 @@ void SetStrategyCommand(
      }
   }
 
+/***************************************************/
+/* SetAgendaIndexingCommand: H/L access routine    */
+/*   for the set-agenda-indexing command.          */
+/***************************************************/
+void SetAgendaIndexingCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   UDFValue theArg;
+
+   returnValue->lexemeValue = CreateBoolean(theEnv,GetAgendaIndexing(theEnv));
+
+   if (! UDFFirstArgument(context,ANY_TYPE_BITS,&theArg))
+     { return; }
+
+   SetAgendaIndexing(theEnv,theArg.value != FalseSymbol(theEnv));
+  }
+
+/***************************************************/
+/* GetAgendaIndexingCommand: H/L access routine    */
+/*   for the get-agenda-indexing command.          */
+/***************************************************/
+void GetAgendaIndexingCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   returnValue->lexemeValue = CreateBoolean(theEnv,GetAgendaIndexing(theEnv));
+  }
+
 /**********************************************************/
 /* GetStrategyName: Given the integer value corresponding */
 /*   to a specified strategy, return a character string   */
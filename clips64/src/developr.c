@@ -135,7 +135,7 @@ void PrimitiveTablesInfoCommand(
    /*====================================*/
 
    symbolArray = GetSymbolTable(theEnv);
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       for (symbolPtr = symbolArray[i]; symbolPtr != NULL; symbolPtr = symbolPtr->next)
         { symbolCount++; }
@@ -146,7 +146,7 @@ void PrimitiveTablesInfoCommand(
    /*====================================*/
 
    integerArray = GetIntegerTable(theEnv);
-   for (i = 0; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0; i < GetIntegerTableSize(theEnv); i++)
      {
       for (integerPtr = integerArray[i]; integerPtr != NULL; integerPtr = integerPtr->next)
         { integerCount++; }
@@ -157,7 +157,7 @@ void PrimitiveTablesInfoCommand(
    /*====================================*/
 
    floatArray = GetFloatTable(theEnv);
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < GetFloatTableSize(theEnv); i++)
      {
       for (floatPtr = floatArray[i]; floatPtr != NULL; floatPtr = floatPtr->next)
         { floatCount++; }
@@ -168,7 +168,7 @@ void PrimitiveTablesInfoCommand(
    /*====================================*/
 
    bitMapArray = GetBitMapTable(theEnv);
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < GetBitMapTableSize(theEnv); i++)
      {
       for (bitMapPtr = bitMapArray[i]; bitMapPtr != NULL; bitMapPtr = bitMapPtr->next)
         { bitMapCount++; }
@@ -221,7 +221,7 @@ void PrimitiveTablesUsageCommand(
    /*====================================*/
 
    symbolArray = GetSymbolTable(theEnv);
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       symbolCount = 0;
       for (symbolPtr = symbolArray[i]; symbolPtr != NULL; symbolPtr = symbolPtr->next)
@@ -241,7 +241,7 @@ void PrimitiveTablesUsageCommand(
    /*===================================*/
 
    floatArray = GetFloatTable(theEnv);
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < GetFloatTableSize(theEnv); i++)
      {
       floatCount = 0;
       for (floatPtr = floatArray[i]; floatPtr != NULL; floatPtr = floatPtr->next)
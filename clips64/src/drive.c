@@ -779,12 +779,6 @@ unsigned long BetaMemoryHashValue(
    struct partialMatch *oldRHSBinds;
    struct joinNode *oldJoin;
    unsigned long hashValue = 0;
-   unsigned long multiplier = 1;
-   union
-     {
-      void *vv;
-      unsigned long liv;
-     } fis;
 
    /*======================================*/
    /* A NULL expression evaluates to zero. */
@@ -835,44 +829,13 @@ unsigned long BetaMemoryHashValue(
       else
         { EvaluateExpression(theEnv,hashExpr,&theResult); }
 
-      switch (theResult.header->type)
-        {
-         case STRING_TYPE:
-         case SYMBOL_TYPE:
-         case INSTANCE_NAME_TYPE:
-           hashValue += theResult.lexemeValue->bucket * multiplier;
-           break;
-
-         case INTEGER_TYPE:
-            hashValue += (theResult.integerValue->bucket * multiplier);
-            break;
-
-         case FLOAT_TYPE:
-           hashValue += (theResult.floatValue->bucket * multiplier);
-           break;
-
-          case FACT_ADDRESS_TYPE:
-#if OBJECT_SYSTEM
-          case INSTANCE_ADDRESS_TYPE:
-#endif
-            fis.liv = 0;
-            fis.vv = theResult.value;
-            hashValue += fis.liv * multiplier;
-            break;
-
-          case EXTERNAL_ADDRESS_TYPE:
-            fis.liv = 0;
-            fis.vv = theResult.externalAddressValue->contents;
-            hashValue += fis.liv * multiplier;
-            break;
-        }
+      hashValue = HashJoinValue(hashValue,&theResult);
 
       /*==============================================*/
       /* Move to the next expression to be evaluated. */
       /*==============================================*/
 
       hashExpr = hashExpr->nextArg;
-	  multiplier = multiplier * 509;
 	 }
 
    /*=======================================*/
@@ -89,10 +89,15 @@ struct bsaveSlotValueAtom
                                                                unsigned int *,bool *);
 
    static bool                    VerifyBinaryHeader(Environment *,const char *);
+   static long                    ReadBinaryFacts(Environment *,const char *);
+   static bool                    VerifyBinaryFactsBuffer(Environment *,const char *,size_t);
+   static bool                    ReadBufferValue(const char *,size_t,size_t *,void *,size_t);
+   static bool                    SkipBufferArray(size_t,size_t *,unsigned long,size_t);
 
    static long                    MarkFacts(Environment *,SaveScope,Deftemplate **,unsigned int,size_t *);
    static void                    MarkSingleFact(Environment *,Fact *,size_t *);
    static void                    MarkNeededAtom(Environment *,CLIPSValue *,size_t *);
+   static long                    WriteBinaryFacts(Environment *,FILE *,SaveScope,Expression *);
    static void                    WriteBinaryHeader(Environment *,FILE *);
    static long                    SaveBinaryFacts(Environment *,FILE *,SaveScope,Deftemplate **,unsigned int count,size_t *);
    static void                    SaveSingleFactBinary(Environment *theEnv,FILE *,Fact *);
@@ -749,10 +754,6 @@ long BinaryLoadFacts(
   Environment *theEnv,
   const char *fileName)
   {
-   GCBlock gcb;
-   long i;
-   long factCount;
-
    /*=====================================*/
    /* If embedded, clear the error flags. */
    /*=====================================*/
@@ -770,6 +771,57 @@ long BinaryLoadFacts(
       return -1;
      }
 
+   return ReadBinaryFacts(theEnv,fileName);
+  }
+
+/***********************************************************/
+/* BinaryLoadFactsFromBuffer: C access routine for loading */
+/*   facts saved in the bsave-facts format from memory.    */
+/***********************************************************/
+long BinaryLoadFactsFromBuffer(
+  Environment *theEnv,
+  const char *buffer,
+  size_t size)
+  {
+   /*=====================================*/
+   /* If embedded, clear the error flags. */
+   /*=====================================*/
+   
+   if (EvaluationData(theEnv)->CurrentExpression == NULL)
+     { ResetErrorFlags(theEnv); }
+
+   /*===========================================*/
+   /* The buffer may come from an untrusted     */
+   /* source, so it is checked as a whole       */
+   /* before any of its contents are allocated. */
+   /*===========================================*/
+
+   if ((buffer == NULL) || (VerifyBinaryFactsBuffer(theEnv,buffer,size) == false))
+     { return -1; }
+
+   /*===================================*/
+   /* Read the binary file from memory. */
+   /*===================================*/
+
+   if (GenOpenReadBinaryBuffer(theEnv,buffer,size) == false)
+     { return -1; }
+
+   return ReadBinaryFacts(theEnv,"<memory buffer>");
+  }
+
+/****************************************************/
+/* ReadBinaryFacts: Loads the facts from the opened */
+/*   binary file and closes it. Shared by the file  */
+/*   and memory buffer variants of bload-facts.     */
+/****************************************************/
+static long ReadBinaryFacts(
+  Environment *theEnv,
+  const char *fileName)
+  {
+   GCBlock gcb;
+   long i;
+   long factCount;
+
    /*======================================*/
    /* Check the binary header to determine */
    /* if this is a binary fact file.       */
@@ -798,6 +850,12 @@ long BinaryLoadFacts(
    GenReadBinary(theEnv,&UtilityData(theEnv)->BinaryFileSize,sizeof(size_t));
    GenReadBinary(theEnv,&factCount,sizeof(long));
 
+   if (GenBinaryBufferShortRead(theEnv))
+     {
+      SetEvaluationError(theEnv,true);
+      factCount = 0;
+     }
+
    for (i = 0; i < factCount; i++)
      {
       if (LoadSingleBinaryFact(theEnv) == false)
@@ -846,6 +904,233 @@ long BinaryLoadFacts(
    return factCount;
   }
 
+/************************************************************/
+/* VerifyBinaryFactsBuffer: Walks a bsave-facts image held  */
+/*   in memory the way ReadBinaryFacts reads it, checking   */
+/*   that every count fits in the buffer, that the symbol   */
+/*   names are terminated, and that every symbol, float and */
+/*   integer index is within its table.                     */
+/************************************************************/
+static bool VerifyBinaryFactsBuffer(
+  Environment *theEnv,
+  const char *buffer,
+  size_t size)
+  {
+   size_t position = 0, factsStart, binaryFileSize;
+   unsigned long symbolCount = 0, floatCount = 0, integerCount = 0, bitMapCount = 0;
+   unsigned long space, offset, i, k, nameIndex, totalValueCount, valueSum;
+   unsigned short type, slotCount, bitMapSize;
+   unsigned char implied;
+   const char *area, *end;
+   long factCount, f;
+   struct bsaveSlotValue bs;
+   struct bsaveSlotValueAtom bsa;
+   bool valid = false;
+
+   /*=======================================*/
+   /* Check the prefix and version strings. */
+   /*=======================================*/
+
+   if ((SkipBufferArray(size,&position,strlen(BINARY_FACTS_PREFIX_ID) + 1,1) == false) ||
+       (memcmp(buffer,BINARY_FACTS_PREFIX_ID,strlen(BINARY_FACTS_PREFIX_ID) + 1) != 0) ||
+       (SkipBufferArray(size,&position,strlen(BINARY_FACTS_VERSION_ID) + 1,1) == false) ||
+       (memcmp(buffer + strlen(BINARY_FACTS_PREFIX_ID) + 1,BINARY_FACTS_VERSION_ID,
+               strlen(BINARY_FACTS_VERSION_ID) + 1) != 0))
+     { goto done; }
+
+   /*=========================================*/
+   /* Check the symbol types and names. Each  */
+   /* name must end within the names area.    */
+   /*=========================================*/
+
+   if ((! ReadBufferValue(buffer,size,&position,&symbolCount,sizeof(long))) ||
+       (! ReadBufferValue(buffer,size,&position,&space,sizeof(unsigned long))))
+     { goto done; }
+
+   if (symbolCount != 0)
+     {
+      area = buffer + position;
+      if (! SkipBufferArray(size,&position,symbolCount,sizeof(unsigned short)))
+        { goto done; }
+      for (i = 0; i < symbolCount; i++)
+        {
+         memcpy(&type,area + (i * sizeof(unsigned short)),sizeof(unsigned short));
+         if ((type != SYMBOL_TYPE) && (type != STRING_TYPE) && (type != INSTANCE_NAME_TYPE))
+           { goto done; }
+        }
+
+      area = buffer + position;
+      if (! SkipBufferArray(size,&position,space,1))
+        { goto done; }
+      for (i = 0, offset = 0; i < symbolCount; i++)
+        {
+         if (offset >= space) goto done;
+         end = (const char *) memchr(area + offset,'\0',space - offset);
+         if (end == NULL) goto done;
+         offset = (unsigned long) (end - area) + 1;
+        }
+     }
+
+   /*================================*/
+   /* Check the floats and integers. */
+   /*================================*/
+
+   if ((! ReadBufferValue(buffer,size,&position,&floatCount,sizeof(long))) ||
+       ((floatCount != 0) && (! SkipBufferArray(size,&position,floatCount,sizeof(double)))) ||
+       (! ReadBufferValue(buffer,size,&position,&integerCount,sizeof(unsigned long))) ||
+       ((integerCount != 0) && (! SkipBufferArray(size,&position,integerCount,sizeof(long long)))))
+     { goto done; }
+
+   /*=============================================*/
+   /* Check that each bitmap fits in its area.    */
+   /*=============================================*/
+
+   if ((! ReadBufferValue(buffer,size,&position,&bitMapCount,sizeof(long))) ||
+       (! ReadBufferValue(buffer,size,&position,&space,sizeof(unsigned long))))
+     { goto done; }
+
+   if (bitMapCount != 0)
+     {
+      area = buffer + position;
+      if (! SkipBufferArray(size,&position,space,1))
+        { goto done; }
+      for (i = 0, offset = 0; i < bitMapCount; i++)
+        {
+         if ((space - offset) < sizeof(unsigned short)) goto done;
+         memcpy(&bitMapSize,area + offset,sizeof(unsigned short));
+         offset += sizeof(unsigned short);
+         if ((space - offset) < bitMapSize) goto done;
+         offset += bitMapSize;
+        }
+     }
+
+   /*=============================================*/
+   /* The facts are read in blocks bound by the   */
+   /* size recorded in the image, which must then */
+   /* be within the buffer and cover every fact.  */
+   /*=============================================*/
+
+   if ((! ReadBufferValue(buffer,size,&position,&binaryFileSize,sizeof(size_t))) ||
+       (! ReadBufferValue(buffer,size,&position,&factCount,sizeof(long))) ||
+       (factCount < 0) ||
+       (binaryFileSize > (size - position)))
+     { goto done; }
+
+   factsStart = position;
+   size = position + binaryFileSize;
+
+   for (f = 0; f < factCount; f++)
+     {
+      if ((! ReadBufferValue(buffer,size,&position,&nameIndex,sizeof(unsigned long))) ||
+          (nameIndex >= symbolCount) ||
+          (! ReadBufferValue(buffer,size,&position,&implied,sizeof(bool))) ||
+          (implied > 1) ||
+          (! ReadBufferValue(buffer,size,&position,&slotCount,sizeof(unsigned short))))
+        { goto done; }
+
+      if (slotCount == 0) continue;
+
+      /*====================================================*/
+      /* Implied slots are unnamed. The value counts of the */
+      /* slots must add up to the number of atoms.          */
+      /*====================================================*/
+
+      valueSum = 0;
+      for (k = 0; k < slotCount; k++)
+        {
+         if (! ReadBufferValue(buffer,size,&position,&bs,sizeof(struct bsaveSlotValue)))
+           { goto done; }
+         if (implied ? (bs.slotName != ULONG_MAX) : (bs.slotName >= symbolCount))
+           { goto done; }
+         if (bs.valueCount > (ULONG_MAX - valueSum))
+           { goto done; }
+         valueSum += bs.valueCount;
+        }
+
+      if ((! ReadBufferValue(buffer,size,&position,&totalValueCount,sizeof(unsigned long))) ||
+          (totalValueCount != valueSum))
+        { goto done; }
+
+      for (k = 0; k < totalValueCount; k++)
+        {
+         if (! ReadBufferValue(buffer,size,&position,&bsa,sizeof(struct bsaveSlotValueAtom)))
+           { goto done; }
+         switch (bsa.type)
+           {
+            case SYMBOL_TYPE:
+            case STRING_TYPE:
+            case INSTANCE_NAME_TYPE:
+              if (bsa.value >= symbolCount) goto done;
+              break;
+
+            case FLOAT_TYPE:
+              if (bsa.value >= floatCount) goto done;
+              break;
+
+            case INTEGER_TYPE:
+              if (bsa.value >= integerCount) goto done;
+              break;
+
+            case FACT_ADDRESS_TYPE:
+            case EXTERNAL_ADDRESS_TYPE:
+              break;
+
+            default:
+              goto done;
+           }
+        }
+     }
+
+   valid = ((position - factsStart) <= binaryFileSize);
+
+done:
+   if (! valid)
+     {
+      PrintErrorID(theEnv,"FACTFILE",4,false);
+      WriteString(theEnv,STDERR,"Function 'bload-facts' found a malformed or truncated binary facts image in memory.\n");
+     }
+
+   return valid;
+  }
+
+/***********************************************************/
+/* ReadBufferValue: Copies a value from a memory buffer at */
+/*   the given position and advances the position past    */
+/*   it. Returns false if the value exceeds the buffer.   */
+/***********************************************************/
+static bool ReadBufferValue(
+  const char *buffer,
+  size_t size,
+  size_t *position,
+  void *value,
+  size_t valueSize)
+  {
+   if (valueSize > (size - *position)) return false;
+
+   memcpy(value,buffer + *position,valueSize);
+   *position += valueSize;
+
+   return true;
+  }
+
+/************************************************************/
+/* SkipBufferArray: Advances a position in a memory buffer  */
+/*   past an array. Returns false if the array exceeds the  */
+/*   buffer, without overflowing when the count is bogus.   */
+/************************************************************/
+static bool SkipBufferArray(
+  size_t size,
+  size_t *position,
+  unsigned long count,
+  size_t elementSize)
+  {
+   if (count > ((size - *position) / elementSize)) return false;
+
+   *position += count * elementSize;
+
+   return true;
+  }
+
 /***********************/
 /* VerifyBinaryHeader: */
 /***********************/
@@ -918,6 +1203,9 @@ static bool LoadSingleBinaryFact(
    
    BufferedRead(theEnv,&slotCount,sizeof(unsigned short));
 
+   if (GenBinaryBufferShortRead(theEnv))
+     { return false; }
+
    /*==================================*/
    /* Make sure the deftemplate exists */
    /* and check the slot count.        */
@@ -949,21 +1237,14 @@ static bool LoadSingleBinaryFact(
       return false;
      }
 
-   /*==================================*/
-   /* Create the new unitialized fact. */
-   /*==================================*/
-   
-   newFact = CreateFactBySize(theEnv,slotCount);
-   newFact->whichDeftemplate = theDeftemplate;
-
    if (slotCount == 0)
      {
+      newFact = CreateFactBySize(theEnv,slotCount);
+      newFact->whichDeftemplate = theDeftemplate;
       Assert(newFact);
       return true;
      }
    
-   sp = theDeftemplate->slotList;
-
    /*====================================*/
    /* Read all slot information and slot */
    /* value atoms into big arrays.       */
@@ -981,45 +1262,40 @@ static bool LoadSingleBinaryFact(
       BufferedRead(theEnv,bsaArray,(totalValueCount * sizeof(struct bsaveSlotValueAtom)));
      }
 
-   /*==================================*/
-   /* Insert the values for the slots. */
-   /*==================================*/
+   /*====================================*/
+   /* Don't create a fact from the zeros */
+   /* a truncated buffer is padded with. */
+   /*====================================*/
+
+   if (GenBinaryBufferShortRead(theEnv))
+     { success = false; }
+
+   /*=======================================================*/
+   /* Here is another check for the validity of the binary  */
+   /* file: the order of the slots in the file should match */
+   /* the order in the deftemplate definition. A single-    */
+   /* field slot holds exactly one atom, and no slot may    */
+   /* read past the end of the atoms of the fact. The       */
+   /* checks precede the creation of the fact, so a fact    */
+   /* is never returned with uninitialized slots.           */
+   /*=======================================================*/
    
-   for (i = 0 , j = 0L ; i < slotCount ; i++)
+   sp = theDeftemplate->slotList;
+   for (i = 0 , j = 0L ; success && (i < slotCount) ; i++)
      {
-      /*=======================================================*/
-      /* Here is another check for the validity of the binary  */
-      /* file: the order of the slots in the file should match */
-      /* the order in the deftemplate definition.              */
-      /*=======================================================*/
-      
       if (implied)
-        {
-         if (bsArray[i].slotName != ULONG_MAX)
-           {
-            BinaryLoadFactError(theEnv,theDeftemplate);
-            ReturnFact(theEnv,newFact);
-            success = false;
-            break;
-           }
-        }
+        { success = (bsArray[i].slotName == ULONG_MAX); }
       else
-        {
-         if (sp->slotName != SymbolPointer(bsArray[i].slotName))
-           {
-            BinaryLoadFactError(theEnv,theDeftemplate);
-            ReturnFact(theEnv,newFact);
-            success = false;
-            break;
-           }
-        }
+        { success = (sp->slotName == SymbolPointer(bsArray[i].slotName)); }
 
       isMultislot = implied || (sp->multislot == true);
-        
-      CreateSlotValue(theEnv,&slotValue,(struct bsaveSlotValueAtom *) &bsaArray[j],
-                      bsArray[i].valueCount,isMultislot);
 
-      newFact->theProposition.contents[i].value = slotValue.value;
+      if (((! isMultislot) && (bsArray[i].valueCount != 1)) ||
+          (bsArray[i].valueCount > (totalValueCount - (unsigned long) j)))
+        { success = false; }
+
+      if (! success)
+        { BinaryLoadFactError(theEnv,theDeftemplate); }
 
       j += (unsigned long) bsArray[i].valueCount;
 
@@ -1027,6 +1303,33 @@ static bool LoadSingleBinaryFact(
         { sp = sp->next; }
      }
 
+   /*=======================================*/
+   /* Create the fact and insert the values */
+   /* for the slots.                        */
+   /*=======================================*/
+   
+   if (success)
+     {
+      newFact = CreateFactBySize(theEnv,slotCount);
+      newFact->whichDeftemplate = theDeftemplate;
+
+      sp = theDeftemplate->slotList;
+      for (i = 0 , j = 0L ; i < slotCount ; i++)
+        {
+         isMultislot = implied || (sp->multislot == true);
+        
+         CreateSlotValue(theEnv,&slotValue,(struct bsaveSlotValueAtom *) &bsaArray[j],
+                         bsArray[i].valueCount,isMultislot);
+
+         newFact->theProposition.contents[i].value = slotValue.value;
+
+         j += (unsigned long) bsArray[i].valueCount;
+
+         if (! implied)
+           { sp = sp->next; }
+        }
+     }
+
    rm(theEnv,bsArray,(sizeof(struct bsaveSlotValue) * slotCount));
 
    if (totalValueCount != 0L)
@@ -1254,10 +1557,6 @@ long BinarySaveFactsDriver(
   Expression *theList)
   {
    FILE *filePtr;
-   Deftemplate **deftemplateArray;
-   unsigned int templateCount;
-   bool error;
-   size_t neededSpace = 0;
    long factCount;
 
    /*=====================================*/
@@ -1277,6 +1576,81 @@ long BinarySaveFactsDriver(
       return -1;
      }
 
+   factCount = WriteBinaryFacts(theEnv,filePtr,saveCode,theList);
+
+   /*=================*/
+   /* Close the file. */
+   /*=================*/
+
+   GenClose(theEnv,filePtr);
+
+   return factCount;
+  }
+
+/**********************************************************/
+/* BinarySaveFactsToBuffer: C access routine for saving   */
+/*   facts in the bsave-facts format to memory. The       */
+/*   buffer is allocated with malloc and must be released */
+/*   with free. No buffer is returned on errors.          */
+/**********************************************************/
+long BinarySaveFactsToBuffer(
+  Environment *theEnv,
+  SaveScope saveCode,
+  char **buffer,
+  size_t *size)
+  {
+   FILE *filePtr;
+   long factCount;
+
+   *buffer = NULL;
+   *size = 0;
+
+   /*=====================================*/
+   /* If embedded, clear the error flags. */
+   /*=====================================*/
+
+   if (EvaluationData(theEnv)->CurrentExpression == NULL)
+     { ResetErrorFlags(theEnv); }
+
+   /*====================================*/
+   /* Write the binary file into memory. */
+   /*====================================*/
+
+   if ((filePtr = GenOpenWriteBuffer(theEnv)) == NULL)
+     { return -1; }
+
+   factCount = WriteBinaryFacts(theEnv,filePtr,saveCode,NULL);
+
+   if (GenCloseWriteBuffer(theEnv,filePtr,buffer,size) == false)
+     { return -1; }
+
+   if (factCount < 0)
+     {
+      free(*buffer);
+      *buffer = NULL;
+      *size = 0;
+     }
+
+   return factCount;
+  }
+
+/**********************************************************/
+/* WriteBinaryFacts: Writes the facts to the opened file. */
+/*   Shared by the file and memory buffer variants of     */
+/*   bsave-facts.                                         */
+/**********************************************************/
+static long WriteBinaryFacts(
+  Environment *theEnv,
+  FILE *filePtr,
+  SaveScope saveCode,
+  Expression *theList)
+  {
+   Deftemplate **deftemplateArray;
+   unsigned int templateCount;
+   bool error;
+   size_t neededSpace = 0;
+   long factCount;
+
    /*===================================================*/
    /* Determine the list of specific facts to be saved. */
    /*===================================================*/
@@ -1284,11 +1658,7 @@ long BinarySaveFactsDriver(
    deftemplateArray = GetSaveFactsDeftemplateNames(theEnv,"bsave-facts",theList,
                                                    saveCode,&templateCount,&error);
 
-   if (error)
-     {
-      GenClose(theEnv,filePtr);
-      return -1;
-     }
+   if (error) return -1;
 
    InitAtomicValueNeededFlags(theEnv);
    
@@ -1306,12 +1676,6 @@ long BinarySaveFactsDriver(
 
    RestoreAtomicValueBuckets(theEnv);
    
-   /*=================*/
-   /* Close the file. */
-   /*=================*/
-
-   GenClose(theEnv,filePtr);
-
    /*==================================*/
    /* Free the deftemplate name array. */
    /*==================================*/
@@ -1437,8 +1801,10 @@ static void MarkSingleFact(
    else
      {
       *neededSpace += (sizeof(unsigned short) + // Number of slots
-                       (sizeof(struct bsaveSlotValue) * theFact->whichDeftemplate->numberOfSlots) +
-                       sizeof(unsigned long)); // Number of atoms
+                       (sizeof(struct bsaveSlotValue) * theFact->whichDeftemplate->numberOfSlots));
+
+      if (theFact->whichDeftemplate->numberOfSlots != 0)
+        { *neededSpace += sizeof(unsigned long); } // Number of atoms
       
       sp = theFact->whichDeftemplate->slotList;
       for (i = 0 ; i < theFact->whichDeftemplate->numberOfSlots ; i++)
@@ -1532,7 +1532,7 @@ Fact *CreateFactBySize(
    if (size <= 0) newSize = 1;
    else newSize = size;
 
-   theFact = get_var_struct(theEnv,fact,sizeof(struct clipsValue) * (newSize - 1));
+   theFact = get_slab_struct(theEnv,fact,sizeof(struct clipsValue) * (newSize - 1));
 
    theFact->patternHeader.header.type = FACT_ADDRESS_TYPE;
    theFact->garbage = false;
@@ -1585,7 +1585,7 @@ void ReturnFact(
    if (theFact->theProposition.length == 0) newSize = 1;
    else newSize = theFact->theProposition.length;
 
-   rtn_var_struct(theEnv,fact,sizeof(struct clipsValue) * (newSize - 1),theFact);
+   rtn_slab_struct(theEnv,fact,sizeof(struct clipsValue) * (newSize - 1),theFact);
   }
 
 /*************************************************************/
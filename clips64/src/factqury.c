@@ -552,6 +552,7 @@ void QueryDoForAllFacts(
    ReleaseUDFV(theEnv,FactQueryData(theEnv)->QueryCore->result);
 
    FactQueryData(theEnv)->AbortQuery = false;
+   FactQueryData(theEnv)->StartFact = NULL;
    ProcedureFunctionData(theEnv)->BreakFlag = false;
    rm(theEnv,FactQueryData(theEnv)->QueryCore->solns,(sizeof(Fact *) * rcnt));
    rtn_struct(theEnv,fact_query_core,FactQueryData(theEnv)->QueryCore);
@@ -559,6 +560,27 @@ void QueryDoForAllFacts(
    DeleteQueryTemplates(theEnv,qtemplates);
   }
 
+/******************************************************************************
+  NAME         : SetFactQueryStart
+  DESCRIPTION  : Sets the fact at which the next do-for-all-facts
+                   query starts visiting its first template, so a
+                   caller paging through the facts of a template
+                   resumes where the previous page ended
+  INPUTS       : The first fact to visit, or NULL to start from
+                   the beginning of the template
+  RETURNS      : Nothing useful
+  SIDE EFFECTS : The start fact is consumed by the next query
+  NOTES        : The fact is ignored if it has been retracted or
+                   does not belong to the first template of the
+                   query
+ ******************************************************************************/
+void SetFactQueryStart(
+  Environment *theEnv,
+  Fact *theFact)
+  {
+   FactQueryData(theEnv)->StartFact = theFact;
+  }
+
 /******************************************************************************
   NAME         : DelayedQueryDoForAllFacts
   DESCRIPTION  : Finds all sets of facts which satisfy the query and
@@ -1151,6 +1173,20 @@ static void TestEntireTemplate(
    GCBlockStart(theEnv,&gcb);
 
    theFact = templatePtr->factList;
+
+   /*=================================================*/
+   /* The first template of the query may resume from */
+   /* a fact set with SetFactQueryStart.              */
+   /*=================================================*/
+
+   if ((indx == 0) && (FactQueryData(theEnv)->StartFact != NULL))
+     {
+      if ((FactQueryData(theEnv)->StartFact->whichDeftemplate == templatePtr) &&
+          (! FactQueryData(theEnv)->StartFact->garbage))
+        { theFact = FactQueryData(theEnv)->StartFact; }
+      FactQueryData(theEnv)->StartFact = NULL;
+     }
+
    while (theFact != NULL)
      {
       FactQueryData(theEnv)->QueryCore->solns[indx] = theFact;
@@ -377,6 +377,8 @@ static void PrimeJoinFromLeftMemory(
    /* beta memory to the new join.               */
    /*============================================*/
 
+   CompleteBetaMemoryRehash(theEnv,theMemory);
+
    for (b = 0; b < theMemory->size; b++)
      {
       for (theList = theMemory->beta[b];
@@ -468,6 +470,8 @@ static void PrimeJoinFromRightMemory(
    /* beta memory to the new join.               */
    /*============================================*/
 
+   CompleteBetaMemoryRehash(theEnv,theMemory);
+
    for (b = 0; b < theMemory->size; b++)
      {
       for (theList = theMemory->beta[b];
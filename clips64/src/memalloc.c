@@ -62,8 +62,10 @@
 #include "memalloc.h"
 #include "prntutil.h"
 #include "router.h"
+#include "sysdep.h"
 #include "utility.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #if WIN_MVC
@@ -75,6 +77,16 @@
 #define SpecialMalloc(sz) malloc((STD_SIZE) sz)
 #define SpecialFree(ptr) free(ptr)
 
+#define SLAB_BLOCK_SIZE (SLAB_SIZE + SLAB_ALIGNMENT)
+
+/***************************************/
+/* LOCAL INTERNAL FUNCTION DEFINITIONS */
+/***************************************/
+
+   static long long               ReleaseEmptySlabs(Environment *,struct slabClass *);
+   static struct memorySlab      *FindSlab(struct memorySlab **,size_t,void *);
+   static int                     CompareSlabs(const void *,const void *);
+
 /********************************************/
 /* InitializeMemory: Sets up memory tables. */
 /********************************************/
@@ -272,6 +284,10 @@ long long ReleaseMem(
    struct memoryPtr *tmpPtr, *memPtr;
    unsigned int i;
    long long returns = 0;
+
+   amount = ReleaseSlabs(theEnv);
+   if ((amount > maximum) && (maximum > 0))
+     { return amount; }
    
    for (i = (MEM_TABLE_SIZE - 1) ; i >= sizeof(char *) ; i--)
      {
@@ -425,6 +441,14 @@ unsigned long PoolSize(
          memPtr = memPtr->next;
         }
      }
+
+   for (i = 1 ; i < SLAB_CLASSES ; i++)
+     {
+      struct slabClass *theClass = &MemoryData(theEnv)->SlabClasses[i];
+
+      cnt += (unsigned long) (((theClass->slabCount * theClass->objectsPerSlab) -
+                               (size_t) theClass->liveObjects) * theClass->objectSize);
+     }
 #endif
 
    return(cnt);
@@ -479,3 +503,313 @@ void genmemcpy(
    for (i = 0L ; i < size ; i++)
      dst[i] = src[i];
   }
+
+/*****************************************************/
+/* SlabAllocate: Allocates an object from the slab   */
+/*   class of its size, carving a new slab when the  */
+/*   class has no free objects. Objects larger than  */
+/*   SLAB_MAX_OBJECT_SIZE are allocated by genalloc. */
+/*****************************************************/
+void *SlabAllocate(
+  Environment *theEnv,
+  size_t size)
+  {
+   struct slabClass *theClass;
+   struct memorySlab *theSlab;
+   struct memoryPtr *memPtr;
+   char *objects;
+   void *block;
+   size_t i;
+
+   if (size > SLAB_MAX_OBJECT_SIZE)
+     { return genalloc(theEnv,size); }
+
+   if (size < sizeof(struct memoryPtr))
+     { size = sizeof(struct memoryPtr); }
+
+   theClass = SlabClassOf(theEnv,size);
+
+   if (theClass->freeList == NULL)
+     {
+      if (theClass->objectSize == 0)
+        {
+         theClass->objectSize = (size_t) (theClass - MemoryData(theEnv)->SlabClasses) * SLAB_GRANULE;
+         theClass->objectsPerSlab = (SLAB_SIZE - SLAB_ALIGNMENT) / theClass->objectSize;
+        }
+
+      /*=================================================*/
+      /* Align the slab to a cache line. The header uses */
+      /* the first line and the objects the remainder.   */
+      /*=================================================*/
+
+      block = genalloc(theEnv,SLAB_BLOCK_SIZE);
+      if (block == NULL)
+        { return NULL; }
+
+      theSlab = (struct memorySlab *)
+                (((uintptr_t) block + SLAB_ALIGNMENT - 1) & ~((uintptr_t) SLAB_ALIGNMENT - 1));
+      theSlab->block = block;
+      theSlab->freeObjects = 0;
+      theSlab->next = theClass->slabs;
+      theClass->slabs = theSlab;
+      theClass->slabCount++;
+
+      /*==================================================*/
+      /* Objects are handed out in address order so that */
+      /* matches created together share cache lines.      */
+      /*==================================================*/
+
+      objects = ((char *) theSlab) + SLAB_ALIGNMENT;
+      for (i = theClass->objectsPerSlab; i > 0; i--)
+        {
+         memPtr = (struct memoryPtr *) (objects + ((i - 1) * theClass->objectSize));
+         memPtr->next = theClass->freeList;
+         theClass->freeList = memPtr;
+        }
+     }
+
+   memPtr = theClass->freeList;
+   theClass->freeList = memPtr->next;
+   theClass->liveObjects++;
+   theClass->allocations++;
+
+   return (void *) memPtr;
+  }
+
+/**************************************************/
+/* ReleaseSlabs: Returns the slabs without objects */
+/*   in use to the operating system. Called by     */
+/*   reset and clear, and by release-mem.          */
+/**************************************************/
+long long ReleaseSlabs(
+  Environment *theEnv)
+  {
+   struct slabClass *theClass;
+   struct memorySlab *theSlab, *nextSlab;
+   long long amount = 0;
+   unsigned int i;
+
+   for (i = 1; i < SLAB_CLASSES; i++)
+     {
+      theClass = &MemoryData(theEnv)->SlabClasses[i];
+      if (theClass->slabs == NULL)
+        { continue; }
+
+      /*==============================================*/
+      /* If no object of the class is in use, all of  */
+      /* its slabs are released without inspecting    */
+      /* the free list.                               */
+      /*==============================================*/
+
+      if (theClass->liveObjects == 0)
+        {
+         for (theSlab = theClass->slabs; theSlab != NULL; theSlab = nextSlab)
+           {
+            nextSlab = theSlab->next;
+            genfree(theEnv,theSlab->block,SLAB_BLOCK_SIZE);
+            amount += SLAB_BLOCK_SIZE;
+           }
+         theClass->slabs = NULL;
+         theClass->freeList = NULL;
+         theClass->slabCount = 0;
+        }
+      else
+        { amount += ReleaseEmptySlabs(theEnv,theClass); }
+     }
+
+   return amount;
+  }
+
+/*******************************************************/
+/* ReleaseEmptySlabs: Releases the slabs of a class    */
+/*   whose objects are all on the free list. The free  */
+/*   objects are counted per slab by looking up their  */
+/*   addresses in the slabs sorted by address.         */
+/*******************************************************/
+static long long ReleaseEmptySlabs(
+  Environment *theEnv,
+  struct slabClass *theClass)
+  {
+   struct memorySlab **slabs, *theSlab;
+   struct memoryPtr *memPtr, *nextPtr, *lastPtr;
+   long long amount = 0;
+   size_t i, count = 0;
+
+   slabs = (struct memorySlab **) malloc(sizeof(struct memorySlab *) * theClass->slabCount);
+   if (slabs == NULL)
+     { return 0; }
+
+   for (theSlab = theClass->slabs; theSlab != NULL; theSlab = theSlab->next)
+     {
+      theSlab->freeObjects = 0;
+      slabs[count++] = theSlab;
+     }
+
+   qsort(slabs,count,sizeof(struct memorySlab *),CompareSlabs);
+
+   for (memPtr = theClass->freeList; memPtr != NULL; memPtr = memPtr->next)
+     { FindSlab(slabs,count,memPtr)->freeObjects++; }
+
+   for (i = 0; i < count; i++)
+     {
+      if (slabs[i]->freeObjects == theClass->objectsPerSlab)
+        { break; }
+     }
+
+   if (i == count)
+     {
+      free(slabs);
+      return 0;
+     }
+
+   /*==========================================*/
+   /* Drop the objects of the empty slabs from */
+   /* the free list, keeping the others in     */
+   /* their order.                             */
+   /*==========================================*/
+
+   lastPtr = NULL;
+   for (memPtr = theClass->freeList; memPtr != NULL; memPtr = nextPtr)
+     {
+      nextPtr = memPtr->next;
+      if (FindSlab(slabs,count,memPtr)->freeObjects == theClass->objectsPerSlab)
+        { continue; }
+
+      if (lastPtr == NULL)
+        { theClass->freeList = memPtr; }
+      else
+        { lastPtr->next = memPtr; }
+      lastPtr = memPtr;
+     }
+
+   if (lastPtr == NULL)
+     { theClass->freeList = NULL; }
+   else
+     { lastPtr->next = NULL; }
+
+   /*===========================================*/
+   /* Release the empty slabs and relink those */
+   /* remaining.                                */
+   /*===========================================*/
+
+   theClass->slabs = NULL;
+   theClass->slabCount = 0;
+   for (i = count; i > 0; i--)
+     {
+      theSlab = slabs[i - 1];
+      if (theSlab->freeObjects == theClass->objectsPerSlab)
+        {
+         genfree(theEnv,theSlab->block,SLAB_BLOCK_SIZE);
+         amount += SLAB_BLOCK_SIZE;
+        }
+      else
+        {
+         theSlab->next = theClass->slabs;
+         theClass->slabs = theSlab;
+         theClass->slabCount++;
+        }
+     }
+
+   free(slabs);
+
+   return amount;
+  }
+
+/***************************************************/
+/* FindSlab: Returns the slab holding an object by */
+/*   binary search of the slabs sorted by address. */
+/***************************************************/
+static struct memorySlab *FindSlab(
+  struct memorySlab **slabs,
+  size_t count,
+  void *theObject)
+  {
+   size_t low = 0, high = count;
+   size_t middle;
+
+   while ((high - low) > 1)
+     {
+      middle = low + ((high - low) / 2);
+      if ((uintptr_t) slabs[middle] <= (uintptr_t) theObject)
+        { low = middle; }
+      else
+        { high = middle; }
+     }
+
+   return slabs[low];
+  }
+
+/********************************************/
+/* CompareSlabs: Orders slabs by address.   */
+/********************************************/
+static int CompareSlabs(
+  const void *first,
+  const void *second)
+  {
+   uintptr_t a = (uintptr_t) *((struct memorySlab * const *) first);
+   uintptr_t b = (uintptr_t) *((struct memorySlab * const *) second);
+
+   if (a < b) return -1;
+   if (a > b) return 1;
+   return 0;
+  }
+
+/**************************************************/
+/* SlabMemory: Returns the number of bytes held by */
+/*   the slabs, whether their objects are in use.  */
+/**************************************************/
+long long SlabMemory(
+  Environment *theEnv)
+  {
+   long long amount = 0;
+   unsigned int i;
+
+   for (i = 1; i < SLAB_CLASSES; i++)
+     { amount += (long long) MemoryData(theEnv)->SlabClasses[i].slabCount * SLAB_BLOCK_SIZE; }
+
+   return amount;
+  }
+
+/************************************************/
+/* ListSlabStats: Lists the slabs, objects in   */
+/*   use and allocations of each size class.    */
+/************************************************/
+void ListSlabStats(
+  Environment *theEnv,
+  const char *logicalName)
+  {
+   struct slabClass *theClass;
+   char buffer[120];
+   unsigned int i;
+   size_t slabs = 0;
+   long long objects = 0, live = 0, allocations = 0;
+
+   WriteString(theEnv,logicalName,"  Size     Slabs    Objects     In use       Free    Allocations\n");
+
+   for (i = 1; i < SLAB_CLASSES; i++)
+     {
+      theClass = &MemoryData(theEnv)->SlabClasses[i];
+      if ((theClass->slabCount == 0) && (theClass->allocations == 0))
+        { continue; }
+
+      gensnprintf(buffer,sizeof(buffer),"%6zu %9zu %10lld %10lld %10lld %14lld\n",
+                  theClass->objectSize,theClass->slabCount,
+                  (long long) (theClass->slabCount * theClass->objectsPerSlab),
+                  theClass->liveObjects,
+                  (long long) (theClass->slabCount * theClass->objectsPerSlab) - theClass->liveObjects,
+                  theClass->allocations);
+      WriteString(theEnv,logicalName,buffer);
+
+      slabs += theClass->slabCount;
+      objects += (long long) (theClass->slabCount * theClass->objectsPerSlab);
+      live += theClass->liveObjects;
+      allocations += theClass->allocations;
+     }
+
+   gensnprintf(buffer,sizeof(buffer)," Total %9zu %10lld %10lld %10lld %14lld\n",
+               slabs,objects,live,objects - live,allocations);
+   WriteString(theEnv,logicalName,buffer);
+
+   gensnprintf(buffer,sizeof(buffer),"Slab memory: %lld bytes\n",SlabMemory(theEnv));
+   WriteString(theEnv,logicalName,buffer);
+  }
@@ -127,6 +127,7 @@
 #include "multifld.h"
 #include "prntutil.h"
 #include "router.h"
+#include "symbol.h"
 #include "sysdep.h"
 #include "utility.h"
 
@@ -190,9 +191,12 @@ void MiscFunctionDefinitions(
    AddUDF(theEnv,"seed","v",1,1,"l",SeedFunction,"SeedFunction",NULL);
    AddUDF(theEnv,"conserve-mem","v",1,1,"y",ConserveMemCommand,"ConserveMemCommand",NULL);
    AddUDF(theEnv,"release-mem","l",0,0,NULL,ReleaseMemCommand,"ReleaseMemCommand",NULL);
+   AddUDF(theEnv,"get-atom-table-resizing","b",0,0,NULL,GetAtomTableResizingCommand,"GetAtomTableResizingCommand",NULL);
+   AddUDF(theEnv,"set-atom-table-resizing","b",1,1,NULL,SetAtomTableResizingCommand,"SetAtomTableResizingCommand",NULL);
 #if DEBUGGING_FUNCTIONS
    AddUDF(theEnv,"mem-used","l",0,0,NULL,MemUsedCommand,"MemUsedCommand",NULL);
    AddUDF(theEnv,"mem-requests","l",0,0,NULL,MemRequestsCommand,"MemRequestsCommand",NULL);
+   AddUDF(theEnv,"mem-stats","l",0,0,NULL,MemStatsCommand,"MemStatsCommand",NULL);
 #endif
 
    AddUDF(theEnv,"options","v",0,0,NULL,OptionsCommand,"OptionsCommand",NULL);
@@ -495,6 +499,46 @@ void ReleaseMemCommand(
    returnValue->integerValue = CreateInteger(theEnv,ReleaseMem(theEnv,-1));
   }
 
+/***************************************************/
+/* SetAtomTableResizingCommand: H/L access routine */
+/*   for the set-atom-table-resizing command.      */
+/***************************************************/
+void SetAtomTableResizingCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   UDFValue theArg;
+
+   returnValue->lexemeValue = CreateBoolean(theEnv,GetAtomTableResizing(theEnv));
+
+   /*================================================*/
+   /* The symbol FALSE keeps the atom tables at      */
+   /* their current size. Any other value lets them  */
+   /* grow with the number of atoms they hold.       */
+   /*================================================*/
+
+   if (! UDFFirstArgument(context,ANY_TYPE_BITS,&theArg))
+     { return; }
+
+   if (theArg.value == FalseSymbol(theEnv))
+     { SetAtomTableResizing(theEnv,false); }
+   else
+     { SetAtomTableResizing(theEnv,true); }
+  }
+
+/***************************************************/
+/* GetAtomTableResizingCommand: H/L access routine */
+/*   for the get-atom-table-resizing command.      */
+/***************************************************/
+void GetAtomTableResizingCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   returnValue->lexemeValue = CreateBoolean(theEnv,GetAtomTableResizing(theEnv));
+  }
+
 /******************************************/
 /* ConserveMemCommand: H/L access routine */
 /*   for the conserve-mem command.        */
@@ -585,6 +629,22 @@ void MemRequestsCommand(
    returnValue->integerValue = CreateInteger(theEnv,MemRequests(theEnv));
   }
 
+/******************************************/
+/* MemStatsCommand: H/L access routine    */
+/*   for the mem-stats command. Lists the */
+/*   slab classes and returns the number  */
+/*   of bytes held by slabs.              */
+/******************************************/
+void MemStatsCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   ListSlabStats(theEnv,STDOUT);
+
+   returnValue->integerValue = CreateInteger(theEnv,SlabMemory(theEnv));
+  }
+
 #endif
 
 /****************************************/
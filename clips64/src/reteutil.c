@@ -62,6 +62,7 @@
 /*************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 
 #include "setup.h"
 
@@ -94,8 +95,14 @@
    static void                        InitializePMLinks(struct partialMatch *);
    static void                        UnlinkBetaPartialMatchfromAlphaAndBetaLineage(struct partialMatch *);
    static int                         CountPriorPatterns(struct joinNode *);
-   static void                        ResizeBetaMemory(Environment *,struct betaMemory *);
+   static unsigned long               BetaMemoryLocation(struct betaMemory *,unsigned long,
+                                                         struct partialMatch ***,struct partialMatch ***);
+   static void                        ResizeBetaMemory(Environment *,struct betaMemory *,unsigned long);
+   static void                        RehashBetaMemory(Environment *,struct betaMemory *,unsigned long);
+   static void                        MigrateBetaMemoryBucket(struct betaMemory *,unsigned long);
+   static void                        ReturnOldBetaMemory(Environment *,struct betaMemory *);
    static void                        ResetBetaMemory(Environment *,struct betaMemory *);
+   static unsigned long long          MixJoinHashValue(unsigned long long);
 #if (CONSTRUCT_COMPILER || BLOAD_AND_BSAVE) && (! RUN_TIME)
    static void                        TagNetworkTraverseJoins(Environment *,unsigned long *,unsigned long *,struct joinNode *);
 #endif
@@ -138,8 +145,8 @@ struct partialMatch *CopyPartialMatch(
    struct partialMatch *linker;
    unsigned short i;
 
-   linker = get_var_struct(theEnv,partialMatch,sizeof(struct genericMatch) *
-                                        (list->bcount - 1));
+   linker = get_slab_struct(theEnv,partialMatch,sizeof(struct genericMatch) *
+                                         (list->bcount - 1));
 
    InitializePMLinks(linker);
    linker->betaMemory = true;
@@ -162,7 +169,7 @@ struct partialMatch *CreateEmptyPartialMatch(
   {
    struct partialMatch *linker;
 
-   linker = get_struct(theEnv,partialMatch);
+   linker = get_slab_struct(theEnv,partialMatch,0);
 
    InitializePMLinks(linker);
    linker->betaMemory = true;
@@ -212,6 +219,7 @@ void UpdateBetaPMLinks(
   {
    unsigned long betaLocation;
    struct betaMemory *theMemory;
+   struct partialMatch **theBeta, **theLast;
 
    if (side == LHS)
      {
@@ -230,26 +238,26 @@ void UpdateBetaPMLinks(
    /* Update the node's linked list. */
    /*================================*/
 
-   betaLocation = hashValue % theMemory->size;
+   betaLocation = BetaMemoryLocation(theMemory,hashValue,&theBeta,&theLast);
 
    if (side == LHS)
      {
-      thePM->nextInMemory = theMemory->beta[betaLocation];
-      if (theMemory->beta[betaLocation] != NULL)
-        { theMemory->beta[betaLocation]->prevInMemory = thePM; }
-      theMemory->beta[betaLocation] = thePM;
+      thePM->nextInMemory = theBeta[betaLocation];
+      if (theBeta[betaLocation] != NULL)
+        { theBeta[betaLocation]->prevInMemory = thePM; }
+      theBeta[betaLocation] = thePM;
      }
    else
      {
-      if (theMemory->last[betaLocation] != NULL)
+      if (theLast[betaLocation] != NULL)
         {
-         theMemory->last[betaLocation]->nextInMemory = thePM;
-         thePM->prevInMemory = theMemory->last[betaLocation];
+         theLast[betaLocation]->nextInMemory = thePM;
+         thePM->prevInMemory = theLast[betaLocation];
         }
       else
-        { theMemory->beta[betaLocation] = thePM; }
+        { theBeta[betaLocation] = thePM; }
 
-      theMemory->last[betaLocation] = thePM;
+      theLast[betaLocation] = thePM;
      }
 
    theMemory->count++;
@@ -286,12 +294,28 @@ void UpdateBetaPMLinks(
       thePM->leftParent = lhsBinds;
      }
 
-   if (! DefruleData(theEnv)->BetaMemoryResizingFlag)
+   /*=================================================*/
+   /* A memory being rehashed migrates a few of its   */
+   /* buckets with each addition rather than all of   */
+   /* them at once. No other resizing is started      */
+   /* until the rehash completes.                     */
+   /*=================================================*/
+
+   if (theMemory->oldBeta != NULL)
+     {
+      RehashBetaMemory(theEnv,theMemory,BETA_MEMORY_REHASH_STEP);
+      return;
+     }
+
+   if ((! DefruleData(theEnv)->BetaMemoryResizingFlag) ||
+       (theMemory->size == 1))
      { return; }
 
-   if ((theMemory->size > 1) &&
-       (theMemory->count > (theMemory->size * 11)))
-     { ResizeBetaMemory(theEnv,theMemory); }
+   if (theMemory->count > (theMemory->size * DefruleData(theEnv)->BetaMemoryLoadFactor))
+     { ResizeBetaMemory(theEnv,theMemory,(theMemory->size * 2) + 1); }
+   else if ((theMemory->size > INITIAL_BETA_HASH_SIZE) &&
+            (theMemory->count < (theMemory->size * DefruleData(theEnv)->BetaMemoryMinLoadFactor)))
+     { ResizeBetaMemory(theEnv,theMemory,theMemory->size / 2); }
   }
 
 /**********************************************************/
@@ -351,6 +375,7 @@ void UnlinkBetaPMFromNodeAndLineage(
   {
    unsigned long betaLocation;
    struct betaMemory *theMemory;
+   struct partialMatch **theBeta, **theLast;
 
    if (side == LHS)
      { theMemory = join->leftMemory; }
@@ -368,17 +393,14 @@ void UnlinkBetaPMFromNodeAndLineage(
    else
     { join->memoryRightDeletes++; }
 
-   betaLocation = thePM->hashValue % theMemory->size;
+   betaLocation = BetaMemoryLocation(theMemory,thePM->hashValue,&theBeta,&theLast);
 
    if ((side == RHS) &&
-       (theMemory->last[betaLocation] == thePM))
-     { theMemory->last[betaLocation] = thePM->prevInMemory; }
+       (theLast[betaLocation] == thePM))
+     { theLast[betaLocation] = thePM->prevInMemory; }
 
    if (thePM->prevInMemory == NULL)
-     {
-      betaLocation = thePM->hashValue % theMemory->size;
-      theMemory->beta[betaLocation] = thePM->nextInMemory;
-     }
+     { theBeta[betaLocation] = thePM->nextInMemory; }
    else
      { thePM->prevInMemory->nextInMemory = thePM->nextInMemory; }
 
@@ -409,6 +431,7 @@ void UnlinkNonLeftLineage(
    unsigned long betaLocation;
    struct betaMemory *theMemory;
    struct partialMatch *tempPM;
+   struct partialMatch **theBeta, **theLast;
 
    if (side == LHS)
      { theMemory = join->leftMemory; }
@@ -426,17 +449,14 @@ void UnlinkNonLeftLineage(
    else
     { join->memoryRightDeletes++; }
 
-   betaLocation = thePM->hashValue % theMemory->size;
+   betaLocation = BetaMemoryLocation(theMemory,thePM->hashValue,&theBeta,&theLast);
 
    if ((side == RHS) &&
-       (theMemory->last[betaLocation] == thePM))
-     { theMemory->last[betaLocation] = thePM->prevInMemory; }
+       (theLast[betaLocation] == thePM))
+     { theLast[betaLocation] = thePM->prevInMemory; }
 
    if (thePM->prevInMemory == NULL)
-     {
-      betaLocation = thePM->hashValue % theMemory->size;
-      theMemory->beta[betaLocation] = thePM->nextInMemory;
-     }
+     { theBeta[betaLocation] = thePM->nextInMemory; }
    else
      { thePM->prevInMemory->nextInMemory = thePM->nextInMemory; }
 
@@ -598,7 +618,7 @@ struct partialMatch *MergePartialMatches(
    /* Allocate the new partial match. */
    /*=================================*/
 
-   linker = get_var_struct(theEnv,partialMatch,sizeof(struct genericMatch) * lhsBind->bcount);
+   linker = get_slab_struct(theEnv,partialMatch,sizeof(struct genericMatch) * lhsBind->bcount);
 
    /*============================================*/
    /* Set the flags to their appropriate values. */
@@ -680,7 +700,7 @@ struct partialMatch *CreateAlphaMatch(
    /* Create the alpha match and intialize its values. */
    /*==================================================*/
 
-   theMatch = get_struct(theEnv,partialMatch);
+   theMatch = get_slab_struct(theEnv,partialMatch,0);
    InitializePMLinks(theMatch);
    theMatch->betaMemory = false;
    theMatch->busy = false;
@@ -688,7 +708,7 @@ struct partialMatch *CreateAlphaMatch(
    theMatch->bcount = 1;
    theMatch->hashValue = hashOffset;
 
-   afbtemp = get_struct(theEnv,alphaMatch);
+   afbtemp = get_slab_struct(theEnv,alphaMatch,0);
    afbtemp->next = NULL;
    afbtemp->matchingItem = (struct patternEntity *) theEntity;
 
@@ -1073,10 +1093,11 @@ struct partialMatch *GetLeftBetaMemory(
   unsigned long hashValue)
   {
    unsigned long betaLocation;
+   struct partialMatch **theBeta, **theLast;
 
-   betaLocation = hashValue % theJoin->leftMemory->size;
+   betaLocation = BetaMemoryLocation(theJoin->leftMemory,hashValue,&theBeta,&theLast);
 
-   return theJoin->leftMemory->beta[betaLocation];
+   return theBeta[betaLocation];
   }
 
 /******************************************/
@@ -1088,10 +1109,11 @@ struct partialMatch *GetRightBetaMemory(
   unsigned long hashValue)
   {
    unsigned long betaLocation;
+   struct partialMatch **theBeta, **theLast;
 
-   betaLocation = hashValue % theJoin->rightMemory->size;
+   betaLocation = BetaMemoryLocation(theJoin->rightMemory,hashValue,&theBeta,&theLast);
 
-   return theJoin->rightMemory->beta[betaLocation];
+   return theBeta[betaLocation];
   }
 
 /***************************************/
@@ -1103,6 +1125,7 @@ void ReturnLeftMemory(
   struct joinNode *theJoin)
   {
    if (theJoin->leftMemory == NULL) return;
+   ReturnOldBetaMemory(theEnv,theJoin->leftMemory);
    genfree(theEnv,theJoin->leftMemory->beta,sizeof(struct partialMatch *) * theJoin->leftMemory->size);
    rtn_struct(theEnv,betaMemory,theJoin->leftMemory);
    theJoin->leftMemory = NULL;
@@ -1117,6 +1140,7 @@ void ReturnRightMemory(
   struct joinNode *theJoin)
   {
    if (theJoin->rightMemory == NULL) return;
+   ReturnOldBetaMemory(theEnv,theJoin->rightMemory);
    genfree(theEnv,theJoin->rightMemory->beta,sizeof(struct partialMatch *) * theJoin->rightMemory->size);
    genfree(theEnv,theJoin->rightMemory->last,sizeof(struct partialMatch *) * theJoin->rightMemory->size);
    rtn_struct(theEnv,betaMemory,theJoin->rightMemory);
@@ -1142,6 +1166,8 @@ void DestroyBetaMemory(
      {
       if (theJoin->leftMemory == NULL) return;
 
+      CompleteBetaMemoryRehash(theEnv,theJoin->leftMemory);
+
       for (i = 0; i < theJoin->leftMemory->size; i++)
         { DestroyAlphaBetaMemory(theEnv,theJoin->leftMemory->beta[i]); }
      }
@@ -1149,6 +1175,8 @@ void DestroyBetaMemory(
      {
       if (theJoin->rightMemory == NULL) return;
 
+      CompleteBetaMemoryRehash(theEnv,theJoin->rightMemory);
+
       for (i = 0; i < theJoin->rightMemory->size; i++)
         { DestroyAlphaBetaMemory(theEnv,theJoin->rightMemory->beta[i]); }
      }
@@ -1172,6 +1200,8 @@ void FlushBetaMemory(
      {
       if (theJoin->leftMemory == NULL) return;
 
+      CompleteBetaMemoryRehash(theEnv,theJoin->leftMemory);
+
       for (i = 0; i < theJoin->leftMemory->size; i++)
         { FlushAlphaBetaMemory(theEnv,theJoin->leftMemory->beta[i]); }
      }
@@ -1179,6 +1209,8 @@ void FlushBetaMemory(
      {
       if (theJoin->rightMemory == NULL) return;
 
+      CompleteBetaMemoryRehash(theEnv,theJoin->rightMemory);
+
       for (i = 0; i < theJoin->rightMemory->size; i++)
         { FlushAlphaBetaMemory(theEnv,theJoin->rightMemory->beta[i]); }
      }
@@ -1392,6 +1424,101 @@ static void UnlinkAlphaMemoryBucketSiblings(
      { theAlphaMemory->next->prev = theAlphaMemory->prev; }
   }
 
+/***********************************************************/
+/* MixJoinHashValue: Scrambles the bits of a hash value so */
+/*   that keys differing in a few bits (such as small      */
+/*   integers or neighboring addresses) are spread evenly  */
+/*   across the buckets of a beta memory.                  */
+/***********************************************************/
+static unsigned long long MixJoinHashValue(
+  unsigned long long hashValue)
+  {
+   hashValue ^= hashValue >> 30;
+   hashValue *= 0xbf58476d1ce4e5b9ULL;
+   hashValue ^= hashValue >> 27;
+   hashValue *= 0x94d049bb133111ebULL;
+   hashValue ^= hashValue >> 31;
+
+   return hashValue;
+  }
+
+/****************************************************************/
+/* HashJoinValue: Combines the value of a join key with the     */
+/*   hash value computed for the preceding keys. Both sides of  */
+/*   a join must hash their keys with this function so that     */
+/*   matching partial matches are given the same hash value.    */
+/****************************************************************/
+unsigned long HashJoinValue(
+  unsigned long hashValue,
+  UDFValue *theValue)
+  {
+   unsigned long long key;
+   union
+     {
+      double fv;
+      void *vv;
+      unsigned long long liv;
+     } fis;
+
+   switch (theValue->header->type)
+     {
+      case STRING_TYPE:
+      case SYMBOL_TYPE:
+      case INSTANCE_NAME_TYPE:
+        key = theValue->lexemeValue->bucket;
+        break;
+
+      case INTEGER_TYPE:
+        key = (unsigned long long) theValue->integerValue->contents;
+        break;
+
+      case FLOAT_TYPE:
+        fis.liv = 0;
+        fis.fv = theValue->floatValue->contents;
+        key = fis.liv;
+        break;
+
+      case FACT_ADDRESS_TYPE:
+#if OBJECT_SYSTEM
+      case INSTANCE_ADDRESS_TYPE:
+#endif
+        fis.liv = 0;
+        fis.vv = theValue->value;
+        key = fis.liv;
+        break;
+
+      case EXTERNAL_ADDRESS_TYPE:
+        fis.liv = 0;
+        fis.vv = theValue->externalAddressValue->contents;
+        key = fis.liv;
+        break;
+
+      default:
+        return hashValue;
+     }
+
+   /*=================================================*/
+   /* The previous hash value is scaled before adding */
+   /* the key so that the order of the keys matters.  */
+   /*=================================================*/
+
+   return (unsigned long)
+          MixJoinHashValue((hashValue * 0x9e3779b97f4a7c15ULL) + key + theValue->header->type);
+  }
+
+/******************************************************************/
+/* InitBetaMemoryRehash: Initializes the incremental rehash state */
+/*   of a newly allocated beta memory. No rehash is in progress.  */
+/******************************************************************/
+void InitBetaMemoryRehash(
+  struct betaMemory *theMemory)
+  {
+   theMemory->oldSize = 0;
+   theMemory->migrated = 0;
+   theMemory->oldBeta = NULL;
+   theMemory->oldLast = NULL;
+  }
+
 /**************************/
 /* ComputeRightHashValue: */
 /**************************/
@@ -1401,19 +1528,13 @@ unsigned long ComputeRightHashValue(
   {
    struct expr *tempExpr;
    unsigned long hashValue = 0;
-   unsigned long multiplier = 1;
-   union
-     {
-      void *vv;
-      unsigned long liv;
-     } fis;
 
    if (theHeader->rightHash == NULL)
      { return hashValue; }
 
    for (tempExpr = theHeader->rightHash;
         tempExpr != NULL;
-        tempExpr = tempExpr->nextArg, multiplier = multiplier * 509)
+        tempExpr = tempExpr->nextArg)
       {
        UDFValue theResult;
        struct expr *oldArgument;
@@ -1423,99 +1544,192 @@ unsigned long ComputeRightHashValue(
        (*EvaluationData(theEnv)->PrimitivesArray[tempExpr->type]->evaluateFunction)(theEnv,tempExpr->value,&theResult);
        EvaluationData(theEnv)->CurrentExpression = oldArgument;
 
-       switch (theResult.header->type)
-         {
-          case STRING_TYPE:
-          case SYMBOL_TYPE:
-          case INSTANCE_NAME_TYPE:
-            hashValue += (theResult.lexemeValue->bucket * multiplier);
-            break;
+       hashValue = HashJoinValue(hashValue,&theResult);
+      }
 
-          case INTEGER_TYPE:
-            hashValue += (theResult.integerValue->bucket * multiplier);
-            break;
+     return hashValue;
+    }
 
-          case FLOAT_TYPE:
-            hashValue += (theResult.floatValue->bucket * multiplier);
-            break;
+/**************************************************************/
+/* BetaMemoryLocation: Returns the bucket of a beta memory    */
+/*   that holds the partial matches with the specified hash   */
+/*   value, along with the arrays containing that bucket.     */
+/*   While the memory is being rehashed, the buckets that     */
+/*   haven't been migrated yet are still in the old arrays.   */
+/**************************************************************/
+static unsigned long BetaMemoryLocation(
+  struct betaMemory *theMemory,
+  unsigned long hashValue,
+  struct partialMatch ***theBeta,
+  struct partialMatch ***theLast)
+  {
+   unsigned long betaLocation;
 
-          case FACT_ADDRESS_TYPE:
-#if OBJECT_SYSTEM
-          case INSTANCE_ADDRESS_TYPE:
-#endif
-            fis.liv = 0;
-            fis.vv = theResult.value;
-            hashValue += fis.liv * multiplier;
-            break;
-
-          case EXTERNAL_ADDRESS_TYPE:
-            fis.liv = 0;
-            fis.vv = theResult.externalAddressValue->contents;
-            hashValue += fis.liv * multiplier;
-            break;
-          }
-       }
+   if (theMemory->oldBeta != NULL)
+     {
+      betaLocation = hashValue % theMemory->oldSize;
+      if (betaLocation >= theMemory->migrated)
+        {
+         *theBeta = theMemory->oldBeta;
+         *theLast = theMemory->oldLast;
+         return betaLocation;
+        }
+     }
 
-     return hashValue;
-    }
+   *theBeta = theMemory->beta;
+   *theLast = theMemory->last;
 
-/*********************/
-/* ResizeBetaMemory: */
-/*********************/
-void ResizeBetaMemory(
+   return hashValue % theMemory->size;
+  }
+
+/*****************************************************************/
+/* ResizeBetaMemory: Starts rehashing a beta memory into the     */
+/*   specified number of buckets. The partial matches are moved  */
+/*   to the new buckets incrementally by RehashBetaMemory.       */
+/*****************************************************************/
+static void ResizeBetaMemory(
   Environment *theEnv,
-  struct betaMemory *theMemory)
+  struct betaMemory *theMemory,
+  unsigned long newSize)
   {
-   struct partialMatch **oldArray, **lastAdd, *thePM, *nextPM;
-   unsigned long i, oldSize, betaLocation;
+   CompleteBetaMemoryRehash(theEnv,theMemory);
 
-   oldSize = theMemory->size;
-   oldArray = theMemory->beta;
+   theMemory->oldSize = theMemory->size;
+   theMemory->oldBeta = theMemory->beta;
+   theMemory->oldLast = theMemory->last;
+   theMemory->migrated = 0;
 
-   theMemory->size = oldSize * 11;
-   theMemory->beta = (struct partialMatch **) genalloc(theEnv,sizeof(struct partialMatch *) * theMemory->size);
+   theMemory->size = newSize;
+   theMemory->beta = (struct partialMatch **) genalloc(theEnv,sizeof(struct partialMatch *) * newSize);
+   memset(theMemory->beta,0,sizeof(struct partialMatch *) * newSize);
 
-   lastAdd = (struct partialMatch **) genalloc(theEnv,sizeof(struct partialMatch *) * theMemory->size);
-   memset(theMemory->beta,0,sizeof(struct partialMatch *) * theMemory->size);
-   memset(lastAdd,0,sizeof(struct partialMatch *) * theMemory->size);
+   if (theMemory->oldLast != NULL)
+     {
+      theMemory->last = (struct partialMatch **) genalloc(theEnv,sizeof(struct partialMatch *) * newSize);
+      memset(theMemory->last,0,sizeof(struct partialMatch *) * newSize);
+     }
 
-   for (i = 0; i < oldSize; i++)
+   RehashBetaMemory(theEnv,theMemory,BETA_MEMORY_REHASH_STEP);
+  }
+
+/****************************************************************/
+/* RehashBetaMemory: Migrates up to the specified number of     */
+/*   buckets from the old arrays of a beta memory being rehashed */
+/*   and releases the old arrays once all have been migrated.   */
+/****************************************************************/
+static void RehashBetaMemory(
+  Environment *theEnv,
+  struct betaMemory *theMemory,
+  unsigned long buckets)
+  {
+   if (theMemory->oldBeta == NULL)
+     { return; }
+
+   while ((buckets > 0) && (theMemory->migrated < theMemory->oldSize))
      {
-      thePM = oldArray[i];
-      while (thePM != NULL)
-        {
-         nextPM = thePM->nextInMemory;
+      MigrateBetaMemoryBucket(theMemory,theMemory->migrated);
+      theMemory->migrated++;
+      buckets--;
+     }
 
-         thePM->nextInMemory = NULL;
+   if (theMemory->migrated == theMemory->oldSize)
+     { ReturnOldBetaMemory(theEnv,theMemory); }
+  }
 
-         betaLocation = thePM->hashValue % theMemory->size;
-         thePM->prevInMemory = lastAdd[betaLocation];
+/***************************************************************/
+/* CompleteBetaMemoryRehash: Migrates all of the buckets left  */
+/*   in a beta memory being rehashed. Must be called before    */
+/*   traversing the buckets of a beta memory.                  */
+/***************************************************************/
+void CompleteBetaMemoryRehash(
+  Environment *theEnv,
+  struct betaMemory *theMemory)
+  {
+   if (theMemory->oldBeta == NULL)
+     { return; }
 
-         if (lastAdd[betaLocation] != NULL)
-           { lastAdd[betaLocation]->nextInMemory = thePM; }
-         else
-           { theMemory->beta[betaLocation] = thePM; }
+   RehashBetaMemory(theEnv,theMemory,theMemory->oldSize - theMemory->migrated);
+  }
 
-         lastAdd[betaLocation] = thePM;
+/*****************************************************************/
+/* MigrateBetaMemoryBucket: Moves the partial matches in one of  */
+/*   the old buckets of a beta memory to the new buckets. The    */
+/*   bucket is traversed from its end and each partial match is  */
+/*   placed at the front of its new bucket, so partial matches   */
+/*   with the same hash value keep their relative order. None of */
+/*   them can be in the new buckets yet, since partial matches   */
+/*   are added to the old bucket until it has been migrated.     */
+/*****************************************************************/
+static void MigrateBetaMemoryBucket(
+  struct betaMemory *theMemory,
+  unsigned long oldLocation)
+  {
+   struct partialMatch *thePM, *prevPM;
+   unsigned long betaLocation;
 
-         thePM = nextPM;
-        }
-     }
+   thePM = theMemory->oldBeta[oldLocation];
+   if (thePM == NULL)
+     { return; }
 
-   if (theMemory->last != NULL)
+   if (theMemory->oldLast != NULL)
      {
-      genfree(theEnv,theMemory->last,sizeof(struct partialMatch *) * oldSize);
-      theMemory->last = lastAdd;
+      thePM = theMemory->oldLast[oldLocation];
+      theMemory->oldLast[oldLocation] = NULL;
      }
    else
-     { genfree(theEnv,lastAdd,sizeof(struct partialMatch *) * theMemory->size); }
+     {
+      while (thePM->nextInMemory != NULL)
+        { thePM = thePM->nextInMemory; }
+     }
 
-   genfree(theEnv,oldArray,sizeof(struct partialMatch *) * oldSize);
+   theMemory->oldBeta[oldLocation] = NULL;
+
+   while (thePM != NULL)
+     {
+      prevPM = thePM->prevInMemory;
+
+      betaLocation = thePM->hashValue % theMemory->size;
+
+      thePM->prevInMemory = NULL;
+      thePM->nextInMemory = theMemory->beta[betaLocation];
+
+      if (theMemory->beta[betaLocation] != NULL)
+        { theMemory->beta[betaLocation]->prevInMemory = thePM; }
+      else if (theMemory->last != NULL)
+        { theMemory->last[betaLocation] = thePM; }
+
+      theMemory->beta[betaLocation] = thePM;
+
+      thePM = prevPM;
+     }
   }
 
-/********************/
-/* ResetBetaMemory: */
-/********************/
+/***************************************************************/
+/* ReturnOldBetaMemory: Releases the arrays a beta memory was  */
+/*   being rehashed from. They must be empty or no longer used. */
+/***************************************************************/
+static void ReturnOldBetaMemory(
+  Environment *theEnv,
+  struct betaMemory *theMemory)
+  {
+   if (theMemory->oldBeta == NULL)
+     { return; }
+
+   genfree(theEnv,theMemory->oldBeta,sizeof(struct partialMatch *) * theMemory->oldSize);
+
+   if (theMemory->oldLast != NULL)
+     { genfree(theEnv,theMemory->oldLast,sizeof(struct partialMatch *) * theMemory->oldSize); }
+
+   theMemory->oldBeta = NULL;
+   theMemory->oldLast = NULL;
+   theMemory->oldSize = 0;
+   theMemory->migrated = 0;
+  }
+
+/*******************************************************/
+/* ResetBetaMemory: Returns an empty beta memory to its */
+/*   initial size, abandoning any rehash in progress.  */
+/*******************************************************/
 static void ResetBetaMemory(
   Environment *theEnv,
   struct betaMemory *theMemory)
@@ -1523,6 +1737,8 @@ static void ResetBetaMemory(
    struct partialMatch **oldArray, **lastAdd;
    unsigned long oldSize;
 
+   ReturnOldBetaMemory(theEnv,theMemory);
+
    if ((theMemory->size == 1) ||
        (theMemory->size == INITIAL_BETA_HASH_SIZE))
      { return; }
@@ -1544,6 +1760,62 @@ static void ResetBetaMemory(
      }
   }
 
+/****************************************************************/
+/* GetBetaMemoryStats: Computes the distribution of the lengths */
+/*   of the bucket chains of a beta memory. Chain lengths are   */
+/*   counted in power of two ranges: 1, 2-3, 4-7, and so on,    */
+/*   with the last range holding all of the longer chains.      */
+/****************************************************************/
+void GetBetaMemoryStats(
+  struct betaMemory *theMemory,
+  struct betaMemoryStats *theStats)
+  {
+   struct partialMatch **theBeta;
+   struct partialMatch *thePM;
+   unsigned long b, size, length;
+   unsigned int bin;
+   int pass;
+
+   memset(theStats,0,sizeof(struct betaMemoryStats));
+
+   for (pass = 0; pass < 2; pass++)
+     {
+      if (pass == 0)
+        {
+         theBeta = theMemory->beta;
+         size = theMemory->size;
+         b = 0;
+        }
+      else if (theMemory->oldBeta != NULL)
+        {
+         theBeta = theMemory->oldBeta;
+         size = theMemory->oldSize;
+         b = theMemory->migrated;
+        }
+      else
+        { break; }
+
+      for ( ; b < size; b++)
+        {
+         length = 0;
+         for (thePM = theBeta[b]; thePM != NULL; thePM = thePM->nextInMemory)
+           { length++; }
+
+         if (length == 0)
+           { continue; }
+
+         theStats->usedBuckets++;
+         if (length > theStats->longestChain)
+           { theStats->longestChain = length; }
+
+         for (bin = 0; (length > 1) && (bin < (BETA_CHAIN_LENGTH_BINS - 1)); bin++)
+           { length >>= 1; }
+
+         theStats->chains[bin]++;
+        }
+     }
+  }
+
 /********************/
 /* PrintBetaMemory: */
 /********************/
@@ -1561,6 +1833,8 @@ unsigned long PrintBetaMemory(
    if (GetHaltExecution(theEnv) == true)
      { return count; }
 
+   CompleteBetaMemoryRehash(theEnv,theMemory);
+
    for (b = 0; b < theMemory->size; b++)
      {
       listOfMatches = theMemory->beta[b];
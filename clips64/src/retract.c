@@ -578,7 +578,7 @@ void ReturnPartialMatch(
      {
       if (waste->binds[0].gm.theMatch->markers != NULL)
         { ReturnMarkers(theEnv,waste->binds[0].gm.theMatch->markers); }
-      rm(theEnv,waste->binds[0].gm.theMatch,sizeof(struct alphaMatch));
+      rtn_slab_struct(theEnv,alphaMatch,0,waste->binds[0].gm.theMatch);
      }
 
    /*=================================================*/
@@ -593,9 +593,9 @@ void ReturnPartialMatch(
    /* Return the partial match to the pool of free memory. */
    /*======================================================*/
 
-   rtn_var_struct(theEnv,partialMatch,sizeof(struct genericMatch *) *
-                  (waste->bcount - 1),
-                  waste);
+   rtn_slab_struct(theEnv,partialMatch,sizeof(struct genericMatch *) *
+                   (waste->bcount - 1),
+                   waste);
   }
 
 /***************************************************************/
@@ -617,7 +617,7 @@ void DestroyPartialMatch(
      {
       if (waste->binds[0].gm.theMatch->markers != NULL)
         { ReturnMarkers(theEnv,waste->binds[0].gm.theMatch->markers); }
-      rm(theEnv,waste->binds[0].gm.theMatch,sizeof(struct alphaMatch));
+      rtn_slab_struct(theEnv,alphaMatch,0,waste->binds[0].gm.theMatch);
      }
 
    /*=================================================*/
@@ -632,9 +632,9 @@ void DestroyPartialMatch(
    /* Return the partial match to the pool of free memory. */
    /*======================================================*/
 
-   rtn_var_struct(theEnv,partialMatch,sizeof(struct genericMatch *) *
-                  (waste->bcount - 1),
-                  waste);
+   rtn_slab_struct(theEnv,partialMatch,sizeof(struct genericMatch *) *
+                   (waste->bcount - 1),
+                   waste);
   }
 
 /******************************************************/
@@ -678,7 +678,7 @@ void FlushGarbagePartialMatches(
    while (EngineData(theEnv)->GarbageAlphaMatches != NULL)
      {
       amPtr = EngineData(theEnv)->GarbageAlphaMatches->next;
-      rtn_struct(theEnv,alphaMatch,EngineData(theEnv)->GarbageAlphaMatches);
+      rtn_slab_struct(theEnv,alphaMatch,0,EngineData(theEnv)->GarbageAlphaMatches);
       EngineData(theEnv)->GarbageAlphaMatches = amPtr;
      }
 
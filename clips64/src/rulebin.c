@@ -140,6 +140,7 @@ static void DeallocateDefruleBloadData(
         {
          tmpActivation = theActivation->next;
 
+         ReturnActivationIndex(theEnv,theActivation);
          rtn_struct(theEnv,activation,theActivation);
 
          theActivation = tmpActivation;
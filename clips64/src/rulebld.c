@@ -1109,6 +1109,7 @@ static struct joinNode *CreateNewJoin(
          newJoin->leftMemory->beta[0] = NULL;
          newJoin->leftMemory->last = NULL;
          newJoin->leftMemory->size = 1;
+         InitBetaMemoryRehash(newJoin->leftMemory);
          newJoin->leftMemory->count = 0;
          }
       else
@@ -1118,6 +1119,7 @@ static struct joinNode *CreateNewJoin(
          memset(newJoin->leftMemory->beta,0,sizeof(struct partialMatch *) * INITIAL_BETA_HASH_SIZE);
          newJoin->leftMemory->last = NULL;
          newJoin->leftMemory->size = INITIAL_BETA_HASH_SIZE;
+         InitBetaMemoryRehash(newJoin->leftMemory);
          newJoin->leftMemory->count = 0;
         }
 
@@ -1148,6 +1150,7 @@ static struct joinNode *CreateNewJoin(
          newJoin->rightMemory->beta[0] = NULL;
          newJoin->rightMemory->last[0] = NULL;
          newJoin->rightMemory->size = 1;
+         InitBetaMemoryRehash(newJoin->rightMemory);
          newJoin->rightMemory->count = 0;
          }
       else
@@ -1158,6 +1161,7 @@ static struct joinNode *CreateNewJoin(
          memset(newJoin->rightMemory->beta,0,sizeof(struct partialMatch *) * INITIAL_BETA_HASH_SIZE);
          memset(newJoin->rightMemory->last,0,sizeof(struct partialMatch *) * INITIAL_BETA_HASH_SIZE);
          newJoin->rightMemory->size = INITIAL_BETA_HASH_SIZE;
+         InitBetaMemoryRehash(newJoin->rightMemory);
          newJoin->rightMemory->count = 0;
         }
      }
@@ -1171,6 +1175,7 @@ static struct joinNode *CreateNewJoin(
       newJoin->rightMemory->beta[0]->rhsMemory = true;
       newJoin->rightMemory->last[0] = newJoin->rightMemory->beta[0];
       newJoin->rightMemory->size = 1;
+      InitBetaMemoryRehash(newJoin->rightMemory);
       newJoin->rightMemory->count = 1;
      }
    else
@@ -129,6 +129,8 @@
    static const char             *BetaHeaderString(Environment *,struct joinInformation *,long,long);
    static const char             *ActivityHeaderString(Environment *,struct joinInformation *,long,long);
    static void                    JoinActivityReset(Environment *,ConstructHeader *,void *);
+   static void                    ListBetaMemoryStats(Environment *,struct joinInformation *,long,long,
+                                                      long long *,long long *,long long *);
 #endif
 
 /****************************************************************/
@@ -152,6 +154,7 @@ void DefruleCommands(
    AddUDF(theEnv,"matches","bm",1,2,"y",MatchesCommand,"MatchesCommand",NULL);
    AddUDF(theEnv,"join-activity","bm",1,2,"y",JoinActivityCommand,"JoinActivityCommand",NULL);
    AddUDF(theEnv,"join-activity-reset","v",0,0,NULL,JoinActivityResetCommand,"JoinActivityResetCommand",NULL);
+   AddUDF(theEnv,"beta-memory-stats","bm",1,1,"y",BetaMemoryStatsCommand,"BetaMemoryStatsCommand",NULL);
    AddUDF(theEnv,"list-focus-stack","v",0,0,NULL,ListFocusStackCommand,"ListFocusStackCommand",NULL);
    AddUDF(theEnv,"dependencies","v",1,1,"infly",DependenciesCommand,"DependenciesCommand",NULL);
    AddUDF(theEnv,"dependents","v",1,1,"infly",DependentsCommand,"DependentsCommand",NULL);
@@ -161,9 +164,15 @@ void DefruleCommands(
 
    AddUDF(theEnv,"get-beta-memory-resizing","b",0,0,NULL,GetBetaMemoryResizingCommand,"GetBetaMemoryResizingCommand",NULL);
    AddUDF(theEnv,"set-beta-memory-resizing","b",1,1,NULL,SetBetaMemoryResizingCommand,"SetBetaMemoryResizingCommand",NULL);
+   AddUDF(theEnv,"get-beta-memory-load-factor","d",0,0,NULL,GetBetaMemoryLoadFactorCommand,"GetBetaMemoryLoadFactorCommand",NULL);
+   AddUDF(theEnv,"set-beta-memory-load-factor","d",1,1,"ld",SetBetaMemoryLoadFactorCommand,"SetBetaMemoryLoadFactorCommand",NULL);
+   AddUDF(theEnv,"get-beta-memory-min-load-factor","d",0,0,NULL,GetBetaMemoryMinLoadFactorCommand,"GetBetaMemoryMinLoadFactorCommand",NULL);
+   AddUDF(theEnv,"set-beta-memory-min-load-factor","d",1,1,"ld",SetBetaMemoryMinLoadFactorCommand,"SetBetaMemoryMinLoadFactorCommand",NULL);
 
    AddUDF(theEnv,"get-strategy","y",0,0,NULL,GetStrategyCommand,"GetStrategyCommand",NULL);
    AddUDF(theEnv,"set-strategy","y",1,1,"y",SetStrategyCommand,"SetStrategyCommand",NULL);
+   AddUDF(theEnv,"get-agenda-indexing","b",0,0,NULL,GetAgendaIndexingCommand,"GetAgendaIndexingCommand",NULL);
+   AddUDF(theEnv,"set-agenda-indexing","b",1,1,NULL,SetAgendaIndexingCommand,"SetAgendaIndexingCommand",NULL);
 
 #if DEVELOPER && (! BLOAD_ONLY)
    AddUDF(theEnv,"rule-complexity","l",1,1,"y",RuleComplexityCommand,"RuleComplexityCommand",NULL);
@@ -247,6 +256,163 @@ void GetBetaMemoryResizingCommand(
    returnValue->lexemeValue = CreateBoolean(theEnv,GetBetaMemoryResizing(theEnv));
   }
 
+/**************************************************/
+/* GetBetaMemoryLoadFactor: C access routine      */
+/*   for the get-beta-memory-load-factor command. */
+/**************************************************/
+double GetBetaMemoryLoadFactor(
+  Environment *theEnv)
+  {
+   return DefruleData(theEnv)->BetaMemoryLoadFactor;
+  }
+
+/*****************************************************/
+/* SetBetaMemoryLoadFactor: C access routine for the */
+/*   set-beta-memory-load-factor command. The load   */
+/*   factor is the mean number of partial matches    */
+/*   per bucket above which a beta memory grows. It  */
+/*   must be greater than twice the minimum load     */
+/*   factor. Returns -1.0 if the value is invalid.   */
+/*****************************************************/
+double SetBetaMemoryLoadFactor(
+  Environment *theEnv,
+  double value)
+  {
+   double ov;
+
+   if ((value <= 0.0) ||
+       (value <= (DefruleData(theEnv)->BetaMemoryMinLoadFactor * 2.0)))
+     { return -1.0; }
+
+   ov = DefruleData(theEnv)->BetaMemoryLoadFactor;
+
+   DefruleData(theEnv)->BetaMemoryLoadFactor = value;
+
+   return ov;
+  }
+
+/*******************************************************/
+/* SetBetaMemoryLoadFactorCommand: H/L access routine  */
+/*   for the set-beta-memory-load-factor command.      */
+/*******************************************************/
+void SetBetaMemoryLoadFactorCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   UDFValue theArg;
+   double value;
+
+   if (! UDFFirstArgument(context,NUMBER_BITS,&theArg))
+     { return; }
+
+   value = CVCoerceToFloat(&theArg);
+
+   if (value <= 0.0)
+     {
+      UDFInvalidArgumentMessage(context,"number greater than 0");
+      returnValue->floatValue = CreateFloat(theEnv,-1.0);
+     }
+   else if (value <= (GetBetaMemoryMinLoadFactor(theEnv) * 2.0))
+     {
+      UDFInvalidArgumentMessage(context,"number greater than twice the beta memory minimum load factor");
+      returnValue->floatValue = CreateFloat(theEnv,-1.0);
+     }
+   else
+     { returnValue->floatValue = CreateFloat(theEnv,SetBetaMemoryLoadFactor(theEnv,value)); }
+  }
+
+/*******************************************************/
+/* GetBetaMemoryLoadFactorCommand: H/L access routine  */
+/*   for the get-beta-memory-load-factor command.      */
+/*******************************************************/
+void GetBetaMemoryLoadFactorCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   returnValue->floatValue = CreateFloat(theEnv,GetBetaMemoryLoadFactor(theEnv));
+  }
+
+/****************************************************/
+/* GetBetaMemoryMinLoadFactor: C access routine for */
+/*   the get-beta-memory-min-load-factor command.   */
+/****************************************************/
+double GetBetaMemoryMinLoadFactor(
+  Environment *theEnv)
+  {
+   return DefruleData(theEnv)->BetaMemoryMinLoadFactor;
+  }
+
+/********************************************************/
+/* SetBetaMemoryMinLoadFactor: C access routine for the */
+/*   set-beta-memory-min-load-factor command. A beta    */
+/*   memory shrinks when partial matches are added to   */
+/*   it while its mean number of partial matches per    */
+/*   bucket is below this value. Zero disables          */
+/*   shrinking. It must be less than half the load      */
+/*   factor. Returns -1.0 if the value is invalid.      */
+/********************************************************/
+double SetBetaMemoryMinLoadFactor(
+  Environment *theEnv,
+  double value)
+  {
+   double ov;
+
+   if ((value < 0.0) ||
+       ((value * 2.0) >= DefruleData(theEnv)->BetaMemoryLoadFactor))
+     { return -1.0; }
+
+   ov = DefruleData(theEnv)->BetaMemoryMinLoadFactor;
+
+   DefruleData(theEnv)->BetaMemoryMinLoadFactor = value;
+
+   return ov;
+  }
+
+/**********************************************************/
+/* SetBetaMemoryMinLoadFactorCommand: H/L access routine  */
+/*   for the set-beta-memory-min-load-factor command.     */
+/**********************************************************/
+void SetBetaMemoryMinLoadFactorCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   UDFValue theArg;
+   double value;
+
+   if (! UDFFirstArgument(context,NUMBER_BITS,&theArg))
+     { return; }
+
+   value = CVCoerceToFloat(&theArg);
+
+   if (value < 0.0)
+     {
+      UDFInvalidArgumentMessage(context,"number greater than or equal to 0");
+      returnValue->floatValue = CreateFloat(theEnv,-1.0);
+     }
+   else if ((value * 2.0) >= GetBetaMemoryLoadFactor(theEnv))
+     {
+      UDFInvalidArgumentMessage(context,"number less than half the beta memory load factor");
+      returnValue->floatValue = CreateFloat(theEnv,-1.0);
+     }
+   else
+     { returnValue->floatValue = CreateFloat(theEnv,SetBetaMemoryMinLoadFactor(theEnv,value)); }
+  }
+
+/**********************************************************/
+/* GetBetaMemoryMinLoadFactorCommand: H/L access routine  */
+/*   for the get-beta-memory-min-load-factor command.     */
+/**********************************************************/
+void GetBetaMemoryMinLoadFactorCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   returnValue->floatValue = CreateFloat(theEnv,GetBetaMemoryMinLoadFactor(theEnv));
+  }
+
 /******************************************/
 /* GetFocusFunction: H/L access routine   */
 /*   for the get-focus function.          */
@@ -1299,6 +1465,155 @@ void JoinActivityResetCommand(
                       DefruleData(theEnv)->DefruleModuleIndex,true,NULL);
   }
 
+/**********************************************/
+/* BetaMemoryStatsCommand: H/L access routine */
+/*   for the beta-memory-stats command.       */
+/**********************************************/
+void BetaMemoryStatsCommand(
+  Environment *theEnv,
+  UDFContext *context,
+  UDFValue *returnValue)
+  {
+   const char *ruleName;
+   Defrule *rulePtr;
+   UDFValue theArg;
+
+   if (! UDFFirstArgument(context,SYMBOL_BIT,&theArg))
+     { return; }
+
+   ruleName = theArg.lexemeValue->contents;
+
+   rulePtr = FindDefrule(theEnv,ruleName);
+   if (rulePtr == NULL)
+     {
+      CantFindItemErrorMessage(theEnv,"defrule",ruleName,true);
+      returnValue->lexemeValue = FalseSymbol(theEnv);
+      return;
+     }
+
+   BetaMemoryStats(theEnv,rulePtr,returnValue);
+  }
+
+/***************************************************/
+/* BetaMemoryStats: C access routine for the       */
+/*   beta-memory-stats command. Lists the size and  */
+/*   the chain lengths of each of the beta memories */
+/*   of a rule. Returns the total number of buckets */
+/*   and partial matches and the longest chain.     */
+/***************************************************/
+void BetaMemoryStats(
+  Environment *theEnv,
+  Defrule *theRule,
+  UDFValue *returnValue)
+  {
+   Defrule *rulePtr;
+   long joinIndex;
+   unsigned short arraySize;
+   struct joinInformation *theInfo;
+   long long buckets = 0, matches = 0, longest = 0;
+
+   /*=================================================*/
+   /* Loop through each of the disjuncts for the rule */
+   /*=================================================*/
+
+   for (rulePtr = theRule; rulePtr != NULL; rulePtr = rulePtr->disjunct)
+     {
+      arraySize = BetaJoinCount(theEnv,rulePtr);
+
+      theInfo = CreateJoinArray(theEnv,arraySize);
+
+      BetaJoins(theEnv,rulePtr,arraySize,theInfo);
+
+      for (joinIndex = 0; joinIndex < arraySize; joinIndex++)
+        { ListBetaMemoryStats(theEnv,theInfo,joinIndex,arraySize,&buckets,&matches,&longest); }
+
+      FreeJoinArray(theEnv,theInfo,arraySize);
+     }
+
+   returnValue->begin = 0;
+   returnValue->range = 3;
+   returnValue->value = CreateMultifield(theEnv,3L);
+
+   returnValue->multifieldValue->contents[0].integerValue = CreateInteger(theEnv,buckets);
+   returnValue->multifieldValue->contents[1].integerValue = CreateInteger(theEnv,matches);
+   returnValue->multifieldValue->contents[2].integerValue = CreateInteger(theEnv,longest);
+  }
+
+/************************/
+/* ListBetaMemoryStats: */
+/************************/
+static void ListBetaMemoryStats(
+  Environment *theEnv,
+  struct joinInformation *infoArray,
+  long joinIndex,
+  long arraySize,
+  long long *buckets,
+  long long *matches,
+  long long *longest)
+  {
+   struct betaMemory *theMemory;
+   struct betaMemoryStats theStats;
+   char buffer[100], label[32];
+   unsigned int bin;
+   unsigned long low;
+
+   if (GetHaltExecution(theEnv) == true)
+     { return; }
+
+   theMemory = infoArray[joinIndex].theMemory;
+
+   GetBetaMemoryStats(theMemory,&theStats);
+
+   WriteString(theEnv,STDOUT,"Beta memory for CEs ");
+   WriteString(theEnv,STDOUT,
+                  BetaHeaderString(theEnv,infoArray,joinIndex,arraySize));
+   WriteString(theEnv,STDOUT,"\n");
+
+   gensnprintf(buffer,sizeof(buffer),"   Buckets:         %10lu\n",theMemory->size);
+   WriteString(theEnv,STDOUT,buffer);
+   if (theMemory->oldBeta != NULL)
+     {
+      gensnprintf(buffer,sizeof(buffer),"   Rehashing:       %10lu of %lu buckets migrated\n",
+                  theMemory->migrated,theMemory->oldSize);
+      WriteString(theEnv,STDOUT,buffer);
+     }
+   gensnprintf(buffer,sizeof(buffer),"   Partial matches: %10lu\n",theMemory->count);
+   WriteString(theEnv,STDOUT,buffer);
+   gensnprintf(buffer,sizeof(buffer),"   Used buckets:    %10lu\n",theStats.usedBuckets);
+   WriteString(theEnv,STDOUT,buffer);
+   gensnprintf(buffer,sizeof(buffer),"   Longest chain:   %10lu\n",theStats.longestChain);
+   WriteString(theEnv,STDOUT,buffer);
+   gensnprintf(buffer,sizeof(buffer),"   Mean chain:      %10.2f\n",
+               (theStats.usedBuckets == 0) ? 0.0 : ((double) theMemory->count) / theStats.usedBuckets);
+   WriteString(theEnv,STDOUT,buffer);
+
+   /*==========================================*/
+   /* List the number of chains of each length */
+   /* range, skipping the empty ranges.        */
+   /*==========================================*/
+
+   for (bin = 0, low = 1; bin < BETA_CHAIN_LENGTH_BINS; bin++, low *= 2)
+     {
+      if (theStats.chains[bin] == 0)
+        { continue; }
+
+      if (low == 1)
+        { gensnprintf(label,sizeof(label),"Chains of 1:"); }
+      else if (bin == (BETA_CHAIN_LENGTH_BINS - 1))
+        { gensnprintf(label,sizeof(label),"Chains of %lu+:",low); }
+      else
+        { gensnprintf(label,sizeof(label),"Chains of %lu-%lu:",low,(low * 2) - 1); }
+
+      gensnprintf(buffer,sizeof(buffer),"   %-17s%10lu\n",label,theStats.chains[bin]);
+      WriteString(theEnv,STDOUT,buffer);
+     }
+
+   *buckets += (long long) theMemory->size;
+   *matches += (long long) theMemory->count;
+   if ((long long) theStats.longestChain > *longest)
+     { *longest = (long long) theStats.longestChain; }
+  }
+
 /***************************************/
 /* TimetagFunction: H/L access routine */
 /*   for the timetag function.         */
@@ -153,6 +153,8 @@ void InitializeDefrules(
    for (i = 0; i < ALPHA_MEMORY_HASH_SIZE; i++) DefruleData(theEnv)->AlphaMemoryTable[i] = NULL;
 
    DefruleData(theEnv)->BetaMemoryResizingFlag = true;
+   DefruleData(theEnv)->BetaMemoryLoadFactor = DEFAULT_BETA_MEMORY_LOAD_FACTOR;
+   DefruleData(theEnv)->BetaMemoryMinLoadFactor = DEFAULT_BETA_MEMORY_MIN_LOAD_FACTOR;
 
    DefruleData(theEnv)->RightPrimeJoins = NULL;
    DefruleData(theEnv)->LeftPrimeJoins = NULL;
@@ -191,6 +193,7 @@ static void DeallocateDefruleData(
         {
          tmpActivation = theActivation->next;
 
+         ReturnActivationIndex(theEnv,theActivation);
          rtn_struct(theEnv,activation,theActivation);
 
          theActivation = tmpActivation;
@@ -469,6 +472,7 @@ void AddBetaMemoriesToJoin(
          theNode->leftMemory->beta = (struct partialMatch **) genalloc(theEnv,sizeof(struct partialMatch *));
          theNode->leftMemory->beta[0] = NULL;
          theNode->leftMemory->size = 1;
+         InitBetaMemoryRehash(theNode->leftMemory);
          theNode->leftMemory->count = 0;
          theNode->leftMemory->last = NULL;
         }
@@ -478,6 +482,7 @@ void AddBetaMemoriesToJoin(
          theNode->leftMemory->beta = (struct partialMatch **) genalloc(theEnv,sizeof(struct partialMatch *) * INITIAL_BETA_HASH_SIZE);
          memset(theNode->leftMemory->beta,0,sizeof(struct partialMatch *) * INITIAL_BETA_HASH_SIZE);
          theNode->leftMemory->size = INITIAL_BETA_HASH_SIZE;
+         InitBetaMemoryRehash(theNode->leftMemory);
          theNode->leftMemory->count = 0;
          theNode->leftMemory->last = NULL;
         }
@@ -501,6 +506,7 @@ void AddBetaMemoriesToJoin(
          theNode->rightMemory->beta[0] = NULL;
          theNode->rightMemory->last[0] = NULL;
          theNode->rightMemory->size = 1;
+         InitBetaMemoryRehash(theNode->rightMemory);
          theNode->rightMemory->count = 0;
         }
       else
@@ -511,6 +517,7 @@ void AddBetaMemoriesToJoin(
          memset(theNode->rightMemory->beta,0,sizeof(struct partialMatch **) * INITIAL_BETA_HASH_SIZE);
          memset(theNode->rightMemory->last,0,sizeof(struct partialMatch **) * INITIAL_BETA_HASH_SIZE);
          theNode->rightMemory->size = INITIAL_BETA_HASH_SIZE;
+         InitBetaMemoryRehash(theNode->rightMemory);
          theNode->rightMemory->count = 0;
         }
      }
@@ -524,6 +531,7 @@ void AddBetaMemoriesToJoin(
       theNode->rightMemory->beta[0]->rhsMemory = true;
       theNode->rightMemory->last[0] = theNode->rightMemory->beta[0];
       theNode->rightMemory->size = 1;
+      InitBetaMemoryRehash(theNode->rightMemory);
       theNode->rightMemory->count = 1;
      }
    else
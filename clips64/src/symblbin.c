@@ -95,7 +95,7 @@ void InitAtomicValueNeededFlags(
 
    symbolArray = GetSymbolTable(theEnv);
 
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       symbolPtr = symbolArray[i];
       while (symbolPtr != NULL)
@@ -111,7 +111,7 @@ void InitAtomicValueNeededFlags(
 
    floatArray = GetFloatTable(theEnv);
 
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < GetFloatTableSize(theEnv); i++)
      {
       floatPtr = floatArray[i];
       while (floatPtr != NULL)
@@ -127,7 +127,7 @@ void InitAtomicValueNeededFlags(
 
    integerArray = GetIntegerTable(theEnv);
 
-   for (i = 0; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0; i < GetIntegerTableSize(theEnv); i++)
      {
       integerPtr = integerArray[i];
       while (integerPtr != NULL)
@@ -143,7 +143,7 @@ void InitAtomicValueNeededFlags(
 
    bitMapArray = GetBitMapTable(theEnv);
 
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < GetBitMapTableSize(theEnv); i++)
      {
       bitMapPtr = bitMapArray[i];
       while (bitMapPtr != NULL)
@@ -179,7 +179,7 @@ void WriteNeededSymbols(
    /* Get the number of symbols and the total string size. */
    /*======================================================*/
 
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       for (symbolPtr = symbolArray[i];
            symbolPtr != NULL;
@@ -204,7 +204,7 @@ void WriteNeededSymbols(
    /* Write out the symbol types. */
    /*=============================*/
    
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       for (symbolPtr = symbolArray[i];
            symbolPtr != NULL;
@@ -219,7 +219,7 @@ void WriteNeededSymbols(
    /* Write out the symbols. */
    /*========================*/
    
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       for (symbolPtr = symbolArray[i];
            symbolPtr != NULL;
@@ -242,7 +242,7 @@ void WriteNeededFloats(
   Environment *theEnv,
   FILE *fp)
   {
-   int i;
+   unsigned long i;
    CLIPSFloat **floatArray;
    CLIPSFloat *floatPtr;
    unsigned long numberOfUsedFloats = 0;
@@ -257,7 +257,7 @@ void WriteNeededFloats(
    /* Get the number of floats. */
    /*===========================*/
 
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < GetFloatTableSize(theEnv); i++)
      {
       for (floatPtr = floatArray[i];
            floatPtr != NULL;
@@ -271,7 +271,7 @@ void WriteNeededFloats(
 
    GenWrite(&numberOfUsedFloats,sizeof(unsigned long),fp);
 
-   for (i = 0 ; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0 ; i < GetFloatTableSize(theEnv); i++)
      {
       for (floatPtr = floatArray[i];
            floatPtr != NULL;
@@ -292,7 +292,7 @@ void WriteNeededIntegers(
   Environment *theEnv,
   FILE *fp)
   {
-   int i;
+   unsigned long i;
    CLIPSInteger **integerArray;
    CLIPSInteger *integerPtr;
    unsigned long numberOfUsedIntegers = 0;
@@ -307,7 +307,7 @@ void WriteNeededIntegers(
    /* Get the number of integers. */
    /*=============================*/
 
-   for (i = 0 ; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0 ; i < GetIntegerTableSize(theEnv); i++)
      {
       for (integerPtr = integerArray[i];
            integerPtr != NULL;
@@ -323,7 +323,7 @@ void WriteNeededIntegers(
 
    GenWrite(&numberOfUsedIntegers,sizeof(unsigned long),fp);
 
-   for (i = 0 ; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0 ; i < GetIntegerTableSize(theEnv); i++)
      {
       for (integerPtr = integerArray[i];
            integerPtr != NULL;
@@ -346,7 +346,7 @@ static void WriteNeededBitMaps(
   Environment *theEnv,
   FILE *fp)
   {
-   int i;
+   unsigned long i;
    CLIPSBitMap **bitMapArray;
    CLIPSBitMap *bitMapPtr;
    unsigned long numberOfUsedBitMaps = 0, size = 0;
@@ -362,7 +362,7 @@ static void WriteNeededBitMaps(
    /* Get the number of bitmaps and the total bitmap size. */
    /*======================================================*/
 
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < GetBitMapTableSize(theEnv); i++)
      {
       for (bitMapPtr = bitMapArray[i];
            bitMapPtr != NULL;
@@ -383,7 +383,7 @@ static void WriteNeededBitMaps(
    GenWrite(&numberOfUsedBitMaps,sizeof(unsigned long),fp);
    GenWrite(&size,sizeof(unsigned long),fp);
 
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < GetBitMapTableSize(theEnv); i++)
      {
       for (bitMapPtr = bitMapArray[i];
            bitMapPtr != NULL;
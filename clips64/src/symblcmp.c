@@ -89,6 +89,13 @@ void AtomicValuesToCode(
   {
    unsigned int version; // TBD Necessary?
 
+   /*====================================================*/
+   /* The tables of the run-time image are arrays of the */
+   /* initial sizes, so any growth is undone first.      */
+   /*====================================================*/
+
+   ShrinkAtomTables(theEnv);
+
    SetAtomicValueIndices(theEnv,true);
 
    HashTablesToCode(theEnv,fileName,pathName,fileNameBuffer);
@@ -182,7 +189,8 @@ static unsigned int SymbolHashNodesToCode(
               { fprintf(fp,"&S%d_%d[%ld],",ConstructCompilerData(theEnv)->ImageID,arrayVersion,j + 1); }
            }
 
-         fprintf(fp,"%ld,1,0,0,%ld,",hashPtr->count + 1,i);
+         fprintf(fp,"%ld,1,0,0,%lu,",hashPtr->count + 1,
+                     (unsigned long) HashSymbol(hashPtr->contents,ATOM_HASH_RANGE));
          PrintCString(fp,hashPtr->contents);
 
          count++;
@@ -288,8 +296,9 @@ static unsigned int BitMapHashNodesToCode(
               { fprintf(fp,"&B%d_%d[%d],",ConstructCompilerData(theEnv)->ImageID,arrayVersion,j + 1); }
            }
 
-         fprintf(fp,"%ld,1,0,0,%d,(char *) &L%d_%d[%d],%d",
-                     hashPtr->count + 1,i,
+         fprintf(fp,"%ld,1,0,0,%lu,(char *) &L%d_%d[%d],%d",
+                     hashPtr->count + 1,
+                     (unsigned long) HashBitMap(hashPtr->contents,ATOM_HASH_RANGE,hashPtr->size),
                      ConstructCompilerData(theEnv)->ImageID,longsReqdPartition,longsReqdPartitionCount,
                      hashPtr->size);
 
@@ -518,7 +527,8 @@ static unsigned int FloatHashNodesToCode(
               { fprintf(fp,"&F%d_%d[%d],",ConstructCompilerData(theEnv)->ImageID,arrayVersion,j + 1); }
            }
 
-         fprintf(fp,"%ld,1,0,0,%d,",hashPtr->count + 1,i);
+         fprintf(fp,"%ld,1,0,0,%lu,",hashPtr->count + 1,
+                     (unsigned long) HashFloat(hashPtr->contents,ATOM_HASH_RANGE));
          fprintf(fp,"%s",FloatToString(theEnv,hashPtr->contents));
 
          count++;
@@ -623,7 +633,8 @@ static unsigned int IntegerHashNodesToCode(
               { fprintf(fp,"&I%d_%d[%d],",ConstructCompilerData(theEnv)->ImageID,arrayVersion,j + 1); }
            }
 
-         fprintf(fp,"%ld,1,0,0,%d,",hashPtr->count + 1,i);
+         fprintf(fp,"%ld,1,0,0,%lu,",hashPtr->count + 1,
+                     (unsigned long) HashInteger(hashPtr->contents,ATOM_HASH_RANGE));
          fprintf(fp,"%lldLL",hashPtr->contents);
 
          count++;
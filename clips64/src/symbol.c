@@ -70,6 +70,7 @@
 /*                                                           */
 /*************************************************************/
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -105,12 +106,21 @@
 /* LOCAL INTERNAL FUNCTION DEFINITIONS */
 /***************************************/
 
-   static void                    RemoveHashNode(Environment *,GENERIC_HN *,GENERIC_HN **,int,int);
+   static void                    RemoveHashNode(Environment *,GENERIC_HN *,GENERIC_HN **,
+                                                 struct atomTable *,int,int);
    static void                    AddEphemeralHashNode(Environment *,GENERIC_HN *,struct ephemeron **,
                                                        int,int,bool);
    static void                    RemoveEphemeralHashNodes(Environment *,struct ephemeron **,
-                                                           GENERIC_HN **,
+                                                           GENERIC_HN **,struct atomTable *,
                                                            int,int,int);
+   static GENERIC_HN            **CreateAtomTable(Environment *,struct atomTable *,unsigned long);
+   static GENERIC_HN            **AtomTableChain(GENERIC_HN **,struct atomTable *,size_t);
+   static GENERIC_HN            **AddAtomTableEntry(Environment *,GENERIC_HN **,struct atomTable *);
+   static GENERIC_HN            **ResizeAtomTable(Environment *,GENERIC_HN **,struct atomTable *,unsigned long);
+   static void                    MigrateAtomTableBuckets(Environment *,GENERIC_HN **,struct atomTable *,unsigned long);
+   static void                    CompleteAtomTableRehash(Environment *,GENERIC_HN **,struct atomTable *);
+   static uint64_t                HashBytes(const char *,size_t);
+   static uint64_t                MixHashValue(uint64_t);
    static const char             *StringWithinString(const char *,const char *);
    static size_t                  CommonPrefixLength(const char *,const char *);
    static void                    DeallocateSymbolData(Environment *);
@@ -135,7 +145,6 @@ void InitializeAtomTables(
 #pragma unused(bitmapTable)
 #pragma unused(externalAddressTable)
 #endif
-   unsigned long i;
 
    AllocateEnvironmentData(theEnv,SYMBOL_DATA,sizeof(struct symbolData),DeallocateSymbolData);
 
@@ -145,29 +154,21 @@ void InitializeAtomTables(
    /*=========================*/
 
    SymbolData(theEnv)->SymbolTable = (CLIPSLexeme **)
-                  gm2(theEnv,sizeof (CLIPSLexeme *) * SYMBOL_HASH_SIZE);
+                  CreateAtomTable(theEnv,&SymbolData(theEnv)->SymbolHash,SYMBOL_HASH_SIZE);
 
    SymbolData(theEnv)->FloatTable = (CLIPSFloat **)
-                  gm2(theEnv,sizeof (CLIPSFloat *) * FLOAT_HASH_SIZE);
+                  CreateAtomTable(theEnv,&SymbolData(theEnv)->FloatHash,FLOAT_HASH_SIZE);
 
    SymbolData(theEnv)->IntegerTable = (CLIPSInteger **)
-                   gm2(theEnv,sizeof (CLIPSInteger *) * INTEGER_HASH_SIZE);
+                   CreateAtomTable(theEnv,&SymbolData(theEnv)->IntegerHash,INTEGER_HASH_SIZE);
 
    SymbolData(theEnv)->BitMapTable = (CLIPSBitMap **)
-                   gm2(theEnv,sizeof (CLIPSBitMap *) * BITMAP_HASH_SIZE);
+                   CreateAtomTable(theEnv,&SymbolData(theEnv)->BitMapHash,BITMAP_HASH_SIZE);
 
    SymbolData(theEnv)->ExternalAddressTable = (CLIPSExternalAddress **)
-                   gm2(theEnv,sizeof (CLIPSExternalAddress *) * EXTERNAL_ADDRESS_HASH_SIZE);
-
-   /*===================================================*/
-   /* Initialize all of the hash table entries to NULL. */
-   /*===================================================*/
+                   CreateAtomTable(theEnv,&SymbolData(theEnv)->ExternalAddressHash,EXTERNAL_ADDRESS_HASH_SIZE);
 
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++) SymbolData(theEnv)->SymbolTable[i] = NULL;
-   for (i = 0; i < FLOAT_HASH_SIZE; i++) SymbolData(theEnv)->FloatTable[i] = NULL;
-   for (i = 0; i < INTEGER_HASH_SIZE; i++) SymbolData(theEnv)->IntegerTable[i] = NULL;
-   for (i = 0; i < BITMAP_HASH_SIZE; i++) SymbolData(theEnv)->BitMapTable[i] = NULL;
-   for (i = 0; i < EXTERNAL_ADDRESS_HASH_SIZE; i++) SymbolData(theEnv)->ExternalAddressTable[i] = NULL;
+   SymbolData(theEnv)->AtomTableResizing = true;
 
    /*========================*/
    /* Predefine some values. */
@@ -184,15 +185,25 @@ void InitializeAtomTables(
    SymbolData(theEnv)->Zero = CreateInteger(theEnv,0LL);
    IncrementIntegerCount(SymbolData(theEnv)->Zero);
 #else
+   /*===================================================*/
+   /* The tables of a run-time image are static arrays, */
+   /* so they keep the sizes they were generated with.  */
+   /*===================================================*/
+
    SetSymbolTable(theEnv,symbolTable);
    SetFloatTable(theEnv,floatTable);
    SetIntegerTable(theEnv,integerTable);
    SetBitMapTable(theEnv,bitmapTable);
 
+   SymbolData(theEnv)->SymbolHash.size = SymbolData(theEnv)->SymbolHash.initialSize = SYMBOL_HASH_SIZE;
+   SymbolData(theEnv)->FloatHash.size = SymbolData(theEnv)->FloatHash.initialSize = FLOAT_HASH_SIZE;
+   SymbolData(theEnv)->IntegerHash.size = SymbolData(theEnv)->IntegerHash.initialSize = INTEGER_HASH_SIZE;
+   SymbolData(theEnv)->BitMapHash.size = SymbolData(theEnv)->BitMapHash.initialSize = BITMAP_HASH_SIZE;
+
    SymbolData(theEnv)->ExternalAddressTable = (CLIPSExternalAddress **)
-                gm2(theEnv,sizeof (CLIPSExternalAddress *) * EXTERNAL_ADDRESS_HASH_SIZE);
+                CreateAtomTable(theEnv,&SymbolData(theEnv)->ExternalAddressHash,EXTERNAL_ADDRESS_HASH_SIZE);
 
-   for (i = 0; i < EXTERNAL_ADDRESS_HASH_SIZE; i++) SymbolData(theEnv)->ExternalAddressTable[i] = NULL;
+   SymbolData(theEnv)->AtomTableResizing = false;
    
    theEnv->TrueSymbol = FindSymbolHN(theEnv,TRUE_STRING,SYMBOL_BIT);
    theEnv->FalseSymbol = FindSymbolHN(theEnv,FALSE_STRING,SYMBOL_BIT);
@@ -209,7 +220,7 @@ void InitializeAtomTables(
 static void DeallocateSymbolData(
   Environment *theEnv)
   {
-   int i;
+   unsigned long i;
    CLIPSLexeme *shPtr, *nextSHPtr;
    CLIPSInteger *ihPtr, *nextIHPtr;
    CLIPSFloat *fhPtr, *nextFHPtr;
@@ -224,8 +235,19 @@ static void DeallocateSymbolData(
      { return; }
      
    genfree(theEnv,theEnv->VoidConstant,sizeof(TypeHeader));
-   
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+
+   /*============================================*/
+   /* Move the atoms left in the tables replaced */
+   /* by a resize so each table is walked once.  */
+   /*============================================*/
+
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->SymbolTable,&SymbolData(theEnv)->SymbolHash);
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->FloatTable,&SymbolData(theEnv)->FloatHash);
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->IntegerTable,&SymbolData(theEnv)->IntegerHash);
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->BitMapTable,&SymbolData(theEnv)->BitMapHash);
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->ExternalAddressTable,&SymbolData(theEnv)->ExternalAddressHash);
+
+   for (i = 0; i < SymbolData(theEnv)->SymbolHash.size; i++)
      {
       shPtr = SymbolData(theEnv)->SymbolTable[i];
 
@@ -241,7 +263,7 @@ static void DeallocateSymbolData(
         }
      }
 
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < SymbolData(theEnv)->FloatHash.size; i++)
      {
       fhPtr = SymbolData(theEnv)->FloatTable[i];
 
@@ -254,7 +276,7 @@ static void DeallocateSymbolData(
         }
      }
 
-   for (i = 0; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0; i < SymbolData(theEnv)->IntegerHash.size; i++)
      {
       ihPtr = SymbolData(theEnv)->IntegerTable[i];
 
@@ -267,7 +289,7 @@ static void DeallocateSymbolData(
         }
      }
 
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < SymbolData(theEnv)->BitMapHash.size; i++)
      {
       bmhPtr = SymbolData(theEnv)->BitMapTable[i];
 
@@ -283,7 +305,7 @@ static void DeallocateSymbolData(
         }
      }
 
-   for (i = 0; i < EXTERNAL_ADDRESS_HASH_SIZE; i++)
+   for (i = 0; i < SymbolData(theEnv)->ExternalAddressHash.size; i++)
      {
       eahPtr = SymbolData(theEnv)->ExternalAddressTable[i];
 
@@ -303,16 +325,16 @@ static void DeallocateSymbolData(
    /*================================*/
 
  #if ! RUN_TIME
-   rm(theEnv,SymbolData(theEnv)->SymbolTable,sizeof (CLIPSLexeme *) * SYMBOL_HASH_SIZE);
+   genfree(theEnv,SymbolData(theEnv)->SymbolTable,sizeof (CLIPSLexeme *) * SymbolData(theEnv)->SymbolHash.size);
 
-   genfree(theEnv,SymbolData(theEnv)->FloatTable,sizeof (CLIPSFloat *) * FLOAT_HASH_SIZE);
+   genfree(theEnv,SymbolData(theEnv)->FloatTable,sizeof (CLIPSFloat *) * SymbolData(theEnv)->FloatHash.size);
 
-   genfree(theEnv,SymbolData(theEnv)->IntegerTable,sizeof (CLIPSInteger *) * INTEGER_HASH_SIZE);
+   genfree(theEnv,SymbolData(theEnv)->IntegerTable,sizeof (CLIPSInteger *) * SymbolData(theEnv)->IntegerHash.size);
 
-   genfree(theEnv,SymbolData(theEnv)->BitMapTable,sizeof (CLIPSBitMap *) * BITMAP_HASH_SIZE);
+   genfree(theEnv,SymbolData(theEnv)->BitMapTable,sizeof (CLIPSBitMap *) * SymbolData(theEnv)->BitMapHash.size);
 #endif
 
-   genfree(theEnv,SymbolData(theEnv)->ExternalAddressTable,sizeof (CLIPSExternalAddress *) * EXTERNAL_ADDRESS_HASH_SIZE);
+   genfree(theEnv,SymbolData(theEnv)->ExternalAddressTable,sizeof (CLIPSExternalAddress *) * SymbolData(theEnv)->ExternalAddressHash.size);
 
    /*==============================*/
    /* Remove binary symbol tables. */
@@ -388,6 +410,7 @@ CLIPSLexeme *AddSymbol(
    size_t tally;
    size_t length;
    CLIPSLexeme *past = NULL, *peek;
+   GENERIC_HN **chain;
    char *buffer;
 
     /*====================================*/
@@ -400,8 +423,9 @@ CLIPSLexeme *AddSymbol(
        ExitRouter(theEnv,EXIT_FAILURE);
       }
 
-    tally = HashSymbol(str,SYMBOL_HASH_SIZE);
-    peek = SymbolData(theEnv)->SymbolTable[tally];
+    tally = HashSymbol(str,ATOM_HASH_RANGE);
+    chain = AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->SymbolTable,&SymbolData(theEnv)->SymbolHash,tally);
+    peek = (CLIPSLexeme *) *chain;
 
     /*==================================================*/
     /* Search for the string in the list of entries for */
@@ -425,7 +449,7 @@ CLIPSLexeme *AddSymbol(
 
     peek = get_struct(theEnv,clipsLexeme);
 
-    if (past == NULL) SymbolData(theEnv)->SymbolTable[tally] = peek;
+    if (past == NULL) *chain = (GENERIC_HN *) peek;
     else past->next = peek;
 
     length = strlen(str) + 1;
@@ -445,6 +469,8 @@ CLIPSLexeme *AddSymbol(
     AddEphemeralHashNode(theEnv,(GENERIC_HN *) peek,&UtilityData(theEnv)->CurrentGarbageFrame->ephemeralSymbolList,
                          sizeof(CLIPSLexeme),AVERAGE_STRING_SIZE,true);
     UtilityData(theEnv)->CurrentGarbageFrame->dirty = true;
+    SymbolData(theEnv)->SymbolTable = (CLIPSLexeme **)
+       AddAtomTableEntry(theEnv,(GENERIC_HN **) SymbolData(theEnv)->SymbolTable,&SymbolData(theEnv)->SymbolHash);
 
     /*===================================*/
     /* Return the address of the symbol. */
@@ -465,9 +491,10 @@ CLIPSLexeme *FindSymbolHN(
    size_t tally;
    CLIPSLexeme *peek;
 
-    tally = HashSymbol(str,SYMBOL_HASH_SIZE);
+    tally = HashSymbol(str,ATOM_HASH_RANGE);
 
-    for (peek = SymbolData(theEnv)->SymbolTable[tally];
+    for (peek = (CLIPSLexeme *) *AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->SymbolTable,
+                                                &SymbolData(theEnv)->SymbolHash,tally);
          peek != NULL;
          peek = peek->next)
       {
@@ -491,13 +518,15 @@ CLIPSFloat *CreateFloat(
   {
    size_t tally;
    CLIPSFloat *past = NULL, *peek;
+   GENERIC_HN **chain;
 
     /*====================================*/
     /* Get the hash value for the double. */
     /*====================================*/
 
-    tally = HashFloat(number,FLOAT_HASH_SIZE);
-    peek = SymbolData(theEnv)->FloatTable[tally];
+    tally = HashFloat(number,ATOM_HASH_RANGE);
+    chain = AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->FloatTable,&SymbolData(theEnv)->FloatHash,tally);
+    peek = (CLIPSFloat *) *chain;
 
     /*==================================================*/
     /* Search for the double in the list of entries for */
@@ -520,7 +549,7 @@ CLIPSFloat *CreateFloat(
 
     peek = get_struct(theEnv,clipsFloat);
 
-    if (past == NULL) SymbolData(theEnv)->FloatTable[tally] = peek;
+    if (past == NULL) *chain = (GENERIC_HN *) peek;
     else past->next = peek;
 
     peek->contents = number;
@@ -537,6 +566,8 @@ CLIPSFloat *CreateFloat(
     AddEphemeralHashNode(theEnv,(GENERIC_HN *) peek,&UtilityData(theEnv)->CurrentGarbageFrame->ephemeralFloatList,
                          sizeof(CLIPSFloat),0,true);
     UtilityData(theEnv)->CurrentGarbageFrame->dirty = true;
+    SymbolData(theEnv)->FloatTable = (CLIPSFloat **)
+       AddAtomTableEntry(theEnv,(GENERIC_HN **) SymbolData(theEnv)->FloatTable,&SymbolData(theEnv)->FloatHash);
 
     /*==================================*/
     /* Return the address of the float. */
@@ -557,13 +588,15 @@ CLIPSInteger *CreateInteger(
   {
    size_t tally;
    CLIPSInteger *past = NULL, *peek;
+   GENERIC_HN **chain;
 
     /*==================================*/
     /* Get the hash value for the long. */
     /*==================================*/
 
-    tally = HashInteger(number,INTEGER_HASH_SIZE);
-    peek = SymbolData(theEnv)->IntegerTable[tally];
+    tally = HashInteger(number,ATOM_HASH_RANGE);
+    chain = AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->IntegerTable,&SymbolData(theEnv)->IntegerHash,tally);
+    peek = (CLIPSInteger *) *chain;
 
     /*================================================*/
     /* Search for the long in the list of entries for */
@@ -585,7 +618,7 @@ CLIPSInteger *CreateInteger(
     /*================================================*/
 
     peek = get_struct(theEnv,clipsInteger);
-    if (past == NULL) SymbolData(theEnv)->IntegerTable[tally] = peek;
+    if (past == NULL) *chain = (GENERIC_HN *) peek;
     else past->next = peek;
 
     peek->contents = number;
@@ -602,6 +635,8 @@ CLIPSInteger *CreateInteger(
     AddEphemeralHashNode(theEnv,(GENERIC_HN *) peek,&UtilityData(theEnv)->CurrentGarbageFrame->ephemeralIntegerList,
                          sizeof(CLIPSInteger),0,true);
     UtilityData(theEnv)->CurrentGarbageFrame->dirty = true;
+    SymbolData(theEnv)->IntegerTable = (CLIPSInteger **)
+       AddAtomTableEntry(theEnv,(GENERIC_HN **) SymbolData(theEnv)->IntegerTable,&SymbolData(theEnv)->IntegerHash);
 
     /*====================================*/
     /* Return the address of the integer. */
@@ -621,9 +656,10 @@ CLIPSInteger *FindLongHN(
    size_t tally;
    CLIPSInteger *peek;
 
-   tally = HashInteger(theLong,INTEGER_HASH_SIZE);
+   tally = HashInteger(theLong,ATOM_HASH_RANGE);
 
-   for (peek = SymbolData(theEnv)->IntegerTable[tally];
+   for (peek = (CLIPSInteger *) *AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->IntegerTable,
+                                                &SymbolData(theEnv)->IntegerHash,tally);
         peek != NULL;
         peek = peek->next)
      { if (peek->contents == theLong) return(peek); }
@@ -646,6 +682,7 @@ void *AddBitMap(
    size_t tally;
    unsigned short i;
    CLIPSBitMap *past = NULL, *peek;
+   GENERIC_HN **chain;
    char *buffer;
 
     /*====================================*/
@@ -658,8 +695,9 @@ void *AddBitMap(
        ExitRouter(theEnv,EXIT_FAILURE);
       }
 
-    tally = HashBitMap(theBitMap,BITMAP_HASH_SIZE,size);
-    peek = SymbolData(theEnv)->BitMapTable[tally];
+    tally = HashBitMap(theBitMap,ATOM_HASH_RANGE,size);
+    chain = AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->BitMapTable,&SymbolData(theEnv)->BitMapHash,tally);
+    peek = (CLIPSBitMap *) *chain;
 
     /*==================================================*/
     /* Search for the bitmap in the list of entries for */
@@ -687,7 +725,7 @@ void *AddBitMap(
     /*==================================================*/
 
     peek = get_struct(theEnv,clipsBitMap);
-    if (past == NULL) SymbolData(theEnv)->BitMapTable[tally] = peek;
+    if (past == NULL) *chain = (GENERIC_HN *) peek;
     else past->next = peek;
 
     buffer = (char *) gm2(theEnv,size);
@@ -707,6 +745,8 @@ void *AddBitMap(
     AddEphemeralHashNode(theEnv,(GENERIC_HN *) peek,&UtilityData(theEnv)->CurrentGarbageFrame->ephemeralBitMapList,
                          sizeof(CLIPSBitMap),sizeof(long),true);
     UtilityData(theEnv)->CurrentGarbageFrame->dirty = true;
+    SymbolData(theEnv)->BitMapTable = (CLIPSBitMap **)
+       AddAtomTableEntry(theEnv,(GENERIC_HN **) SymbolData(theEnv)->BitMapTable,&SymbolData(theEnv)->BitMapHash);
 
     /*===================================*/
     /* Return the address of the bitmap. */
@@ -740,14 +780,15 @@ CLIPSExternalAddress *CreateExternalAddress(
   {
    size_t tally;
    CLIPSExternalAddress *past = NULL, *peek;
+   GENERIC_HN **chain;
 
     /*====================================*/
     /* Get the hash value for the bitmap. */
     /*====================================*/
 
-    tally = HashExternalAddress(theExternalAddress,EXTERNAL_ADDRESS_HASH_SIZE);
-
-    peek = SymbolData(theEnv)->ExternalAddressTable[tally];
+    tally = HashExternalAddress(theExternalAddress,ATOM_HASH_RANGE);
+    chain = AtomTableChain((GENERIC_HN **) SymbolData(theEnv)->ExternalAddressTable,&SymbolData(theEnv)->ExternalAddressHash,tally);
+    peek = (CLIPSExternalAddress *) *chain;
 
     /*=============================================================*/
     /* Search for the external address in the list of entries for  */
@@ -771,7 +812,7 @@ CLIPSExternalAddress *CreateExternalAddress(
     /*=================================================*/
 
     peek = get_struct(theEnv,clipsExternalAddress);
-    if (past == NULL) SymbolData(theEnv)->ExternalAddressTable[tally] = peek;
+    if (past == NULL) *chain = (GENERIC_HN *) peek;
     else past->next = peek;
 
     peek->contents = theExternalAddress;
@@ -789,6 +830,8 @@ CLIPSExternalAddress *CreateExternalAddress(
     AddEphemeralHashNode(theEnv,(GENERIC_HN *) peek,&UtilityData(theEnv)->CurrentGarbageFrame->ephemeralExternalAddressList,
                          sizeof(CLIPSExternalAddress),sizeof(long),true);
     UtilityData(theEnv)->CurrentGarbageFrame->dirty = true;
+    SymbolData(theEnv)->ExternalAddressTable = (CLIPSExternalAddress **)
+       AddAtomTableEntry(theEnv,(GENERIC_HN **) SymbolData(theEnv)->ExternalAddressTable,&SymbolData(theEnv)->ExternalAddressHash);
 
     /*=============================================*/
     /* Return the address of the external address. */
@@ -804,11 +847,9 @@ size_t HashSymbol(
   const char *word,
   size_t range)
   {
-   size_t i;
-   size_t tally = 0;
+   size_t tally;
 
-   for (i = 0; word[i]; i++)
-     { tally = tally * 127 + (size_t) word[i]; }
+   tally = (size_t) HashBytes(word,strlen(word));
 
    if (range == 0)
      { return tally; }
@@ -823,14 +864,11 @@ size_t HashFloat(
   double number,
   size_t range)
   {
-   size_t tally = 0;
-   char *word;
-   size_t i;
-
-   word = (char *) &number;
+   size_t tally;
+   uint64_t bits;
 
-   for (i = 0; i < sizeof(double); i++)
-     { tally = tally * 127 + (size_t) word[i]; }
+   memcpy(&bits,&number,sizeof(bits));
+   tally = (size_t) MixHashValue(bits);
 
    if (range == 0)
      { return tally; }
@@ -847,18 +885,12 @@ size_t HashInteger(
   {
    size_t tally;
 
-#if WIN_MVC
-   if (number < 0)
-     { number = - number; }
-   tally = (((size_t) number) % range);
-#else
-   tally = (((size_t) llabs(number)) % range);
-#endif
+   tally = (size_t) MixHashValue((uint64_t) number);
 
    if (range == 0)
      { return tally; }
 
-   return tally;
+   return tally % range;
   }
 
 /****************************************/
@@ -870,15 +902,8 @@ size_t HashExternalAddress(
   size_t range)
   {
    size_t tally;
-   union
-     {
-      void *vv;
-      unsigned uv;
-     } fis;
 
-   fis.uv = 0;
-   fis.vv = theExternalAddress;
-   tally = (fis.uv / 256);
+   tally = (size_t) MixHashValue((uint64_t) (uintptr_t) theExternalAddress);
 
    if (range == 0)
      { return tally; }
@@ -894,42 +919,71 @@ size_t HashBitMap(
   size_t range,
   unsigned length)
   {
-   unsigned k,j,i;
    size_t tally;
-   unsigned longLength;
-   unsigned long count = 0L,tmpLong;
-   char *tmpPtr;
 
-   tmpPtr = (char *) &tmpLong;
+   tally = (size_t) HashBytes(word,length);
+
+   if (range == 0)
+     { return tally; }
 
-   /*============================================================*/
-   /* Add up the first part of the word as unsigned long values. */
-   /*============================================================*/
+   return tally % range;
+  }
 
-   longLength = length / sizeof(unsigned long);
-   for (i = 0 , j = 0 ; i < longLength; i++)
+/******************************************************/
+/* HashBytes: Computes the hash value of a sequence   */
+/*   of bytes. The bytes are consumed eight at a time */
+/*   rather than one at a time, and every bit of the  */
+/*   result depends on every bit of the input, so the */
+/*   value can be reduced to any table size.          */
+/******************************************************/
+static uint64_t HashBytes(
+  const char *bytes,
+  size_t length)
+  {
+   uint64_t tally = (uint64_t) length * 0x9e3779b97f4a7c15ULL;
+   uint64_t word;
+   size_t i;
+
+   for (i = 0; i + sizeof(word) <= length; i += sizeof(word))
      {
-      for (k = 0 ; k < sizeof(unsigned long) ; k++ , j++)
-        tmpPtr[k] = word[j];
-      count += tmpLong;
+      memcpy(&word,bytes + i,sizeof(word));
+      word *= 0x87c37b91114253d5ULL;
+      word = (word << 31) | (word >> 33);
+      tally ^= word * 0x4cf5ad432745937fULL;
+      tally = ((tally << 27) | (tally >> 37)) * 5 + 0x52dce729;
      }
 
-   /*============================================*/
-   /* Add the remaining characters to the count. */
-   /*============================================*/
-
-   for (; j < length; j++) count += (size_t) word[j];
+   /*========================================*/
+   /* Pad the remaining bytes with zeros and */
+   /* add them as one last word.             */
+   /*========================================*/
 
-   /*========================*/
-   /* Return the hash value. */
-   /*========================*/
+   if (i < length)
+     {
+      word = 0;
+      memcpy(&word,bytes + i,length - i);
+      word *= 0x87c37b91114253d5ULL;
+      word = (word << 31) | (word >> 33);
+      tally ^= word * 0x4cf5ad432745937fULL;
+     }
 
-   if (range == 0)
-     { return count; }
+   return MixHashValue(tally);
+  }
 
-   tally = (count % range);
+/********************************************************/
+/* MixHashValue: Scrambles a 64 bit value so that small */
+/*   differences in the input spread over all the bits. */
+/********************************************************/
+static uint64_t MixHashValue(
+  uint64_t value)
+  {
+   value ^= value >> 33;
+   value *= 0xff51afd7ed558ccdULL;
+   value ^= value >> 33;
+   value *= 0xc4ceb9fe1a85ec53ULL;
+   value ^= value >> 33;
 
-   return tally;
+   return value;
   }
 
 /****************************************************/
@@ -1164,10 +1218,11 @@ static void RemoveHashNode(
   Environment *theEnv,
   GENERIC_HN *theValue,
   GENERIC_HN **theTable,
+  struct atomTable *theInfo,
   int size,
   int type)
   {
-   GENERIC_HN *previousNode, *currentNode;
+   GENERIC_HN *previousNode, *currentNode, **chain;
    CLIPSExternalAddress *theAddress;
 
    /*=============================================*/
@@ -1175,7 +1230,8 @@ static void RemoveHashNode(
    /*=============================================*/
 
    previousNode = NULL;
-   currentNode = theTable[theValue->bucket];
+   chain = AtomTableChain(theTable,theInfo,theValue->bucket);
+   currentNode = *chain;
 
    while (currentNode != theValue)
      {
@@ -1195,10 +1251,13 @@ static void RemoveHashNode(
    /*===========================================*/
 
    if (previousNode == NULL)
-     { theTable[theValue->bucket] = theValue->next; }
+     { *chain = theValue->next; }
    else
      { previousNode->next = currentNode->next; }
 
+   if (theInfo->count > 0)
+     { theInfo->count--; }
+
    /*=================================================*/
    /* Symbol and bit map nodes have additional memory */
    /* use to store the character or bitmap string.    */
@@ -1290,15 +1349,15 @@ void RemoveEphemeralAtoms(
    if (! theGarbageFrame->dirty) return;
 
    RemoveEphemeralHashNodes(theEnv,&theGarbageFrame->ephemeralSymbolList,(GENERIC_HN **) SymbolData(theEnv)->SymbolTable,
-                            sizeof(CLIPSLexeme),SYMBOL_TYPE,AVERAGE_STRING_SIZE);
+                            &SymbolData(theEnv)->SymbolHash,sizeof(CLIPSLexeme),SYMBOL_TYPE,AVERAGE_STRING_SIZE);
    RemoveEphemeralHashNodes(theEnv,&theGarbageFrame->ephemeralFloatList,(GENERIC_HN **) SymbolData(theEnv)->FloatTable,
-                            sizeof(CLIPSFloat),FLOAT_TYPE,0);
+                            &SymbolData(theEnv)->FloatHash,sizeof(CLIPSFloat),FLOAT_TYPE,0);
    RemoveEphemeralHashNodes(theEnv,&theGarbageFrame->ephemeralIntegerList,(GENERIC_HN **) SymbolData(theEnv)->IntegerTable,
-                            sizeof(CLIPSInteger),INTEGER_TYPE,0);
+                            &SymbolData(theEnv)->IntegerHash,sizeof(CLIPSInteger),INTEGER_TYPE,0);
    RemoveEphemeralHashNodes(theEnv,&theGarbageFrame->ephemeralBitMapList,(GENERIC_HN **) SymbolData(theEnv)->BitMapTable,
-                            sizeof(CLIPSBitMap),BITMAPARRAY,AVERAGE_BITMAP_SIZE);
+                            &SymbolData(theEnv)->BitMapHash,sizeof(CLIPSBitMap),BITMAPARRAY,AVERAGE_BITMAP_SIZE);
    RemoveEphemeralHashNodes(theEnv,&theGarbageFrame->ephemeralExternalAddressList,(GENERIC_HN **) SymbolData(theEnv)->ExternalAddressTable,
-                            sizeof(CLIPSExternalAddress),EXTERNAL_ADDRESS_TYPE,0);
+                            &SymbolData(theEnv)->ExternalAddressHash,sizeof(CLIPSExternalAddress),EXTERNAL_ADDRESS_TYPE,0);
   }
 
 /***********************************************/
@@ -1378,6 +1437,7 @@ static void RemoveEphemeralHashNodes(
   Environment *theEnv,
   struct ephemeron **theEphemeralList,
   GENERIC_HN **theTable,
+  struct atomTable *theInfo,
   int hashNodeSize,
   int hashNodeType,
   int averageContentsSize)
@@ -1404,7 +1464,7 @@ static void RemoveEphemeralHashNodes(
 
       if (edPtr->associatedValue->count == 0)
         {
-         RemoveHashNode(theEnv,edPtr->associatedValue,theTable,hashNodeSize,hashNodeType);
+         RemoveHashNode(theEnv,edPtr->associatedValue,theTable,theInfo,hashNodeSize,hashNodeType);
          rtn_struct(theEnv,ephemeron,edPtr);
          if (lastPtr == NULL) *theEphemeralList = nextPtr;
          else lastPtr->next = nextPtr;
@@ -1442,6 +1502,7 @@ static void RemoveEphemeralHashNodes(
 CLIPSLexeme **GetSymbolTable(
   Environment *theEnv)
   {
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->SymbolTable,&SymbolData(theEnv)->SymbolHash);
    return(SymbolData(theEnv)->SymbolTable);
   }
 
@@ -1461,6 +1522,7 @@ void SetSymbolTable(
 CLIPSFloat **GetFloatTable(
   Environment *theEnv)
   {
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->FloatTable,&SymbolData(theEnv)->FloatHash);
    return(SymbolData(theEnv)->FloatTable);
   }
 
@@ -1480,6 +1542,7 @@ void SetFloatTable(
 CLIPSInteger **GetIntegerTable(
   Environment *theEnv)
   {
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->IntegerTable,&SymbolData(theEnv)->IntegerHash);
    return(SymbolData(theEnv)->IntegerTable);
   }
 
@@ -1499,6 +1562,7 @@ void SetIntegerTable(
 CLIPSBitMap **GetBitMapTable(
   Environment *theEnv)
   {
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->BitMapTable,&SymbolData(theEnv)->BitMapHash);
    return(SymbolData(theEnv)->BitMapTable);
   }
 
@@ -1512,12 +1576,53 @@ void SetBitMapTable(
    SymbolData(theEnv)->BitMapTable = value;
   }
 
+/*********************************************/
+/* GetSymbolTableSize: Returns the number of */
+/*   locations in the SymbolTable.           */
+/*********************************************/
+unsigned long GetSymbolTableSize(
+  Environment *theEnv)
+  {
+   return SymbolData(theEnv)->SymbolHash.size;
+  }
+
+/********************************************/
+/* GetFloatTableSize: Returns the number of */
+/*   locations in the FloatTable.           */
+/********************************************/
+unsigned long GetFloatTableSize(
+  Environment *theEnv)
+  {
+   return SymbolData(theEnv)->FloatHash.size;
+  }
+
+/**********************************************/
+/* GetIntegerTableSize: Returns the number of */
+/*   locations in the IntegerTable.           */
+/**********************************************/
+unsigned long GetIntegerTableSize(
+  Environment *theEnv)
+  {
+   return SymbolData(theEnv)->IntegerHash.size;
+  }
+
+/*********************************************/
+/* GetBitMapTableSize: Returns the number of */
+/*   locations in the BitMapTable.           */
+/*********************************************/
+unsigned long GetBitMapTableSize(
+  Environment *theEnv)
+  {
+   return SymbolData(theEnv)->BitMapHash.size;
+  }
+
 /***************************************************************************/
 /* GetExternalAddressTable: Returns a pointer to the ExternalAddressTable. */
 /***************************************************************************/
 CLIPSExternalAddress **GetExternalAddressTable(
   Environment *theEnv)
   {
+   CompleteAtomTableRehash(theEnv,(GENERIC_HN **) SymbolData(theEnv)->ExternalAddressTable,&SymbolData(theEnv)->ExternalAddressHash);
    return(SymbolData(theEnv)->ExternalAddressTable);
   }
 
@@ -1531,6 +1636,242 @@ void SetExternalAddressTable(
    SymbolData(theEnv)->ExternalAddressTable = value;
   }
 
+/**************************************************/
+/* GetAtomTableResizing: Returns true if the atom */
+/*   tables grow as atoms are added to them.      */
+/**************************************************/
+bool GetAtomTableResizing(
+  Environment *theEnv)
+  {
+   return SymbolData(theEnv)->AtomTableResizing;
+  }
+
+/****************************************************/
+/* SetAtomTableResizing: Enables or disables growth */
+/*   of the atom tables. When disabled, the tables  */
+/*   keep their current size. Returns the previous  */
+/*   setting. The tables of a run-time image never  */
+/*   grow.                                          */
+/****************************************************/
+bool SetAtomTableResizing(
+  Environment *theEnv,
+  bool value)
+  {
+   bool ov;
+
+   ov = SymbolData(theEnv)->AtomTableResizing;
+#if ! RUN_TIME
+   SymbolData(theEnv)->AtomTableResizing = value;
+#else
+#if MAC_XCD
+#pragma unused(value)
+#endif
+#endif
+   return ov;
+  }
+
+/*****************************************************/
+/* ShrinkAtomTables: Returns the symbol, float,      */
+/*   integer, and bitmap tables to their initial     */
+/*   sizes. Used before generating a run-time image, */
+/*   whose tables are arrays of the initial sizes.   */
+/*****************************************************/
+void ShrinkAtomTables(
+  Environment *theEnv)
+  {
+#if ! RUN_TIME
+   SymbolData(theEnv)->SymbolTable = (CLIPSLexeme **)
+      ResizeAtomTable(theEnv,(GENERIC_HN **) SymbolData(theEnv)->SymbolTable,&SymbolData(theEnv)->SymbolHash,
+                      SymbolData(theEnv)->SymbolHash.initialSize);
+   SymbolData(theEnv)->FloatTable = (CLIPSFloat **)
+      ResizeAtomTable(theEnv,(GENERIC_HN **) SymbolData(theEnv)->FloatTable,&SymbolData(theEnv)->FloatHash,
+                      SymbolData(theEnv)->FloatHash.initialSize);
+   SymbolData(theEnv)->IntegerTable = (CLIPSInteger **)
+      ResizeAtomTable(theEnv,(GENERIC_HN **) SymbolData(theEnv)->IntegerTable,&SymbolData(theEnv)->IntegerHash,
+                      SymbolData(theEnv)->IntegerHash.initialSize);
+   SymbolData(theEnv)->BitMapTable = (CLIPSBitMap **)
+      ResizeAtomTable(theEnv,(GENERIC_HN **) SymbolData(theEnv)->BitMapTable,&SymbolData(theEnv)->BitMapHash,
+                      SymbolData(theEnv)->BitMapHash.initialSize);
+#else
+#if MAC_XCD
+#pragma unused(theEnv)
+#endif
+#endif
+  }
+
+/*************************************************/
+/* CreateAtomTable: Allocates an atom table with */
+/*   all of its locations set to NULL.           */
+/*************************************************/
+static GENERIC_HN **CreateAtomTable(
+  Environment *theEnv,
+  struct atomTable *theInfo,
+  unsigned long size)
+  {
+   GENERIC_HN **theTable;
+   unsigned long i;
+
+   theTable = (GENERIC_HN **) genalloc(theEnv,sizeof(GENERIC_HN *) * size);
+   for (i = 0; i < size; i++) theTable[i] = NULL;
+
+   theInfo->oldTable = NULL;
+   theInfo->size = size;
+   theInfo->initialSize = size;
+   theInfo->oldSize = 0;
+   theInfo->migrated = 0;
+   theInfo->count = 0;
+
+   return theTable;
+  }
+
+/****************************************************/
+/* AtomTableChain: Returns the location of the list */
+/*   of entries holding the atoms with the given    */
+/*   hash value. While a table is being rehashed,   */
+/*   the list may still be in the old array.        */
+/****************************************************/
+static GENERIC_HN **AtomTableChain(
+  GENERIC_HN **theTable,
+  struct atomTable *theInfo,
+  size_t hashValue)
+  {
+   size_t oldPosition;
+
+   if (theInfo->oldTable != NULL)
+     {
+      oldPosition = hashValue % theInfo->oldSize;
+      if (oldPosition >= theInfo->migrated)
+        { return &theInfo->oldTable[oldPosition]; }
+     }
+
+   return &theTable[hashValue % theInfo->size];
+  }
+
+/*******************************************************/
+/* AddAtomTableEntry: Accounts for an atom added to a  */
+/*   table. Moves a few buckets of a pending rehash,   */
+/*   or starts one when the table is too full. Returns */
+/*   the array the table now uses.                     */
+/*******************************************************/
+static GENERIC_HN **AddAtomTableEntry(
+  Environment *theEnv,
+  GENERIC_HN **theTable,
+  struct atomTable *theInfo)
+  {
+   theInfo->count++;
+
+   if (theInfo->oldTable != NULL)
+     {
+      MigrateAtomTableBuckets(theEnv,theTable,theInfo,ATOM_TABLE_REHASH_STEP);
+      return theTable;
+     }
+
+   if ((! SymbolData(theEnv)->AtomTableResizing) ||
+       SymbolData(theEnv)->AtomIndicesSet ||
+       (theInfo->count <= theInfo->size * ATOM_TABLE_LOAD_FACTOR) ||
+       (theInfo->size >= (ATOM_HASH_RANGE / 2)))
+     { return theTable; }
+
+   return ResizeAtomTable(theEnv,theTable,theInfo,theInfo->size * 2 + 1);
+  }
+
+/********************************************************/
+/* ResizeAtomTable: Replaces the array of a table with  */
+/*   one of a new size. The entries are moved over by   */
+/*   subsequent additions, or all at once by a call to  */
+/*   CompleteAtomTableRehash. Returns the new array.    */
+/********************************************************/
+static GENERIC_HN **ResizeAtomTable(
+  Environment *theEnv,
+  GENERIC_HN **theTable,
+  struct atomTable *theInfo,
+  unsigned long newSize)
+  {
+   GENERIC_HN **newTable;
+   unsigned long i;
+
+   CompleteAtomTableRehash(theEnv,theTable,theInfo);
+
+   if (newSize == theInfo->size)
+     { return theTable; }
+
+   newTable = (GENERIC_HN **) genalloc(theEnv,sizeof(GENERIC_HN *) * newSize);
+   for (i = 0; i < newSize; i++) newTable[i] = NULL;
+
+   theInfo->oldTable = theTable;
+   theInfo->oldSize = theInfo->size;
+   theInfo->size = newSize;
+   theInfo->migrated = 0;
+
+   return newTable;
+  }
+
+/*********************************************************/
+/* MigrateAtomTableBuckets: Moves the entries of up to   */
+/*   count buckets of the old array of a table being     */
+/*   rehashed to the new array. The old array is freed   */
+/*   once all of its buckets have been moved.            */
+/*********************************************************/
+static void MigrateAtomTableBuckets(
+  Environment *theEnv,
+  GENERIC_HN **theTable,
+  struct atomTable *theInfo,
+  unsigned long count)
+  {
+   GENERIC_HN *theNode, *nextNode, **chain;
+
+   for (;
+        (count > 0) && (theInfo->migrated < theInfo->oldSize);
+        count--, theInfo->migrated++)
+     {
+      for (theNode = theInfo->oldTable[theInfo->migrated];
+           theNode != NULL;
+           theNode = nextNode)
+        {
+         nextNode = theNode->next;
+         theNode->next = NULL;
+
+         /*=========================================*/
+         /* Entries are appended so the relative    */
+         /* order of the entries in a list is kept. */
+         /*=========================================*/
+
+         for (chain = &theTable[theNode->bucket % theInfo->size];
+              *chain != NULL;
+              chain = &(*chain)->next)
+           { /* Do Nothing */ }
+
+         *chain = theNode;
+        }
+
+      theInfo->oldTable[theInfo->migrated] = NULL;
+     }
+
+   if (theInfo->migrated < theInfo->oldSize)
+     { return; }
+
+   genfree(theEnv,theInfo->oldTable,sizeof(GENERIC_HN *) * theInfo->oldSize);
+   theInfo->oldTable = NULL;
+   theInfo->oldSize = 0;
+   theInfo->migrated = 0;
+  }
+
+/*******************************************************/
+/* CompleteAtomTableRehash: Moves the entries left in  */
+/*   the old array of a table being rehashed, so that  */
+/*   traversals of the table see all of its entries.   */
+/*******************************************************/
+static void CompleteAtomTableRehash(
+  Environment *theEnv,
+  GENERIC_HN **theTable,
+  struct atomTable *theInfo)
+  {
+   if (theInfo->oldTable == NULL)
+     { return; }
+
+   MigrateAtomTableBuckets(theEnv,theTable,theInfo,theInfo->oldSize - theInfo->migrated);
+  }
+
 /******************************************************/
 /* RefreshSpecialSymbols: Resets the values of the    */
 /*   TrueSymbol, FalseSymbol, Zero, PositiveInfinity, */
@@ -1637,11 +1978,14 @@ CLIPSLexeme *GetNextSymbolMatch(
   bool anywhere,
   size_t *commonPrefixLength)
   {
-   unsigned long i;
-   CLIPSLexeme *hashPtr;
+   unsigned long i, size;
+   CLIPSLexeme *hashPtr, **symbolTable;
    bool flag = true;
    size_t prefixLength;
 
+   symbolTable = GetSymbolTable(theEnv);
+   size = GetSymbolTableSize(theEnv);
+
    /*==========================================*/
    /* If we're looking anywhere in the string, */
    /* then there's no common prefix length.    */
@@ -1658,7 +2002,7 @@ CLIPSLexeme *GetNextSymbolMatch(
    if (prevSymbol == NULL)
      {
       i = 0;
-      hashPtr = SymbolData(theEnv)->SymbolTable[0];
+      hashPtr = symbolTable[0];
      }
 
    /*==========================================*/
@@ -1668,7 +2012,7 @@ CLIPSLexeme *GetNextSymbolMatch(
 
    else
      {
-      i = prevSymbol->bucket;
+      i = prevSymbol->bucket % size;
       hashPtr = prevSymbol->next;
      }
 
@@ -1749,8 +2093,8 @@ CLIPSLexeme *GetNextSymbolMatch(
       /* Move on to the next bucket in the symbol table. */
       /*=================================================*/
 
-      if (++i >= SYMBOL_HASH_SIZE) flag = false;
-      else hashPtr = SymbolData(theEnv)->SymbolTable[i];
+      if (++i >= size) flag = false;
+      else hashPtr = symbolTable[i];
      }
 
    /*=====================================*/
@@ -1808,12 +2152,19 @@ void SetAtomicValueIndices(
   bool setAll)
   {
    unsigned int count;
-   unsigned int i;
+   unsigned long i;
    CLIPSLexeme *symbolPtr, **symbolArray;
    CLIPSFloat *floatPtr, **floatArray;
    CLIPSInteger *integerPtr, **integerArray;
    CLIPSBitMap *bitMapPtr, **bitMapArray;
 
+   /*==========================================*/
+   /* Tables may not grow while the buckets of */
+   /* their entries hold indices.              */
+   /*==========================================*/
+
+   SymbolData(theEnv)->AtomIndicesSet = true;
+
    /*===================================*/
    /* Set indices for the symbol table. */
    /*===================================*/
@@ -1821,7 +2172,7 @@ void SetAtomicValueIndices(
    count = 0;
    symbolArray = GetSymbolTable(theEnv);
 
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       for (symbolPtr = symbolArray[i];
            symbolPtr != NULL;
@@ -1839,7 +2190,7 @@ void SetAtomicValueIndices(
    count = 0;
    floatArray = GetFloatTable(theEnv);
 
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < GetFloatTableSize(theEnv); i++)
      {
       for (floatPtr = floatArray[i];
            floatPtr != NULL;
@@ -1857,7 +2208,7 @@ void SetAtomicValueIndices(
    count = 0;
    integerArray = GetIntegerTable(theEnv);
 
-   for (i = 0; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0; i < GetIntegerTableSize(theEnv); i++)
      {
       for (integerPtr = integerArray[i];
            integerPtr != NULL;
@@ -1875,7 +2226,7 @@ void SetAtomicValueIndices(
    count = 0;
    bitMapArray = GetBitMapTable(theEnv);
 
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < GetBitMapTableSize(theEnv); i++)
      {
       for (bitMapPtr = bitMapArray[i];
            bitMapPtr != NULL;
@@ -1895,24 +2246,26 @@ void SetAtomicValueIndices(
 void RestoreAtomicValueBuckets(
   Environment *theEnv)
   {
-   unsigned int i;
+   unsigned long i;
    CLIPSLexeme *symbolPtr, **symbolArray;
    CLIPSFloat *floatPtr, **floatArray;
    CLIPSInteger *integerPtr, **integerArray;
    CLIPSBitMap *bitMapPtr, **bitMapArray;
 
-   /*================================================*/
-   /* Restore the bucket values in the symbol table. */
-   /*================================================*/
+   /*=================================================*/
+   /* Restore the bucket values in the symbol table.  */
+   /* The bucket of an entry is the hash value of its */
+   /* contents, whatever the size of its table.       */
+   /*=================================================*/
 
    symbolArray = GetSymbolTable(theEnv);
 
-   for (i = 0; i < SYMBOL_HASH_SIZE; i++)
+   for (i = 0; i < GetSymbolTableSize(theEnv); i++)
      {
       for (symbolPtr = symbolArray[i];
            symbolPtr != NULL;
            symbolPtr = symbolPtr->next)
-        { symbolPtr->bucket = i; }
+        { symbolPtr->bucket = (unsigned int) HashSymbol(symbolPtr->contents,ATOM_HASH_RANGE); }
      }
 
    /*===============================================*/
@@ -1921,12 +2274,12 @@ void RestoreAtomicValueBuckets(
 
    floatArray = GetFloatTable(theEnv);
 
-   for (i = 0; i < FLOAT_HASH_SIZE; i++)
+   for (i = 0; i < GetFloatTableSize(theEnv); i++)
      {
       for (floatPtr = floatArray[i];
            floatPtr != NULL;
            floatPtr = floatPtr->next)
-        { floatPtr->bucket = i; }
+        { floatPtr->bucket = (unsigned int) HashFloat(floatPtr->contents,ATOM_HASH_RANGE); }
      }
 
    /*=================================================*/
@@ -1935,12 +2288,12 @@ void RestoreAtomicValueBuckets(
 
    integerArray = GetIntegerTable(theEnv);
 
-   for (i = 0; i < INTEGER_HASH_SIZE; i++)
+   for (i = 0; i < GetIntegerTableSize(theEnv); i++)
      {
       for (integerPtr = integerArray[i];
            integerPtr != NULL;
            integerPtr = integerPtr->next)
-        { integerPtr->bucket = i; }
+        { integerPtr->bucket = (unsigned int) HashInteger(integerPtr->contents,ATOM_HASH_RANGE); }
      }
 
    /*================================================*/
@@ -1949,13 +2302,15 @@ void RestoreAtomicValueBuckets(
 
    bitMapArray = GetBitMapTable(theEnv);
 
-   for (i = 0; i < BITMAP_HASH_SIZE; i++)
+   for (i = 0; i < GetBitMapTableSize(theEnv); i++)
      {
       for (bitMapPtr = bitMapArray[i];
            bitMapPtr != NULL;
            bitMapPtr = bitMapPtr->next)
-        { bitMapPtr->bucket = i; }
+        { bitMapPtr->bucket = (unsigned int) HashBitMap(bitMapPtr->contents,ATOM_HASH_RANGE,bitMapPtr->size); }
      }
+
+   SymbolData(theEnv)->AtomIndicesSet = false;
   }
 
 #endif /* BLOAD_AND_BSAVE || CONSTRUCT_COMPILER || BSAVE_INSTANCES */
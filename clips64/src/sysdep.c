@@ -185,6 +185,12 @@ struct systemDependentData
 #if (! WIN_MVC)
    FILE *BinaryFP;
 #endif
+   const char *BinaryBuffer;
+   size_t BinaryBufferSize;
+   size_t BinaryBufferPosition;
+   bool BinaryBufferShortRead;
+   char *WriteBuffer;
+   size_t WriteBufferSize;
    int (*BeforeOpenFunction)(Environment *);
    int (*AfterOpenFunction)(Environment *);
    jmp_buf *jmpBuffer;
@@ -192,6 +198,25 @@ struct systemDependentData
 
 #define SystemDependentData(theEnv) ((struct systemDependentData *) GetEnvironmentData(theEnv,SYSTEM_DEPENDENT_DATA))
 
+/*==========================================================*/
+/* Memory streams (open_memstream) are used to write binary */
+/* data to memory where available, otherwise the data is    */
+/* written to a temporary file and then read back.          */
+/*==========================================================*/
+
+#if (! WINDOWS_OS) && (DARWIN || (defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE >= 200809L)))
+#define MEMORY_STREAMS 1
+#else
+#define MEMORY_STREAMS 0
+#endif
+
+/***************************************/
+/* LOCAL INTERNAL FUNCTION DEFINITIONS */
+/***************************************/
+
+   static size_t                  ReadBinaryBuffer(Environment *,void *,size_t);
+   static void                    SeekBinaryBuffer(Environment *,long);
+
 /********************************************************/
 /* InitializeSystemDependentData: Allocates environment */
 /*    data for system dependent routines.               */
@@ -771,6 +796,89 @@ bool GenOpenReadBinary(
    return true;
   }
 
+/******************************************************/
+/* GenOpenReadBinaryBuffer: Opens a memory buffer for */
+/*   binary access. Reads, seeks and the closing of   */
+/*   the binary file are served from the buffer until */
+/*   GenCloseBinary is called. The buffer must remain */
+/*   valid until then.                                */
+/******************************************************/
+bool GenOpenReadBinaryBuffer(
+  Environment *theEnv,
+  const char *buffer,
+  size_t size)
+  {
+   if (buffer == NULL) return false;
+
+   SystemDependentData(theEnv)->BinaryBuffer = buffer;
+   SystemDependentData(theEnv)->BinaryBufferSize = size;
+   SystemDependentData(theEnv)->BinaryBufferPosition = 0;
+   SystemDependentData(theEnv)->BinaryBufferShortRead = false;
+
+   return true;
+  }
+
+/**************************************************/
+/* GenBinaryBufferShortRead: Returns true if any  */
+/*   read from the binary memory buffer went past */
+/*   its end since the buffer was opened.         */
+/**************************************************/
+bool GenBinaryBufferShortRead(
+  Environment *theEnv)
+  {
+   return (SystemDependentData(theEnv)->BinaryBuffer != NULL) &&
+          SystemDependentData(theEnv)->BinaryBufferShortRead;
+  }
+
+/*****************************************************/
+/* ReadBinaryBuffer: Copies the next bytes of the    */
+/*   binary memory buffer. Bytes requested past the  */
+/*   end of the buffer are zeroed and zero is        */
+/*   returned, as fread does for a short read.       */
+/*****************************************************/
+static size_t ReadBinaryBuffer(
+  Environment *theEnv,
+  void *dataPtr,
+  size_t size)
+  {
+   size_t available;
+
+   available = SystemDependentData(theEnv)->BinaryBufferSize -
+               SystemDependentData(theEnv)->BinaryBufferPosition;
+
+   if (size > available)
+     {
+      memcpy(dataPtr,SystemDependentData(theEnv)->BinaryBuffer +
+                     SystemDependentData(theEnv)->BinaryBufferPosition,available);
+      memset((char *) dataPtr + available,0,size - available);
+      SystemDependentData(theEnv)->BinaryBufferPosition = SystemDependentData(theEnv)->BinaryBufferSize;
+      SystemDependentData(theEnv)->BinaryBufferShortRead = true;
+      return 0;
+     }
+
+   memcpy(dataPtr,SystemDependentData(theEnv)->BinaryBuffer +
+                  SystemDependentData(theEnv)->BinaryBufferPosition,size);
+   SystemDependentData(theEnv)->BinaryBufferPosition += size;
+
+   return 1;
+  }
+
+/***************************************************/
+/* SeekBinaryBuffer: Moves the position within the */
+/*   binary memory buffer, clamped to its bounds.  */
+/***************************************************/
+static void SeekBinaryBuffer(
+  Environment *theEnv,
+  long position)
+  {
+   if (position < 0)
+     { position = 0; }
+   else if ((size_t) position > SystemDependentData(theEnv)->BinaryBufferSize)
+     { position = (long) SystemDependentData(theEnv)->BinaryBufferSize; }
+
+   SystemDependentData(theEnv)->BinaryBufferPosition = (size_t) position;
+  }
+
 /***********************************************/
 /* GenReadBinary: Generic and machine specific */
 /*   code for reading from a file.             */
@@ -780,6 +888,9 @@ size_t GenReadBinary(
   void *dataPtr,
   size_t size)
   {
+   if (SystemDependentData(theEnv)->BinaryBuffer != NULL)
+     { return ReadBinaryBuffer(theEnv,dataPtr,size); }
+
 #if WIN_MVC
    char *tempPtr;
    size_t rv = 0;
@@ -811,6 +922,12 @@ void GetSeekCurBinary(
   Environment *theEnv,
   long offset)
   {
+   if (SystemDependentData(theEnv)->BinaryBuffer != NULL)
+     {
+      SeekBinaryBuffer(theEnv,(long) SystemDependentData(theEnv)->BinaryBufferPosition + offset);
+      return;
+     }
+
 #if WIN_MVC
    _lseek(SystemDependentData(theEnv)->BinaryFileHandle,offset,SEEK_CUR);
 #endif
@@ -828,6 +945,12 @@ void GetSeekSetBinary(
   Environment *theEnv,
   long offset)
   {
+   if (SystemDependentData(theEnv)->BinaryBuffer != NULL)
+     {
+      SeekBinaryBuffer(theEnv,offset);
+      return;
+     }
+
 #if WIN_MVC
    _lseek(SystemDependentData(theEnv)->BinaryFileHandle,offset,SEEK_SET);
 #endif
@@ -845,6 +968,12 @@ void GenTellBinary(
   Environment *theEnv,
   long *offset)
   {
+   if (SystemDependentData(theEnv)->BinaryBuffer != NULL)
+     {
+      *offset = (long) SystemDependentData(theEnv)->BinaryBufferPosition;
+      return;
+     }
+
 #if WIN_MVC
    *offset = _lseek(SystemDependentData(theEnv)->BinaryFileHandle,0,SEEK_CUR);
 #endif
@@ -861,6 +990,14 @@ void GenTellBinary(
 void GenCloseBinary(
   Environment *theEnv)
   {
+   if (SystemDependentData(theEnv)->BinaryBuffer != NULL)
+     {
+      SystemDependentData(theEnv)->BinaryBuffer = NULL;
+      SystemDependentData(theEnv)->BinaryBufferSize = 0;
+      SystemDependentData(theEnv)->BinaryBufferPosition = 0;
+      return;
+     }
+
    if (SystemDependentData(theEnv)->BeforeOpenFunction != NULL)
      { (*SystemDependentData(theEnv)->BeforeOpenFunction)(theEnv); }
 
@@ -892,3 +1029,89 @@ size_t GenWrite(
 
    return size;
   }
+
+/******************************************************/
+/* GenOpenWriteBuffer: Opens a stream for writing to  */
+/*   memory. The contents written are retrieved with  */
+/*   GenCloseWriteBuffer, which also closes the       */
+/*   stream. Only one buffer may be open at a time.   */
+/******************************************************/
+FILE *GenOpenWriteBuffer(
+  Environment *theEnv)
+  {
+#if MEMORY_STREAMS
+   SystemDependentData(theEnv)->WriteBuffer = NULL;
+   SystemDependentData(theEnv)->WriteBufferSize = 0;
+
+   return open_memstream(&SystemDependentData(theEnv)->WriteBuffer,
+                         &SystemDependentData(theEnv)->WriteBufferSize);
+#else
+   return tmpfile();
+#endif
+  }
+
+/*******************************************************/
+/* GenCloseWriteBuffer: Closes a stream opened with    */
+/*   GenOpenWriteBuffer and retrieves its contents.    */
+/*   The buffer is allocated with malloc and must be   */
+/*   released with free. Returns false on failure, in  */
+/*   which case no buffer is retrieved.                */
+/*******************************************************/
+bool GenCloseWriteBuffer(
+  Environment *theEnv,
+  FILE *theStream,
+  char **buffer,
+  size_t *size)
+  {
+#if (! MEMORY_STREAMS)
+   long length;
+#endif
+
+   *buffer = NULL;
+   *size = 0;
+
+#if MEMORY_STREAMS
+   if (fclose(theStream) != 0)
+     {
+      free(SystemDependentData(theEnv)->WriteBuffer);
+      SystemDependentData(theEnv)->WriteBuffer = NULL;
+      return false;
+     }
+
+   *buffer = SystemDependentData(theEnv)->WriteBuffer;
+   *size = SystemDependentData(theEnv)->WriteBufferSize;
+   SystemDependentData(theEnv)->WriteBuffer = NULL;
+   SystemDependentData(theEnv)->WriteBufferSize = 0;
+
+   return true;
+#else
+   if ((fflush(theStream) != 0) ||
+       (fseek(theStream,0,SEEK_END) != 0) ||
+       ((length = ftell(theStream)) < 0))
+     {
+      fclose(theStream);
+      return false;
+     }
+
+   rewind(theStream);
+
+   if ((*buffer = (char *) malloc((length > 0) ? (size_t) length : 1)) == NULL)
+     {
+      fclose(theStream);
+      return false;
+     }
+
+   if ((length > 0) && (fread(*buffer,(size_t) length,1,theStream) != 1))
+     {
+      free(*buffer);
+      *buffer = NULL;
+      fclose(theStream);
+      return false;
+     }
+
+   *size = (size_t) length;
+   fclose(theStream);
+
+   return true;
+#endif
+  }
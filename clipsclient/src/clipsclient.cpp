@@ -3,6 +3,9 @@
 #include "reply.h"
 
 #include <regex>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
 #include <boost/bind/bind.hpp>
 
 
@@ -10,8 +13,52 @@ namespace asio = boost::asio;
 using asio::ip::tcp;
 
 
+/* ** ********************************************************
+* Local helpers
+* *** *******************************************************/
+/**
+ * Largest assert-batch request sent with protocol v2.
+ * Keeps server-side reassembly buffers small.
+ */
+static const size_t MaxFactBatchSize = 1 << 20;
+
+/**
+ * Largest restore chunk sent with protocol v2
+ */
+static const size_t MaxRestoreChunk = 1 << 20;
+
+/**
+ * Time to wait for the server to accept a protocol switch.
+ * Servers that predate it never answer.
+ */
+static const std::chrono::milliseconds ProtocolTimeout(2000);
+
+/**
+ * Flags of the chunks of a restore request
+ */
+static const uint8_t RestoreFlagFirst = 0x01;
+static const uint8_t RestoreFlagLast  = 0x02;
+
+/**
+ * Appends a fact to an assert-batch argument.
+ * The argument is a 4-byte LE fact count followed by each fact as
+ * a 4-byte LE length and its bytes.
+ */
+static inline
+void append_batch_fact(std::string& args, const std::string& fact){
+	uint32_t count, length = fact.length();
+	if( args.empty() ) args.assign(4, 0);
+	std::memcpy(&count, &args[0], 4);
+	++count;
+	std::memcpy(&args[0], &count, 4);
+	args.append((char*)&length, 4);
+	args+= fact;
+}
+
+
 ClipsClient::ClipsClient(const Private&) :
-	is(&buffer), clipsStatus(NULL){}
+	protocolVersion(1), readProtocolVersion(1), protoCmdId(Request::CommandIdNone),
+	clipsStatus(NULL){}
 
 
 
@@ -43,6 +90,8 @@ bool ClipsClient::connect(const std::string& address, uint16_t port){
 		return false;
 	}
 
+	protocolVersion = readProtocolVersion = 1;
+	fragments.clear();
 	buffer.prepare(0xffff);
 	beginReceive();
 	serviceThreadPtr = std::shared_ptr<boost::thread>( new boost::thread(
@@ -50,11 +99,39 @@ bool ClipsClient::connect(const std::string& address, uint16_t port){
 				this->io_service.run();
 			}
 	));
+	negotiateProtocol(2);
 	onConnected();
 	return true;
 }
 
 
+uint8_t ClipsClient::getProtocolVersion() const{
+	return protocolVersion;
+}
+
+
+bool ClipsClient::negotiateProtocol(uint8_t version){
+	if(!socketPtr || !socketPtr->is_open() ) return false;
+
+	Request rq("proto", std::to_string(version));
+	PendingCommandPtr pc = std::make_shared<PendingCommand>();
+	std::future<ReplyPtr> reply = pc->promise.get_future();
+	// The response must be recognized as soon as it arrives
+	// since the frames that follow it use the new protocol.
+	protoCmdId = rq.getCommandId();
+	sendRequest(rq, pc, ProtocolTimeout);
+	ReplyPtr r = reply.get();
+	if( !r ){
+		// Keep using v1 and ignore a late answer
+		protoCmdId = Request::CommandIdNone;
+		return false;
+	}
+	if( !r->getSuccess() ) return false;
+	protocolVersion = version;
+	return true;
+}
+
+
 
 void ClipsClient::disconnect(){
 	abortAllRPC();
@@ -102,6 +179,69 @@ void ClipsClient::assertFact(const std::string& fact){
 
 
 
+bool ClipsClient::assertFacts(const std::vector<std::string>& facts){
+	std::vector<bool> results;
+	return assertFacts(facts, results);
+}
+
+
+
+bool ClipsClient::assertFacts(const std::vector<std::string>& facts, std::vector<bool>& results){
+	results.assign(facts.size(), false);
+	if(!socketPtr || !socketPtr->is_open() ) return false;
+
+	static const std::string cmd("assert-batch");
+	// 0x00 + 4byte CmdId + command + space
+	size_t overhead = 5 + cmd.length() + 1;
+	size_t maxArgs = (protocolVersion < 2) ? 0xffff - 2 - overhead : MaxFactBatchSize;
+
+	// Requests are pipelined: all are sent before awaiting any reply.
+	std::vector<std::pair<std::future<ReplyPtr>, std::vector<size_t>>> sent; // Reply, indices of its facts
+	std::vector<size_t> indices;
+	std::string args;
+	// A fact that doesn't fit in a request can't be sent at all.
+	// Nothing is sent in such case so facts are not half-asserted.
+	for(size_t i = 0; i < facts.size(); ++i){
+		if(4 + 4 + facts[i].length() > maxArgs)
+			throw std::length_error("fact " + std::to_string(i) + " exceeds the size of an assert-batch request.");
+	}
+	auto flush = [&](){
+		if( indices.empty() ) return;
+		sent.push_back( std::make_pair(rpcAsync(cmd, args), std::move(indices)) );
+		args.clear();
+		indices.clear();
+	};
+
+	for(size_t i = 0; i < facts.size(); ++i){
+		size_t needed = 4 + facts[i].length();
+		if(args.length() + needed > maxArgs) flush();
+		append_batch_fact(args, facts[i]);
+		indices.push_back(i);
+	}
+	flush();
+
+	bool all = true;
+	for(auto& rq : sent){
+		ReplyPtr r = rq.first.get();
+		if( !r ) continue;
+		const std::string bits = r->getResult();
+		// Result holds one success bit per fact, LSB first
+		const std::vector<size_t>& idx = rq.second;
+		for(size_t i = 0; (i < idx.size()) && (i / 8 < bits.length()); ++i)
+			results[idx[i]] = (bits[i / 8] >> (i % 8)) & 1;
+	}
+	for(bool r : results) all = all && r;
+	return all;
+}
+
+
+
+bool ClipsClient::assertFact(const TypedFact& fact){
+	return rpc("assert-typed", fact.encode());
+}
+
+
+
 void ClipsClient::retractFact(const std::string& fact){
 	rpc("raw", "(retract " + fact + ")" );
 }
@@ -112,6 +252,11 @@ bool ClipsClient::setPath(const std::string& path){
 	return rpc("path", path);
 }
 
+
+bool ClipsClient::setEnvironment(const std::string& name){
+	return rpc("env", name);
+}
+
 	/**
 	 * Requests ClipsServer to execute a command.
 	 * A command is any of
@@ -154,6 +299,134 @@ bool ClipsClient::query(const std::string& query, std::string& result){
 }
 
 
+bool ClipsClient::eval(const std::string& expression, QueryValue& value){
+	ReplyPtr reply = rpcAsync("eval", expression).get();
+	return reply && reply->getSuccess() && reply->getValue(value);
+}
+
+
+bool ClipsClient::findFacts(const std::string& templateName, const std::string& test,
+	std::vector<QueryValue>& facts, int64_t& token, size_t pageSize){
+	if( (pageSize < 1) || (token < 0) ) return false;
+	std::string args = templateName + " " + std::to_string(pageSize) + " " + std::to_string(token);
+	if( !test.empty() ) args+= " " + test;
+
+	// Reply is: 8byte next token + the page encoded as a multifield
+	std::string result;
+	QueryValue page;
+	if( !rpc("find-facts", args, result) || (result.length() < sizeof(token)) ) return false;
+	int64_t next;
+	std::memcpy(&next, result.data(), sizeof(next));
+	if( !QueryValue::decode(result.substr(sizeof(next)), page) ||
+		(page.getType() != QueryValue::Type::Multifield) )
+		return false;
+	facts = page.getFields();
+	token = next;
+	return true;
+}
+
+
+bool ClipsClient::findFacts(const std::string& templateName, const std::string& test,
+	std::function<bool(const std::vector<QueryValue>&)> onPage, size_t pageSize){
+	if(!onPage) return false;
+	int64_t token = 0;
+	std::vector<QueryValue> facts;
+	do{
+		if( !findFacts(templateName, test, facts, token, pageSize) ) return false;
+		if( !onPage(facts) ) return true;
+	}while(token != 0);
+	return true;
+}
+
+
+bool ClipsClient::snapshot(std::string& data, int64_t& count, uint32_t chunkSize){
+	data.clear();
+	count = 0;
+	// v1 frames can't hold more than 64kB: 0x00 + 4byte 0xff + flag + 4byte CmdId + data
+	uint32_t maxChunk = 0xffff - 2 - 10;
+	if( (protocolVersion < 2) && (!chunkSize || (chunkSize > maxChunk)) ) chunkSize = maxChunk;
+	// The snapshot is registered before the request is sent since its
+	// chunks arrive before the reply
+	Request rq("snapshot", chunkSize ? std::to_string(chunkSize) : "");
+	uint32_t cmdId = rq.getCommandId();
+	{std::lock_guard<std::mutex> lock(snapshotsMutex);
+		snapshots[cmdId].clear();
+	}
+	PendingCommandPtr pc = std::make_shared<PendingCommand>();
+	std::future<ReplyPtr> reply = pc->promise.get_future();
+	sendRequest(rq, pc, std::chrono::milliseconds(0));
+	ReplyPtr r = reply.get();
+	{std::lock_guard<std::mutex> lock(snapshotsMutex);
+		data.swap(snapshots[cmdId]);
+		snapshots.erase(cmdId);
+	}
+
+	// Reply is: 8byte snapshot size + 8byte fact count
+	uint64_t size;
+	if( !r || !r->getSuccess() || (r->getResult().length() != sizeof(size) + sizeof(count)) ) return false;
+	std::memcpy(&size, r->getResult().data(), sizeof(size));
+	std::memcpy(&count, r->getResult().data() + sizeof(size), sizeof(count));
+	return data.length() == size;
+}
+
+
+bool ClipsClient::restore(const std::string& data, int64_t& count){
+	count = 0;
+	if(!socketPtr || !socketPtr->is_open() ) return false;
+
+	static const std::string cmd("restore");
+	// 0x00 + 4byte CmdId + command + space + flags
+	size_t overhead = 5 + cmd.length() + 2;
+	size_t chunkSize = (protocolVersion < 2) ? 0xffff - 2 - overhead : MaxRestoreChunk;
+
+	// Chunks are pipelined: all are sent before awaiting any reply.
+	std::vector<std::future<ReplyPtr>> sent;
+	std::string args;
+	size_t offset = 0;
+	do{
+		size_t length = std::min(chunkSize, data.length() - offset);
+		uint8_t flags = 0;
+		if(offset == 0) flags|= RestoreFlagFirst;
+		if(offset + length == data.length()) flags|= RestoreFlagLast;
+		args.assign(1, (char)flags);
+		args.append(data, offset, length);
+		sent.push_back( rpcAsync(cmd, args) );
+		offset+= length;
+	}while(offset < data.length());
+
+	bool success = true;
+	ReplyPtr r;
+	for(auto& rq : sent){
+		r = rq.get();
+		success = success && r && r->getSuccess();
+	}
+	if( !success || (r->getResult().length() != sizeof(count)) ) return false;
+	std::memcpy(&count, r->getResult().data(), sizeof(count));
+	return true;
+}
+
+
+bool ClipsClient::subscribe(const std::string& templateName){
+	return rpc("subscribe", templateName);
+}
+
+
+bool ClipsClient::unsubscribe(const std::string& templateName){
+	return rpc("unsubscribe", templateName);
+}
+
+
+bool ClipsClient::ruleStats(std::string& table, size_t max){
+	return rpc("stats", max ? "rules " + std::to_string(max) : "rules", table);
+}
+
+
+bool ClipsClient::streamRuleStats(std::chrono::milliseconds interval){
+	if(interval.count() <= 0) return rpc("stats", "rules stream off");
+	return rpc("stats", "rules stream " + std::to_string(interval.count()));
+}
+
+
 uint32_t ClipsClient::getWatches(){
 	rpc("watch");
 	return clipsStatus ? clipsStatus->getWatches() : -1;
@@ -167,8 +440,26 @@ uint32_t ClipsClient::toggleWatch(const std::string& watch){
 }
 
 
+std::future<ReplyPtr> ClipsClient::rpcAsync(const std::string& cmd, const std::string& args,
+	std::chrono::milliseconds timeout){
+	PendingCommandPtr pc = std::make_shared<PendingCommand>();
+	std::future<ReplyPtr> reply = pc->promise.get_future();
+	sendRequest(Request(cmd, args), pc, timeout);
+	return reply;
+}
+
+
+void ClipsClient::rpcAsync(const std::string& cmd, const std::string& args,
+	std::function<void(const ReplyPtr&)> callback, std::chrono::milliseconds timeout){
+	PendingCommandPtr pc = std::make_shared<PendingCommand>();
+	pc->callback = callback;
+	sendRequest(Request(cmd, args), pc, timeout);
+}
+
+
 bool ClipsClient::send(const std::string& s){
 	if(!socketPtr || !socketPtr->is_open() ) return false;
+	std::lock_guard<std::mutex> lock(sendMutex);
 	socketPtr->send( asio::buffer(s) );
 	return true;
 }
@@ -179,45 +470,73 @@ bool ClipsClient::sendCommand(const std::string& command, const std::string& arg
 
 	Request rq(command, args);
 	cmdId = rq.getCommandId();
-	socketPtr->send( asio::buffer(rq.getPayload()) );
+	std::vector<char> payload = rq.getPayload(protocolVersion);
+	if( payload.empty() ) return false;
+	std::lock_guard<std::mutex> lock(sendMutex);
+	socketPtr->send( asio::buffer(payload) );
 
 	return true;
 }
 
 
-bool ClipsClient::awaitResponse(int cmdId, bool& success, std::string& result){
-	std::unique_lock<std::mutex> lock(pcmutex);
-	bool aborted = false;
-	do{
-		pccv.wait(lock, [&]{ return hasReponseArrived(cmdId, aborted); } );
-	} while(!hasReponseArrived(cmdId, aborted));
-	if( (pendingCommands[cmdId] == nullptr) || aborted)
+bool ClipsClient::sendRequest(const Request& rq, const PendingCommandPtr& pc, std::chrono::milliseconds timeout){
+	std::vector<char> payload;
+	if( socketPtr && socketPtr->is_open() ) payload = rq.getPayload(protocolVersion);
+	if( payload.empty() ){
+		deliverReply(pc, NULL);
 		return false;
-	success = pendingCommands[cmdId]->getSuccess();
-	result  = pendingCommands[cmdId]->getResult();
-	pendingCommands.erase(cmdId);
+	}
+
+	// The command is registered before being sent so its response
+	// can't arrive before anyone awaits it.
+	uint32_t cmdId = rq.getCommandId();
+	if(timeout.count() > 0)
+		pc->timer = std::make_shared<asio::steady_timer>(io_service, timeout);
+	pendingCommands.insert(cmdId, pc);
+	if(pc->timer){
+		// Timers are only touched from the service thread
+		std::shared_ptr<asio::steady_timer> timer = pc->timer;
+		io_service.post([this, timer, cmdId](){
+			timer->async_wait([this, cmdId](const boost::system::error_code& error){
+				if(!error) completeCommand(cmdId, NULL);
+			});
+		});
+	}
+
+	boost::system::error_code error;
+	{std::lock_guard<std::mutex> lock(sendMutex);
+		asio::write(*socketPtr, asio::buffer(payload), error);
+	}
+	if(error){
+		completeCommand(cmdId, NULL);
+		return false;
+	}
 	return true;
 }
 
 
-bool ClipsClient::hasReponseArrived(uint32_t cmdId, bool& aborted){
-	if( pendingCommands.count(cmdId) < 1 ){
-		aborted = true;
-		return true;
+void ClipsClient::completeCommand(uint32_t cmdId, const ReplyPtr& reply){
+	PendingCommandPtr pc;
+	if( !pendingCommands.take(cmdId, pc) ) return;
+	if(pc->timer){
+		std::shared_ptr<asio::steady_timer> timer = pc->timer;
+		io_service.post([timer](){ timer->cancel(); });
 	}
-	return pendingCommands[cmdId] != nullptr;
+	deliverReply(pc, reply);
+}
+
+
+void ClipsClient::deliverReply(const PendingCommandPtr& pc, const ReplyPtr& reply){
+	if(pc->callback) pc->callback(reply);
+	else pc->promise.set_value(reply);
 }
 
 
 bool ClipsClient::rpc(const std::string& cmd, const std::string& args, std::string& result){
-	uint32_t cmdId = 0;
-	bool success = false;
-	if( !sendCommand(cmd, args, cmdId) ) {fprintf(stderr, "Failed to send command\n");return false;}
-	{std::lock_guard<std::mutex> lock(pcmutex);
-		pendingCommands[cmdId] = NULL;
-	}
-	if( !awaitResponse(cmdId, success, result) ) return false;
-	return success;
+	ReplyPtr r = rpcAsync(cmd, args).get();
+	if( !r ) return false;
+	result = r->getResult();
+	return r->getSuccess();
 }
 
 bool ClipsClient::rpc(const std::string& cmd){
@@ -232,10 +551,10 @@ bool ClipsClient::rpc(const std::string& cmd, const std::string& args){
 
 
 void ClipsClient::abortAllRPC(){
-	std::unique_lock<std::mutex> lock(pcmutex);
-	pendingCommands.clear();
-	lock.unlock();
-	pccv.notify_all();
+	std::vector<PendingCommandPtr> aborted;
+	pendingCommands.takeAll(aborted);
+	for(const PendingCommandPtr& pc : aborted)
+		deliverReply(pc, NULL);
 }
 
 
@@ -264,43 +583,78 @@ void ClipsClient::asyncReadHandler(const boost::system::error_code& error, size_
 		return;
 	}
 
-	do{
+	while(true){
 		// 1. Read message header to read only complete messages.
-		// If header is incomplete, the bytes read are returned to the buffer
-		uint16_t msgsize;
-		is.read((char*)&msgsize, sizeof(msgsize));
-		if(buffer.size() < (size_t)(msgsize - 2) ){
-			is.unget(); is.unget();
-			break;
+		// v1 header is 2byte frame size (header included)
+		// v2 header is 4byte payload size + 1byte flags
+		const char* data = asio::buffer_cast<const char*>(buffer.data());
+		size_t hdrsize = (readProtocolVersion < 2) ? 2 : 5;
+		size_t msgsize = 0;
+		uint8_t flags = 0;
+		if(buffer.size() < hdrsize) break;
+		if(readProtocolVersion < 2){
+			uint16_t framesize;
+			std::memcpy(&framesize, data, sizeof(framesize));
+			if(framesize > hdrsize) msgsize = framesize - hdrsize;
 		}
-		// If message size is 2 or less (empty/malformed), discard.
-		if(!(msgsize-=2)) continue;
-		// 2. Read the whole message. Bytes read are removed from the buffer by the istream
-		std::string s(msgsize, 0);
-		is.read(&s[0], msgsize);
+		else{
+			uint32_t payloadsize;
+			std::memcpy(&payloadsize, data, sizeof(payloadsize));
+			msgsize = payloadsize;
+			flags = data[4];
+		}
+		if(buffer.size() < hdrsize + msgsize) break;
+
+		// 2. Read the whole message and remove it from the buffer
+		std::string s(data + hdrsize, msgsize);
+		buffer.consume(hdrsize + msgsize);
+		if(flags & Request::FrameFlagMore){
+			fragments+= s;
+			continue;
+		}
+		if( !fragments.empty() ){
+			s = fragments + s;
+			fragments.clear();
+		}
+		// If message is empty (or malformed), discard.
+		if( s.empty() ) continue;
 
 		// 3. If the message is a command's response, process it. Else publish the read string.
 		if(s[0] == 0) handleResponseMesage(s);
 		else onMessageReceived(s);
 		// Repeat while buffer has data
-	}while(buffer.size() > 0);
+	}
 
 	beginReceive();
 }
 
 
 void ClipsClient::handleResponseMesage(const std::string& s){
+	// Fact changes are pushed as status messages flagged with 0x02
+	if( (s.length() > 6) && (s.compare(0, 6, "\0\xff\xff\xff\xff\x02", 6) == 0) ){
+		onFactsChanged(s.substr(6));
+		return;
+	}
+	// And rule statistics with 0x03
+	if( (s.length() > 6) && (s.compare(0, 6, "\0\xff\xff\xff\xff\x03", 6) == 0) ){
+		onRuleStats(s.substr(6));
+		return;
+	}
+	// And snapshot chunks with 0x04
+	if( (s.length() > 10) && (s.compare(0, 6, "\0\xff\xff\xff\xff\x04", 6) == 0) ){
+		onSnapshotChunk(s);
+		return;
+	}
 	ReplyPtr rplptr = Reply::fromMessage(s);
 	if( rplptr ){
 		if(rplptr->getCommandId() == Reply::CommandIdNone){
 			updateStatus(rplptr);
 			return;
 		}
-		std::unique_lock<std::mutex> lock(pcmutex);
-		if( !pendingCommands.count(rplptr->getCommandId()) )  return;
-		pendingCommands[rplptr->getCommandId()] = rplptr;
-		lock.unlock();
-		pccv.notify_all();
+		// Frames following an accepted protocol request use the new protocol
+		if( (rplptr->getCommandId() == protoCmdId) && rplptr->getSuccess() )
+			readProtocolVersion = std::atoi( rplptr->getResult().c_str() );
+		completeCommand(rplptr->getCommandId(), rplptr);
 	}
 }
 
@@ -351,6 +705,35 @@ void ClipsClient::onClipsStatusChanged(){
 }
 
 
+void ClipsClient::onFactsChanged(const std::string& changes){
+	if( factsChangedHandlers.empty() ) return;
+	std::vector<FactDelta> deltas;
+	if( !FactDelta::decode(changes, deltas) ) return;
+	for(auto it = factsChangedHandlers.begin(); it != factsChangedHandlers.end(); ++it){
+		try{ (*it)( getPtr(), deltas ); }
+		catch(int err){}
+	}
+}
+
+
+void ClipsClient::onRuleStats(const std::string& table){
+	for(auto it = ruleStatsHandlers.begin(); it != ruleStatsHandlers.end(); ++it){
+		try{ (*it)( getPtr(), table ); }
+		catch(int err){}
+	}
+}
+
+
+void ClipsClient::onSnapshotChunk(const std::string& s){
+	// Chunk is: 6byte header + 4byte CmdId of the snapshot + data
+	uint32_t cmdId;
+	std::memcpy(&cmdId, s.data() + 6, sizeof(cmdId));
+	std::lock_guard<std::mutex> lock(snapshotsMutex);
+	auto it = snapshots.find(cmdId);
+	if(it != snapshots.end()) it->second.append(s, 10, std::string::npos);
+}
+
+
 void ClipsClient::addConnectedHandler(std::function<void(const ClipsClientPtr&)> handler){
 	if(!handler) return;
 	connectedHandlers.push_back(handler);
@@ -374,6 +757,18 @@ void ClipsClient::addClipsStatusChangedHandler(std::function<void(const ClipsCli
 }
 
 
+void ClipsClient::addFactsChangedHandler(std::function<void(const ClipsClientPtr&, const std::vector<FactDelta>&)> handler){
+	if(!handler) return;
+	factsChangedHandlers.push_back(handler);
+}
+
+
+void ClipsClient::addRuleStatsHandler(std::function<void(const ClipsClientPtr&, const std::string&)> handler){
+	if(!handler) return;
+	ruleStatsHandlers.push_back(handler);
+}
+
+
 #if __GNUC__ > 10
 
 void ClipsClient::removeConnectedHandler(std::function<void(const ClipsClientPtr&)> handler){
@@ -423,4 +818,28 @@ void ClipsClient::removeClipsStatusChangedHandler(std::function<void(const Clips
 	}
 }
 
+
+void ClipsClient::removeFactsChangedHandler(std::function<void(const ClipsClientPtr&, const std::vector<FactDelta>&)> handler){
+	if(!handler) return;
+
+	typedef void(HT)(const ClipsClientPtr&, const std::vector<FactDelta>&);
+	auto htarget = handler.target<HT>();
+	for(auto it = factsChangedHandlers.begin(); it != factsChangedHandlers.end(); ++it){
+		if (it->target<HT>() != htarget) continue;
+		factsChangedHandlers.erase(it);
+	}
+}
+
+
+void ClipsClient::removeRuleStatsHandler(std::function<void(const ClipsClientPtr&, const std::string&)> handler){
+	if(!handler) return;
+
+	typedef void(HT)(const ClipsClientPtr&, const std::string&);
+	auto htarget = handler.target<HT>();
+	for(auto it = ruleStatsHandlers.begin(); it != ruleStatsHandlers.end(); ++it){
+		if (it->target<HT>() != htarget) continue;
+		ruleStatsHandlers.erase(it);
+	}
+}
+
 #endif
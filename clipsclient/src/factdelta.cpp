@@ -0,0 +1,24 @@
+#include "factdelta.h"
+
+#include <cstring>
+
+
+bool FactDelta::decode(const std::string& data, std::vector<FactDelta>& deltas){
+	uint32_t count;
+	deltas.clear();
+	if(data.length() < sizeof(count)) return false;
+	std::memcpy(&count, data.data(), sizeof(count));
+	size_t offset = sizeof(count);
+	// Each change takes at least ten bytes
+	if(count > (data.length() - offset) / 10) return false;
+
+	deltas.resize(count);
+	for(FactDelta& delta : deltas){
+		if(offset >= data.length()) return false;
+		delta.kind = (Kind)data[offset++];
+		if( (delta.kind != Kind::Assert) && (delta.kind != Kind::Retract) && (delta.kind != Kind::Modify) )
+			return false;
+		if( !QueryValue::decode(data, offset, delta.fact) ) return false;
+	}
+	return offset == data.length();
+}
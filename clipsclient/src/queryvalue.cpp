@@ -0,0 +1,161 @@
+#include "queryvalue.h"
+
+#include <cstring>
+
+
+/* ** ********************************************************
+* Local helpers
+* *** *******************************************************/
+/**
+ * Maximum nesting of decoded values. A fact inside a multifield
+ * holding a multifield slot is the deepest clips::eval encodes.
+ */
+static const int MaxDepth = 4;
+
+template<typename T>
+static inline
+bool read_value(const std::string& s, size_t& offset, T& value){
+	if(s.length() - offset < sizeof(T)) return false;
+	std::memcpy(&value, s.data() + offset, sizeof(T));
+	offset+= sizeof(T);
+	return true;
+}
+
+static inline
+bool read_lexeme(const std::string& s, size_t& offset, std::string& lexeme){
+	uint32_t length;
+	if( !read_value(s, offset, length) ) return false;
+	if(s.length() - offset < length) return false;
+	lexeme.assign(s.data() + offset, length);
+	offset+= length;
+	return true;
+}
+
+
+/* ** ********************************************************
+* Class members
+* *** *******************************************************/
+QueryValue::QueryValue() : type(Type::Void){
+	number.i = 0;
+}
+
+
+QueryValue::Type QueryValue::getType() const{
+	return type;
+}
+
+
+int64_t QueryValue::getInteger() const{
+	return number.i;
+}
+
+
+double QueryValue::getFloat() const{
+	return number.d;
+}
+
+
+const std::string& QueryValue::getLexeme() const{
+	return lexeme;
+}
+
+
+int64_t QueryValue::getFactIndex() const{
+	return number.i;
+}
+
+
+const std::vector<QueryValue>& QueryValue::getFields() const{
+	return fields;
+}
+
+
+const std::vector<std::string>& QueryValue::getSlotNames() const{
+	return slotNames;
+}
+
+
+const QueryValue* QueryValue::getSlot(const std::string& slot) const{
+	for(size_t i = 0; i < slotNames.size(); ++i){
+		if(slotNames[i] == slot) return &fields[i];
+	}
+	return NULL;
+}
+
+
+bool QueryValue::isNumber() const{
+	return (type == Type::Integer) || (type == Type::Float);
+}
+
+
+bool QueryValue::isLexeme() const{
+	return (type == Type::Symbol) || (type == Type::String) || (type == Type::InstanceName);
+}
+
+
+bool QueryValue::decode(const std::string& data, QueryValue& value){
+	size_t offset = 0;
+	value = QueryValue();
+	return decode(data, offset, value, 0) && (offset == data.length());
+}
+
+
+bool QueryValue::decode(const std::string& data, size_t& offset, QueryValue& value){
+	value = QueryValue();
+	return decode(data, offset, value, 0);
+}
+
+
+bool QueryValue::decode(const std::string& data, size_t& offset, QueryValue& value, int depth){
+	uint8_t type;
+	if( (depth > MaxDepth) || !read_value(data, offset, type) ) return false;
+	value.type = (Type)type;
+	switch(value.type){
+		case Type::Integer:
+		case Type::FactAddress:
+			return read_value(data, offset, value.number.i);
+
+		case Type::Float:
+			return read_value(data, offset, value.number.d);
+
+		case Type::Symbol:
+		case Type::String:
+		case Type::InstanceName:
+		case Type::InstanceAddress:
+			return read_lexeme(data, offset, value.lexeme);
+
+		case Type::Multifield:{
+			uint32_t count;
+			if( !read_value(data, offset, count) ) return false;
+			// Each field takes at least one byte
+			if(count > data.length() - offset) return false;
+			value.fields.resize(count);
+			for(QueryValue& field : value.fields)
+				if( !decode(data, offset, field, depth + 1) ) return false;
+			return true;
+		}
+
+		case Type::Fact:{
+			uint32_t count;
+			if( !read_value(data, offset, value.number.i) ||
+				!read_lexeme(data, offset, value.lexeme) ||
+				!read_value(data, offset, count) )
+				return false;
+			// Each slot takes at least five bytes
+			if(count > (data.length() - offset) / 5) return false;
+			value.slotNames.resize(count);
+			value.fields.resize(count);
+			for(uint32_t i = 0; i < count; ++i){
+				if( !read_lexeme(data, offset, value.slotNames[i]) ||
+					!decode(data, offset, value.fields[i], depth + 1) )
+					return false;
+			}
+			return true;
+		}
+
+		case Type::Void:
+		case Type::ExternalAddress:
+			return true;
+	}
+	return false;
+}
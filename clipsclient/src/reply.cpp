@@ -24,6 +24,12 @@ std::string Reply::getResult() const{
 
 
 
+bool Reply::getValue(QueryValue& value) const{
+	return QueryValue::decode(result, value);
+}
+
+
+
 bool Reply::matches(const Request& r){
 	return r.getCommandId() == cmdId;
 }
@@ -1,14 +1,25 @@
 #include "request.h"
 
+#include <cstring>
+
 namespace asio = boost::asio;
 using asio::ip::tcp;
 
-uint32_t Request::lastCommandId = 0;
+std::atomic<uint32_t> Request::lastCommandId(0);
 
 Request::Request(){}
 
 Request::Request(const std::string& command, const std::string& args) :
-	cmdId(++Request::lastCommandId), cmd(command), args(args){}
+	cmdId(Request::nextCommandId()), cmd(command), args(args){}
+
+
+
+uint32_t Request::nextCommandId(){
+	uint32_t id;
+	// CommandIdNone identifies status messages
+	do{ id = ++lastCommandId; } while(id == CommandIdNone);
+	return id;
+}
 
 
 
@@ -30,18 +41,36 @@ std::string Request::getArgs() const{
 
 
 
-std::vector<char> Request::getPayload() const{
-	std::string content = cmd;
+std::vector<char> Request::getPayload(uint8_t protocolVersion) const{
+	// A command is 0x00 + 4byte CmdId + content
+	std::string content(5, 0);
+	std::memcpy(&content[1], &cmdId, 4);
+	content+= cmd;
 	if( !args.empty() ) content += " " + args;
 
 	std::vector<char> payload;
-	uint16_t packetsize = 7 + content.length();
-	payload.resize(packetsize, 0);
-	char* buffer = payload.data();
-	std::memcpy(buffer, &packetsize, 2);
-	buffer[2] = 0;
-	std::memcpy(buffer+3, &cmdId, 4);
-	content.copy(buffer+7, content.length());
+	if(protocolVersion < 2){
+		// v1 frame is 2byte size (header included) + content
+		uint16_t packetsize = 2 + content.length();
+		if(content.length() > 0xffff - 2) return payload;
+		payload.resize(packetsize, 0);
+		std::memcpy(payload.data(), &packetsize, 2);
+		content.copy(payload.data()+2, content.length());
+		return payload;
+	}
+
+	// v2 frames are 4byte content size + 1byte flags + content
+	size_t fragments = (content.length() + MaxFragmentSize - 1) / MaxFragmentSize;
+	payload.reserve(content.length() + 5 * fragments);
+	for(size_t offset = 0, i = 0; i < fragments; ++i, offset+= MaxFragmentSize){
+		uint32_t length = content.length() - offset;
+		if(length > MaxFragmentSize) length = MaxFragmentSize;
+		char hdr[5];
+		std::memcpy(hdr, &length, 4);
+		hdr[4] = (i + 1 < fragments) ? FrameFlagMore : 0;
+		payload.insert(payload.end(), hdr, hdr + 5);
+		payload.insert(payload.end(), content.begin() + offset, content.begin() + offset + length);
+	}
 	return payload;
 }
 
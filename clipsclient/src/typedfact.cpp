@@ -0,0 +1,134 @@
+#include "typedfact.h"
+
+#include <stdexcept>
+
+
+/* ** ********************************************************
+* Local helpers
+* *** *******************************************************/
+/**
+ * Value types understood by assert-typed.
+ * Must match clips::SlotValue::Type
+ */
+enum class SlotType : uint8_t{
+	Integer      = 0,
+	Float        = 1,
+	Symbol       = 2,
+	String       = 3,
+	InstanceName = 4,
+	Multifield   = 5,
+};
+
+
+TypedFact::TypedFact(const std::string& templateName) :
+	templateName(templateName), slotCount(0){
+	if(templateName.length() > 0xff)
+		throw std::invalid_argument("templateName can't exceed 255 bytes.");
+}
+
+
+TypedFact& TypedFact::put(const std::string& slot, int64_t value){
+	beginSlot(slot, (uint8_t)SlotType::Integer);
+	append(value);
+	return *this;
+}
+
+
+TypedFact& TypedFact::put(const std::string& slot, int value){
+	return put(slot, (int64_t)value);
+}
+
+
+TypedFact& TypedFact::put(const std::string& slot, double value){
+	beginSlot(slot, (uint8_t)SlotType::Float);
+	append(value);
+	return *this;
+}
+
+
+TypedFact& TypedFact::putSymbol(const std::string& slot, const std::string& value){
+	beginSlot(slot, (uint8_t)SlotType::Symbol);
+	appendLexeme(value);
+	return *this;
+}
+
+
+TypedFact& TypedFact::putString(const std::string& slot, const std::string& value){
+	beginSlot(slot, (uint8_t)SlotType::String);
+	appendLexeme(value);
+	return *this;
+}
+
+
+TypedFact& TypedFact::putInstanceName(const std::string& slot, const std::string& value){
+	beginSlot(slot, (uint8_t)SlotType::InstanceName);
+	appendLexeme(value);
+	return *this;
+}
+
+
+TypedFact& TypedFact::putSymbols(const std::string& slot, const std::vector<std::string>& values){
+	beginSlot(slot, (uint8_t)SlotType::Multifield);
+	append((uint32_t)values.size());
+	for(const std::string& value : values){
+		append((uint8_t)SlotType::Symbol);
+		appendLexeme(value);
+	}
+	return *this;
+}
+
+
+TypedFact& TypedFact::putIntegers(const std::string& slot, const std::vector<int64_t>& values){
+	beginSlot(slot, (uint8_t)SlotType::Multifield);
+	append((uint32_t)values.size());
+	for(int64_t value : values){
+		append((uint8_t)SlotType::Integer);
+		append(value);
+	}
+	return *this;
+}
+
+
+TypedFact& TypedFact::putFloats(const std::string& slot, const std::vector<double>& values){
+	beginSlot(slot, (uint8_t)SlotType::Multifield);
+	append((uint32_t)values.size());
+	for(double value : values){
+		append((uint8_t)SlotType::Float);
+		append(value);
+	}
+	return *this;
+}
+
+
+size_t TypedFact::getSlotCount() const{
+	return slotCount;
+}
+
+
+std::string TypedFact::encode() const{
+	std::string s;
+	s.reserve(2 + templateName.length() + slots.length());
+	s+= (char)templateName.length();
+	s+= templateName;
+	s+= (char)slotCount;
+	s+= slots;
+	return s;
+}
+
+
+void TypedFact::beginSlot(const std::string& slot, uint8_t type){
+	if(slot.length() > 0xff)
+		throw std::invalid_argument("slot name can't exceed 255 bytes.");
+	if(slotCount >= 0xff)
+		throw std::length_error("a fact can't have more than 255 slots.");
+	++slotCount;
+	append((uint8_t)slot.length());
+	slots+= slot;
+	append(type);
+}
+
+
+void TypedFact::appendLexeme(const std::string& value){
+	append((uint32_t)value.length());
+	slots+= value;
+}
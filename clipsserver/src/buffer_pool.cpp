@@ -0,0 +1,49 @@
+#include "buffer_pool.h"
+
+
+BufferPool::BufferPool(size_t chunkSize, size_t maxFree):
+	state(std::make_shared<State>()){
+	state->chunkSize = chunkSize;
+	state->maxFree = maxFree;
+}
+
+
+BufferPool::~BufferPool(){
+	std::lock_guard<std::mutex> lock(state->m);
+	for(char* chunk : state->freeChunks)
+		delete[] chunk;
+	state->freeChunks.clear();
+	// Chunks still in use are freed upon release
+	state->maxFree = 0;
+}
+
+
+size_t BufferPool::getChunkSize() const{
+	return state->chunkSize;
+}
+
+
+std::shared_ptr<char> BufferPool::acquire(){
+	char* chunk = NULL;
+	{
+		std::lock_guard<std::mutex> lock(state->m);
+		if( !state->freeChunks.empty() ){
+			chunk = state->freeChunks.back();
+			state->freeChunks.pop_back();
+		}
+	}
+	if(!chunk) chunk = new char[state->chunkSize];
+
+	std::shared_ptr<State> st = state;
+	return std::shared_ptr<char>(chunk, [st](char* p){ BufferPool::release(st, p); });
+}
+
+
+void BufferPool::release(const std::shared_ptr<State>& state, char* chunk){
+	std::lock_guard<std::mutex> lock(state->m);
+	if(state->freeChunks.size() < state->maxFree){
+		state->freeChunks.push_back(chunk);
+		return;
+	}
+	delete[] chunk;
+}
@@ -0,0 +1,92 @@
+/* ** ***************************************************************
+* buffer_pool.h
+*
+* Author: Mauricio Matamoros
+*
+* Pool of fixed-size, reference-counted memory chunks
+*
+** ** **************************************************************/
+/** @file buffer_pool.h
+ * Definition of the BufferPool class: a thread-safe pool of
+ * fixed-size, reference-counted memory chunks used to receive data
+ */
+
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+#pragma once
+
+/** @cond */
+#include <mutex>
+#include <memory>
+#include <vector>
+/** @endcond */
+
+
+/**
+ * Implements a thread-safe pool of fixed-size memory chunks.
+ * Chunks are handed out as shared pointers that return the memory to
+ * the pool once the last reference is released, so slices of a chunk
+ * can be shared with the aliasing constructor of std::shared_ptr.
+ * The pool may be destroyed while chunks are still in use.
+ */
+class BufferPool{
+public:
+	/**
+	 * Initializes a new instance of BufferPool
+	 * @param chunkSize The size in bytes of each chunk
+	 * @param maxFree   The maximum number of released chunks
+	 *                  kept for reuse
+	 */
+	BufferPool(size_t chunkSize, size_t maxFree);
+	~BufferPool();
+
+	// Disable copy constructor and assignment op.
+private:
+	/**
+	 * Copy constructor disabled
+	 */
+	BufferPool(BufferPool const& obj)        = delete;
+	/**
+	 * Copy assignment operator disabled
+	 */
+	BufferPool& operator=(BufferPool const&) = delete;
+
+public:
+	/**
+	 * Retrieves a chunk from the pool, allocating a new one if
+	 * the pool is empty
+	 * @return A shared pointer to a chunk of getChunkSize() bytes
+	 */
+	std::shared_ptr<char> acquire();
+
+	/**
+	 * Gets the size in bytes of the chunks managed by the pool
+	 * @return The size of the chunks
+	 */
+	size_t getChunkSize() const;
+
+private:
+	/**
+	 * Pool state shared with the chunks' deleters so released
+	 * chunks can outlive the pool
+	 */
+	struct State{
+		size_t chunkSize;
+		size_t maxFree;
+		std::mutex m;
+		std::vector<char*> freeChunks;
+	};
+
+	/**
+	 * Returns a chunk to the pool or frees it if the pool is full
+	 */
+	static void release(const std::shared_ptr<State>& state, char* chunk);
+
+private:
+	/**
+	 * The state of the pool
+	 */
+	std::shared_ptr<State> state;
+};
+
+#endif // __BUFFER_POOL_H__
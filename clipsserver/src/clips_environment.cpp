@@ -0,0 +1,998 @@
+#include "clips_environment.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <boost/filesystem.hpp>
+
+#include <unistd.h>
+
+#include "server.h"
+#include "clipswrapper.h"
+
+
+/* ** ********************************************************
+* Local helpers
+* *** *******************************************************/
+static inline
+bool ends_with(const std::string& s, const std::string& end){
+	if (end.size() > s.size()) return false;
+	return std::equal(end.rbegin(), end.rend(), s.rbegin());
+}
+
+static inline
+void split_path(const std::string& fpath, std::string& dir, std::string& fname){
+	size_t slashp = fpath.rfind("/");
+	if(slashp == std::string::npos){
+		dir = std::string();
+		fname = fpath;
+		return;
+	}
+	dir = fpath.substr(0, slashp);
+	fname = fpath.substr(slashp+1);
+}
+
+static inline
+std::string compose_fact(const std::string& fact, const boost::string_view& s){
+	std::string as;
+	as.reserve(fact.length() + s.length() + 3);
+	as+= '(';
+	as+= fact;
+	as+= ' ';
+	as.append(s.data(), s.length());
+	as+= ')';
+	return as;
+}
+
+template<typename T>
+static inline
+bool read_value(const boost::string_view& s, size_t& offset, T& value){
+	if(s.length() - offset < sizeof(T)) return false;
+	std::memcpy(&value, s.data() + offset, sizeof(T));
+	offset+= sizeof(T);
+	return true;
+}
+
+static inline
+bool read_lexeme(const boost::string_view& s, size_t& offset, size_t length, std::string& lexeme){
+	if(s.length() - offset < length) return false;
+	lexeme.assign(s.data() + offset, length);
+	offset+= length;
+	return true;
+}
+
+static inline
+bool parse_uint(const std::string& s, uint32_t& value){
+	if( s.empty() || (s.length() > 9) || (s.find_first_not_of("0123456789") != std::string::npos) )
+		return false;
+	value = (uint32_t)std::stoul(s);
+	return true;
+}
+
+static
+bool read_slot_value(const boost::string_view& s, size_t& offset, clips::SlotValue& value, bool nested=false){
+	typedef clips::SlotValue::Type Type;
+	uint8_t type;
+	if( !read_value(s, offset, type) ) return false;
+	switch((Type)type){
+		case Type::Integer:{
+			int64_t i;
+			if( !read_value(s, offset, i) ) return false;
+			value = clips::SlotValue(i);
+			return true;
+		}
+
+		case Type::Float:{
+			double d;
+			if( !read_value(s, offset, d) ) return false;
+			value = clips::SlotValue(d);
+			return true;
+		}
+
+		case Type::Symbol:
+		case Type::String:
+		case Type::InstanceName:{
+			uint32_t length;
+			std::string lexeme;
+			if( !read_value(s, offset, length) || !read_lexeme(s, offset, length, lexeme) )
+				return false;
+			value = clips::SlotValue(lexeme, (Type)type);
+			return true;
+		}
+
+		case Type::Multifield:{
+			uint32_t count;
+			if( nested || !read_value(s, offset, count) ) return false;
+			// Each field takes at least five bytes
+			if(count > (s.length() - offset) / 5) return false;
+			std::vector<clips::SlotValue> fields(count);
+			for(clips::SlotValue& field : fields)
+				if( !read_slot_value(s, offset, field, true) ) return false;
+			value = clips::SlotValue(fields);
+			return true;
+		}
+	}
+	return false;
+}
+
+static inline
+std::string get_current_path(){
+	char buff[FILENAME_MAX];
+	getcwd(buff, sizeof(buff));
+	return std::string(buff);
+}
+
+static inline
+std::string canonicalize_path(std::string path){
+	if (path.length() < 1) return path;
+	if(path == "~") path = std::getenv("HOME");
+	else if( (path.length() > 1) && (path.substr(0, 2) == "~/") )
+		path = std::getenv("HOME") + path.substr(1);
+	try{ return boost::filesystem::canonical(path).string(); }
+	catch(...){ return ""; }
+}
+
+static inline
+void splitCommand(const std::string& s, std::string& cmd, std::string& arg){
+	std::string::size_type sp = s.find(" ");
+	if(sp == std::string::npos){
+		// Trims leading zeroes from command, if any.
+		cmd = s.substr(0, s.find_first_of( (char)0 ));
+		arg.clear();
+	}
+	else{
+		cmd = s.substr(0, sp);
+		arg = s.substr(sp+1);
+		// Trims leading zeroes from arg, if any.
+		std::string::size_type zp = arg.find_first_of( (char)0 );
+		if(zp != std::string::npos) arg.erase(zp);
+	}
+}
+
+/**
+ * The environment running on each worker thread
+ */
+static thread_local ClipsEnvironment* currentEnvironment = NULL;
+
+/**
+ * Shortest interval between rule statistics pushed to a client, in
+ * milliseconds
+ */
+static const uint32_t MinRuleStatsInterval = 100;
+
+/**
+ * Maximum number of messages dispatched between checks of the fact
+ * batch and the fact and rule statistics subscriptions
+ */
+static const size_t MaxDispatch = 256;
+
+/**
+ * Default size of the chunks of a fact snapshot, in bytes
+ */
+static const uint32_t DefaultSnapshotChunk = 1 << 20;
+
+/**
+ * Smallest and largest sizes of the chunks of a fact snapshot, in bytes
+ */
+static const uint32_t MinSnapshotChunk = 4096;
+static const uint32_t MaxSnapshotChunk = 16 << 20;
+
+/**
+ * Largest fact snapshot accepted for restoring, in bytes
+ */
+static const size_t MaxRestoreSize = (size_t)1 << 30;
+
+/**
+ * Largest size of all the partial restores of all environments, in bytes
+ */
+static const size_t MaxRestoreTotal = (size_t)1 << 31;
+
+/**
+ * Size of all the partial restores of all environments, in bytes
+ */
+static std::atomic<size_t> restoreTotal(0);
+
+/**
+ * Time after which a partial restore with no new chunks is discarded
+ */
+static const std::chrono::seconds RestoreTimeout(60);
+
+/**
+ * Flags of the chunks of a restore
+ */
+static const uint8_t RestoreFlagFirst = 0x01;
+static const uint8_t RestoreFlagLast  = 0x02;
+
+/**
+ * Largest number of facts in a page of find-facts
+ */
+static const uint32_t MaxFindFactsPage = 10000;
+
+/**
+ * Largest page of find-facts for v2 clients, in bytes. Pages for v1
+ * clients are bound to the size of a v1 frame.
+ */
+static const size_t MaxFindFactsBytes = 1 << 20;
+
+
+/* ** ********************************************************
+* Constructor
+* *** *******************************************************/
+ClipsEnvironment::ClipsEnvironment(const std::string& name, Server& server):
+	name(name), server(server), flgFacts(false), flgRules(false), argc(0), argv(NULL),
+	running(false), watches(0), defaultMsgInFact("network 0.0.0.0:0"),
+	batchSize(0), batchTimeout(1000), restoreCount(0),
+	metrics({"assert", "reset", "clear", "query", "eval", "find-facts", "subscribe",
+		"unsubscribe", "raw", "path", "print", "watch", "load", "run", "stats", "log",
+		"metrics", "assert-batch", "assert-typed", "snapshot", "restore"}){
+}
+
+ClipsEnvironment::~ClipsEnvironment(){
+	stop();
+}
+
+
+/* ** ********************************************************
+*
+* Class methods
+* Initialization
+*
+* *** *******************************************************/
+const std::string& ClipsEnvironment::getName() const{
+	return name;
+}
+
+
+void ClipsEnvironment::setBatching(size_t batchSize, uint32_t batchTimeout){
+	this->batchSize = batchSize;
+	this->batchTimeout = batchTimeout;
+}
+
+
+void ClipsEnvironment::setIngressLimits(size_t capacity, size_t quota){
+	queue.setLimits(capacity, quota);
+}
+
+
+const EnvironmentMetrics& ClipsEnvironment::getMetrics() const{
+	return metrics;
+}
+
+
+size_t ClipsEnvironment::getQueueSize(){
+	return queue.size();
+}
+
+
+uint64_t ClipsEnvironment::getDroppedMessages() const{
+	return queue.getDropped();
+}
+
+
+uint64_t ClipsEnvironment::getDeferredReads() const{
+	return queue.getDeferred();
+}
+
+
+ClipsEnvironment* ClipsEnvironment::current(){
+	return currentEnvironment;
+}
+
+
+void ClipsEnvironment::start(const std::string& clipsFile, bool watchFacts, bool watchRules,
+	int argc, char** argv){
+	if(running) return;
+	this->clipsFile = clipsFile;
+	this->flgFacts = watchFacts;
+	this->flgRules = watchRules;
+	this->argc = argc;
+	this->argv = argv;
+	running = true;
+	worker = std::thread(&ClipsEnvironment::run, this);
+}
+
+
+void ClipsEnvironment::stop(){
+	running = false;
+	if( !worker.joinable() ) return;
+	// Wake up the worker thread
+	queue.interrupt();
+	worker.join();
+}
+
+
+void ClipsEnvironment::initCLIPS(){
+	clips::initialize();
+	if(argc > 0) clips::rerouteStdin(argc, argv);
+	clips::clear();
+	server.initUserFunctions();
+	printf("Clips environment '%s' ready\n", name.c_str());
+
+	// Load clp files specified in file
+	if( !clipsFile.empty() ) loadFile(clipsFile);
+	if(flgFacts) clips::toggleWatch(clips::WatchItem::Facts);
+	if(flgRules) clips::toggleWatch(clips::WatchItem::Rules);
+	watches = (int)clips::getWatches();
+
+	// Further CLIPS initialization (routers, etc).
+	clips::QueryRouter& qr = clips::QueryRouter::getInstance();
+	qr.addLogicalName("wdisplay"); // Capture display info
+	qr.addLogicalName("wtrace");   // Capture trace info
+	qr.addLogicalName("stdout");   // Capture everything else
+}
+
+
+/* ** ********************************************************
+*
+* Class methods: Worker thread
+*
+* *** *******************************************************/
+void ClipsEnvironment::run(){
+	currentEnvironment = this;
+	initCLIPS();
+
+	while(running){
+		// Sleep until messages arrive, the current batch expires, or
+		// rule statistics are due
+		bool timed = false;
+		std::chrono::microseconds timeout(0);
+		if( !factBatch.empty() && (batchTimeout > 0) ){
+			timed = true;
+			timeout = batchTimeLeft();
+		}
+		if( !ruleStatsStreams.empty() ){
+			std::chrono::microseconds left = ruleStatsTimeLeft();
+			if(!timed || (left < timeout)) timeout = left;
+			timed = true;
+		}
+		if(timed)
+			queue.timedConsume(pending, MaxDispatch, timeout);
+		else
+			queue.consume(pending, MaxDispatch);
+
+		if( !pending.empty() ) metrics.queueDepth.observe(pending.size());
+		for(auto& msg : pending){
+			if(!msg) continue;
+			metrics.queueLatency.observe( std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - msg->getReceptionTime()).count() );
+			parseMessage( msg );
+		}
+		pending.clear();
+		dropClosedRestores();
+
+		if( (batchSize > 0) && ((batchTimeout == 0) || (batchTimeLeft().count() == 0)) )
+			flushFactBatch();
+		publishFactChanges();
+		publishRuleStats();
+
+		metrics.facts = clips::getFactCount();
+		metrics.activations = clips::getActivationCount();
+		metrics.memory = clips::getMemoryUsed();
+	}
+
+	clips::destroyEnvironment( clips::getEnvironment() );
+	currentEnvironment = NULL;
+}
+
+
+IngressQueue::Admission ClipsEnvironment::enqueueTcpMessage(std::shared_ptr<TcpMessage> messagePtr,
+	const std::shared_ptr<IngressQueue::Source>& source){
+	return queue.produce(messagePtr, source);
+}
+
+
+bool ClipsEnvironment::deferResume(const std::shared_ptr<IngressQueue::Source>& source, std::function<void()> resume){
+	return queue.deferResume(source, std::move(resume));
+}
+
+
+void ClipsEnvironment::sessionClosed(SessionId id){
+	// handleRestore() checks the session is still connected after
+	// counting its restore, so a restore is never missed here
+	if(restoreCount == 0) return;
+	{std::lock_guard<std::mutex> lock(closedSessionsMutex);
+		closedSessions.push_back(id);
+	}
+	// Wake up the worker thread to release the memory
+	queue.interrupt();
+}
+
+
+/**
+ * Parses messages from network clients
+ * Re-implements original parse_network_message by Jesús Savage
+ * @param msg The received message
+ */
+void ClipsEnvironment::parseMessage(std::shared_ptr<TcpMessage> msg){
+	boost::string_view m = msg->getMessage();
+
+	if((m[0] == 0) && (m.length() > 5)){
+		// Facts received before a command must be asserted before it runs
+		flushFactBatch();
+		std::string result;
+		boost::string_view c = m.substr(5);
+		auto start = std::chrono::steady_clock::now();
+		// Bulk asserts carry binary data and are parsed in place
+		static const std::string assertBatchCmd("assert-batch ");
+		static const std::string assertTypedCmd("assert-typed ");
+		static const std::string restoreCmd("restore ");
+		static const std::string snapshotCmd("snapshot");
+		bool success;
+		if(c.starts_with(assertBatchCmd))
+			success = handleAssertBatch(c.substr(assertBatchCmd.length()), result);
+		else if(c.starts_with(assertTypedCmd))
+			success = handleAssertTyped(c.substr(assertTypedCmd.length()));
+		else if(c.starts_with(restoreCmd))
+			success = handleRestore(msg->getSource(), c.substr(restoreCmd.length()), result);
+		else if( c.starts_with(snapshotCmd) && ((c.length() == snapshotCmd.length()) || (c[snapshotCmd.length()] == ' ')) )
+			success = handleSnapshot(msg, c.substr(snapshotCmd.length()).to_string(), result);
+		else
+			success = handleCommand(c.to_string(), result, msg->getSource());
+		// Commands are measured until their reply is queued
+		acknowledgeMessage(msg, success, result);
+		std::string name = c.substr(0, c.find_first_of(boost::string_view(" \0", 2))).to_string();
+		metrics.command(name).observe( std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count() );
+		return;
+	}
+
+	const std::string& ep = msg->getSourceAlias();
+	if(batchSize > 0) batchFact(m, "network " + ep);
+	else assertFact(m, "network " + ep);
+}
+
+
+/* ** ********************************************************
+*
+* Class methods: Clips wrappers
+*
+* *** *******************************************************/
+void ClipsEnvironment::assertFact(const boost::string_view& s, const std::string& fact, bool resetFactListChanged) {
+	std::string as = compose_fact(fact.empty() ? defaultMsgInFact : fact, s);
+	clips::assertString( as );
+	if(resetFactListChanged)
+		clips::setFactListChanged(0);
+	printf("Asserted string %s\n", as.c_str());
+}
+
+
+void ClipsEnvironment::batchFact(const boost::string_view& s, const std::string& fact){
+	if( factBatch.empty() ) batchStart = std::chrono::steady_clock::now();
+	factBatch.push_back( compose_fact(fact, s) );
+	if(factBatch.size() >= batchSize) flushFactBatch();
+}
+
+
+std::chrono::microseconds ClipsEnvironment::batchTimeLeft() const{
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - batchStart);
+	auto timeout = std::chrono::microseconds(batchTimeout);
+	return (elapsed < timeout) ? timeout - elapsed : std::chrono::microseconds(0);
+}
+
+
+void ClipsEnvironment::flushFactBatch(){
+	if( factBatch.empty() ) return;
+
+	for(const std::string& as : factBatch)
+		clips::assertString( as );
+	clips::setFactListChanged(0);
+	int fired = runCLIPS();
+
+	uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - batchStart).count();
+	batchStats.batches++;
+	batchStats.facts+= factBatch.size();
+	batchStats.fired+= fired;
+	batchStats.lastSize = factBatch.size();
+	batchStats.lastLatency = latency;
+	batchStats.totalLatency+= latency;
+	if(latency > batchStats.maxLatency) batchStats.maxLatency = latency;
+	printf("Asserted batch of %lu facts (%d rules fired in %luus)\n",
+		factBatch.size(), fired, latency);
+	factBatch.clear();
+}
+
+
+void ClipsEnvironment::clearCLIPS(){
+	clips::clear();
+	printf("KDB cleared (clear)\n");
+}
+
+
+void ClipsEnvironment::resetCLIPS(){
+	clips::reset();
+	printf("KDB reset (reset)\n");
+}
+
+
+bool ClipsEnvironment::sendCommand(std::string const& s){
+	printf("Executing command: %s\n", s.c_str());
+	return clips::sendCommand(s);
+}
+
+
+bool ClipsEnvironment::loadClp(const std::string& fpath){
+	printf("Loading file '%s'...\n", fpath.c_str() );
+	if( !clips::load( canonicalize_path(fpath) ) ){
+		printf("Error in file '%s' or does not exist\n", fpath.c_str());
+		return false;
+	}
+	printf("File %s loaded successfully\n", fpath.c_str());
+	return true;
+}
+
+
+bool ClipsEnvironment::loadDat(const std::string& fpath){
+	if( fpath.empty() ) return false;
+	std::ifstream fs;
+	fs.open( canonicalize_path(fpath) );
+
+	if( fs.fail() || !fs.is_open() ){
+		fprintf(stderr, "File '%s' does not exists\n", fpath.c_str());
+		return false;
+	}
+
+	bool err = false;
+	std::string line, fdir, fname;
+	std::string here = get_current_path();
+	split_path(fpath, fdir, fname);
+	if(!fdir.empty()) chdir(fdir.c_str());
+	printf("Loading '%s'...\n", fname.c_str());
+	while(!err && std::getline(fs, line) ){
+		if(line.empty()) continue;
+		if (!loadClp(line)) err = true;
+	}
+	fs.close();
+	chdir(here.c_str());
+	printf(err? "Aborted.\n" : "Done.");
+
+	return !err;
+}
+
+
+bool ClipsEnvironment::loadFile(std::string const& fpath){
+	// The working directory is shared by all environments
+	std::lock_guard<std::mutex> lock(server.pathMutex);
+	printf("Current path '%s'\n", get_current_path().c_str() );
+	if(ends_with(fpath, ".dat"))
+		return loadDat(fpath);
+	else if(ends_with(fpath, ".clp"))
+		return loadClp(fpath);
+	return false;
+}
+
+
+/* ** ********************************************************
+*
+* Class methods: Command handling
+*
+* *** *******************************************************/
+bool ClipsEnvironment::handleCommand(const std::string& c, std::string& result, SessionId source){
+	std::string cmd, arg;
+	splitCommand(c, cmd, arg);
+
+	if(cmd == "assert")     { clips::assertString(arg); return true; }
+	else if(cmd == "reset") { resetCLIPS();             return true; }
+	else if(cmd == "clear") { clearCLIPS();             return true; }
+	else if(cmd == "query") { return clips::query(arg, result); }
+	else if(cmd == "eval")  { return clips::eval(arg, result); }
+	else if(cmd == "find-facts") { return handleFindFacts(source, arg, result); }
+	else if(cmd == "subscribe")   { return handleSubscribe(source, arg, true); }
+	else if(cmd == "unsubscribe") { return handleSubscribe(source, arg, false); }
+	else if(cmd == "raw")   { return sendCommand(arg); }
+	else if(cmd == "path")  { return handlePath(arg); }
+	else if(cmd == "print") { return handlePrint(arg); }
+	else if(cmd == "watch") { return handleWatch(arg); }
+	else if(cmd == "load")  { return loadFile(arg); }
+	else if(cmd == "run")   { return handleRun(arg); }
+	else if(cmd == "stats") { return handleStats(source, arg, result); }
+	else if(cmd == "log")   { return handleLog(arg); }
+	else if(cmd == "metrics") { result = server.getMetrics(); return true; }
+	return false;
+}
+
+
+bool ClipsEnvironment::handleAssertBatch(const boost::string_view& arg, std::string& result){
+	uint32_t count, length;
+	if(arg.length() < 4) return false;
+	std::memcpy(&count, arg.data(), 4);
+	if(count > arg.length() / 4) return false;
+
+	result.assign((count + 7) / 8, 0);
+	bool success = true;
+	std::string fact;
+	size_t offset = 4;
+	for(uint32_t i = 0; i < count; ++i){
+		if(arg.length() - offset < 4) return false;
+		std::memcpy(&length, arg.data() + offset, 4);
+		offset+= 4;
+		if(arg.length() - offset < length) return false;
+		fact.assign(arg.data() + offset, length);
+		offset+= length;
+		if( clips::assertString(fact) ) result[i / 8]|= (char)(1 << (i % 8));
+		else success = false;
+	}
+	clips::setFactListChanged(0);
+	printf("Asserted batch of %u facts\n", count);
+	return success;
+}
+
+
+bool ClipsEnvironment::handleAssertTyped(const boost::string_view& arg){
+	size_t offset = 0;
+	uint8_t length, count;
+	std::string templateName;
+	if( !read_value(arg, offset, length) || !read_lexeme(arg, offset, length, templateName) )
+		return false;
+	if( !read_value(arg, offset, count) ) return false;
+
+	std::vector<clips::Slot> slots(count);
+	for(clips::Slot& slot : slots){
+		if( !read_value(arg, offset, length) || !read_lexeme(arg, offset, length, slot.name) )
+			return false;
+		if( !read_slot_value(arg, offset, slot.value) ) return false;
+	}
+	if(offset != arg.length()) return false;
+
+	bool success = clips::assertFact(templateName, slots);
+	clips::setFactListChanged(0);
+	printf("Asserted %s fact with %u slots\n", templateName.c_str(), count);
+	return success;
+}
+
+
+bool ClipsEnvironment::handleFindFacts(SessionId source, const std::string& arg, std::string& result){
+	std::istringstream iss(arg);
+	std::string templateName, size, test;
+	uint32_t pageSize;
+	int64_t token;
+	if( !(iss >> templateName >> size >> token) || !parse_uint(size, pageSize) || (token < 0) )
+		return false;
+	std::getline(iss >> std::ws, test);
+	pageSize = std::min(pageSize, MaxFindFactsPage);
+
+	// The reply must fit in a single v1 frame along with the
+	// 0x00 + 4byte CmdId + success byte prefix and the token
+	std::shared_ptr<Session> session = server.getSession(source);
+	size_t maxBytes = MaxFindFactsBytes;
+	if( !session || (session->getProtocolVersion() < 2) )
+		maxBytes = 0xffff - 2 - 6 - sizeof(token);
+
+	std::string page;
+	if( !clips::findFacts(templateName, test, pageSize, token, page, maxBytes) ) return false;
+	result.reserve(sizeof(token) + page.length());
+	result.assign((const char*)&token, sizeof(token));
+	result+= page;
+	return true;
+}
+
+
+bool ClipsEnvironment::handleSnapshot(const std::shared_ptr<TcpMessage>& msg, const std::string& arg, std::string& result){
+	uint32_t chunkSize = DefaultSnapshotChunk;
+	std::string opt = arg;
+	opt.erase(0, opt.find_first_not_of(' '));
+	if( !opt.empty() && !parse_uint(opt, chunkSize) ) return false;
+	chunkSize = std::min(std::max(chunkSize, MinSnapshotChunk), MaxSnapshotChunk);
+
+	// Chunks are tagged with the id of the command so the client can
+	// tell concurrent snapshots apart
+	static const std::string header("\0\xff\xff\xff\xff\x04", 6);
+	// Each chunk must fit in a single v1 frame along with the header
+	// and the CmdId
+	std::shared_ptr<Session> session = server.getSession(msg->getSource());
+	if( !session || (session->getProtocolVersion() < 2) )
+		chunkSize = std::min<uint32_t>(chunkSize, 0xffff - 2 - header.length() - 4);
+
+	std::string snapshot;
+	auto start = std::chrono::steady_clock::now();
+	int64_t count = clips::binarySaveFacts(snapshot, true);
+	if(count < 0) return false;
+
+	std::string chunk;
+	chunk.reserve(header.length() + 4 + std::min<size_t>(chunkSize, snapshot.length()));
+	for(size_t offset = 0; offset < snapshot.length(); offset+= chunkSize){
+		chunk.assign(header);
+		chunk.append(msg->getMessage().data() + 1, 4);
+		chunk.append(snapshot, offset, chunkSize);
+		if( !server.sendTo(msg->getSource(), chunk) ) return false;
+	}
+
+	uint64_t size = snapshot.length();
+	result.assign((const char*)&size, sizeof(size));
+	result.append((const char*)&count, sizeof(count));
+	printf("Sent snapshot of %ld facts (%lu bytes) in %ldus\n", (long)count, (unsigned long)size,
+		(long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	return true;
+}
+
+
+bool ClipsEnvironment::handleRestore(SessionId source, const boost::string_view& arg, std::string& result){
+	// Restores of clients that went silent without disconnecting
+	auto now = std::chrono::steady_clock::now();
+	for(auto it = restores.begin(); it != restores.end(); ){
+		auto next = std::next(it);
+		if(now - it->second.last > RestoreTimeout) dropRestore(it);
+		it = next;
+	}
+
+	if( arg.empty() ) return false;
+	uint8_t flags = (uint8_t)arg[0];
+	boost::string_view data = arg.substr(1);
+	auto it = restores.find(source);
+	if(flags & RestoreFlagFirst){
+		if(it != restores.end()) dropRestore(it);
+		it = restores.emplace(source, PendingRestore()).first;
+		++restoreCount;
+	}
+	else if(it == restores.end()) return false;
+
+	// The chunk is accounted before checking so that only what was
+	// added is subtracted when it is refused
+	PendingRestore& restore = it->second;
+	size_t total = restoreTotal.fetch_add(data.length()) + data.length();
+	if( (restore.data.length() + data.length() > MaxRestoreSize) || (total > MaxRestoreTotal) ){
+		restoreTotal-= data.length();
+		dropRestore(it);
+		return false;
+	}
+	restore.data.append(data.data(), data.length());
+	restore.last = now;
+
+	// A client that disconnected after being checked by sessionClosed()
+	// is no longer registered in the server
+	if( !server.getSession(source) ){
+		dropRestore(it);
+		return false;
+	}
+	if( !(flags & RestoreFlagLast) ) return true;
+
+	std::string snapshot;
+	restoreTotal-= restore.data.length();
+	snapshot.swap(restore.data);
+	dropRestore(it);
+	int64_t count = clips::binaryLoadFacts(snapshot);
+	clips::setFactListChanged(0);
+	if(count < 0) return false;
+	result.assign((const char*)&count, sizeof(count));
+	printf("Restored snapshot of %ld facts (%lu bytes)\n", (long)count, (unsigned long)snapshot.length());
+	return true;
+}
+
+
+void ClipsEnvironment::dropRestore(std::unordered_map<SessionId, PendingRestore>::iterator it){
+	restoreTotal-= it->second.data.length();
+	restores.erase(it);
+	--restoreCount;
+}
+
+
+void ClipsEnvironment::dropClosedRestores(){
+	std::vector<SessionId> closed;
+	{std::lock_guard<std::mutex> lock(closedSessionsMutex);
+		closed.swap(closedSessions);
+	}
+	for(SessionId id : closed){
+		auto it = restores.find(id);
+		if(it != restores.end()) dropRestore(it);
+	}
+}
+
+
+bool ClipsEnvironment::handleSubscribe(SessionId source, const std::string& arg, bool subscribe){
+	clips::FactFeed& feed = clips::FactFeed::getInstance();
+	// Subscribers are named after the session id, which sendTo accepts
+	std::string subscriber = std::to_string(source);
+	if(!subscribe){
+		feed.unsubscribe(subscriber, arg);
+		return true;
+	}
+	if( arg.empty() || (arg.find_first_of(" \t") != std::string::npos) ) return false;
+	feed.subscribe(subscriber, arg);
+	printf("Client %u subscribed to %s facts\n", source, arg.c_str());
+	return true;
+}
+
+
+bool ClipsEnvironment::handleLog(const std::string& arg){
+	return true;
+}
+
+
+bool ClipsEnvironment::handlePath(const std::string& path){
+	{std::lock_guard<std::mutex> lock(server.pathMutex);
+		std::string cpath = canonicalize_path(path);
+		if(chdir( cpath.c_str() ) != 0){
+			fprintf(stderr, "Can't access {%s}: %s\n", path.c_str(), std::strerror(errno));
+			printf("Reset clppath to {%s}\n", server.getClpPath().c_str() );
+			return false;
+		}
+		server.setClpPath(cpath);
+		printf("clppath set to {%s}\n", cpath.c_str() );
+	}
+	publishStatus();
+	return true;
+}
+
+
+bool ClipsEnvironment::handlePrint(const std::string& arg){
+	if(arg == "facts"){       clips::printFacts();  }
+	else if(arg == "rules"){  clips::printRules();  }
+	else if(arg == "agenda"){ clips::printAgenda(); }
+	else return false;
+	return true;
+}
+
+
+int ClipsEnvironment::handleRun(const std::string& arg){
+	int n = std::stoi(arg);
+	return runCLIPS(n);
+}
+
+
+int ClipsEnvironment::runCLIPS(int maxRules){
+	auto start = std::chrono::steady_clock::now();
+	int fired = clips::run(maxRules);
+	metrics.runDuration.observe( std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count() );
+	if(fired > 0) metrics.rulesFired+= fired;
+	return fired;
+}
+
+
+bool ClipsEnvironment::handleStats(SessionId source, const std::string& arg, std::string& result){
+	if(arg == "batch"){
+		const BatchStats& bs = batchStats;
+		uint64_t n = bs.batches ? bs.batches : 1;
+		result = "batches:"      + std::to_string(bs.batches)
+		       + "|facts:"       + std::to_string(bs.facts)
+		       + "|fired:"       + std::to_string(bs.fired)
+		       + "|size:"        + std::to_string(bs.lastSize)
+		       + "|avg-size:"    + std::to_string(bs.facts / n)
+		       + "|latency:"     + std::to_string(bs.lastLatency)
+		       + "|avg-latency:" + std::to_string(bs.totalLatency / n)
+		       + "|max-latency:" + std::to_string(bs.maxLatency);
+		return true;
+	}
+	std::string what, opt;
+	splitCommand(arg, what, opt);
+	if(what == "rules") return handleRuleStats(source, opt, result);
+	return false;
+}
+
+
+bool ClipsEnvironment::handleRuleStats(SessionId source, const std::string& arg, std::string& result){
+	clips::RuleStats& stats = clips::RuleStats::getInstance();
+	std::string opt, value;
+	splitCommand(arg, opt, value);
+	uint32_t n = 0;
+
+	if( opt.empty() || parse_uint(opt, n) ){
+		stats.enable();
+		result = clips::RuleStats::toTable(stats.getStats(), n);
+		return true;
+	}
+	else if(opt == "reset"){
+		stats.reset();
+		return true;
+	}
+	else if(opt == "off"){
+		stats.disable();
+		ruleStatsStreams.clear();
+		return true;
+	}
+	else if(opt != "stream") return false;
+
+	if(value == "off"){
+		ruleStatsStreams.erase(source);
+		return true;
+	}
+	if( !parse_uint(value, n) || (n < MinRuleStatsInterval) ) return false;
+	stats.enable();
+	RuleStatsStream& stream = ruleStatsStreams[source];
+	stream.interval = std::chrono::milliseconds(n);
+	stream.next = std::chrono::steady_clock::now() + stream.interval;
+	stream.sequence = stats.getSequence();
+	printf("Client %u subscribed to rule statistics every %ums\n", source, n);
+	return true;
+}
+
+
+bool ClipsEnvironment::handleWatch(const std::string& arg){
+	if(arg == "functions"){    clips::toggleWatch(clips::WatchItem::Deffunctions); }
+	else if(arg == "globals"){ clips::toggleWatch(clips::WatchItem::Globals);      }
+	else if(arg == "facts"){   clips::toggleWatch(clips::WatchItem::Facts);        }
+	else if(arg == "rules"){   clips::toggleWatch(clips::WatchItem::Rules);        }
+	else if( !arg.empty() ) return false;
+	watches = (int)clips::getWatches();
+	publishStatus();
+	return true;
+}
+
+
+void ClipsEnvironment::acknowledgeMessage(std::shared_ptr<TcpMessage> message, bool success, const std::string& result){
+	// 1. Copy 5bytes 0x00+CommandID from original message. Discard the rest.
+	// 2. Place success as 1byte boolean
+	// 3. Append result if any.
+	// 4. Send
+
+	std::string ack = message->getMessage().substr(0, 5).to_string();
+	ack+= success ? '\x01' : '\x00';
+	ack+= result;
+
+	server.sendTo(message->getSource(), ack);
+}
+
+
+/* ** ********************************************************
+*
+* Class methods: Communication
+*
+* *** *******************************************************/
+std::string ClipsEnvironment::getStatus() const{
+	std::string status;
+	status+= '\0';
+	status+= "\xff\xff\xff\xff\x01watching:" + std::to_string(watches.load());
+	status+= "|path:" + server.getClpPath();
+	return status;
+}
+
+
+bool ClipsEnvironment::publishStatus(){
+	return server.broadcast(getStatus(), this);
+}
+
+
+std::chrono::microseconds ClipsEnvironment::ruleStatsTimeLeft() const{
+	auto now = std::chrono::steady_clock::now();
+	auto next = std::chrono::steady_clock::time_point::max();
+	for(const auto& kv : ruleStatsStreams)
+		if(kv.second.next < next) next = kv.second.next;
+	if(next <= now) return std::chrono::microseconds(0);
+	return std::chrono::duration_cast<std::chrono::microseconds>(next - now);
+}
+
+
+void ClipsEnvironment::publishRuleStats(){
+	if( ruleStatsStreams.empty() ) return;
+
+	static const std::string header("\0\xff\xff\xff\xff\x03", 6);
+	clips::RuleStats& stats = clips::RuleStats::getInstance();
+	auto now = std::chrono::steady_clock::now();
+	uint64_t sequence = stats.getSequence();
+	std::string message;
+	for(auto it = ruleStatsStreams.begin(); it != ruleStatsStreams.end(); ){
+		RuleStatsStream& stream = it->second;
+		// Nothing is sent when no rules fired since the last sample
+		if( (now < stream.next) || (stream.sequence == sequence) ){
+			if(now >= stream.next) stream.next = now + stream.interval;
+			++it;
+			continue;
+		}
+		message.assign(header);
+		message+= clips::RuleStats::toTable(stats.getStats(stream.sequence));
+		stream.sequence = sequence;
+		stream.next = now + stream.interval;
+		if( server.sendTo(it->first, message) ) ++it;
+		else it = ruleStatsStreams.erase(it);
+	}
+}
+
+
+void ClipsEnvironment::publishFactChanges(){
+	clips::FactFeed& feed = clips::FactFeed::getInstance();
+	if( !feed.hasChanges() ) return;
+
+	static const std::string header("\0\xff\xff\xff\xff\x02", 6);
+	std::string message;
+	feed.flush([&](const std::string& subscriber, const std::string& changes){
+		message.reserve(header.length() + changes.length());
+		message.assign(header);
+		message+= changes;
+		return server.sendTo(subscriber, message);
+	});
+}
@@ -0,0 +1,730 @@
+/* ** *****************************************************************
+* clips_environment.h
+*
+* Author: Mauricio Matamoros
+*
+* ** *****************************************************************/
+/** @file clips_environment.h
+ * Definition of the ClipsEnvironment class: a named CLIPS environment
+ * hosted by the server and running on its own worker thread.
+ */
+
+#ifndef __CLIPS_ENVIRONMENT_H__
+#define __CLIPS_ENVIRONMENT_H__
+#pragma once
+
+/** @cond */
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include <boost/utility/string_view.hpp>
+/** @endcond */
+
+#include "metrics.h"
+#include "tcp_message.h"
+#include "ingress_queue.h"
+
+
+class Server;
+
+/**
+ * Accumulated statistics of the fact batching stage
+ */
+struct BatchStats{
+	/**
+	 * Number of batches asserted so far
+	 */
+	uint64_t batches = 0;
+	/**
+	 * Number of facts asserted through batches so far
+	 */
+	uint64_t facts = 0;
+	/**
+	 * Number of rules fired by the batches
+	 */
+	uint64_t fired = 0;
+	/**
+	 * Size of the last asserted batch
+	 */
+	size_t lastSize = 0;
+	/**
+	 * Time elapsed between the arrival of the first fact of the last
+	 * batch and the end of its run, in microseconds
+	 */
+	uint64_t lastLatency = 0;
+	/**
+	 * Largest batch latency observed, in microseconds
+	 */
+	uint64_t maxLatency = 0;
+	/**
+	 * Sum of all batch latencies, in microseconds
+	 */
+	uint64_t totalLatency = 0;
+};
+
+
+/**
+ * A client receiving periodic rule statistics
+ */
+struct RuleStatsStream{
+	/**
+	 * Time between samples
+	 */
+	std::chrono::milliseconds interval;
+	/**
+	 * When the next sample is due
+	 */
+	std::chrono::steady_clock::time_point next;
+	/**
+	 * Rule firing sequence number of the last sample sent
+	 * (see clips::RuleStats::getSequence())
+	 */
+	uint64_t sequence;
+};
+
+
+/**
+ * A fact snapshot being uploaded by a client in chunks
+ */
+struct PendingRestore{
+	/**
+	 * The chunks received so far
+	 */
+	std::string data;
+	/**
+	 * Arrival time of the last chunk
+	 */
+	std::chrono::steady_clock::time_point last;
+};
+
+
+/**
+ * Implements a named CLIPS environment hosted by the server.
+ * Each environment owns a CLIPS environment and a message queue, and
+ * runs on its own worker thread: the only thread allowed to enter its
+ * CLIPS environment. Sessions bound to the environment enqueue their
+ * messages, which the worker thread drains and parses in arrival order.
+ */
+class ClipsEnvironment{
+public:
+	/**
+	 * Initializes a new instance of ClipsEnvironment
+	 * @param name   The name of the environment
+	 * @param server The server that hosts the environment
+	 */
+	ClipsEnvironment(const std::string& name, Server& server);
+	~ClipsEnvironment();
+
+	// Disable copy constructor and assignment op.
+private:
+	/**
+	 * Copy constructor disabled
+	 */
+	ClipsEnvironment(ClipsEnvironment const& obj)        = delete;
+	/**
+	 * Copy assignment operator disabled
+	 */
+	ClipsEnvironment& operator=(ClipsEnvironment const&) = delete;
+
+
+public:
+	/**
+	 * Gets the name of the environment
+	 * @return The name of the environment
+	 */
+	const std::string& getName() const;
+
+	/**
+	 * Sets the batching parameters. Must be called before start().
+	 * @param batchSize    Maximum number of network facts asserted per
+	 *                     batch. Zero disables batching.
+	 * @param batchTimeout Maximum time in microseconds a fact waits in
+	 *                     the batch. Zero flushes the batch every time
+	 *                     the message queue is drained.
+	 */
+	void setBatching(size_t batchSize, uint32_t batchTimeout);
+
+	/**
+	 * Sets the limits of the message queue (see IngressQueue)
+	 * @param capacity Maximum number of messages queued in total
+	 * @param quota    Maximum number of messages queued per session
+	 */
+	void setIngressLimits(size_t capacity, size_t quota);
+
+	/**
+	 * Starts the worker thread, which initializes CLIPS and then
+	 * dispatches the enqueued messages until stop() is called.
+	 * @param clipsFile  Optional. File to load upon initialization.
+	 * @param watchFacts Optional. When true, activates fact watching
+	 *                   during initialization.
+	 * @param watchRules Optional. When true, activates defrule watching
+	 *                   during initialization.
+	 * @param argc       Optional. The main's argc, rerouted to CLIPS.
+	 * @param argv       Optional. The main's argv, rerouted to CLIPS.
+	 */
+	void start(const std::string& clipsFile = "", bool watchFacts = false, bool watchRules = false,
+		int argc = 0, char** argv = NULL);
+
+	/**
+	 * Stops the worker thread, discarding pending messages.
+	 * The CLIPS environment is destroyed along with the thread.
+	 */
+	void stop();
+
+	/**
+	 * Enqueues a received TCP message in the environment's message queue
+	 * @param  messagePtr A pointer to the received message
+	 * @param  source     The ingress state of the session
+	 * @return            Whether the message was queued, and whether the
+	 *                    session must stop reading (see deferResume())
+	 */
+	IngressQueue::Admission enqueueTcpMessage(std::shared_ptr<TcpMessage> messagePtr,
+		const std::shared_ptr<IngressQueue::Source>& source);
+
+	/**
+	 * Registers the function that resumes a session asked to stop
+	 * reading by enqueueTcpMessage()
+	 * @param  source The ingress state of the session
+	 * @param  resume The function that resumes reading, called from
+	 *                the worker thread
+	 * @return        true if the function was registered, false if the
+	 *                session must not stop reading
+	 */
+	bool deferResume(const std::shared_ptr<IngressQueue::Source>& source, std::function<void()> resume);
+
+	/**
+	 * Notifies the environment that a session disconnected, so the
+	 * partial restore it may have left is released.
+	 * Safe to call from any thread.
+	 * @param id The id of the session
+	 */
+	void sessionClosed(SessionId id);
+
+	/**
+	 * Gets the status message of the environment, as published to
+	 * its sessions. Safe to call from any thread.
+	 * @return The status message
+	 */
+	std::string getStatus() const;
+
+	/**
+	 * Gets the metrics of the environment. Safe to read from any thread.
+	 * @return The metrics of the environment
+	 */
+	const EnvironmentMetrics& getMetrics() const;
+
+	/**
+	 * Gets the number of messages waiting in the queue
+	 * @return The number of messages waiting to be dispatched
+	 */
+	size_t getQueueSize();
+
+	/**
+	 * Gets the number of messages discarded due to overload
+	 */
+	uint64_t getDroppedMessages() const;
+
+	/**
+	 * Gets the number of times a session was asked to stop reading
+	 */
+	uint64_t getDeferredReads() const;
+
+	/**
+	 * Gets the environment running on the calling thread
+	 * @return The environment running on the calling thread,
+	 *         or NULL if called outside a worker thread
+	 */
+	static ClipsEnvironment* current();
+
+
+private:
+	/**
+	 * Worker thread main loop.
+	 * Sleeps on the queue until messages arrive, the current batch
+	 * expires, or rule statistics are due, then dispatches the pending
+	 * messages (up to MaxDispatch at once, taken in turns from each
+	 * session).
+	 */
+	void run();
+
+	/**
+	 * Initializes CLIPS.
+	 * It calls clips::initialize(), clips::rerouteStdin(argc, argv)
+	 * and clips::clear() in that order, registers the server's user
+	 * functions, and loads the file specified by clipsFile.
+	 */
+	void initCLIPS();
+
+	/**
+	 * Parses messages received via network.
+	 * Two types of messages are accepted: facts and commands.
+	 * Any non-command string is considered a fact and thus is asserted
+	 * with assertFact().
+	 * Commands are strings that start with a NULL character ('\\0').
+	 * When batching is enabled facts are accumulated and asserted
+	 * with flushFactBatch() instead.
+	 * The following commands are supported:
+	 * assert      calls clips::assertString()
+	 * reset       calls clips::reset()
+	 * clear       calls clips::clear()
+	 * raw         Injects a code via sendCommand()
+	 * query expr  Runs expr capturing its output (see clips::query())
+	 * eval expr   Evaluates expr replying its binary encoded value
+	 *             (see clips::eval())
+	 * find-facts  Replies a page of matching facts (see handleFindFacts())
+	 * subscribe t    Pushes the changes of the facts of t (see publishFactChanges())
+	 * unsubscribe t  Stops pushing the changes of t, or of all if omitted
+	 * print what  Prints facts, rules or agenda
+	 * watch what  Toggles the specified watches
+	 * load  file  Loads the specified file
+	 * run num     Performs the specified number of runs
+	 * stats what  Reports statistics (batch, rules; see handleStats())
+	 * metrics     Replies the metrics of the server (see Server::getMetrics())
+	 * log         Unimplemented
+	 * assert-batch facts  Asserts many facts (see handleAssertBatch())
+	 * assert-typed fact   Asserts a typed template fact (see handleAssertTyped())
+	 * snapshot [size]     Streams the facts in binary format (see handleSnapshot())
+	 * restore chunk       Loads facts streamed in binary format (see handleRestore())
+	 *
+	 * @param msg  The received message
+	 */
+	void parseMessage(std::shared_ptr<TcpMessage> msg);
+
+	/**
+	 * Asserts the input string as a fact as (assert (network s))
+	 * @param s                    The string to be asserted
+	 * @param fact                 Optional. The fact under which \p s
+	 *                             will be asserted. When empty it
+	 *                             defaults to whatever defaultMsgInFact
+	 *                             is set. Default: an empty string.
+	 * @param resetFactListChanged Optional. When true
+	 *                             clips::setFactListChanged(0) is reset,
+	 *                             telling clips that no changes to the
+	 *                             facts list have been done.
+	 *                             Default: true
+	 */
+	void assertFact(const boost::string_view& s, const std::string& fact = "", bool resetFactListChanged = true);
+
+	/**
+	 * Adds a fact received via network to the current batch.
+	 * The batch is flushed when it reaches batchSize facts or
+	 * batchTimeout microseconds after its first fact arrived.
+	 * @param s    The string to be asserted
+	 * @param fact The fact under which \p s will be asserted
+	 */
+	void batchFact(const boost::string_view& s, const std::string& fact);
+
+	/**
+	 * Asserts all facts in the current batch in a single pass and
+	 * then calls clips::run() once, updating the batch statistics.
+	 * Does nothing if the batch is empty.
+	 */
+	void flushFactBatch();
+
+	/**
+	 * Gets the time left before the current batch must be flushed
+	 * @return The time left, zero if the batch is due
+	 */
+	std::chrono::microseconds batchTimeLeft() const;
+
+	/**
+	 * Acknowledges reception/excecution of a message
+	 * @param message   The message to acknowledge
+	 * @param success   Optional. Indicates whether the command contained in the message
+	 *                  was successfully executed. Default: true.
+	 * @param response  Optional. Contains the execution result of the command contained
+	 *                  in the message, if any. Default: an empty string.
+	 */
+	void acknowledgeMessage(std::shared_ptr<TcpMessage> message, bool success=true, const std::string& result = "");
+
+	/**
+	 * Handles commands received via network
+	 * @param c      The received command message
+	 * @param result When this method returns contains the result of
+	 *               the command, if any
+	 * @param source The session of the client that sent the command
+	 */
+	bool handleCommand(const std::string& c, std::string& result, SessionId source);
+
+	/**
+	 * Handles bulk assert commands received via network.
+	 * The argument is a 4-byte little-endian fact count followed by
+	 * each fact as a 4-byte little-endian length and the fact itself.
+	 * @param arg    The encoded facts
+	 * @param result When this method returns contains one success bit
+	 *               per fact, least significant bit first
+	 * @return       true if all facts were asserted, false otherwise
+	 */
+	bool handleAssertBatch(const boost::string_view& arg, std::string& result);
+
+	/**
+	 * Handles typed template fact asserts received via network.
+	 * Slots are filled with clips::assertFact(), so nothing is parsed
+	 * by CLIPS. The argument is encoded as follows (little-endian):
+	 *   uint8 name length, deftemplate name,
+	 *   uint8 slot count and, for each slot,
+	 *   uint8 name length, slot name, and a value made of
+	 *   uint8 type (see clips::SlotValue::Type) followed by
+	 *     Integer:                       int64
+	 *     Float:                         IEEE 754 double
+	 *     Symbol, String, InstanceName:  uint32 length and the bytes
+	 *     Multifield:                    uint32 count and the values
+	 * @param arg The encoded fact
+	 * @return    true if the fact was asserted, false otherwise
+	 */
+	bool handleAssertTyped(const boost::string_view& arg);
+
+	/**
+	 * Handles fact snapshot requests received via network.
+	 * The facts are saved in the binary format of bsave-facts (see
+	 * clips::binarySaveFacts()) and pushed to the client in chunks of
+	 * at most size bytes (1MiB by default), so snapshots are not bound
+	 * to the size of a single message. Each chunk is a status message
+	 * whose flag byte is 0x04 followed by the 4-byte id of the
+	 * snapshot command and the data. All chunks are sent before the
+	 * reply. Chunks sent to clients without protocol v2 are bound to
+	 * the size of a 64kB frame.
+	 * @param msg    The received command message
+	 * @param arg    The chunk size, optional
+	 * @param result When this method returns contains the uint64 size
+	 *               of the snapshot followed by the int64 number of
+	 *               facts saved (little-endian)
+	 * @return       true if the snapshot was sent, false otherwise
+	 */
+	bool handleSnapshot(const std::shared_ptr<TcpMessage>& msg, const std::string& arg, std::string& result);
+
+	/**
+	 * Handles fact restore chunks received via network.
+	 * The argument is a flags byte followed by the next chunk of a
+	 * snapshot (see handleSnapshot()). Flag 0x01 starts a new restore,
+	 * discarding any partial one of the client, and flag 0x02 marks
+	 * the last chunk, upon which the facts are loaded with
+	 * clips::binaryLoadFacts(). Facts already asserted are kept.
+	 * Partial restores are discarded when their client disconnects or
+	 * when idle for RestoreTimeout. Chunks are refused past
+	 * MaxRestoreSize per client, or MaxRestoreTotal across all of them.
+	 * @param source The session of the client
+	 * @param arg    The flags and the chunk
+	 * @param result When this method returns after the last chunk,
+	 *               contains the int64 number of facts loaded
+	 * @return       true if the chunk was accepted and, if last, the
+	 *               facts were loaded, false otherwise
+	 */
+	bool handleRestore(SessionId source, const boost::string_view& arg, std::string& result);
+
+	/**
+	 * Discards a partial restore
+	 * @param it The restore
+	 */
+	void dropRestore(std::unordered_map<SessionId, PendingRestore>::iterator it);
+
+	/**
+	 * Discards the partial restores of the sessions notified to
+	 * sessionClosed()
+	 */
+	void dropClosedRestores();
+
+	/**
+	 * Handles paged fact-set queries received via network.
+	 * The argument is: template page-size token [test]
+	 * where token is zero for the first page and the value replied
+	 * with the previous page otherwise. The test is optional and
+	 * refers to the fact as ?f (see clips::findFacts()).
+	 * Facts are encoded as they are found, so only one page is ever
+	 * held in memory. Pages hold up to MaxFindFactsPage facts and are
+	 * cut short to fit in a single frame for v1 clients, or at
+	 * MaxFindFactsBytes for v2 clients.
+	 * @param source The session of the client
+	 * @param arg    The query
+	 * @param result When this method returns contains the int64
+	 *               (little-endian) token for the next page, zero
+	 *               when there are no more facts, followed by the
+	 *               page encoded as a Multifield of Fact values
+	 * @return       true if the query was performed, false otherwise
+	 */
+	bool handleFindFacts(SessionId source, const std::string& arg, std::string& result);
+
+	/**
+	 * Handles fact-change subscription commands received via network
+	 * @param source    The session of the client
+	 * @param arg       The deftemplate, or * for all facts
+	 * @param subscribe true to subscribe, false to unsubscribe
+	 */
+	bool handleSubscribe(SessionId source, const std::string& arg, bool subscribe);
+
+	/**
+	 * Unimplemented
+	 * @param arg Unimplemented
+	 */
+	bool handleLog(const std::string& arg);
+
+	/**
+	 * Handles path request commands received via network
+	 * @param path The path where CLP files are
+	 */
+	bool handlePath(const std::string& path);
+
+	/**
+	 * Handles print request commands received via network
+	 * @param arg What to print. Accepted values are facts, rules
+	 *            and agenda.
+	 */
+	bool handlePrint(const std::string& arg);
+
+	/**
+	 * Handles run request commands received via network.
+	 * On a successful parsing of the argument performs clips::run(arg)
+	 * @param arg A string representation of an integer specifying
+	 *            the maximum number of run steps to perform
+	 */
+	int handleRun(const std::string& arg);
+
+	/**
+	 * Handles statistics request commands received via network
+	 * @param source The session of the client
+	 * @param arg    What to report. Accepted values are: batch, and
+	 *               rules followed by its options (see handleRuleStats())
+	 * @param result When this method returns contains the requested
+	 *               statistics
+	 */
+	bool handleStats(SessionId source, const std::string& arg, std::string& result);
+
+	/**
+	 * Handles rule statistics commands received via network.
+	 * Recording starts with the first request. Options are:
+	 *   (none) or N  Replies the statistics of all rules, or of the N
+	 *                rules with the longest total RHS time, as a table
+	 *                (see clips::RuleStats::toTable())
+	 *   reset        Clears the statistics
+	 *   off          Stops recording and all streams
+	 *   stream ms    Pushes to the client, every ms milliseconds (100
+	 *                at least), the statistics of the rules fired
+	 *                since the previous push (see publishRuleStats())
+	 *   stream off   Stops pushing statistics to the client
+	 * @param source The session of the client
+	 * @param arg    The options
+	 * @param result When this method returns contains the table
+	 */
+	bool handleRuleStats(SessionId source, const std::string& arg, std::string& result);
+
+	/**
+	 * Calls clips::run() measuring its duration and the rules fired
+	 * @param  maxRules Maximum number of rules to fire. -1 fires all.
+	 * @return          The number of rules fired
+	 */
+	int runCLIPS(int maxRules = -1);
+
+	/**
+	 * Handles toggle-watch request commands received via network.
+	 * On a successful parsing of the argument toggles the watching
+	 * of functions, globals, facts or rules
+	 * @param arg A string specifying which watch shall be toggled
+	 */
+	bool handleWatch(const std::string& arg);
+
+	/**
+	 * Injects a command into CLIPS by calling clisp::sendCommand(s)
+	 * @param s The CLIPS command to be injected
+	 */
+	bool sendCommand(std::string const& s);
+
+	/**
+	 * Clears CLIPS by calling clips::clear()
+	 */
+	void clearCLIPS();
+
+	/**
+	 * Resets CLIPS by calling clips::reset()
+	 */
+	void resetCLIPS();
+
+	/**
+	 * Loads a file
+	 * @remark       Works only with clp or dat file extensions.
+	 *               A dat file contains several clp files.
+	 * @param  fpath The path of the file to load
+	 * @return       true if the file was loaded successfully, false otherwise
+	 */
+	bool loadFile(std::string const& fpath);
+
+	/**
+	 * Loads a clp file
+	 * @param  fpath The path of the file to load
+	 * @return       true if the file was loaded successfully, false otherwise
+	 */
+	bool loadClp(std::string const& fpath);
+
+	/**
+	 * Loads a dat file
+	 * @param  fpath The path of the file to load
+	 * @return       true if the file was loaded successfully, false otherwise
+	 */
+	bool loadDat(std::string const& fpath);
+
+	/**
+	 * Publishes the status of the environment to its sessions
+	 * @return         true if the status was successfully published,
+	 *                 false otherwise
+	 */
+	bool publishStatus();
+
+	/**
+	 * Pushes to each subscribed client the fact changes made since
+	 * the last call, coalesced (see clips::FactFeed). Called once all
+	 * queued messages have been processed.
+	 * Changes are sent as status messages whose flag byte is 0x02,
+	 * followed by the changes encoded by clips::FactFeed::flush().
+	 */
+	void publishFactChanges();
+
+	/**
+	 * Pushes to each client streaming rule statistics whose sample is
+	 * due the statistics of the rules fired since its previous sample.
+	 * Nothing is sent when no rules fired. Statistics are sent as
+	 * status messages whose flag byte is 0x03 followed by the table.
+	 */
+	void publishRuleStats();
+
+	/**
+	 * Gets the time left before the next rule statistics sample is due
+	 * @return The time left, zero if a sample is due
+	 */
+	std::chrono::microseconds ruleStatsTimeLeft() const;
+
+
+private:
+	/**
+	 * The name of the environment
+	 */
+	std::string name;
+
+	/**
+	 * The server that hosts the environment
+	 */
+	Server& server;
+
+	/**
+	 * Stores the file that will be loaded into CLIPS during
+	 * initialization.
+	 */
+	std::string clipsFile;
+
+	/**
+	 * When true, activates fact watching during initialization
+	 */
+	bool flgFacts;
+
+	/**
+	 * When true, activates defrule watching during initialization
+	 */
+	bool flgRules;
+
+	/**
+	 * The main's argc, rerouted to CLIPS during initialization
+	 */
+	int argc;
+
+	/**
+	 * The main's argv, rerouted to CLIPS during initialization
+	 */
+	char** argv;
+
+	/**
+	 * Internal flag that keeps the worker thread running
+	 */
+	std::atomic<bool> running;
+
+	/**
+	 * The worker thread, the only one that enters CLIPS
+	 */
+	std::thread worker;
+
+	/**
+	 * The bounded queue used to pass messages to CLIPS.
+	 * Interrupting it wakes up the worker thread.
+	 */
+	IngressQueue queue;
+
+	/**
+	 * Messages drained from the queue awaiting to be parsed.
+	 * Kept as member to reuse its storage between dispatches.
+	 */
+	std::vector<std::shared_ptr<TcpMessage>> pending;
+
+	/**
+	 * Current CLIPS watches, cached for the status message
+	 */
+	std::atomic<int> watches;
+
+	/**
+	 * Stores the name of the fact where network messages are asserted.
+	 */
+	std::string defaultMsgInFact;
+
+	/**
+	 * Maximum number of network facts asserted per batch.
+	 * Zero disables batching, asserting each fact upon arrival.
+	 */
+	size_t batchSize;
+
+	/**
+	 * Maximum time in microseconds a fact waits in the batch before
+	 * the batch is flushed. Zero flushes the batch every time the
+	 * message queue is drained.
+	 */
+	uint32_t batchTimeout;
+
+	/**
+	 * Facts awaiting to be asserted
+	 */
+	std::vector<std::string> factBatch;
+
+	/**
+	 * Arrival time of the first fact of the current batch
+	 */
+	std::chrono::steady_clock::time_point batchStart;
+
+	/**
+	 * Statistics of the fact batching stage
+	 */
+	BatchStats batchStats;
+
+	/**
+	 * Clients receiving rule statistics, indexed by session
+	 */
+	std::unordered_map<SessionId, RuleStatsStream> ruleStatsStreams;
+
+	/**
+	 * Snapshots being restored, indexed by session
+	 */
+	std::unordered_map<SessionId, PendingRestore> restores;
+
+	/**
+	 * Number of partial restores, read by sessionClosed() to skip
+	 * waking up the worker thread when there are none
+	 */
+	std::atomic<size_t> restoreCount;
+
+	/**
+	 * Sessions that disconnected with partial restores pending
+	 */
+	std::vector<SessionId> closedSessions;
+
+	/**
+	 * Mutex for closedSessions
+	 */
+	std::mutex closedSessionsMutex;
+
+	/**
+	 * Metrics of the environment
+	 */
+	EnvironmentMetrics metrics;
+};
+
+#endif // __CLIPS_ENVIRONMENT_H__
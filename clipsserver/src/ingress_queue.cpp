@@ -0,0 +1,170 @@
+#include "ingress_queue.h"
+
+#include <algorithm>
+
+
+/* ** ********************************************************
+* Local helpers
+* *** *******************************************************/
+/**
+ * Commands start with a null character and expect a reply
+ */
+static inline
+bool is_command(const std::shared_ptr<TcpMessage>& msg){
+	boost::string_view m = msg->getMessage();
+	return !m.empty() && (m[0] == 0);
+}
+
+
+/* ** ********************************************************
+* Constructors
+* *** *******************************************************/
+IngressQueue::Source::Source() : queued(0), paused(false){}
+
+
+IngressQueue::IngressQueue(size_t capacity, size_t quota):
+	total(0), dropped(0), deferred(0){
+	setLimits(capacity, quota);
+}
+
+
+/* ** ********************************************************
+* Class methods: Producers
+* *** *******************************************************/
+void IngressQueue::setLimits(size_t capacity, size_t quota){
+	// A single source must not be able to fill the queue
+	if(!capacity) capacity = 1;
+	this->capacity = capacity;
+	this->quota = std::max<size_t>(1, std::min(quota, capacity / 2));
+}
+
+
+IngressQueue::Admission IngressQueue::produce(const std::shared_ptr<TcpMessage>& msg, const std::shared_ptr<Source>& source){
+	size_t capacity = this->capacity.load(std::memory_order_relaxed);
+	// Facts are shed under overload. Commands are always queued since
+	// their senders await a reply.
+	if( (total.load(std::memory_order_relaxed) >= capacity) && !is_command(msg) ){
+		++dropped;
+		return Admission::Dropped;
+	}
+
+	size_t queued = ++source->queued;
+	size_t count = ++total;
+	inbox.produce( Entry{msg, source} );
+	if( (queued < quota.load(std::memory_order_relaxed)) && (count < capacity) )
+		return Admission::Accepted;
+	++deferred;
+	return Admission::Paused;
+}
+
+
+bool IngressQueue::deferResume(const std::shared_ptr<Source>& source, std::function<void()> resume){
+	source->resume = std::move(resume);
+	source->paused.store(true);
+	// The consumer may have drained the source meanwhile. Whoever clears
+	// the flag first takes the function.
+	if( canResume(*source) && source->paused.exchange(false) ){
+		source->resume = nullptr;
+		return false;
+	}
+	// Let the consumer know, since the source may have nothing queued
+	inbox.produce( Entry{nullptr, source} );
+	return true;
+}
+
+
+void IngressQueue::interrupt(){
+	inbox.interrupt();
+}
+
+
+size_t IngressQueue::size() const{
+	return total.load(std::memory_order_relaxed);
+}
+
+
+uint64_t IngressQueue::getDropped() const{
+	return dropped;
+}
+
+
+uint64_t IngressQueue::getDeferred() const{
+	return deferred;
+}
+
+
+bool IngressQueue::canResume(const Source& s) const{
+	return (s.queued.load() <= quota.load(std::memory_order_relaxed) / 2) &&
+		(total.load() < capacity.load(std::memory_order_relaxed));
+}
+
+
+/* ** ********************************************************
+* Class methods: Consumer
+* *** *******************************************************/
+size_t IngressQueue::consume(std::vector<std::shared_ptr<TcpMessage>>& out, size_t max){
+	// Backlogged messages are served without waiting
+	if( ring.empty() ) inbox.consume(received, SIZE_MAX);
+	else inbox.tryConsume(received, SIZE_MAX);
+	sort(received);
+	return drain(out, max);
+}
+
+
+size_t IngressQueue::timedConsume(std::vector<std::shared_ptr<TcpMessage>>& out, size_t max,
+	const std::chrono::microseconds& timeout){
+	if( ring.empty() ) inbox.timedConsume(received, SIZE_MAX, timeout);
+	else inbox.tryConsume(received, SIZE_MAX);
+	sort(received);
+	return drain(out, max);
+}
+
+
+void IngressQueue::sort(std::vector<Entry>& entries){
+	for(Entry& e : entries){
+		if(!e.msg){
+			paused.push_back( std::move(e.source) );
+			continue;
+		}
+		Backlog& b = backlogs[e.source.get()];
+		if( b.messages.empty() ){
+			b.source = std::move(e.source);
+			ring.push_back(&b);
+		}
+		b.messages.push_back( std::move(e.msg) );
+	}
+	entries.clear();
+}
+
+
+size_t IngressQueue::drain(std::vector<std::shared_ptr<TcpMessage>>& out, size_t max){
+	size_t count = 0;
+	out.reserve(out.size() + std::min(max, total.load(std::memory_order_relaxed)));
+	while( (count < max) && !ring.empty() ){
+		Backlog* b = ring.front();
+		ring.pop_front();
+		out.push_back( std::move(b->messages.front()) );
+		b->messages.pop_front();
+		--b->source->queued;
+		++count;
+
+		if( !b->messages.empty() ) ring.push_back(b);
+		else backlogs.erase(b->source.get());
+	}
+	total.fetch_sub(count);
+
+	// Sources are resumed here since they may be paused by the capacity
+	// with nothing queued. Resuming may queue messages right away.
+	for(size_t i = 0; i < paused.size(); ){
+		Source& s = *paused[i];
+		if( s.paused.load() && !canResume(s) ){ ++i; continue; }
+		if( s.paused.exchange(false) ){
+			std::function<void()> resume = std::move(s.resume);
+			s.resume = nullptr;
+			resume();
+		}
+		paused[i] = std::move(paused.back());
+		paused.pop_back();
+	}
+	return count;
+}
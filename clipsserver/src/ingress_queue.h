@@ -0,0 +1,267 @@
+/* ** ***************************************************************
+* ingress_queue.h
+*
+* Author: Mauricio Matamoros
+*
+* Bounded queue of received messages with per-session quotas
+*
+** ** **************************************************************/
+/** @file ingress_queue.h
+ * Definition of the IngressQueue class: a bounded, thread-safe queue
+ * of received messages drained fairly across their sources
+ */
+
+#ifndef __INGRESS_QUEUE_H__
+#define __INGRESS_QUEUE_H__
+#pragma once
+
+/** @cond */
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+/** @endcond */
+
+#include "tcp_message.h"
+#include "mpsc_queue.h"
+
+
+/**
+ * Implements the bounded queue where sessions place the messages
+ * received for an environment.
+ *
+ * Each source (session) has its own FIFO queue. Once it holds quota
+ * messages the source must stop reading from its socket, so TCP
+ * pushes back on the client instead of the server buffering its data.
+ * When the total number of queued messages reaches the capacity, facts
+ * are shed (they expect no reply) and sources sending commands must
+ * stop reading as well. Sources resume reading once their queue drains
+ * to half the quota and the total is below the capacity.
+ *
+ * The consumer drains the sources in round-robin, one message each
+ * turn, so a flooding client can't starve the others.
+ *
+ * Producers never lock: messages are handed over to the consumer
+ * through an mpsc_queue and accounted with atomic counters. The
+ * per-source queues and the round-robin are owned by the consumer,
+ * which must be a single thread.
+ */
+class IngressQueue{
+public:
+	/**
+	 * Enumerates the outcomes of queueing a message
+	 */
+	enum class Admission{
+		/**
+		 * The message was queued
+		 */
+		Accepted,
+		/**
+		 * The message was queued, but the source must stop reading
+		 * until resumed (see deferResume())
+		 */
+		Paused,
+		/**
+		 * The message was discarded due to overload
+		 */
+		Dropped
+	};
+
+	/**
+	 * The ingress state of a source, shared by the source and the
+	 * queues holding its messages
+	 */
+	class Source{
+	public:
+		Source();
+
+		// Disable copy constructor and assignment op.
+		Source(Source const& obj)        = delete;
+		Source& operator=(Source const&) = delete;
+
+	private:
+		friend class IngressQueue;
+		/**
+		 * Number of messages of the source not yet consumed
+		 */
+		std::atomic<size_t> queued;
+		/**
+		 * Set while the source is paused and awaits to be resumed
+		 */
+		std::atomic<bool> paused;
+		/**
+		 * Resumes the source. Written by the source before pausing,
+		 * and taken by whoever clears paused.
+		 */
+		std::function<void()> resume;
+	};
+
+	/**
+	 * Initializes a new instance of IngressQueue
+	 * @param capacity Maximum number of messages queued in total
+	 * @param quota    Maximum number of messages queued per source
+	 */
+	IngressQueue(size_t capacity = 65536, size_t quota = 1024);
+
+	// Disable copy constructor and assignment op.
+	IngressQueue(IngressQueue const& obj)        = delete;
+	IngressQueue& operator=(IngressQueue const&) = delete;
+
+public:
+	/**
+	 * Sets the queue limits
+	 * @param capacity Maximum number of messages queued in total
+	 * @param quota    Maximum number of messages queued per source,
+	 *                 capped to half the capacity
+	 */
+	void setLimits(size_t capacity, size_t quota);
+
+	/**
+	 * Queues a message received from a source.
+	 * Safe to call from any thread.
+	 * @param  msg    The message
+	 * @param  source The source of the message
+	 * @return        Whether the message was queued, and whether its
+	 *                source must stop reading
+	 */
+	Admission produce(const std::shared_ptr<TcpMessage>& msg, const std::shared_ptr<Source>& source);
+
+	/**
+	 * Registers the function that resumes a paused source. It is
+	 * called from the consumer thread once the source may resume.
+	 * Must not be called again until the source is resumed.
+	 * @param  source The source
+	 * @param  resume The function that resumes reading
+	 * @return        true if the function was registered, false if the
+	 *                source may already resume, in which case it must
+	 *                not pause
+	 */
+	bool deferResume(const std::shared_ptr<Source>& source, std::function<void()> resume);
+
+	/**
+	 * Retrieves messages in round-robin across sources, waiting until
+	 * there is at least one or interrupt() is called
+	 * @param out Vector where the retrieved messages are appended
+	 * @param max Maximum number of messages to retrieve
+	 * @return    The number of messages retrieved
+	 */
+	size_t consume(std::vector<std::shared_ptr<TcpMessage>>& out, size_t max);
+
+	/**
+	 * Retrieves messages in round-robin across sources, waiting until
+	 * there is at least one, the timeout expires, or interrupt() is called
+	 * @param out     Vector where the retrieved messages are appended
+	 * @param max     Maximum number of messages to retrieve
+	 * @param timeout The amount of time to wait for the first message
+	 * @return        The number of messages retrieved
+	 */
+	size_t timedConsume(std::vector<std::shared_ptr<TcpMessage>>& out, size_t max,
+		const std::chrono::microseconds& timeout);
+
+	/**
+	 * Wakes up the consumer, which returns with no messages unless
+	 * there are some queued
+	 */
+	void interrupt();
+
+	/**
+	 * Gets the number of messages queued
+	 */
+	size_t size() const;
+
+	/**
+	 * Gets the number of messages discarded due to overload
+	 */
+	uint64_t getDropped() const;
+
+	/**
+	 * Gets the number of times a source was asked to stop reading
+	 */
+	uint64_t getDeferred() const;
+
+private:
+	/**
+	 * A message handed over to the consumer. Entries without message
+	 * notify the consumer that their source paused.
+	 */
+	struct Entry{
+		std::shared_ptr<TcpMessage> msg;
+		std::shared_ptr<Source> source;
+	};
+
+	/**
+	 * The messages of a source awaiting their turn
+	 */
+	struct Backlog{
+		std::shared_ptr<Source> source;
+		std::deque<std::shared_ptr<TcpMessage>> messages;
+	};
+
+	/**
+	 * Sorts the handed over entries into the backlogs of their sources
+	 * @param entries The entries taken from the inbox
+	 */
+	void sort(std::vector<Entry>& entries);
+
+	/**
+	 * Moves up to max messages to out in round-robin across sources,
+	 * then resumes the sources drained enough
+	 * @param out     Vector where the messages are appended
+	 * @param max     Maximum number of messages to move
+	 * @return        The number of messages moved
+	 */
+	size_t drain(std::vector<std::shared_ptr<TcpMessage>>& out, size_t max);
+
+	/**
+	 * Checks whether a paused source may resume reading
+	 */
+	bool canResume(const Source& s) const;
+
+private:
+	/**
+	 * Maximum number of messages queued in total
+	 */
+	std::atomic<size_t> capacity;
+	/**
+	 * Maximum number of messages queued per source
+	 */
+	std::atomic<size_t> quota;
+	/**
+	 * Number of messages queued, whether handed over or in a backlog
+	 */
+	std::atomic<size_t> total;
+	/**
+	 * Messages handed over by the producers
+	 */
+	mpsc_queue<Entry> inbox;
+	/**
+	 * Entries taken from the inbox. Kept to reuse its storage.
+	 */
+	std::vector<Entry> received;
+	/**
+	 * Backlogs by source. Backlogs are removed once drained.
+	 */
+	std::unordered_map<Source*, Backlog> backlogs;
+	/**
+	 * Backlogs with queued messages, in the order they are served
+	 */
+	std::deque<Backlog*> ring;
+	/**
+	 * Sources that paused, awaiting to be resumed
+	 */
+	std::vector<std::shared_ptr<Source>> paused;
+	/**
+	 * Number of messages discarded due to overload
+	 */
+	std::atomic<uint64_t> dropped;
+	/**
+	 * Number of times a source was asked to stop reading
+	 */
+	std::atomic<uint64_t> deferred;
+};
+
+#endif // __INGRESS_QUEUE_H__
@@ -55,6 +55,7 @@ Server server;
 int main(int argc, char **argv);
 void addUserFunctions();
 inline int server_sendto_invoker(Server& server, const std::string& destPort, const std::string& message);
+inline int server_sendto_invoker(Server& server, SessionId id, const std::string& message);
 inline int server_broadcast_invoker(Server& server, const std::string& message);
 void CLIPS_broadcast_wrapper(clips::udf::Context& ctx, clips::udf::RetVal& rv);
 void CLIPS_sendto_wrapper(clips::udf::Context& ctx, clips::udf::RetVal& rv);
@@ -71,10 +72,11 @@ void CLIPS_sendto_wrapper(clips::udf::Context& ctx, clips::udf::RetVal& rv);
  */
 int main(int argc, char **argv){
 
+	// User functions are registered in every environment
+	server.setUserFunctionsInitializer(&addUserFunctions);
 	if( !server.init(argc, argv) )
 		return -1;
 
-	addUserFunctions();
 	// server.runAsync();
 	server.run();
 	server.stop();
@@ -92,7 +94,9 @@ int main(int argc, char **argv){
  */
 void addUserFunctions(){
 	clips::udf::addFunction("sendto", clips::udf::Type::Integer,
-		std::vector<clips::udf::Type>({clips::udf::Type::String, clips::udf::Type::String}),
+		std::vector<clips::udf::Type>({
+			clips::udf::Type::Integer | clips::udf::Type::String | clips::udf::Type::Symbol,
+			clips::udf::Type::String}),
 		&CLIPS_sendto_wrapper, "CLIPS_sendto_wrapper");
 
 	clips::udf::addFunction("broadcast", clips::udf::Type::Integer,
@@ -103,23 +107,28 @@ void addUserFunctions(){
 
 
 /**
- * Sends the given message (second paramenter) to the specified client via its remote endpoint.
+ * Sends the given message (second paramenter) to the specified client via its remote endpoint
+ * or its session id.
  * Wrapper for the CLIPS' sendto function. It calls Server::sendTo via friend-function server_sendto_invoker.
  * @return Zero if unwrapping was successful, -1 otherwise.
  */
 void CLIPS_sendto_wrapper(clips::udf::Context& ctx, clips::udf::RetVal& rv){
 	// (sendto ?port ?str)
-	std::string strEp, message;
+	clips::SlotValue dest;
+	std::string message;
 	if(
 		(clips::udf::argumentCount(ctx) < 2) ||
-		!clips::udf::firstArgument(ctx, strEp) ||
+		!clips::udf::firstArgument(ctx, dest) ||
 		!clips::udf::nextArgument(ctx, message)
 	) return;
 
 	boost::trim_right(message);
 
 	/* It sends the data */
-	server_sendto_invoker(server, strEp, message + '\n');
+	if(dest.getType() == clips::SlotValue::Type::Integer)
+		server_sendto_invoker(server, (SessionId)dest.getInteger(), message + '\n');
+	else
+		server_sendto_invoker(server, dest.getLexeme(), message + '\n');
 }
 
 inline
@@ -127,8 +136,13 @@ int server_sendto_invoker(Server& server, const std::string& cliEP, const std::s
 	return server.sendTo(cliEP, message) ? 0 : -1;
 }
 
+inline
+int server_sendto_invoker(Server& server, SessionId id, const std::string& message){
+	return server.sendTo(id, message) ? 0 : -1;
+}
+
 /**
- * Broadcasts the given message to all connected clients.
+ * Broadcasts the given message to all clients bound to the calling environment.
  * Wrapper for the CLIPS' broadcast function. It calls Server::broadcast via friend-function server_broadcast_invoker
  * @return Zero if unwrapping was successful, -1 otherwise.
  */
@@ -0,0 +1,109 @@
+#include "metrics.h"
+
+
+/**
+ * Name under which the commands not registered are measured
+ */
+static const std::string otherCommand("other");
+
+constexpr size_t Histogram::Buckets;
+
+
+/* ** ********************************************************
+* Histogram
+* *** *******************************************************/
+Histogram::Histogram() : count(0), sum(0){
+	for(size_t i = 0; i < Buckets; ++i) counts[i] = 0;
+}
+
+
+void Histogram::observe(uint64_t value){
+	// Smallest i such that value <= 2^i
+	size_t bucket = (value <= 1) ? 0 : 64 - __builtin_clzll(value - 1);
+	if(bucket >= Buckets) bucket = Buckets - 1;
+	counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+uint64_t Histogram::getBucketCount(size_t bucket) const{
+	return counts[bucket].load(std::memory_order_relaxed);
+}
+
+
+uint64_t Histogram::getBucketBound(size_t bucket){
+	return (bucket + 1 < Buckets) ? (uint64_t)1 << bucket : UINT64_MAX;
+}
+
+
+uint64_t Histogram::getCount() const{
+	return count.load(std::memory_order_relaxed);
+}
+
+
+uint64_t Histogram::getSum() const{
+	return sum.load(std::memory_order_relaxed);
+}
+
+
+
+/* ** ********************************************************
+* EnvironmentMetrics
+* *** *******************************************************/
+EnvironmentMetrics::EnvironmentMetrics(std::initializer_list<const char*> names):
+	rulesFired(0), facts(0), activations(0), memory(0){
+	for(const char* name : names)
+		commands[name].reset(new Histogram());
+	commands[otherCommand].reset(new Histogram());
+}
+
+
+Histogram& EnvironmentMetrics::command(const std::string& name){
+	auto it = commands.find(name);
+	if(it == commands.end()) it = commands.find(otherCommand);
+	return *it->second;
+}
+
+
+
+/* ** ********************************************************
+* MetricsWriter
+* *** *******************************************************/
+void MetricsWriter::family(const std::string& name, const char* type, const char* help){
+	out+= "# HELP " + name + " " + help + "\n";
+	out+= "# TYPE " + name + " " + type + "\n";
+}
+
+
+void MetricsWriter::sample(const std::string& name, const std::string& labels, int64_t value){
+	out+= name;
+	if( !labels.empty() ) out+= "{" + labels + "}";
+	out+= " " + std::to_string(value) + "\n";
+}
+
+
+void MetricsWriter::histogram(const std::string& name, const std::string& labels, const Histogram& h){
+	// The count is taken from the buckets so a histogram read while
+	// being updated remains consistent
+	uint64_t counts[Histogram::Buckets], total = 0;
+	for(size_t i = 0; i < Histogram::Buckets; ++i)
+		total+= counts[i] = h.getBucketCount(i);
+
+	// Buckets are cumulative. Every bound is emitted, empty or not, so
+	// the set of series of a histogram never changes between scrapes.
+	std::string prefix = labels.empty() ? "" : labels + ",";
+	uint64_t cumulative = 0;
+	for(size_t i = 0; i + 1 < Histogram::Buckets; ++i){
+		cumulative+= counts[i];
+		sample(name + "_bucket", prefix + "le=\"" + std::to_string(Histogram::getBucketBound(i)) + "\"", cumulative);
+	}
+	sample(name + "_bucket", prefix + "le=\"+Inf\"", total);
+	sample(name + "_sum", labels, h.getSum());
+	sample(name + "_count", labels, total);
+}
+
+
+const std::string& MetricsWriter::str() const{
+	return out;
+}
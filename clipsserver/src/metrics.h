@@ -0,0 +1,186 @@
+/* ** ***************************************************************
+* metrics.h
+*
+* Author: Mauricio Matamoros
+*
+* Lock-free counters and histograms exported in the Prometheus text
+* exposition format
+*
+** ** **************************************************************/
+/** @file metrics.h
+ * Definition of the Histogram, EnvironmentMetrics and MetricsWriter
+ * classes used to instrument the server's hot paths
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+#pragma once
+
+/** @cond */
+#include <map>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <initializer_list>
+/** @endcond */
+
+
+/**
+ * Implements a histogram with power-of-two buckets: the upper bound of
+ * bucket i is 2^i, and the last bucket holds larger values.
+ * Values are counted with atomic operations, so any thread may observe
+ * values or read the histogram without locking.
+ */
+class Histogram{
+public:
+	/**
+	 * Number of buckets, the last one unbounded
+	 */
+	static constexpr size_t Buckets = 24;
+
+	/**
+	 * Initializes a new empty instance of Histogram
+	 */
+	Histogram();
+
+	// Disable copy constructor and assignment op.
+	Histogram(Histogram const& obj)        = delete;
+	Histogram& operator=(Histogram const&) = delete;
+
+public:
+	/**
+	 * Counts a value
+	 * @param value The value to count
+	 */
+	void observe(uint64_t value);
+
+	/**
+	 * Gets the number of values in a bucket (not cumulative)
+	 * @param  bucket The index of the bucket
+	 * @return        The number of values
+	 */
+	uint64_t getBucketCount(size_t bucket) const;
+
+	/**
+	 * Gets the upper bound of a bucket
+	 * @param  bucket The index of the bucket
+	 * @return        The upper bound, or UINT64_MAX for the last bucket
+	 */
+	static uint64_t getBucketBound(size_t bucket);
+
+	/**
+	 * Gets the number of values counted
+	 */
+	uint64_t getCount() const;
+
+	/**
+	 * Gets the sum of the values counted
+	 */
+	uint64_t getSum() const;
+
+private:
+	std::atomic<uint64_t> counts[Buckets];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+};
+
+
+/**
+ * Metrics of a ClipsEnvironment. Updated by its worker thread and
+ * read by any thread.
+ */
+struct EnvironmentMetrics{
+	/**
+	 * Initializes a new instance of EnvironmentMetrics
+	 * @param commands The names of the commands whose handling time
+	 *                 is measured. Other commands are measured as one.
+	 */
+	EnvironmentMetrics(std::initializer_list<const char*> commands);
+
+	/**
+	 * Gets the histogram of handling times of a command
+	 * @param  name The name of the command
+	 * @return      The histogram of the command, or that shared by the
+	 *              unknown commands
+	 */
+	Histogram& command(const std::string& name);
+
+	/**
+	 * Messages drained from the queue at once
+	 */
+	Histogram queueDepth;
+	/**
+	 * Time elapsed between the reception of a message and its
+	 * dispatch, in microseconds
+	 */
+	Histogram queueLatency;
+	/**
+	 * Command handling time, in microseconds, by command name. The map
+	 * is filled upon construction so it can be read without locking.
+	 */
+	std::map<std::string, std::unique_ptr<Histogram>> commands;
+	/**
+	 * Duration of clips::run(), in microseconds
+	 */
+	Histogram runDuration;
+	/**
+	 * Rules fired by clips::run()
+	 */
+	std::atomic<uint64_t> rulesFired;
+	/**
+	 * Facts in the fact list, sampled after each dispatch
+	 */
+	std::atomic<uint64_t> facts;
+	/**
+	 * Activations on the agenda, sampled after each dispatch
+	 */
+	std::atomic<uint64_t> activations;
+	/**
+	 * Memory used by CLIPS in bytes, sampled after each dispatch
+	 */
+	std::atomic<int64_t> memory;
+};
+
+
+/**
+ * Writes metrics in the Prometheus text exposition format (v0.0.4)
+ */
+class MetricsWriter{
+public:
+	/**
+	 * Writes the header of a metric family. Samples of the family
+	 * must follow.
+	 * @param name The name of the family
+	 * @param type The type: counter, gauge or histogram
+	 * @param help The description of the family
+	 */
+	void family(const std::string& name, const char* type, const char* help);
+
+	/**
+	 * Writes a sample
+	 * @param name   The name of the sample
+	 * @param labels The labels without braces, e.g. env="default".
+	 *               May be empty.
+	 * @param value  The value
+	 */
+	void sample(const std::string& name, const std::string& labels, int64_t value);
+
+	/**
+	 * Writes the bucket, sum and count samples of a histogram
+	 * @param name   The name of the family
+	 * @param labels The labels without braces. May be empty.
+	 * @param h      The histogram
+	 */
+	void histogram(const std::string& name, const std::string& labels, const Histogram& h);
+
+	/**
+	 * Gets the written metrics
+	 */
+	const std::string& str() const;
+
+private:
+	std::string out;
+};
+
+#endif // __METRICS_H__
@@ -0,0 +1,284 @@
+/* ** ***************************************************************
+* mpsc_queue.h
+*
+* Author: Mauricio Matamoros
+*
+* Implements a lock-free multiple-producer single-consumer queue
+*
+** ** **************************************************************/
+/** @file mpsc_queue.h
+ * Implementation of the mpsc_queue class:
+ * a lock-free multiple-producer single-consumer queue
+ */
+
+#ifndef __MPSC_QUEUE_H__
+#define __MPSC_QUEUE_H__
+#pragma once
+
+/** @cond */
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#ifdef __linux__
+#include <ctime>
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+/** @endcond */
+
+
+/**
+ * Implements a lock-free queue of type T with many producers and a
+ * single consumer.
+ *
+ * Elements are linked in an intrusive list (D. Vyukov's MPSC node
+ * queue): producing is a single atomic exchange and never blocks,
+ * while the only consumer pops without atomic read-modify-write
+ * operations. The consumer sleeps on a futex when the queue is empty,
+ * and producers issue the wake-up system call only when it sleeps.
+ *
+ * Only one thread may call the consume methods at a time.
+ */
+template <class T>
+class mpsc_queue
+{
+private:
+	/**
+	 * A queued element
+	 */
+	struct node{
+		node() : next(NULL){}
+		node(T&& value) : next(NULL), value(std::move(value)){}
+		std::atomic<node*> next;
+		T value;
+	};
+
+	/**
+	 * The last element produced. Producers link after it.
+	 */
+	std::atomic<node*> _head;
+	/**
+	 * The last element consumed (or the stub). Owned by the consumer.
+	 */
+	node* _tail;
+	/**
+	 * Placeholder that keeps the list non-empty
+	 */
+	node _stub;
+	/**
+	 * Number of elements in the queue
+	 */
+	std::atomic<size_t> _size;
+	/**
+	 * Futex word, increased on every wake-up
+	 */
+	std::atomic<uint32_t> _signal;
+	/**
+	 * Set while the consumer sleeps or is about to
+	 */
+	std::atomic<bool> _sleeping;
+	/**
+	 * Set by interrupt() to wake up the consumer
+	 */
+	std::atomic<bool> _interrupted;
+#ifndef __linux__
+	std::mutex _m;
+	std::condition_variable _cv;
+#endif
+
+
+// Disable copy constructor and assignment op.
+private:
+	mpsc_queue(mpsc_queue const& obj) = delete;
+	mpsc_queue& operator=(mpsc_queue const&) = delete;
+
+public:
+	/**
+	 * Creates a new instance of a lock-free queue
+	 */
+	mpsc_queue() : _head(&_stub), _tail(&_stub), _size(0), _signal(0),
+		_sleeping(false), _interrupted(false){}
+
+	/**
+	 * Destroys the queue and the elements it contains
+	 */
+	~mpsc_queue(){
+		std::vector<T> discarded;
+		while(tryConsume(discarded, SIZE_MAX) > 0) discarded.clear();
+	}
+
+	/**
+	 * Enqueues an element, waking up the consumer if it sleeps.
+	 * Safe to call from any thread.
+	 * @param obj  The object to enqueue
+	 */
+	void produce(T obj){
+		node* n = new node( std::move(obj) );
+		++_size;
+		// Once exchanged the node is reachable as soon as it is linked.
+		// Sequentially consistent so either this thread sees the consumer
+		// sleeping, or the consumer sees the node before it sleeps.
+		node* prev = _head.exchange(n, std::memory_order_seq_cst);
+		prev->next.store(n, std::memory_order_release);
+		// Only the first producer to see the consumer asleep wakes it up
+		if( _sleeping.load(std::memory_order_seq_cst) && _sleeping.exchange(false) ) wake();
+	}
+
+	/**
+	 * Moves up to max elements to the given vector without waiting.
+	 * @param out  Vector where the elements are appended in FIFO order
+	 * @param max  Maximum number of elements to move
+	 * @return     The number of elements moved
+	 */
+	size_t tryConsume(std::vector<T>& out, size_t max){
+		size_t count = 0;
+		while(count < max){
+			node* tail = _tail;
+			node* next = tail->next.load(std::memory_order_acquire);
+			if(tail == &_stub){
+				if(!next) break;
+				_tail = tail = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+			if(!next){
+				// tail is the last node unless a producer is linking after it
+				if(tail != _head.load(std::memory_order_acquire)) break;
+				// Requeue the stub so tail can be released
+				_stub.next.store(NULL, std::memory_order_relaxed);
+				node* prev = _head.exchange(&_stub, std::memory_order_acq_rel);
+				prev->next.store(&_stub, std::memory_order_release);
+				next = tail->next.load(std::memory_order_acquire);
+				if(!next) break;
+			}
+			out.push_back( std::move(tail->value) );
+			_tail = next;
+			delete tail;
+			++count;
+		}
+		if(count) _size.fetch_sub(count, std::memory_order_relaxed);
+		return count;
+	}
+
+	/**
+	 * Moves up to max elements to the given vector, waiting until there
+	 * is at least one or interrupt() is called.
+	 * @param out  Vector where the elements are appended in FIFO order
+	 * @param max  Maximum number of elements to move
+	 * @return     The number of elements moved
+	 */
+	size_t consume(std::vector<T>& out, size_t max){
+		while(true){
+			size_t count = tryConsume(out, max);
+			if(count || _interrupted.exchange(false)) return count;
+			wait(NULL);
+		}
+	}
+
+	/**
+	 * Moves up to max elements to the given vector, waiting until there
+	 * is at least one, the timeout expires, or interrupt() is called.
+	 * @param out      Vector where the elements are appended in FIFO order
+	 * @param max      Maximum number of elements to move
+	 * @param timeout  The amount of time to wait for the first element
+	 * @return         The number of elements moved
+	 */
+	size_t timedConsume(std::vector<T>& out, size_t max, const std::chrono::microseconds& timeout){
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while(true){
+			size_t count = tryConsume(out, max);
+			if(count || _interrupted.exchange(false)) return count;
+			auto now = std::chrono::steady_clock::now();
+			if(now >= deadline) return 0;
+			auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+			wait(&left);
+		}
+	}
+
+	/**
+	 * Wakes up the consumer, which returns with no elements unless
+	 * there are some queued. Safe to call from any thread.
+	 */
+	void interrupt(){
+		_interrupted.store(true, std::memory_order_seq_cst);
+		if( _sleeping.load(std::memory_order_seq_cst) && _sleeping.exchange(false) ) wake();
+	}
+
+	/**
+	 * Gets the number of elements in the queue
+	 */
+	size_t size() const{
+		return _size.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Checks whether the queue is empty
+	 */
+	bool empty() const{
+		return size() == 0;
+	}
+
+private:
+	/**
+	 * Checks whether there is something to consume
+	 */
+	bool ready() const{
+		return (_head.load(std::memory_order_seq_cst) != _tail) ||
+			(_tail->next.load(std::memory_order_acquire) != NULL) ||
+			_interrupted.load(std::memory_order_seq_cst);
+	}
+
+	/**
+	 * Sleeps until woken up by a producer or the timeout expires.
+	 * May return spuriously.
+	 * @param timeout  The maximum time to sleep, or NULL to sleep
+	 *                 until woken up
+	 */
+	void wait(const std::chrono::microseconds* timeout){
+		uint32_t signal = _signal.load(std::memory_order_acquire);
+		_sleeping.store(true, std::memory_order_seq_cst);
+		if( ready() ){
+			_sleeping.store(false, std::memory_order_relaxed);
+			// A producer may be linking its node
+			std::this_thread::yield();
+			return;
+		}
+#ifdef __linux__
+		struct timespec ts, *tsp = NULL;
+		if(timeout){
+			ts.tv_sec  = timeout->count() / 1000000;
+			ts.tv_nsec = (timeout->count() % 1000000) * 1000;
+			tsp = &ts;
+		}
+		syscall(SYS_futex, (uint32_t*)&_signal, FUTEX_WAIT_PRIVATE, signal, tsp, NULL, 0);
+#else
+		std::unique_lock<std::mutex> lock(_m);
+		auto pred = [this, signal](){ return _signal.load() != signal; };
+		if(timeout) _cv.wait_for(lock, *timeout, pred);
+		else        _cv.wait(lock, pred);
+#endif
+		_sleeping.store(false, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Wakes up the consumer
+	 */
+	void wake(){
+#ifdef __linux__
+		_signal.fetch_add(1, std::memory_order_release);
+		syscall(SYS_futex, (uint32_t*)&_signal, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+		{std::lock_guard<std::mutex> lock(_m);
+			_signal.fetch_add(1);
+		}
+		_cv.notify_one();
+#endif
+	}
+};
+
+#endif // __MPSC_QUEUE_H__
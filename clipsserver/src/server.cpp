@@ -1,6 +1,7 @@
 #include "server.h"
 
 #include <regex>
+#include <cctype>
 #include <cstdio>
 #include <cstring>
 #include <fstream>
@@ -8,12 +9,10 @@
 #include <iostream>
 
 #include <boost/bind/bind.hpp>
-#include <boost/filesystem.hpp>
 
 #include <unistd.h>
 
 #include "utils.h"
-#include "clipswrapper.h"
 
 namespace ph = std::placeholders;
 namespace asio = boost::asio;
@@ -28,24 +27,6 @@ using asio::ip::tcp;
 /* ** ********************************************************
 * Local helpers
 * *** *******************************************************/
-static inline
-bool ends_with(const std::string& s, const std::string& end){
-	if (end.size() > s.size()) return false;
-	return std::equal(end.rbegin(), end.rend(), s.rbegin());
-}
-
-static inline
-void split_path(const std::string& fpath, std::string& dir, std::string& fname){
-	size_t slashp = fpath.rfind("/");
-	if(slashp == std::string::npos){
-		dir = std::string();
-		fname = fpath;
-		return;
-	}
-	dir = fpath.substr(0, slashp);
-	fname = fpath.substr(slashp+1);
-}
-
 static inline
 std::string get_current_path(){
 	char buff[FILENAME_MAX];
@@ -53,20 +34,27 @@ std::string get_current_path(){
 	return std::string(buff);
 }
 
+/**
+ * Checks whether the given string is a valid environment name:
+ * up to 64 letters, digits, dashes or underscores
+ */
 static inline
-std::string get_home_path(){
-	return std::getenv("HOME");
+bool is_valid_environment_name(const std::string& name){
+	if( name.empty() || (name.length() > 64) ) return false;
+	for(char c : name)
+		if( !std::isalnum((unsigned char)c) && (c != '_') && (c != '-') ) return false;
+	return true;
 }
 
-static inline
-std::string canonicalize_path(std::string path){
-	if (path.length() < 1) return path;
-	if(path == "~") path = std::getenv("HOME");
-	else if( (path.length() > 1) && (path.substr(0, 2) == "~/") )
-		path = std::getenv("HOME") + path.substr(1);
-	try{ return boost::filesystem::canonical(path).string(); }
-	catch(...){ return ""; }
-}
+/**
+ * Name of the environment sessions are bound to upon connection
+ */
+static const std::string defaultEnvironmentName("default");
+
+/**
+ * Largest HTTP request accepted by the metrics listener
+ */
+static const size_t MaxMetricsRequestSize = 8192;
 
 
 /* ** ********************************************************
@@ -74,8 +62,12 @@ std::string canonicalize_path(std::string path){
 * *** *******************************************************/
 Server::Server():
 	// clipsFile("cubes.dat"),
-	flgFacts(false), flgRules(false), clppath(get_current_path()),
-	port(5000), acceptorPtr(NULL), defaultMsgInFact("network 0.0.0.0:0"){
+	flgFacts(false), flgRules(false), clppath(get_current_path()), argc(0), argv(NULL),
+	running(false), ioThreads( std::max(1u, std::min(4u, std::thread::hardware_concurrency())) ),
+	port(5000), metricsPort(0), batchSize(0), batchTimeout(1000),
+	ingressCapacity(65536), ingressQuota(1024),
+	writeHighWaterMark(4 << 20), overflowPolicy(OverflowPolicy::Block), maxEnvironments(16),
+	acceptorPtr(NULL){
 }
 
 Server::~Server(){
@@ -91,33 +83,30 @@ Server::~Server(){
 * *** *******************************************************/
 bool Server::init(int argc, char **argv){
 	if( !parseArgs(argc, argv) ) return false;
+	this->argc = argc;
+	this->argv = argv;
 
-	if( !initTcpServer() ) return false;
-	// std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+	if( !initTcpServer() || !initMetricsServer() ) return false;
 
-	initCLIPS(argc, argv);
-	// publishStatus();
+	// The default environment loads the startup file
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	std::unique_ptr<ClipsEnvironment> env(new ClipsEnvironment(defaultEnvironmentName, *this));
+	env->setBatching(batchSize, batchTimeout);
+	env->setIngressLimits(ingressCapacity, ingressQuota);
+	env->start(clipsFile, flgFacts, flgRules, argc, argv);
+	environments[defaultEnvironmentName] = std::move(env);
 
 	return true;
 }
 
 
-void Server::initCLIPS(int argc, char **argv){
-	clips::initialize();
-	clips::rerouteStdin(argc, argv);
-	clips::clear();
-	std::cout << "Clips ready" << std::endl;
+void Server::setUserFunctionsInitializer(std::function<void()> initializer){
+	userFunctionsInitializer = initializer;
+}
 
-	// Load clp files specified in file
-	loadFile(clipsFile);
-	if(flgFacts) clips::toggleWatch(clips::WatchItem::Facts);
-	if(flgRules) clips::toggleWatch(clips::WatchItem::Rules);
 
-	// Further CLIPS initialization (routers, etc).
-	clips::QueryRouter& qr = clips::QueryRouter::getInstance();
-	qr.addLogicalName("wdisplay"); // Capture display info
-	qr.addLogicalName("wtrace");   // Capture trace info
-	qr.addLogicalName("stdout");   // Capture everything else
+void Server::initUserFunctions(){
+	if(userFunctionsInitializer) userFunctionsInitializer();
 }
 
 
@@ -127,7 +116,7 @@ bool Server::initTcpServer(){
 	acceptorPtr = std::shared_ptr<tcp::acceptor>(new tcp::acceptor(io_context, listen_ep));
 	acceptorPtr->set_option(tcp::acceptor::reuse_address(true));
 
-	std::shared_ptr<tcp::socket> socketPtr(new tcp::socket(io_context));
+	std::shared_ptr<tcp::socket> socketPtr(new tcp::socket( asio::make_strand(io_context) ));
 	acceptorPtr->async_accept(
 		*socketPtr,
 		boost::bind(&Server::acceptHandler, this, boost::asio::placeholders::error, socketPtr));
@@ -137,233 +126,291 @@ bool Server::initTcpServer(){
 }
 
 
-void Server::acceptHandler(const boost::system::error_code& error, std::shared_ptr<tcp::socket> socketPtr){
-	if(!error){
-		auto sp = Session::makeShared(socketPtr, *this);
-		clients[sp->getEndPointStr()] = sp;
-		printf("Connected client %s\n", sp->getEndPointStr().c_str());
-		publishStatus();
+bool Server::initMetricsServer(){
+	if(!metricsPort) return true;
+	try{
+		tcp::endpoint listen_ep{{}, metricsPort};
+		metricsAcceptorPtr = std::make_shared<tcp::acceptor>(io_context, listen_ep);
 	}
-
-	std::shared_ptr<tcp::socket> nextSckt(new tcp::socket(io_context));
-	acceptorPtr->async_accept(
-		*nextSckt,
-		boost::bind(&Server::acceptHandler, this, boost::asio::placeholders::error, nextSckt));
-}
-
-
-void Server::removeSession(const std::string& srep){
-	if(clients.count( srep ) < 1) return;
-	auto disconnected = clients[srep];
-	clients.erase( srep );
-}
-
-
-/* ** ********************************************************
-*
-* Class methods: Clips wrappers
-*
-* *** *******************************************************/
-void Server::assertFact(const std::string& s, const std::string& fact, bool resetFactListChanged) {
-	std::string f = fact.empty() ? defaultMsgInFact : fact;
-	std::string as = "(" + fact + " " + s + ")";
-	clips::assertString( as );
-	if(resetFactListChanged)
-		clips::setFactListChanged(0);
-	printf("Asserted string %s\n", as.c_str());
-}
-
-
-void Server::clearCLIPS(){
-	clips::clear();
-	printf("KDB cleared (clear)\n");
-}
-
-
-void Server::resetCLIPS(){
-	clips::reset();
-	printf("KDB reset (reset)\n");
-}
-
-
-bool Server::sendCommand(std::string const& s){
-	printf("Executing command: %s\n", s.c_str());
-	return clips::sendCommand(s);
-}
-
-
-bool Server::loadClp(const std::string& fpath){
-	printf("Loading file '%s'...\n", fpath.c_str() );
-	if( !clips::load( canonicalize_path(fpath) ) ){
-		printf("Error in file '%s' or does not exist\n", fpath.c_str());
+	catch(const boost::system::system_error& ex){
+		fprintf(stderr, "Can't serve metrics on port %u: %s\n", metricsPort, ex.what());
 		return false;
 	}
-	printf("File %s loaded successfully\n", fpath.c_str());
+	beginMetricsAccept();
+	printf("Serving metrics on port %u\n", metricsPort);
 	return true;
 }
 
 
-bool Server::loadDat(const std::string& fpath){
-	if( fpath.empty() ) return false;
-	std::ifstream fs;
-	fs.open( canonicalize_path(fpath) );
-
-	if( fs.fail() || !fs.is_open() ){
-		fprintf(stderr, "File '%s' does not exists\n", fpath.c_str());
-		return false;
-	}
-
-	bool err = false;
-	std::string line, fdir, fname;
-	std::string here = get_current_path();
-	split_path(fpath, fdir, fname);
-	if(!fdir.empty()) chdir(fdir.c_str());
-	printf("Loading '%s'...\n", fname.c_str());
-	while(!err && std::getline(fs, line) ){
-		if(line.empty()) continue;
-		// size_t slashp = fpath.rfind("/");
-		// if(slashp != std::string::npos) line = fdir + line;
-		if (!loadClp(line)) err = true;
+void Server::acceptHandler(const boost::system::error_code& error, std::shared_ptr<tcp::socket> socketPtr){
+	if(!error){
+		ClipsEnvironment* env = getDefaultEnvironment();
+		auto sp = addSession(socketPtr);
+		if(sp){
+			sp->setHighWaterMark(writeHighWaterMark);
+			sp->setOverflowPolicy(overflowPolicy);
+			sp->setEnvironment(env);
+			printf("Connected client %s (session %u)\n", sp->getEndPointStr().c_str(), sp->getId());
+			sp->send( env->getStatus() );
+			sp->start();
+		}
 	}
-	fs.close();
-	chdir(here.c_str());
-	printf(err? "Aborted.\n" : "Done.");
-
-	return !err;
-}
-
 
-bool Server::loadFile(std::string const& fpath){
-	printf("Current path '%s'\n", get_current_path().c_str() );
-	if(ends_with(fpath, ".dat"))
-		return loadDat(fpath);
-	else if(ends_with(fpath, ".clp"))
-		return loadClp(fpath);
-	return false;
-}
-
-
-void Server::enqueueTcpMessage(std::shared_ptr<TcpMessage> messagePtr){
-	queue.produce(messagePtr);
+	// Each session runs its handlers in its own strand
+	std::shared_ptr<tcp::socket> nextSckt(new tcp::socket( asio::make_strand(io_context) ));
+	acceptorPtr->async_accept(
+		*nextSckt,
+		boost::bind(&Server::acceptHandler, this, boost::asio::placeholders::error, nextSckt));
 }
 
-/**
- * Parses messages from network clients
- * Re-implements original parse_network_message by Jesús Savage
- * @param msgPtr A pointer to the received message
- * @param m      The received message
 
- */
-void Server::parseMessage(std::shared_ptr<TcpMessage> msg){
-	std::string& m = msg->getMessage();
-
-	if((m[0] == 0) && (m.length() > 5)){
-		std::string result;
-		bool success = handleCommand(m.substr(5), result);
-		acknowledgeMessage(msg, success, result);
-		return;
+void Server::beginMetricsAccept(){
+	std::shared_ptr<tcp::socket> socketPtr(new tcp::socket(io_context));
+	metricsAcceptorPtr->async_accept(*socketPtr,
+		[this, socketPtr](const boost::system::error_code& error){
+			if(!error) serveMetrics(socketPtr);
+			beginMetricsAccept();
+		});
+}
+
+
+void Server::serveMetrics(std::shared_ptr<tcp::socket> socketPtr){
+	// The connection is closed once the last handler releases the socket
+	auto request = std::make_shared<asio::streambuf>(MaxMetricsRequestSize);
+	asio::async_read_until(*socketPtr, *request, "\r\n\r\n",
+		[this, socketPtr, request](const boost::system::error_code& error, size_t){
+			if(error) return;
+			std::istream is(request.get());
+			std::string method;
+			is >> method;
+
+			auto response = std::make_shared<std::string>();
+			if(method == "GET"){
+				std::string body = getMetrics();
+				*response = "HTTP/1.0 200 OK\r\n"
+					"Content-Type: text/plain; version=0.0.4\r\n"
+					"Content-Length: " + std::to_string(body.length()) + "\r\n"
+					"Connection: close\r\n\r\n" + body;
+			}
+			else
+				*response = "HTTP/1.0 405 Method Not Allowed\r\n"
+					"Allow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			asio::async_write(*socketPtr, asio::buffer(*response),
+				[socketPtr, response](const boost::system::error_code& error, size_t){
+					if(error){
+						fprintf(stderr, "Could not send metrics: %s\n", error.message().c_str());
+						return;
+					}
+					boost::system::error_code ec;
+					socketPtr->shutdown(tcp::socket::shutdown_both, ec);
+				});
+		});
+}
+
+
+std::shared_ptr<Session> Server::addSession(std::shared_ptr<tcp::socket> socketPtr){
+	static const SessionId MaxSlots = (SessionId)1 << SessionSlotBits;
+	std::lock_guard<std::shared_timed_mutex> lock(clientsMutex);
+	SessionId slot;
+	if( !freeSlots.empty() ) slot = freeSlots.back();
+	else if(clients.size() < MaxSlots) slot = clients.size();
+	else{
+		fprintf(stderr, "Can't accept more than %u clients\n", MaxSlots);
+		return NULL;
 	}
 
-	std::string& ep = msg->getSource();
-	assertFact(m, "network " + ep);
-}
-
-
-static inline
-void splitCommand(const std::string& s, std::string& cmd, std::string& arg){
-	std::string::size_type sp = s.find(" ");
-	if(sp == std::string::npos){
-		// Trims leading zeroes from command, if any.
-		cmd = s.substr(0, s.find_first_of( (char)0 ));
-		arg.clear();
+	SessionId id = (clients.size() > slot ? clients[slot].generation << SessionSlotBits : 0) | slot;
+	std::shared_ptr<Session> session;
+	try{
+		session = Session::makeShared(socketPtr, id, *this);
 	}
+	catch(const boost::system::system_error& ex){
+		// The client disconnected before its endpoint could be read
+		return NULL;
+	}
+
+	if(slot == clients.size()) clients.push_back(SessionSlot{0, session});
 	else{
-		cmd = s.substr(0, sp);
-		arg = s.substr(sp+1);
-		// Trims leading zeroes from arg, if any.
-		arg.erase(arg.find_first_of( (char)0 ));
+		freeSlots.pop_back();
+		clients[slot].session = session;
 	}
+	aliases[session->getEndPointStr()] = id;
+	return session;
+}
+
+
+void Server::removeSession(SessionId id){
+	std::shared_ptr<Session> disconnected;
+	{std::lock_guard<std::shared_timed_mutex> lock(clientsMutex);
+		SessionId slot = id & (((SessionId)1 << SessionSlotBits) - 1);
+		if( (slot >= clients.size()) || !clients[slot].session || (clients[slot].session->getId() != id) )
+			return;
+		disconnected = std::move(clients[slot].session);
+		// Stale ids of the slot won't match the next session
+		clients[slot].generation = (clients[slot].generation + 1) & ((SessionId)-1 >> SessionSlotBits);
+		freeSlots.push_back(slot);
+		aliases.erase( disconnected->getEndPointStr() );
+	}
+
+	// Sessions may have switched environments, so all of them are told
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	for(auto& kv : environments)
+		kv.second->sessionClosed(id);
 }
 
 
-bool Server::handleCommand(const std::string& c, std::string& result){
-	std::string cmd, arg;
-	splitCommand(c, cmd, arg);
-
-	// if( arg.empty() ) printf("Received command {%s} (%lu bytes)\n", cmd.c_str(), cmd.length());
-	// else              printf("Received command {%s %s} (%lu bytes)\n", cmd.c_str(), arg.c_str(), cmd.length() + arg.length() + 1);
-	if(cmd == "assert")     { clips::assertString(arg); return true; }
-	else if(cmd == "reset") { resetCLIPS();             return true; }
-	else if(cmd == "clear") { clearCLIPS();             return true; }
-	else if(cmd == "query") { return clips::query(arg, result); }
-	else if(cmd == "raw")   { return sendCommand(arg); }
-	else if(cmd == "path")  { return handlePath(arg); }
-	else if(cmd == "print") { return handlePrint(arg); }
-	else if(cmd == "watch") { return handleWatch(arg); }
-	else if(cmd == "load")  { return loadFile(arg); }
-	else if(cmd == "run")   { return handleRun(arg); }
-	else if(cmd == "log")   { return handleLog(arg); }
-	// printf("Rejected\n");
-	return false;
+std::vector<std::shared_ptr<Session>> Server::getSessions(const ClipsEnvironment* env){
+	std::vector<std::shared_ptr<Session>> sessions;
+	std::shared_lock<std::shared_timed_mutex> lock(clientsMutex);
+	sessions.reserve(clients.size() - freeSlots.size());
+	for(const SessionSlot& s : clients)
+		if( s.session && (!env || (s.session->getEnvironment() == env)) )
+			sessions.push_back(s.session);
+	return sessions;
 }
 
 
-bool Server::handleLog(const std::string& arg){
-	return true;
+std::shared_ptr<Session> Server::getSession(SessionId id){
+	std::shared_lock<std::shared_timed_mutex> lock(clientsMutex);
+	SessionId slot = id & (((SessionId)1 << SessionSlotBits) - 1);
+	if( (slot < clients.size()) && clients[slot].session && (clients[slot].session->getId() == id) )
+		return clients[slot].session;
+	return NULL;
 }
 
 
-bool Server::handlePath(const std::string& path){
-	std::string cpath = canonicalize_path(path);
-	if(chdir( cpath.c_str() ) != 0){
-		fprintf(stderr, "Can't access {%s}: %s\n", path.c_str(), std::strerror(errno));
-		printf("Reset clppath to {%s}\n", clppath.c_str() );
-		return false;
+/* ** ********************************************************
+*
+* Class methods: Environments
+*
+* *** *******************************************************/
+ClipsEnvironment* Server::getEnvironment(const std::string& name){
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	auto it = environments.find(name);
+	if(it != environments.end()) return it->second.get();
+
+	if( !is_valid_environment_name(name) ) return NULL;
+	if(environments.size() >= maxEnvironments){
+		fprintf(stderr, "Can't create environment '%s': limit of %lu environments reached\n",
+			name.c_str(), maxEnvironments);
+		return NULL;
 	}
-	clppath = cpath;
-	printf("clppath set to {%s}\n", clppath.c_str() );
-	publishStatus();
-	return true;
+	std::unique_ptr<ClipsEnvironment> env(new ClipsEnvironment(name, *this));
+	env->setBatching(batchSize, batchTimeout);
+	env->setIngressLimits(ingressCapacity, ingressQuota);
+	env->start();
+	ClipsEnvironment* envPtr = env.get();
+	environments[name] = std::move(env);
+	return envPtr;
 }
 
 
-bool Server::handlePrint(const std::string& arg){
-	if(arg == "facts"){       clips::printFacts();  }
-	else if(arg == "rules"){  clips::printRules();  }
-	else if(arg == "agenda"){ clips::printAgenda(); }
-	else return false;
-	return true;
+ClipsEnvironment* Server::getDefaultEnvironment(){
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	auto it = environments.find(defaultEnvironmentName);
+	return (it != environments.end()) ? it->second.get() : NULL;
 }
 
 
-int Server::handleRun(const std::string& arg){
-	int n = std::stoi(arg);
-	return clips::run(n);
+std::string Server::getClpPath() const{
+	std::lock_guard<std::mutex> lock(clppathMutex);
+	return clppath;
 }
 
 
-bool Server::handleWatch(const std::string& arg){
-	if(arg == "functions"){    clips::toggleWatch(clips::WatchItem::Deffunctions); }
-	else if(arg == "globals"){ clips::toggleWatch(clips::WatchItem::Globals);      }
-	else if(arg == "facts"){   clips::toggleWatch(clips::WatchItem::Facts);        }
-	else if(arg == "rules"){   clips::toggleWatch(clips::WatchItem::Rules);        }
-	else if( !arg.empty() ) return false;
-	publishStatus();
-	return true;
+void Server::setClpPath(const std::string& path){
+	std::lock_guard<std::mutex> lock(clppathMutex);
+	clppath = path;
 }
 
 
-void Server::acknowledgeMessage(std::shared_ptr<TcpMessage> message, bool success, const std::string& result){
-	// 1. Copy 5bytes 0x00+CommandID from original message. Discard the rest.
-	// 2. Place success as 1byte boolean
-	// 3. Append result if any.
-	// 4. Send
+std::string Server::getMetrics(){
+	// Environments are never removed, so they outlive the lock
+	std::vector<ClipsEnvironment*> envs;
+	{std::lock_guard<std::mutex> lock(environmentsMutex);
+		for(auto& kv : environments) envs.push_back(kv.second.get());
+	}
+	std::vector<std::shared_ptr<Session>> sessions = getSessions();
+
+	MetricsWriter w;
+	auto envLabel = [](const ClipsEnvironment* env){
+		return "env=\"" + env->getName() + "\"";
+	};
+
+	// Network
+	w.family("clipsserver_sessions", "gauge", "Connected clients.");
+	w.sample("clipsserver_sessions", "", sessions.size());
+	std::vector<std::string> sessionLabels;
+	for(auto& session : sessions){
+		ClipsEnvironment* env = session->getEnvironment();
+		sessionLabels.push_back("session=\"" + session->getEndPointStr() + "\"," +
+			(env ? envLabel(env) : "env=\"\""));
+	}
+	struct SessionCounter{ const char* name; const char* type; const char* help; uint64_t (Session::*get)() const; };
+	static const SessionCounter counters[] = {
+		{"clipsserver_session_frames_received_total", "counter", "Frames received from the client.", &Session::getFramesIn},
+		{"clipsserver_session_bytes_received_total",  "counter", "Bytes received from the client.",  &Session::getBytesIn},
+		{"clipsserver_session_frames_sent_total",     "counter", "Messages framed for the client.",  &Session::getFramesOut},
+		{"clipsserver_session_bytes_sent_total",      "counter", "Bytes written to the client.",     &Session::getBytesOut},
+		{"clipsserver_session_read_pauses_total",     "counter", "Times reading paused by a full queue.", &Session::getReadPauses},
+	};
+	for(const SessionCounter& c : counters){
+		w.family(c.name, c.type, c.help);
+		for(size_t i = 0; i < sessions.size(); ++i)
+			w.sample(c.name, sessionLabels[i], ((*sessions[i]).*c.get)());
+	}
+	w.family("clipsserver_session_queued_bytes", "gauge", "Bytes pending delivery to the client.");
+	for(size_t i = 0; i < sessions.size(); ++i)
+		w.sample("clipsserver_session_queued_bytes", sessionLabels[i], sessions[i]->getQueuedBytes());
+	w.family("clipsserver_session_dropped_frames_total", "counter", "Frames discarded by the overflow policy.");
+	for(size_t i = 0; i < sessions.size(); ++i)
+		w.sample("clipsserver_session_dropped_frames_total", sessionLabels[i], sessions[i]->getDroppedFrames());
+
+	// Message queues
+	w.family("clipsserver_queue_messages", "gauge", "Messages waiting to be dispatched.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_queue_messages", envLabel(env), env->getQueueSize());
+	w.family("clipsserver_queue_depth", "histogram", "Messages dispatched at once.");
+	for(ClipsEnvironment* env : envs)
+		w.histogram("clipsserver_queue_depth", envLabel(env), env->getMetrics().queueDepth);
+	w.family("clipsserver_queue_latency_microseconds", "histogram", "Time from reception to dispatch of messages.");
+	for(ClipsEnvironment* env : envs)
+		w.histogram("clipsserver_queue_latency_microseconds", envLabel(env), env->getMetrics().queueLatency);
+	w.family("clipsserver_ingress_dropped_total", "counter", "Network facts discarded due to a full queue.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_ingress_dropped_total", envLabel(env), env->getDroppedMessages());
+	w.family("clipsserver_ingress_deferred_total", "counter", "Times a client was asked to stop reading.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_ingress_deferred_total", envLabel(env), env->getDeferredReads());
+
+	// Commands, only those received at least once
+	w.family("clipsserver_command_duration_microseconds", "histogram", "Time to handle and acknowledge commands.");
+	for(ClipsEnvironment* env : envs){
+		for(const auto& kv : env->getMetrics().commands){
+			if( !kv.second->getCount() ) continue;
+			w.histogram("clipsserver_command_duration_microseconds",
+				envLabel(env) + ",command=\"" + kv.first + "\"", *kv.second);
+		}
+	}
 
-	std::string ack = message->getMessage().substr(0, 5);
-	ack+= success ? '\x01' : '\x00';
-	ack+= result;
+	// Inference engine
+	w.family("clipsserver_run_duration_microseconds", "histogram", "Duration of engine runs.");
+	for(ClipsEnvironment* env : envs)
+		w.histogram("clipsserver_run_duration_microseconds", envLabel(env), env->getMetrics().runDuration);
+	w.family("clipsserver_rules_fired_total", "counter", "Rules fired by engine runs.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_rules_fired_total", envLabel(env), env->getMetrics().rulesFired);
+	w.family("clipsserver_facts", "gauge", "Facts in the fact list.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_facts", envLabel(env), env->getMetrics().facts);
+	w.family("clipsserver_activations", "gauge", "Activations on the agenda.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_activations", envLabel(env), env->getMetrics().activations);
+	w.family("clipsserver_memory_bytes", "gauge", "Memory allocated by CLIPS.");
+	for(ClipsEnvironment* env : envs)
+		w.sample("clipsserver_memory_bytes", envLabel(env), env->getMetrics().memory);
 
-	clients[message->getSource()]->send( ack );
+	return w.str();
 }
 
 
@@ -374,29 +421,47 @@ void Server::acknowledgeMessage(std::shared_ptr<TcpMessage> message, bool succes
 *
 * *** *******************************************************/
 bool Server::broadcast(const std::string& message){
-	for(auto it = clients.begin(); it != clients.end(); ++it)
-		it->second->send( message );
+	return broadcast(message, ClipsEnvironment::current());
+}
+
+
+bool Server::broadcast(const std::string& message, const ClipsEnvironment* env){
+	// Sessions may block while sending. Don't hold the lock meanwhile.
+	for(auto& session : getSessions(env))
+		session->send( message );
 	return true;
 }
 
 
-bool Server::sendTo(const std::string& cliEP, const std::string& message){
-	if (clients.find(cliEP) == clients.end()){
-		fprintf(stderr, "Client %s disconnected or does not exist", cliEP.c_str());
+bool Server::sendTo(SessionId id, const std::string& message){
+	std::shared_ptr<Session> session = getSession(id);
+	if(!session){
+		fprintf(stderr, "Client %u disconnected or does not exist\n", id);
 		return false;
 	}
-	clients[cliEP]->send( message );
+	session->send( message );
 	return true;
 }
 
 
-bool Server::publishStatus(){
-	std::string status;
-	status+= '\0';
-	status+= "\xff\xff\xff\xff\x01watching:" + std::to_string((int)clips::getWatches());
-	status+= "|path:" + clppath;
+bool Server::sendTo(const std::string& cliEP, const std::string& message){
+	// Session ids are written in decimal. Endpoints always have a colon.
+	if( !cliEP.empty() && (cliEP.length() <= 10) &&
+		(cliEP.find_first_not_of("0123456789") == std::string::npos) ){
+		unsigned long long id = std::stoull(cliEP);
+		if(id <= (SessionId)-1) return sendTo( (SessionId)id, message );
+	}
 
-	return broadcast(status);
+	SessionId id;
+	{std::shared_lock<std::shared_timed_mutex> lock(clientsMutex);
+		auto it = aliases.find(cliEP);
+		if(it == aliases.end()){
+			fprintf(stderr, "Client %s disconnected or does not exist\n", cliEP.c_str());
+			return false;
+		}
+		id = it->second;
+	}
+	return sendTo(id, message);
 }
 
 
@@ -406,9 +471,16 @@ bool Server::publishStatus(){
 *
 * *** *******************************************************/
 void Server::stop(){
-	running = false;
+	io_context.stop();
 	if(asyncThread.joinable())
 		asyncThread.join();
+
+	// Release environments blocked while sending
+	for(auto& session : getSessions())
+		session->close();
+	std::lock_guard<std::mutex> lock(environmentsMutex);
+	for(auto& env : environments)
+		env.second->stop();
 }
 
 
@@ -420,15 +492,14 @@ void Server::runAsync(){
 void Server::run(){
 	if(running) return;
 	running = true;
-	// Loop forever
-	while(running){
-		io_context.poll();
-		if( queue.empty() ){
-			std::this_thread::sleep_for(std::chrono::milliseconds(20));
-			continue;
-		}
-		parseMessage( queue.consume() );
-	}
+	io_context.restart();
+	// Sleeps until a network event arrives. Returns once stopped.
+	for(size_t i = 1; i < ioThreads; ++i)
+		ioPool.emplace_back([this](){ io_context.run(); });
+	io_context.run();
+	for(std::thread& t : ioPool) t.join();
+	ioPool.clear();
+	running = false;
 }
 
 
@@ -472,6 +543,40 @@ bool Server::parseArgs(int argc, char **argv){
 		else if (!strcmp(argv[i],"-p")){
 			port = std::stoi(argv[++i]);
 		}
+		else if (!strcmp(argv[i],"-b")){
+			batchSize = std::stoul(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-t")){
+			batchTimeout = std::stoul(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-i")){
+			ingressCapacity = std::stoul(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-s")){
+			ingressQuota = std::stoul(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-q")){
+			writeHighWaterMark = std::stoul(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-n")){
+			maxEnvironments = std::stoul(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-j")){
+			ioThreads = std::max(1ul, std::stoul(argv[++i]));
+		}
+		else if (!strcmp(argv[i],"-m")){
+			metricsPort = std::stoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i],"-o")){
+			std::string policy(argv[++i]);
+			if(policy == "drop")            overflowPolicy = OverflowPolicy::Drop;
+			else if(policy == "disconnect") overflowPolicy = OverflowPolicy::Disconnect;
+			else if(policy == "block")      overflowPolicy = OverflowPolicy::Block;
+			else{
+				fprintf(stderr, "Unknown overflow policy {%s}\n", argv[i]);
+				return false;
+			}
+		}
 
 	}
 	return true;
@@ -487,6 +592,16 @@ void Server::printDefaultArgs(std::string const& pname){
 	std::cout << " -e "   << ( (clipsFile.length() > 0) ? clipsFile : "''");
 	std::cout << " -w "   << flgFacts;
 	std::cout << " -r "   << flgRules;
+	std::cout << " -b "   << batchSize;
+	std::cout << " -t "   << batchTimeout;
+	std::cout << " -i "   << ingressCapacity;
+	std::cout << " -s "   << ingressQuota;
+	std::cout << " -q "   << writeHighWaterMark;
+	std::cout << " -o "   << (overflowPolicy == OverflowPolicy::Drop ? "drop" :
+	                          overflowPolicy == OverflowPolicy::Disconnect ? "disconnect" : "block");
+	std::cout << " -n "   << maxEnvironments;
+	std::cout << " -m "   << metricsPort;
+	std::cout << " -j "   << ioThreads;
 	std::cout << std::endl << std::endl;
 }
 
@@ -500,6 +615,15 @@ void Server::printHelp(std::string const& pname){
 	std::cout << "-e clipsFile ";
 	std::cout << "-w watch_facts ";
 	std::cout << "-r watch_rules ";
+	std::cout << "-b batch_size ";
+	std::cout << "-t batch_timeout_us ";
+	std::cout << "-i ingress_capacity ";
+	std::cout << "-s ingress_quota_per_client ";
+	std::cout << "-q write_high_water_bytes ";
+	std::cout << "-o overflow_policy (drop|disconnect|block) ";
+	std::cout << "-n max_environments ";
+	std::cout << "-m metrics_http_port ";
+	std::cout << "-j io_threads ";
 	std::cout << std::endl << std::endl;
 	std::cout << "Example:" << std::endl;
 	std::cout << "    " << pname << " -e virbot.dat -w 1 -r 1"  << std::endl;
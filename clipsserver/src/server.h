@@ -14,9 +14,15 @@
 #pragma once
 
 /** @cond */
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <shared_mutex>
 #include <thread>
 #include <string>
+#include <vector>
 #include <iomanip>
+#include <functional>
 #include <unordered_map>
 
 #include <boost/asio.hpp>
@@ -24,11 +30,14 @@
 
 #include "session.h"
 #include "tcp_message.h"
-#include "sync_queue.h"
+#include "clips_environment.h"
 
 
 /**
- * Implements a base class for a bridge between ROS and CLIPS
+ * Implements a base class for a bridge between ROS and CLIPS.
+ * The server hosts one or more named CLIPS environments, each running
+ * on its own worker thread. Sessions are bound to the default
+ * environment upon connection and may switch with the env command.
  */
 class Server{
 public:
@@ -52,7 +61,7 @@ private:
 
 public:
 	/**
-	 * Initializes the bridge. Must be called after
+	 * Initializes the bridge and starts the default environment.
 	 * @param  argc  main's argc
 	 * @param  argv  main's argv
 	 * @return       true if initialization completed successfully, false otherwise
@@ -60,30 +69,18 @@ public:
 	bool init(int argc, char **argv);
 
 	/**
-	 * Loads a file
-	 * @remark       Works only with clp or dat file extensions.
-	 *               A dat file contains several clp files.
-	 * @param  fpath The path of the file to load
-	 * @return       true if the file was loaded successfully, false otherwise
+	 * Sets the function that registers user functions in CLIPS.
+	 * It is called by the worker thread of every environment right
+	 * after initializing CLIPS, so it must be set before init().
+	 * @param initializer The function that registers user functions
 	 */
-	bool loadFile(std::string const& fpath);
+	void setUserFunctionsInitializer(std::function<void()> initializer);
 
 	/**
-	 * Loads a clp file
-	 * @param  fpath The path of the file to load
-	 * @return       true if the file was loaded successfully, false otherwise
-	 */
-	bool loadClp(std::string const& fpath);
-
-	/**
-	 * Loads a dat file
-	 * @param  fpath The path of the file to load
-	 * @return       true if the file was loaded successfully, false otherwise
-	 */
-	bool loadDat(std::string const& fpath);
-
-	/**
-	 * Runs the bridge, blocking the calling thread until ROS is shutdown
+	 * Runs the bridge, blocking the calling thread until stop() is called.
+	 * The calling thread and ioThreads - 1 more handle all network I/O
+	 * while the environments dispatch their messages on their own
+	 * worker threads. Each session runs its handlers in a strand.
 	 */
 	void run();
 
@@ -98,154 +95,85 @@ public:
 	void stop();
 
 	/**
-	 * Enqueues a received TCP message in the server's message queue
-	 * @param messagePtr A pointer to the received message
+	 * Gets the environment with the specified name, starting it if it
+	 * does not exist yet and the maximum number of environments has
+	 * not been reached.
+	 * @param  name The name of the environment
+	 * @return      The requested environment, or NULL if the name is
+	 *              invalid or no more environments can be created
 	 */
-	void enqueueTcpMessage(std::shared_ptr<TcpMessage> messagePtr);
+	ClipsEnvironment* getEnvironment(const std::string& name);
 
 	/**
-	 * Removes a session from the server. Called by Session upon disconnection.
-	 * @param sPtr The remote endpoint of the session to remove.
+	 * Gets the environment sessions are bound to upon connection
+	 * @return The default environment
 	 */
-	void removeSession(const std::string& srep);
-
-
+	ClipsEnvironment* getDefaultEnvironment();
 
-protected:
 	/**
-	 * Asserts the input string as a fact as (assert (network s))
-	 * @param s                    The string to be asserted
-	 * @param fact                 Optional. The fact under which \p s
-	 *                             will be asserted. When empty it
-	 *                             defaults to whatever defaultMsgInFact
-	 *                             is set. Default: an empty string.
-	 * @param resetFactListChanged Optional. When true
-	 *                             clips::setFactListChanged(0) is reset,
-	 *                             telling clips that no changes to the
-	 *                             facts list have been done.
-	 *                             Default: true
+	 * Removes a session from the server. Called by Session upon disconnection.
+	 * @param id The id of the session to remove.
 	 */
-	void assertFact(const std::string& s, const std::string& fact = "", bool resetFactListChanged = true);
+	void removeSession(SessionId id);
 
 	/**
-	 * Injects a command into CLIPS by calling clisp::sendCommand(s)
-	 * @param s The CLIPS command to be injected
+	 * Gets the basepath where CLP files are located
+	 * @return The basepath where CLP files are located
 	 */
-	bool sendCommand(std::string const& s);
+	std::string getClpPath() const;
 
 	/**
-	 * Clears CLIPS by calling clips::clear()
-	 */
-	void clearCLIPS();
-	/**
-	 * Resets CLIPS by calling clips::reset()
+	 * Gets the metrics of the server, its sessions and environments in
+	 * the Prometheus text exposition format. Safe to call from any thread.
+	 * @return The metrics
 	 */
-	void resetCLIPS();
-	// std::string& eval(std::string const& s); // Unsupported in 6.0
+	std::string getMetrics();
 
 
-	/**
-	 * Initializes CLIPS.
-	 * It calls clips::initialize(), clips::rerouteStdin(argc, argv)
-	 * and clips::clear() in that order before loading the file
-	 * specified by Server::clips_file.
-	 * @param argc The main's argc
-	 * @param argv The main's argv
-	 */
-	virtual void initCLIPS(int argc, char **argv);
 
+protected:
 	/**
 	 * Initializes the TCP server.
 	 */
 	virtual bool initTcpServer();
 
-private:
-
 	/**
-	 * Parses messages received via network.
-	 * Two types of messages are accepted: facts and commands.
-	 * Any non-command string is considered a fact and thus is asserted
-	 * with Server::assertFact().
-	 * Commands are strings that start with a NULL character ('\\0').
-	 * The following commands are supported:
-	 * assert      calls clips::assertString()
-	 * reset       calls clips::reset()
-	 * clear       calls clips::clear()
-	 * raw         Injects a code via sendCommand()
-	 * print what  Prints facts, rules or agenda
-	 * watch what  Toggles the specified watches
-	 * load  file  Loads the specified file
-	 * run num     Performs the specified number of runs
-	 * log         Unimplemented
-	 *
-	 * @param cliEp      The message source. A string representation of the
-	 *                   remote endpoint of the network client that sends the message
-	 * @param message    The received message
+	 * Initializes the HTTP listener that serves the metrics, if a
+	 * metrics port was specified
 	 */
-	void parseMessage(std::shared_ptr<TcpMessage> m);
-	// void parseMessage(const TcpMessage& m);
+	virtual bool initMetricsServer();
 
 	/**
-	 * Acknowledges reception/excecution of a message
-	 * @param message   The message to acknowledge
-	 * @param success   Optional. Indicates whether the command contained in the message
-	 *                  was successfully executed. Default: true.
-	 * @param response  Optional. Contains the execution result of the command contained
-	 *                  in the message, if any. Default: an empty string.
+	 * Calls the user functions initializer, if any.
+	 * Called by the environments' worker threads.
 	 */
-	void acknowledgeMessage(std::shared_ptr<TcpMessage> message, bool success=true, const std::string& result = "");
+	void initUserFunctions();
 
 	/**
-	 * Handles commands received via topicIn
-	 * @param c The received command message
+	 * Sets the basepath where CLP files are located
+	 * @param path The basepath where CLP files are located
 	 */
-	bool handleCommand(const std::string& c, std::string& result);
-
-	/**
-	 * Unimplemented
-	 * @param arg Unimplemented
-	 */
-	bool handleLog(const std::string& arg);
-
-	/**
-	 * Handles path request commands received via topicIn
-	 * @param path The path where CLP files are
-	 */
-	bool handlePath(const std::string& path);
-
-	/**
-	 * Handles print request commands received via topicIn
-	 * @param arg What to print. Accepted values are facts, rules
-	 *            and agenda.
-	 */
-	bool handlePrint(const std::string& arg);
-
-	/**
-	 * Handles run request commands received via topicIn.
-	 * On a successful parsing of the argument performs clips::run(arg)
-	 * @param arg A string representation of an integer specifying
-	 *            the maximum number of run steps to perform
-	 */
-	int handleRun(const std::string& arg);
-
-	/**
-	 * Handles toggle-watch request commands received via topicIn.
-	 * On a successful parsing of the argument toggles the watching
-	 * of functions, globals, facts or rules
-	 * @param arg A string specifying which watch shall be toggled
-	 */
-	bool handleWatch(const std::string& arg);
+	void setClpPath(const std::string& path);
 
+private:
 	/**
 	 * Parses command line arguments.
 	 * Supported arguments are:
-	 * -i   default input topic  (topicIn)
-	 * -o   default output topic (topicOut)
-	 * -s   default status_topic (topicStatus)
 	 * -d   clp base path (where clips files are
 	 * -e   File to load upon initialization
 	 * -w   Indicates whether to watch facts upon initialization
 	 * -r   Indicates whether to watch rules upon initialization
+	 * -p   TCP port to listen on
+	 * -b   Number of network facts per batch (0 disables batching)
+	 * -t   Batch timeout in microseconds (0 flushes on every dispatch)
+	 * -i   Maximum number of messages queued per environment
+	 * -s   Maximum number of messages queued per client
+	 * -q   Per-client outbound queue high-water mark in bytes
+	 * -o   Policy when a client exceeds the high-water mark
+	 *      (drop, disconnect or block)
+	 * -n   Maximum number of environments
+	 * -m   HTTP port serving the metrics (0 disables it)
+	 * -j   Number of threads handling network I/O
 	 * @param  argc The main's argc
 	 * @param  argv The main's argv
 	 * @return      true if arguments were successfully parsed,
@@ -265,6 +193,30 @@ private:
 	 */
 	void printHelp(const std::string& pname);
 
+	/**
+	 * Creates a session for an accepted connection and registers it
+	 * in the session table
+	 * @param  socketPtr The connection socket
+	 * @return           The new session, or NULL if the session table is
+	 *                   full or the client already disconnected
+	 */
+	std::shared_ptr<Session> addSession(std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr);
+
+	/**
+	 * Gets the active sessions
+	 * @param  env Environment the sessions must be bound to,
+	 *             or NULL to get all sessions
+	 * @return     The sessions
+	 */
+	std::vector<std::shared_ptr<Session>> getSessions(const ClipsEnvironment* env = NULL);
+
+	/**
+	 * Gets an active session
+	 * @param  id The id of the session
+	 * @return    The session, or NULL if it disconnected or does not exist
+	 */
+	std::shared_ptr<Session> getSession(SessionId id);
+
 	/**
 	 * Handles incomming connections and starts an asynchronous accept again
 	 * @param error      Error produced when accepting the connection
@@ -274,54 +226,66 @@ private:
 	void acceptHandler(const boost::system::error_code& error, std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr);
 
 	/**
-	 * Handles incomming data through a socket
-	 * @param error Error produced when accepting the connection
-	 * @param peer  The number of bytes transferred
+	 * Starts an asynchronous accept of HTTP metrics requests
 	 */
-	void asyncReadHandler(const boost::system::error_code& error, size_t bytes_transferred);
+	void beginMetricsAccept();
 
 	/**
-	 * Publishes a message to the default output topic (topicOut)
+	 * Reads an HTTP request and replies the metrics, closing the
+	 * connection afterwards
+	 * @param socketPtr The socket connected with the HTTP client
+	 */
+	void serveMetrics(std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr);
+
+	/**
+	 * Sends a message to all clients bound to the environment running
+	 * on the calling thread, or to all clients if called from outside
+	 * an environment.
 	 * @param  message The message to be published
 	 * @return         true if the message was successfully published,
 	 *                 false otherwise
 	 */
 	bool broadcast(const std::string& message);
 
+	/**
+	 * Sends a message to all clients bound to the specified environment
+	 * @param  message The message to be published
+	 * @param  env     The environment whose clients receive the message.
+	 *                 When NULL the message is sent to all clients.
+	 * @return         true if the message was successfully published,
+	 *                 false otherwise
+	 */
+	bool broadcast(const std::string& message, const ClipsEnvironment* env);
+
 	/**
 	 * Sends a message to the specified client.
-	 * @param  destPort   A string representation of the client's
-	 *                    remote endpoint
+	 * Safe to call from any thread.
+	 * @param  id         The id of the client's session
 	 * @param  message    The message to be published
 	 * @return            true if the message was sent successfully,
 	 *                    false otherwise
 	 */
-	bool sendTo(const std::string& cliEP, const std::string& message);
-
-	/**
-	 * Publishes the status of the bridge to topicStatus
-	 * @return         true if the status was successfully published,
-	 *                 false otherwise
-	 */
-	bool publishStatus();
+	bool sendTo(SessionId id, const std::string& message);
 
 	/**
-	 * Prints all facts by calling clips::printFacts()
+	 * Sends a message to the specified client.
+	 * Safe to call from any thread.
+	 * @param  cliEP      A string representation of the client's
+	 *                    remote endpoint, or its session id in decimal
+	 * @param  message    The message to be published
+	 * @return            true if the message was sent successfully,
+	 *                    false otherwise
 	 */
-	void printFacts();
+	bool sendTo(const std::string& cliEP, const std::string& message);
 
-	/**
-	 * Prints all facts by calling clips::printRules()
-	 */
-	void printRules();
 
+private:
 	/**
-	 * Prints all facts by calling clips::printAgenda()
+	 * Environments call back the server to deliver messages and share
+	 * the working directory
 	 */
-	void printAgenda();
+	friend class ClipsEnvironment;
 
-
-private:
 	/**
 	 * Friend function called by the homonymous registered CLIPS user-
 	 * function when (sendto destport message) is invoked.
@@ -335,6 +299,17 @@ private:
 	 */
 	friend int server_sendto_invoker(Server& server, const std::string& cliEP, const std::string& message);
 
+	/**
+	 * Friend function called by the homonymous registered CLIPS user-
+	 * function when (sendto id message) is invoked with a session id.
+	 * @param  server     A reference to this server
+	 * @param  id         The id of the session where the message will
+	 *                    be delivered
+	 * @param  message    The message to send
+	 * @return            0 if the mesage was sent, -1 otherwise
+	 */
+	friend int server_sendto_invoker(Server& server, SessionId id, const std::string& message);
+
 	/**
 	 * Friend function called by the homonymous registered CLIPS user-
 	 * function when (broadcast message) is invoked.
@@ -349,8 +324,8 @@ private:
 
 protected:
 	/**
-	 * Stores the file that will be loaded into CLIPS during
-	 * initialization.
+	 * Stores the file that will be loaded into the default environment
+	 * during initialization.
 	 */
 	std::string clipsFile;
 
@@ -370,48 +345,161 @@ protected:
 	std::string clppath;
 
 	/**
-	 * Internal flag that keeps the bridge running.
-	 * It is set to true by run() until changed to false by stop() or
-	 * unless an external event modifies it.
+	 * Protects clppath
+	 */
+	mutable std::mutex clppathMutex;
+
+	/**
+	 * Serializes changes of the working directory and file loads,
+	 * since the working directory is shared by all environments
 	 */
-	bool running;
+	std::mutex pathMutex;
 
 	/**
-	 * The syncrhonous queue used to pass messages to CLIPS.
-	 * @remark CLIPS functions crash if called from a separate thread.
+	 * The main's argc, rerouted to the default environment
 	 */
-	sync_queue<std::shared_ptr<TcpMessage>> queue;
+	int argc;
+
+	/**
+	 * The main's argv, rerouted to the default environment
+	 */
+	char** argv;
+
+	/**
+	 * Internal flag set while the bridge is running.
+	 */
+	std::atomic<bool> running;
 
 	/**
 	 * Thread used to asynchronously run the bridge
 	 */
 	std::thread asyncThread;
 
+	/**
+	 * Number of threads running the io_context
+	 */
+	size_t ioThreads;
+
+	/**
+	 * Threads running the io_context along with the one that called run()
+	 */
+	std::vector<std::thread> ioPool;
+
 	/**
 	 * Stores the name of the topic this bridge listens to
 	 */
 	uint16_t port;
 
+	/**
+	 * The HTTP port serving the metrics. Zero disables it.
+	 */
+	uint16_t metricsPort;
+
 	/**
 	 * Context required for async connections
 	 */
 	boost::asio::io_context io_context;
 
+	/**
+	 * Maximum number of network facts asserted per batch.
+	 * Zero disables batching, asserting each fact upon arrival.
+	 */
+	size_t batchSize;
+
+	/**
+	 * Maximum time in microseconds a fact waits in the batch before
+	 * the batch is flushed. Zero flushes the batch every time the
+	 * message queue is drained.
+	 */
+	uint32_t batchTimeout;
+
+	/**
+	 * Maximum number of messages queued in an environment. Beyond it
+	 * network facts are discarded.
+	 */
+	size_t ingressCapacity;
+
+	/**
+	 * Maximum number of messages a client may have queued before the
+	 * server stops reading from it
+	 */
+	size_t ingressQuota;
+
+	/**
+	 * Maximum number of bytes queued for delivery to a single client
+	 */
+	size_t writeHighWaterMark;
+
+	/**
+	 * What to do when a client exceeds writeHighWaterMark
+	 */
+	OverflowPolicy overflowPolicy;
+
+	/**
+	 * Maximum number of environments hosted by the server
+	 */
+	size_t maxEnvironments;
+
+	/**
+	 * Function that registers user functions in each environment
+	 */
+	std::function<void()> userFunctionsInitializer;
+
+	/**
+	 * Environments hosted by the server, by name
+	 */
+	std::map<std::string, std::unique_ptr<ClipsEnvironment>> environments;
+
+	/**
+	 * Protects environments
+	 */
+	std::mutex environmentsMutex;
+
 	/**
 	 * Pointer to an acceptor objects that handles incomming connections
 	 */
 	std::shared_ptr<boost::asio::ip::tcp::acceptor> acceptorPtr;
 
 	/**
-	 * Stores the name of the fact where network messages are asserted.
+	 * Acceptor of HTTP metrics requests, if enabled
+	 */
+	std::shared_ptr<boost::asio::ip::tcp::acceptor> metricsAcceptorPtr;
+
+	/**
+	 * A slot of the session table
+	 */
+	struct SessionSlot{
+		/**
+		 * Number of sessions that held the slot
+		 */
+		SessionId generation;
+		/**
+		 * The session holding the slot, if any
+		 */
+		std::shared_ptr<Session> session;
+	};
+
+	/**
+	 * Active connections to tcp clients, indexed by the slot bits of
+	 * their ids
+	 */
+	std::vector<SessionSlot> clients;
+
+	/**
+	 * Slots of clients released by disconnected sessions
+	 */
+	std::vector<SessionId> freeSlots;
+
+	/**
+	 * Ids of the active sessions by remote endpoint
 	 */
-	std::string defaultMsgInFact;
+	std::unordered_map<std::string, SessionId> aliases;
 
 	/**
-	 * Active connections to tcp clients
+	 * Protects clients, freeSlots and aliases, which are modified by
+	 * the network threads and looked up by the environments' threads
 	 */
-	// std::unordered_map<boost::asio::ip::tcp::endpoint, std::shared_ptr<boost::asio::ip::tcp::socket>> clients;
-	std::unordered_map<std::string, std::shared_ptr<Session>> clients;
+	std::shared_timed_mutex clientsMutex;
 
 
 };
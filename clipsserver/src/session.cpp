@@ -1,20 +1,57 @@
 #include "server.h"
 #include "session.h"
+#include "clips_environment.h"
+#include <cstring>
 #include <boost/bind/bind.hpp>
 
 namespace ph = std::placeholders;
 namespace asio = boost::asio;
 using asio::ip::tcp;
 
+/**
+ * Chunks are large enough to hold the largest v1 frame (64kB).
+ * Larger v2 frames are received in dedicated buffers.
+ */
+BufferPool Session::readPool(0x10000, 256);
+
+constexpr uint8_t Session::MaxProtocolVersion;
+constexpr uint8_t Session::FrameFlagMore;
+constexpr size_t  Session::MaxFragmentSize;
+constexpr size_t  Session::MaxMessageSize;
+
+/* ** ********************************************************
+* Local helpers
+* *** *******************************************************/
+/**
+ * Size of the frame header for each protocol version
+ */
+static inline
+size_t header_size(uint8_t version){
+	return (version < 2) ? 2 : 5;
+}
+
+/**
+ * Longest time a sender waits under the block overflow policy before
+ * the client is disconnected
+ */
+static const std::chrono::seconds BlockTimeout(5);
+
 
 Session::Session(std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr,
-				 Server& server):
-	socketPtr(socketPtr), server(server){
+				 SessionId id, Server& server):
+	id(id),
+	chunkBegin(0), chunkEnd(0), chunkCapacity(0), readVersion(1), writeVersion(1),
+	socketPtr(socketPtr), queuedBytes(0), closed(false), paused(false), readPauses(0),
+	ingress(std::make_shared<IngressQueue::Source>()),
+	environment(NULL), highWaterMark(-1),
+	overflowPolicy(OverflowPolicy::Block), droppedFrames(0),
+	framesIn(0), bytesIn(0), framesOut(0), bytesOut(0), server(server){
 		std::ostringstream os;
 		auto ep = socketPtr->remote_endpoint();
 		os << ep;
-		endpoint = os.str();
-		beginAsyncReceivePoll();
+		endpoint = std::make_shared<const std::string>(os.str());
+		// Writes from the io_context must never block
+		socketPtr->non_blocking(true);
 	}
 
 Session::~Session(){
@@ -23,22 +60,76 @@ Session::~Session(){
 	this->socketPtr = NULL;
 }
 
+SessionId Session::getId() const{
+	return id;
+}
+
+uint8_t Session::getProtocolVersion() const{
+	return writeVersion;
+}
+
 std::string Session::getEndPointStr() const{
-	return endpoint;
+	return *endpoint;
 }
 
 std::shared_ptr<boost::asio::ip::tcp::socket> Session::getSocketPtr() const{
 	return socketPtr;
 }
 
+void Session::setHighWaterMark(size_t bytes){
+	highWaterMark = bytes;
+}
+
+void Session::setOverflowPolicy(OverflowPolicy policy){
+	overflowPolicy = policy;
+}
+
+size_t Session::getQueuedBytes() const{
+	return queuedBytes;
+}
+
+size_t Session::getDroppedFrames() const{
+	return droppedFrames;
+}
+
+uint64_t Session::getFramesIn() const{
+	return framesIn;
+}
+
+uint64_t Session::getBytesIn() const{
+	return bytesIn;
+}
+
+uint64_t Session::getFramesOut() const{
+	return framesOut;
+}
+
+uint64_t Session::getBytesOut() const{
+	return bytesOut;
+}
+
+uint64_t Session::getReadPauses() const{
+	return readPauses;
+}
+
+ClipsEnvironment* Session::getEnvironment() const{
+	return environment;
+}
+
+void Session::setEnvironment(ClipsEnvironment* env){
+	environment = env;
+}
+
+
+void Session::start(){
+	asio::post(socketPtr->get_executor(), boost::bind(&Session::beginAsyncReceivePoll, shared_from_this()));
+}
+
 
 void Session::beginAsyncReceivePoll(){
-	buffer.prepare(0xffff);
-	// asio::async_read_until(*socketPtr, buffer, "\n",
-	asio::async_read(*socketPtr, buffer,
-		// boost::bind(&Session::checkTransferComplete, this,
-			// boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred),
-		boost::asio::transfer_at_least(3),
+	prepareReadChunk();
+	socketPtr->async_read_some(
+		asio::buffer(chunk.get() + chunkEnd, chunkCapacity - chunkEnd),
 		boost::bind(&Session::asyncReadHandler, this,
 			boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)
 	);
@@ -52,64 +143,377 @@ size_t Session::checkTransferComplete(const boost::system::error_code& error, si
 
 void Session::asyncReadHandler(const boost::system::error_code& error, size_t bytes_transferred){
 	if(error){
-		server.removeSession(endpoint);
+		close();
+		server.removeSession(id);
 		// delete this;
 		return;
 	}
 
-	std::istream is(&buffer);
+	chunkEnd+= bytes_transferred;
+	bytesIn+= bytes_transferred;
+	if( !parseFrames() ){
+		fprintf(stderr, "Client %s sent an oversized message. Disconnecting.\n", endpoint->c_str());
+		// The pending read fails and removes the session
+		close();
+		return;
+	}
+	if(!paused) beginAsyncReceivePoll();
+}
+
+
+void Session::resumeReceive(){
+	paused = false;
+	// Without a pending read nothing else removes the session
+	if(closed){
+		server.removeSession(id);
+		return;
+	}
+	if( !parseFrames() ){
+		fprintf(stderr, "Client %s sent an oversized message. Disconnecting.\n", endpoint->c_str());
+		close();
+		server.removeSession(id);
+		return;
+	}
+	if(!paused) beginAsyncReceivePoll();
+}
+
+
+size_t Session::peekFrameSize(uint8_t& flags) const{
+	size_t hdrsize = header_size(readVersion);
+	flags = 0;
+	if(chunkEnd - chunkBegin < hdrsize) return hdrsize;
+
+	const char* hdr = chunk.get() + chunkBegin;
+	if(readVersion < 2){
+		// v1 header is 2 bytes and contains the size of the frame
+		uint16_t framesize;
+		std::memcpy(&framesize, hdr, sizeof(framesize));
+		// Empty or malformed frames are skipped
+		return (framesize < hdrsize) ? hdrsize : framesize;
+	}
+	// v2 header is 4 bytes with the size of the payload plus 1 flags byte
+	uint32_t payloadsize;
+	std::memcpy(&payloadsize, hdr, sizeof(payloadsize));
+	flags = hdr[4];
+	return hdrsize + payloadsize;
+}
+
 
-	do{
+bool Session::parseFrames(){
+	uint8_t flags;
+	while(!paused){
 		// 1. Fetch header.
-		// Header is 2 bytes and contains the size of the message
-		uint16_t msgsize = peekMessageHeader(is);
-		// 2. If the buffer size is smaller than the header the message is incomplete. Skip.
-		if(buffer.size() < msgsize) break;
-		// 3. Retrieve the message
-		std::string s = fetchStringFromBuffer(is);
-		// 4. Enqueue the message
-		server.enqueueTcpMessage( TcpMessage::makeShared(endpoint, s) );
-	}while(buffer.size() > 0);
-	beginAsyncReceivePoll();
+		size_t hdrsize = header_size(readVersion);
+		size_t framesize = peekFrameSize(flags);
+		if(framesize - hdrsize > MaxMessageSize) return false;
+		// 2. If the buffer size is smaller than the frame the message is incomplete. Skip.
+		if(chunkEnd - chunkBegin < framesize) break;
+		// 3. Handle the payload. Handling may change the protocol version.
+		const char* payload = chunk.get() + chunkBegin + hdrsize;
+		chunkBegin+= framesize;
+		++framesIn;
+		if( !handleFrame(payload, framesize - hdrsize, flags) ) return false;
+	}
+	return true;
 }
 
-uint16_t Session::peekMessageHeader(std::istream& is){
-	uint16_t hdr;
-	is.read((char*)&hdr, sizeof(hdr));
-	is.unget(); is.unget();
-	return hdr;
+
+bool Session::handleFrame(const char* payload, size_t length, uint8_t flags){
+	// Fragments are reassembled before being handled
+	if(flags & FrameFlagMore){
+		if(fragments.length() + length > MaxMessageSize) return false;
+		fragments.append(payload, length);
+		return true;
+	}
+
+	std::shared_ptr<const char> data;
+	if( fragments.empty() ){
+		if(!length) return true;
+		data = std::shared_ptr<const char>(chunk, payload);
+	}
+	else{
+		if(fragments.length() + length > MaxMessageSize) return false;
+		fragments.append(payload, length);
+		auto msgPtr = std::make_shared<std::string>( std::move(fragments) );
+		fragments.clear();
+		data = std::shared_ptr<const char>(msgPtr, msgPtr->data());
+		length = msgPtr->length();
+	}
+
+	// Protocol negotiation and environment binding are handled by the session
+	if( handleProtocolRequest(data.get(), length) ) return true;
+	if( handleEnvironmentRequest(data.get(), length) ) return true;
+	// 4. Enqueue a message referencing the payload
+	ClipsEnvironment* env = environment;
+	if( !env || (env->enqueueTcpMessage( TcpMessage::makeShared(id, endpoint, data, length), ingress ) != IngressQueue::Admission::Paused) )
+		return true;
+
+	// The environment is full: stop reading until it drains, so the
+	// client is throttled by TCP flow control
+	auto self = shared_from_this();
+	paused = env->deferResume(ingress, [self](){
+		asio::post(self->socketPtr->get_executor(), [self](){ self->resumeReceive(); });
+	});
+	if(paused) ++readPauses;
+	return true;
 }
 
-std::string Session::fetchStringFromBuffer(std::istream& is){
-	// Reads header again
-	uint16_t bytesToRead;
-	is.read((char*)&bytesToRead, sizeof(bytesToRead));
-	bytesToRead-= sizeof(bytesToRead);
 
-	std::string s(bytesToRead+1, 0);
-	is.read(&s[0], bytesToRead);
-	return s;
+bool Session::handleProtocolRequest(const char* payload, size_t length){
+	// Request is 0x00 + 4byte CmdId + "proto " + version
+	static const std::string cmd("proto ");
+	if( (length < 5 + cmd.length() + 1) || payload[0] || cmd.compare(0, cmd.length(), payload + 5, cmd.length()) )
+		return false;
+
+	int version = std::atoi( std::string(payload + 5 + cmd.length(), length - 5 - cmd.length()).c_str() );
+	bool supported = (version >= 1) && (version <= MaxProtocolVersion);
+
+	// The reply is framed with the current version. Following frames use the new one.
+	std::string ack(payload, 5);
+	ack+= supported ? '\x01' : '\x00';
+	ack+= std::to_string(supported ? version : (int)writeVersion.load());
+	write(ack);
+	if(supported) readVersion = writeVersion = version;
+	return true;
+}
+
+
+bool Session::handleEnvironmentRequest(const char* payload, size_t length){
+	// Request is 0x00 + 4byte CmdId + "env" [+ " " + name]
+	static const std::string cmd("env");
+	if( (length < 5 + cmd.length()) || payload[0] || cmd.compare(0, cmd.length(), payload + 5, cmd.length()) )
+		return false;
+	if( (length > 5 + cmd.length()) && (payload[5 + cmd.length()] != ' ') )
+		return false;
+
+	std::string name;
+	if(length > 5 + cmd.length() + 1)
+		name.assign(payload + 5 + cmd.length() + 1, length - 5 - cmd.length() - 1);
+	std::string::size_type zp = name.find_first_of( (char)0 );
+	if(zp != std::string::npos) name.erase(zp);
+
+	// Without a name the request queries the current environment
+	ClipsEnvironment* env = name.empty() ? environment.load() : server.getEnvironment(name);
+	if(env) environment = env;
+
+	std::string ack(payload, 5);
+	ack+= env ? '\x01' : '\x00';
+	ack+= environment.load()->getName();
+	write(ack);
+	if(env) write( env->getStatus() );
+	return true;
+}
+
+
+void Session::prepareReadChunk(){
+	if(!chunk){
+		chunk = readPool.acquire();
+		chunkCapacity = readPool.getChunkSize();
+		chunkBegin = chunkEnd = 0;
+		return;
+	}
+
+	size_t pending = chunkEnd - chunkBegin;
+	if( !pending && (chunk.use_count() == 1) ){
+		chunkBegin = chunkEnd = 0;
+		return;
+	}
+
+	// Keep reading into the current chunk while the pending frame fits
+	uint8_t flags;
+	size_t needed = peekFrameSize(flags);
+	if( (chunkEnd < chunkCapacity) && (chunkBegin + needed <= chunkCapacity) ) return;
+
+	// Chunks referenced by messages are never overwritten.
+	// Frames larger than a pooled chunk get a dedicated buffer.
+	std::shared_ptr<char> next;
+	size_t capacity = readPool.getChunkSize();
+	if(needed > capacity)
+		next = std::shared_ptr<char>(new char[capacity = needed], std::default_delete<char[]>());
+	else if( (chunk.use_count() == 1) && (chunkCapacity == capacity) )
+		next = chunk;
+	else
+		next = readPool.acquire();
+	std::memmove(next.get(), chunk.get() + chunkBegin, pending);
+	chunk = next;
+	chunkCapacity = capacity;
+	chunkBegin = 0;
+	chunkEnd = pending;
+}
+
+
+std::string Session::makeFrames(const std::string& s) const{
+	std::string frames;
+	if(writeVersion < 2){
+		// v1 frames can't hold more than 64kB
+		size_t length = s.length();
+		if(length > 0xffff - 2){
+			fprintf(stderr, "Message to %s exceeds 64kB and was truncated. Client does not support protocol v2.\n", endpoint->c_str());
+			length = 0xffff - 2;
+		}
+		uint16_t packetsize = 2 + length;
+		frames.reserve(packetsize);
+		frames.append((char*)&packetsize, sizeof(packetsize));
+		frames.append(s, 0, length);
+		return frames;
+	}
+
+	// v2 messages larger than MaxFragmentSize are sent as fragments
+	size_t fragments = s.empty() ? 1 : (s.length() + MaxFragmentSize - 1) / MaxFragmentSize;
+	frames.reserve(s.length() + 5 * fragments);
+	for(size_t offset = 0, i = 0; i < fragments; ++i, offset+= MaxFragmentSize){
+		uint32_t length = std::min<size_t>(s.length() - offset, MaxFragmentSize);
+		char flags = (i + 1 < fragments) ? FrameFlagMore : 0;
+		frames.append((char*)&length, sizeof(length));
+		frames+= flags;
+		frames.append(s, offset, length);
+	}
+	return frames;
 }
 
 
 void Session::send(const std::string& s){
-	if(!this->socketPtr || !this->socketPtr->is_open() ) return;
-	// asio::write( *socketPtr, asio::buffer(message) );
-	//
-	uint16_t packetsize = 2 + s.length();
-	char buffer[packetsize];
-	buffer[0] = *((char*)&packetsize);
-	buffer[1] = *((char*)&packetsize +1);
-	for(size_t i = 0; i < s.length(); ++i)
-		buffer[i+2] = s[i];
-	// buffer[packetsize-1] = 0;
-	asio::write(*socketPtr, asio::buffer(buffer, packetsize));
+	if(closed) return;
+
+	// Frames are built by the io_context so they use the protocol
+	// version in effect when they are queued. Meanwhile the message
+	// is accounted with its unframed size.
+	if(queuedBytes + s.length() > highWaterMark){
+		switch(overflowPolicy){
+			case OverflowPolicy::Drop:
+				++droppedFrames;
+				return;
+
+			case OverflowPolicy::Disconnect:
+				fprintf(stderr, "Client %s exceeded its write queue. Disconnecting.\n", endpoint->c_str());
+				// The pending read fails and removes the session
+				close();
+				return;
+
+			case OverflowPolicy::Block:
+				if( !awaitQueueSpace(s.length()) && closed ) return;
+				break;
+		}
+	}
+
+	updateQueuedBytes(s.length(), 0);
+	auto self = shared_from_this();
+	asio::post(socketPtr->get_executor(), [self, s](){ self->write(s, s.length()); });
+}
+
+
+void Session::write(const std::string& s, size_t counted){
+	if( closed || !socketPtr->is_open() ){
+		updateQueuedBytes(0, counted);
+		return;
+	}
+	std::string frame = makeFrames(s);
+	++framesOut;
+
+	// Fast path: when nothing is queued, try to write the frame right
+	// away without blocking and queue only what the socket didn't take.
+	if( writing.empty() && outbox.empty() ){
+		boost::system::error_code ec;
+		size_t written = socketPtr->write_some(asio::buffer(frame), ec);
+		bytesOut+= written;
+		if( (!ec && (written == frame.length())) ||
+			(ec && (ec != asio::error::would_block) && (ec != asio::error::try_again)) ){
+			updateQueuedBytes(0, counted);
+			return;
+		}
+		frame.erase(0, written);
+	}
+
+	updateQueuedBytes(frame.length(), counted);
+	outbox.push_back( std::move(frame) );
+	beginAsyncWrite();
+}
+
+
+void Session::close(){
+	if(closed.exchange(true)) return;
+	{std::lock_guard<std::mutex> lock(queueMutex);}
+	queueCv.notify_all();
+	auto self = shared_from_this();
+	asio::post(socketPtr->get_executor(), [self](){
+		boost::system::error_code ec;
+		self->socketPtr->close(ec);
+	});
+}
+
+
+void Session::beginAsyncWrite(){
+	if( !writing.empty() || outbox.empty() ) return;
+
+	// Coalesce all queued frames into a single gathered write
+	std::vector<asio::const_buffer> buffers;
+	buffers.reserve(outbox.size());
+	while( !outbox.empty() ){
+		writing.push_back( std::move(outbox.front()) );
+		outbox.pop_front();
+		buffers.push_back( asio::buffer(writing.back()) );
+	}
+	asio::async_write(*socketPtr, buffers,
+		boost::bind(&Session::asyncWriteHandler, shared_from_this(),
+			boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)
+	);
+}
+
+
+void Session::asyncWriteHandler(const boost::system::error_code& error, size_t bytes_transferred){
+	bytesOut+= bytes_transferred;
+	size_t written = 0;
+	for(const std::string& frame : writing)
+		written+= frame.length();
+	writing.clear();
+	if(error){
+		// The pending read fails as well and removes the session
+		for(const std::string& frame : outbox)
+			written+= frame.length();
+		outbox.clear();
+		updateQueuedBytes(0, written);
+		close();
+		return;
+	}
+	updateQueuedBytes(0, written);
+	beginAsyncWrite();
+}
+
+
+bool Session::awaitQueueSpace(size_t bytes){
+	asio::io_context& ioc = static_cast<asio::io_context&>( socketPtr->get_executor().context() );
+	// The io_context drains the queue, so it can't wait for itself.
+	// In such case the frame is queued over the mark.
+	if( ioc.get_executor().running_in_this_thread() ) return false;
+
+	std::unique_lock<std::mutex> lock(queueMutex);
+	bool drained = queueCv.wait_for(lock, BlockTimeout, [this, bytes](){
+		return closed || (queuedBytes == 0) || (queuedBytes + bytes <= highWaterMark);
+	});
+	lock.unlock();
+	// A client that stopped reading must not stall the sender forever
+	if( !drained ){
+		fprintf(stderr, "Client %s did not drain its write queue. Disconnecting.\n", endpoint->c_str());
+		close();
+	}
+	return !closed;
+}
+
+
+void Session::updateQueuedBytes(size_t added, size_t removed){
+	queuedBytes+= added;
+	queuedBytes-= removed;
+	if(removed <= added) return;
+	// Wake up senders blocked by the overflow policy
+	{std::lock_guard<std::mutex> lock(queueMutex);}
+	queueCv.notify_all();
 }
 
 
 std::shared_ptr<Session> Session::makeShared(
 			std::shared_ptr<tcp::socket> socketPtr,
+			SessionId id,
 			Server& server
 	){
-	return std::shared_ptr<Session>(new Session(socketPtr, server));
+	return std::shared_ptr<Session>(new Session(socketPtr, id, server));
 }
@@ -14,26 +14,97 @@
 #pragma once
 
 /** @cond */
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 #include <iomanip>
+#include <condition_variable>
 #include <boost/asio.hpp>
 /** @endcond */
 
 #include "tcp_message.h"
+#include "buffer_pool.h"
+#include "ingress_queue.h"
 
 
 
 class Server;
+class ClipsEnvironment;
+
+/**
+ * Enumerates the actions a session takes when its outbound queue
+ * exceeds the high-water mark
+ */
+enum class OverflowPolicy{
+	/**
+	 * The frame being sent is discarded
+	 */
+	Drop,
+	/**
+	 * The remote client is disconnected
+	 */
+	Disconnect,
+	/**
+	 * The caller is blocked until the queue drains below the mark.
+	 * The client is disconnected if it doesn't drain in time.
+	 */
+	Block
+};
+
+/**
+ * Represents an active connection between a client and the server.
+ *
+ * Sessions start using the v1 framing: a 2-byte little-endian frame
+ * size (header included) followed by the payload. Clients may switch
+ * to the v2 framing with the command "proto 2". v2 frames have a
+ * 4-byte little-endian payload size, a flags byte and the payload.
+ * Messages may span several v2 frames, all but the last one having
+ * the FrameFlagMore flag set.
+ *
+ * Received messages are enqueued in the environment the session is
+ * bound to. Clients may bind to another environment with the command
+ * "env name", which is created on demand. When the environment asks
+ * the session to pause, it stops reading from the socket until resumed.
+ *
+ * The socket is bound to a strand of the server's io_context, so the
+ * handlers of a session never run concurrently even when the
+ * io_context runs on several threads.
+ */
+class Session: public std::enable_shared_from_this<Session>{
+public:
+	/**
+	 * Highest supported protocol version
+	 */
+	static constexpr uint8_t MaxProtocolVersion = 2;
+
+	/**
+	 * v2 frame flag indicating the message continues in the next frame
+	 */
+	static constexpr uint8_t FrameFlagMore = 0x01;
+
+	/**
+	 * Largest payload sent in a single v2 frame
+	 */
+	static constexpr size_t MaxFragmentSize = 0x10000 - 5;
+
+	/**
+	 * Largest message accepted from a client
+	 */
+	static constexpr size_t MaxMessageSize = 64 << 20;
 
-class Session{
 public:
 	/**
 	 * Initializes a new instance of Session
 	 * @param socketPtr    The underlaying connection socket to the remote client.
+	 * @param id           The id assigned to the session by the server.
 	 * @param server       The server that manages the session and handles incomming messages.
 	 */
 	Session(
 		std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr,
+		SessionId id,
 		Server& serverPtr
 	);
 	~Session();
@@ -50,26 +121,131 @@ private:
 	Session& operator=(Session const&) = delete;
 
 public:
+	/**
+	 * Gets the id of the session
+	 * @return The id assigned to the session by the server
+	 */
+	SessionId getId() const;
+
 	/**
 	 * Gets a string representation of the remote endpoint
 	 * @return A string representation of the remote endpoint
 	 */
 	std::string getEndPointStr() const;
 
+	/**
+	 * Gets the protocol version used to frame outgoing messages
+	 * @return The protocol version negotiated with the client
+	 */
+	uint8_t getProtocolVersion() const;
+
 	/**
 	 * Gets the underlaying connection socket to the remote client
 	 * @return The underlaying connection socket to the remote client
 	 */
 	std::shared_ptr<boost::asio::ip::tcp::socket> getSocketPtr() const;
 
+	/**
+	 * Sets the maximum number of bytes that can be queued for delivery
+	 * before the overflow policy is applied
+	 * @param bytes The high-water mark in bytes
+	 */
+	void setHighWaterMark(size_t bytes);
+
+	/**
+	 * Sets the action to take when the outbound queue exceeds the
+	 * high-water mark
+	 * @param policy The overflow policy
+	 */
+	void setOverflowPolicy(OverflowPolicy policy);
+
+	/**
+	 * Gets the number of bytes queued for delivery, including those
+	 * being written
+	 * @return The number of bytes pending delivery
+	 */
+	size_t getQueuedBytes() const;
+
+	/**
+	 * Gets the number of frames discarded due to overflow
+	 * @return The number of discarded frames
+	 */
+	size_t getDroppedFrames() const;
+
+	/**
+	 * Gets the number of frames received from the remote client
+	 * @return The number of frames received
+	 */
+	uint64_t getFramesIn() const;
+
+	/**
+	 * Gets the number of bytes received from the remote client
+	 * @return The number of bytes received
+	 */
+	uint64_t getBytesIn() const;
+
+	/**
+	 * Gets the number of messages framed for delivery to the remote
+	 * client. Fragments of a message are not counted separately.
+	 * @return The number of messages sent
+	 */
+	uint64_t getFramesOut() const;
+
+	/**
+	 * Gets the number of bytes written to the socket, headers included
+	 * @return The number of bytes sent
+	 */
+	uint64_t getBytesOut() const;
+
+	/**
+	 * Gets the number of times the session stopped reading because
+	 * its environment's message queue was full
+	 * @return The number of read pauses
+	 */
+	uint64_t getReadPauses() const;
+
+	/**
+	 * Gets the environment the session is bound to
+	 * @return The environment that handles the session's messages
+	 */
+	ClipsEnvironment* getEnvironment() const;
+
+	/**
+	 * Binds the session to an environment
+	 * @param env The environment that will handle the session's messages
+	 */
+	void setEnvironment(ClipsEnvironment* env);
+
 
 public:
 	/**
-	 * Sends the provided string to the remote client
+	 * Queues the provided string for delivery to the remote client.
+	 * Safe to call from any thread. Messages are framed and written
+	 * asynchronously in the session's strand, coalescing all queued frames
+	 * into a single gathered write.
+	 * Under the block overflow policy the caller waits on queueCv,
+	 * which the write completion handler signals, and disconnects the
+	 * client if the queue doesn't drain in time. The io_context is
+	 * never run from here, so no handler (accept, read, write) runs
+	 * on the caller's stack and the session can't be removed under it.
 	 * @param s The string to send
 	 */
 	void send(const std::string& s);
 
+	/**
+	 * Starts receiving data from the remote client. Must be called
+	 * once the session is configured and registered, since messages
+	 * may be handled right away by another thread.
+	 */
+	void start();
+
+	/**
+	 * Closes the connection with the remote client.
+	 * Safe to call from any thread. Senders blocked by the overflow
+	 * policy are released.
+	 */
+	void close();
+
 
 private:
 	/**
@@ -87,6 +263,13 @@ private:
 	 */
 	void asyncReadHandler(const boost::system::error_code& error, size_t bytes_transferred);
 
+	/**
+	 * Resumes reading after a pause requested by the environment,
+	 * parsing first the frames left in the receive chunk.
+	 * Must be called from the session's strand.
+	 */
+	void resumeReceive();
+
 	/**
 	 * Verifies whether all data has been received
 	 * @param error Error produced when accepting the connection
@@ -95,48 +278,264 @@ private:
 	size_t checkTransferComplete(const boost::system::error_code& error, size_t bytes_transferred);
 
 	/**
-	 * Reads the header of the message from the buffer without advancing the read cursor.
-	 * @param is A istream to read the buffer
+	 * Makes room in the receive chunk for the next read operation.
+	 * When the pending (incomplete) frame can't be completed in the
+	 * current chunk, it is moved to the beginning of a chunk that is
+	 * not referenced by any received message.
 	 */
-	uint16_t peekMessageHeader(std::istream& is);
+	void prepareReadChunk();
 
 	/**
-	 * Reads the a message from the buffer.
-	 * @param is A istream to read the buffer
+	 * Extracts all complete frames from the receive chunk and enqueues
+	 * them in the server as messages that reference the chunk.
+	 * Stops early if the environment asks the session to pause.
+	 * @return false if the client sent a message larger than
+	 *         MaxMessageSize, true otherwise
 	 */
-	std::string fetchStringFromBuffer(std::istream& is);
+	bool parseFrames();
+
+	/**
+	 * Reads the header of the pending frame without consuming it.
+	 * @param flags When this method returns contains the frame flags
+	 * @return      The size of the pending frame including its header,
+	 *              or the header size if the header is incomplete
+	 */
+	size_t peekFrameSize(uint8_t& flags) const;
+
+	/**
+	 * Handles the payload of a received frame, reassembling fragments
+	 * and enqueueing complete messages in the server.
+	 * @param payload Pointer to the payload within the receive chunk
+	 * @param length  The length of the payload
+	 * @param flags   The frame flags (always zero for v1 frames)
+	 * @return        false if the reassembled message is larger than
+	 *                MaxMessageSize, true otherwise
+	 */
+	bool handleFrame(const char* payload, size_t length, uint8_t flags);
+
+	/**
+	 * Handles protocol negotiation requests (proto command).
+	 * The request is acknowledged using the current protocol version
+	 * and all following frames use the requested version, if supported.
+	 * @param payload The received message
+	 * @param length  The length of the message
+	 * @return        true if the message was a protocol request,
+	 *                false otherwise
+	 */
+	bool handleProtocolRequest(const char* payload, size_t length);
+
+	/**
+	 * Handles environment binding requests (env command).
+	 * The request is acknowledged with the name of the environment the
+	 * session is bound to, followed by the status of the environment.
+	 * @param payload The received message
+	 * @param length  The length of the message
+	 * @return        true if the message was an environment request,
+	 *                false otherwise
+	 */
+	bool handleEnvironmentRequest(const char* payload, size_t length);
+
+	/**
+	 * Frames a message with the current protocol version and queues it
+	 * for delivery. Must be called from the session's strand.
+	 * @param s       The message to write
+	 * @param counted The number of bytes already added to queuedBytes
+	 *                on behalf of the message
+	 */
+	void write(const std::string& s, size_t counted = 0);
+
+	/**
+	 * Frames a message for delivery with the current protocol version.
+	 * v2 messages larger than MaxFragmentSize are split in fragments.
+	 * @param  s The message to frame
+	 * @return   The framed message
+	 */
+	std::string makeFrames(const std::string& s) const;
+
+	/**
+	 * Starts an asynchronous write of all queued frames unless one
+	 * is already in progress
+	 */
+	void beginAsyncWrite();
+
+	/**
+	 * Handles the completion of an asynchronous write
+	 * @param error             Error produced during the write operation
+	 * @param bytes_transferred The number of bytes written
+	 */
+	void asyncWriteHandler(const boost::system::error_code& error, size_t bytes_transferred);
+
+	/**
+	 * Waits until the outbound queue can hold \p bytes more bytes
+	 * without exceeding the high-water mark. Blocks on queueCv without
+	 * running the io_context, closing the session if the queue doesn't
+	 * drain within BlockTimeout. Called from an io_context thread it
+	 * returns at once, since that thread drains the queue.
+	 * @param  bytes The number of bytes to be queued
+	 * @return       true if the bytes fit in the queue, false if the
+	 *               wait is not possible or the connection was lost
+	 */
+	bool awaitQueueSpace(size_t bytes);
+
+	/**
+	 * Updates the number of queued bytes, waking up blocked senders
+	 * when the queue shrinks
+	 * @param added   Bytes added to the queue
+	 * @param removed Bytes removed from the queue
+	 */
+	void updateQueuedBytes(size_t added, size_t removed);
 
 
 private:
 	/**
-	 * Stores a string representation of the
+	 * The id assigned to the session by the server
+	 */
+	const SessionId id;
+
+	/**
+	 * Stores a string representation of the remote endpoint.
+	 * Shared with all messages received in this session.
+	 */
+	std::shared_ptr<const std::string> endpoint;
+
+	/**
+	 * Pooled chunk where data is received.
+	 * Received messages are slices of this chunk.
+	 */
+	std::shared_ptr<char> chunk;
+
+	/**
+	 * Offset of the first unparsed byte in chunk
+	 */
+	size_t chunkBegin;
+
+	/**
+	 * Offset past the last received byte in chunk
+	 */
+	size_t chunkEnd;
+
+	/**
+	 * The size of chunk in bytes
 	 */
-	std::string endpoint;
+	size_t chunkCapacity;
 
 	/**
-	 * Dynamic buffer required to receive messages asynchronously
+	 * Protocol version used to parse incomming frames
 	 */
-	boost::asio::streambuf buffer;
+	uint8_t readVersion;
+
+	/**
+	 * Protocol version used to frame outgoing messages.
+	 * Read by the environment threads sending to the session.
+	 */
+	std::atomic<uint8_t> writeVersion;
+
+	/**
+	 * Fragments of a v2 message being reassembled
+	 */
+	std::string fragments;
 
 	/**
 	 * The underlaying connection socket to the remote client
 	 */
 	std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr;
 
+	/**
+	 * Frames waiting for delivery
+	 */
+	std::deque<std::string> outbox;
+
+	/**
+	 * Frames being written by the current asynchronous write
+	 */
+	std::vector<std::string> writing;
+
+	/**
+	 * Number of bytes in outbox and writing, plus those of messages
+	 * sent but not yet framed
+	 */
+	std::atomic<size_t> queuedBytes;
+
+	/**
+	 * Protects the wait of senders blocked by the overflow policy
+	 */
+	std::mutex queueMutex;
+
+	/**
+	 * Signaled when the outbound queue shrinks or the session closes
+	 */
+	std::condition_variable queueCv;
+
+	/**
+	 * Set once the connection is closed or about to be closed
+	 */
+	std::atomic<bool> closed;
+
+	/**
+	 * Set while reading is paused by the environment.
+	 * Accessed only from the session's strand.
+	 */
+	bool paused;
+
+	/**
+	 * Number of times reading was paused
+	 */
+	std::atomic<uint64_t> readPauses;
+
+	/**
+	 * Accounts the messages the session has queued in environments
+	 */
+	std::shared_ptr<IngressQueue::Source> ingress;
+
+	/**
+	 * The environment that handles the session's messages
+	 */
+	std::atomic<ClipsEnvironment*> environment;
+
+	/**
+	 * Maximum number of bytes that can be queued for delivery
+	 */
+	size_t highWaterMark;
+
+	/**
+	 * The action to take when highWaterMark is exceeded
+	 */
+	OverflowPolicy overflowPolicy;
+
+	/**
+	 * Number of frames discarded due to overflow
+	 */
+	std::atomic<size_t> droppedFrames;
+
+	/**
+	 * Traffic counters. Updated by the io_context, read by any thread.
+	 */
+	std::atomic<uint64_t> framesIn;
+	std::atomic<uint64_t> bytesIn;
+	std::atomic<uint64_t> framesOut;
+	std::atomic<uint64_t> bytesOut;
+
 	/**
 	 * The sessions lord and master
 	 */
 	Server& server;
 
+	/**
+	 * Pool of chunks shared by all sessions to receive data
+	 */
+	static BufferPool readPool;
+
 
 public:
 	/**
 	 * Returns a shared pointer to a new instance of Session
 	 * @param socketPtr The underlaying connection socket to the remote client
+	 * @param id        The id assigned to the session by the server
 	 * @param server    The server that manages the session and handles incomming messages.
 	 */
 	static std::shared_ptr<Session> makeShared(
 			std::shared_ptr<boost::asio::ip::tcp::socket> socketPtr,
+			SessionId id,
 			Server& server
 	);
 };
@@ -19,6 +19,7 @@
 /** @cond */
 #include <queue>
 #include <mutex>
+#include <vector>
 #include <chrono>
 #include <condition_variable>
 /** @endcond */
@@ -51,6 +52,22 @@ private:
 	sync_queue(sync_queue const& obj) = delete;
 	sync_queue& operator=(sync_queue const&) = delete;
 
+	/**
+	 * Moves all elements in the queue to the given vector.
+	 * The caller must hold the lock.
+	 * @param out  Vector where the elements are appended in FIFO order
+	 * @return     The number of elements moved
+	 */
+	size_t drain(std::vector<T>& out) {
+		size_t count = this->_q.size();
+		out.reserve(out.size() + count);
+		while( !this->_q.empty() ){
+			out.push_back( std::move(this->_q.front()) ); // Retrieve object
+			this->_q.pop();                               // Pop the queue
+		}
+		return count;
+	}
+
 public:
 	/**
 	 * Creates a new instance of a thread-safe synchronous queue
@@ -78,6 +95,39 @@ public:
 		return obj;
 	}
 
+	/**
+	 * Retrieves all the elements in the synchronous queue, waiting
+	 * until there is at least one
+	 * @param out  Vector where the retrieved elements are appended in FIFO order
+	 * @return     The number of elements retrieved
+	 */
+	virtual size_t consumeAll(std::vector<T>& out) {
+		std::unique_lock<std::timed_mutex> ul(this->_m);  // Exclusive access to the queue
+
+		// Wait until there is an element in the queue
+		// We use a while because there can be spurious wake ups
+		while( this->_q.empty() )
+			this->_cv.wait(ul);                           // Wait for an element to be enqueued
+		return drain(out);
+	}
+
+	/**
+	 * Retrieves all the elements in the synchronous queue, waiting
+	 * until there is at least one or the timeout expires
+	 * @param out      Vector where the retrieved elements are appended in FIFO order
+	 * @param timeout  The amount of time to wait for the first element
+	 * @return         The number of elements retrieved. Zero if the timeout expired.
+	 */
+	virtual size_t timedConsumeAll(std::vector<T>& out, const std::chrono::microseconds& timeout) {
+		std::unique_lock<std::timed_mutex> ul(this->_m);  // Exclusive access to the queue
+
+		// Wait until there is an element in the queue
+		if( this->_q.empty() &&              // Lambda to capture spurious wake ups
+			!this->_cv.wait_for(ul, timeout, [this](){ return !this->_q.empty(); }))
+			return 0;                                     // Or leave if the queue remains empty
+		return drain(out);
+	}
+
 	/**
 	 * Checks whether the queue is empty or not
 	 * @return true if the queue is empty, false otherwise
@@ -87,6 +137,15 @@ public:
 		return this->_q.empty();                          // Return value
 	}
 
+	/**
+	 * Gets the number of elements in the queue
+	 * @return The number of elements in the queue
+	 */
+	virtual size_t size() {
+		std::lock_guard<std::timed_mutex> lock(this->_m); // Exclusive access to the queue
+		return this->_q.size();                           // Return value
+	}
+
 	/**
 	 * Enqueues an element in the synchronous queue
 	 * @param obj The element to enqueue
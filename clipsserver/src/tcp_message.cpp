@@ -1,16 +1,26 @@
 #include "tcp_message.h"
 
-TcpMessage::TcpMessage(const std::string& source, const std::string& message):
-	source(source), message(message){}
+TcpMessage::TcpMessage(const Private&, SessionId source, const std::shared_ptr<const std::string>& alias,
+	const std::shared_ptr<const char>& data, size_t length):
+	source(source), alias(alias), data(data), length(length), received(std::chrono::steady_clock::now()){}
 
-std::string& TcpMessage::getSource(){
+SessionId TcpMessage::getSource() const{
 	return source;
 }
 
-std::string& TcpMessage::getMessage(){
-	return message;
+const std::string& TcpMessage::getSourceAlias() const{
+	return *alias;
 }
 
-std::shared_ptr<TcpMessage> TcpMessage::makeShared(const std::string& source, const std::string& message){
-	return std::shared_ptr<TcpMessage>(new TcpMessage(source, message));
-}
\ No newline at end of file
+boost::string_view TcpMessage::getMessage() const{
+	return boost::string_view(data.get(), length);
+}
+
+std::chrono::steady_clock::time_point TcpMessage::getReceptionTime() const{
+	return received;
+}
+
+std::shared_ptr<TcpMessage> TcpMessage::makeShared(SessionId source, const std::shared_ptr<const std::string>& alias,
+	const std::shared_ptr<const char>& data, size_t length){
+	return std::make_shared<TcpMessage>(Private(), source, alias, data, length);
+}
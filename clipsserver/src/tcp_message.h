@@ -4,9 +4,8 @@
 * Author: Mauricio Matamoros
 *
 * ** *****************************************************************/
-/** @file session.h
- * Definition of a session: represents an active connection between
- * a client and the TCP server
+/** @file tcp_message.h
+ * Definition of a TCP message: a frame received from a network client
  */
 
 #ifndef __TCP_MESSAGE_H__
@@ -14,15 +13,43 @@
 #pragma once
 
 /** @cond */
+#include <chrono>
 #include <memory>
 #include <string>
+#include <cstdint>
+#include <boost/utility/string_view.hpp>
 /** @endcond */
 
+/**
+ * Identifies a session. The low SessionSlotBits bits are the index of
+ * the session in the server's session table, and the remaining bits
+ * count the reuses of the slot so stale ids don't reach new sessions.
+ */
+typedef uint32_t SessionId;
+
+/**
+ * Number of bits of a SessionId holding the slot index
+ */
+static constexpr unsigned SessionSlotBits = 20;
+
+/**
+ * A frame received from a network client.
+ * The message is a view over a reference-counted receive buffer that
+ * is kept alive as long as the message exists.
+ */
 class TcpMessage{
+	struct Private{ explicit Private() = default; };
+public:
 	/**
-	 * Initializes a new instance of TcpMessage
+	 * Initializes a new instance of TcpMessage.
+	 * Use TcpMessage::makeShared instead.
+	 * @param source  The id of the session that received the message
+	 * @param alias   The remote endpoint, shared with the session
+	 * @param data    Pointer to the first byte of the message
+	 * @param length  The length of the message in bytes
 	 */
-	TcpMessage(const std::string& source, const std::string& message);
+	TcpMessage(const Private&, SessionId source, const std::shared_ptr<const std::string>& alias,
+		const std::shared_ptr<const char>& data, size_t length);
 
 	// Disable copy constructor and assignment op.
 private:
@@ -37,38 +64,67 @@ private:
 
 public:
 	/**
-	 * Retrieves the mesage source. Typically a string
-	 * representation of the remote endpoint of the network
-	 * client that sends the message
+	 * Retrieves the mesage source: the id of the session that
+	 * received the message
 	 * @return The message source
 	 */
-	std::string& getSource();
+	SessionId getSource() const;
+
+	/**
+	 * Retrieves a human-readable alias of the message source: the
+	 * string representation of the remote endpoint of the network
+	 * client that sends the message
+	 * @return The alias of the message source
+	 */
+	const std::string& getSourceAlias() const;
 
 	/**
 	 * Retrieves the message contained in the packet
-	 * @return The message contained in the packet
+	 * @return A view of the message contained in the packet
 	 */
-	std::string& getMessage();
+	boost::string_view getMessage() const;
+
+	/**
+	 * Gets the time the message was received
+	 * @return The reception time
+	 */
+	std::chrono::steady_clock::time_point getReceptionTime() const;
 
 private:
 	/**
-	 * The message source. Typically a string representation of the
-	 * remote endpoint of the network client that sends the message
+	 * The id of the session that received the message
+	 */
+	SessionId source;
+	/**
+	 * The string representation of the remote endpoint of the
+	 * network client that sends the message
+	 */
+	std::shared_ptr<const std::string> alias;
+	/**
+	 * The message itself. Points into a shared receive buffer.
+	 */
+	std::shared_ptr<const char> data;
+	/**
+	 * The length of the message in bytes
 	 */
-	std::string source;
+	size_t length;
 	/**
-	 * The message itself
+	 * The time the message was received
 	 */
-	std::string message;
+	std::chrono::steady_clock::time_point received;
 
 
 public:
 	/**
 	 * Returns a shared pointer to a new instance of TcpMessage
-	 * @param source    The message source
-	 * @param message   The message itself
+	 * @param source    The id of the session that received the message
+	 * @param alias     The remote endpoint, shared with the session
+	 * @param data      Pointer to the first byte of the message.
+	 *                  Typically an alias of a pooled receive buffer.
+	 * @param length    The length of the message in bytes
 	 */
-	static std::shared_ptr<TcpMessage> makeShared(const std::string& source, const std::string& message);
+	static std::shared_ptr<TcpMessage> makeShared(SessionId source, const std::shared_ptr<const std::string>& alias,
+		const std::shared_ptr<const char>& data, size_t length);
 
 };
 
@@ -0,0 +1,250 @@
+/* ** ***************************************************************
+* assertfact.cpp
+*
+* Author: Mauricio Matamoros
+*
+* Typed deftemplate fact assertion with cached template lookups
+*
+** ** **************************************************************/
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "clipsdefenv.h"
+#include "clipswrapper.h"
+
+extern "C"{
+	#include "clips/envrnmnt.h"
+	#include "clips/userdata.h"
+	#include "clips/cstrnchk.h"
+	#include "clips/tmpltdef.h"
+	#include "clips/factmngr.h"
+	#include "clips/multifld.h"
+}
+
+/**
+ * Environment data position where the deftemplate cache of each
+ * environment is stored
+ */
+#define TEMPLATE_CACHE_DATA USER_ENVIRONMENT_DATA + 1
+
+namespace clips{
+
+struct TemplateCache;
+
+/**
+ * Cached lookups of a deftemplate. Entries are attached to their
+ * deftemplate as user data, so CLIPS releases them (and they unlink
+ * themselves from the cache) when the deftemplate is deleted.
+ */
+struct TemplateEntry : public ::userData{
+	/**
+	 * The cache the entry is registered in
+	 */
+	TemplateCache* cache;
+	/**
+	 * The deftemplate
+	 */
+	Deftemplate* deftemplate;
+	/**
+	 * The module that was current when the name was resolved
+	 */
+	Defmodule* module;
+	/**
+	 * The names the entry is registered under
+	 */
+	std::vector<std::string> names;
+	/**
+	 * The slots of the deftemplate indexed by name
+	 */
+	std::unordered_map<std::string, std::pair<unsigned short, TemplateSlot*>> slots;
+};
+
+
+/**
+ * Per environment cache of deftemplates indexed by name
+ */
+struct TemplateCache{
+	/**
+	 * The user data record used to attach entries to deftemplates
+	 */
+	struct userDataRecord record;
+	/**
+	 * The cached deftemplates
+	 */
+	std::unordered_map<std::string, TemplateEntry*> templates;
+};
+
+
+/* ** ***************************************************************
+*
+* Cache management
+*
+** ** **************************************************************/
+static void* createTemplateEntry(Environment* env){
+	TemplateEntry* entry = new TemplateEntry();
+	entry->cache = NULL;
+	entry->deftemplate = NULL;
+	entry->module = NULL;
+	return static_cast<::userData*>(entry);
+}
+
+
+static void deleteTemplateEntry(Environment* env, void* data){
+	TemplateEntry* entry = static_cast<TemplateEntry*>((::userData*)data);
+	if(entry->cache){
+		for(const std::string& name : entry->names){
+			auto it = entry->cache->templates.find(name);
+			if((it != entry->cache->templates.end()) && (it->second == entry))
+				entry->cache->templates.erase(it);
+		}
+	}
+	delete entry;
+}
+
+
+static void destroyTemplateCache(Environment* env){
+	TemplateCache** cache = (TemplateCache**)GetEnvironmentData(env, TEMPLATE_CACHE_DATA);
+	if(!cache || !*cache) return;
+	// Entries still attached to deftemplates must not unlink themselves
+	for(auto& kv : (*cache)->templates)
+		kv.second->cache = NULL;
+	delete *cache;
+	*cache = NULL;
+}
+
+
+static TemplateCache* getTemplateCache(){
+	TemplateCache** cache = (TemplateCache**)GetEnvironmentData(defEnv, TEMPLATE_CACHE_DATA);
+	if(!cache){
+		AllocateEnvironmentData(defEnv, TEMPLATE_CACHE_DATA, sizeof(TemplateCache*), destroyTemplateCache);
+		cache = (TemplateCache**)GetEnvironmentData(defEnv, TEMPLATE_CACHE_DATA);
+		*cache = new TemplateCache();
+		(*cache)->record.createUserData = createTemplateEntry;
+		(*cache)->record.deleteUserData = deleteTemplateEntry;
+		InstallUserDataRecord(defEnv, &(*cache)->record);
+	}
+	return *cache;
+}
+
+
+static TemplateEntry* findTemplate(const std::string& templateName){
+	TemplateCache* cache = getTemplateCache();
+	Defmodule* module = GetCurrentModule(defEnv);
+	auto it = cache->templates.find(templateName);
+	if((it != cache->templates.end()) && (it->second->module == module))
+		return it->second;
+
+	// Name not cached or resolved in another module
+	Deftemplate* deftemplate = FindDeftemplate(defEnv, templateName.c_str());
+	if(!deftemplate || deftemplate->implied) return NULL;
+	TemplateEntry* entry = static_cast<TemplateEntry*>(
+		FetchUserData(defEnv, cache->record.dataID, &deftemplate->header.usrData));
+	if(!entry->deftemplate){
+		entry->cache = cache;
+		entry->deftemplate = deftemplate;
+		unsigned short i = 0;
+		for(TemplateSlot* slot = deftemplate->slotList; slot; slot = slot->next, ++i)
+			entry->slots[slot->slotName->contents] = std::make_pair(i, slot);
+	}
+	entry->module = module;
+	if(std::find(entry->names.begin(), entry->names.end(), templateName) == entry->names.end())
+		entry->names.push_back(templateName);
+	cache->templates[templateName] = entry;
+	return entry;
+}
+
+
+/* ** ***************************************************************
+*
+* Value conversion
+*
+** ** **************************************************************/
+static bool toClipsValue(const SlotValue& value, CLIPSValue& cv, bool nested=false){
+	switch(value.getType()){
+		case SlotValue::Type::Integer:
+			cv.integerValue = CreateInteger(defEnv, value.getInteger());
+			return true;
+
+		case SlotValue::Type::Float:
+			cv.floatValue = CreateFloat(defEnv, value.getFloat());
+			return true;
+
+		case SlotValue::Type::Symbol:
+			cv.lexemeValue = CreateSymbol(defEnv, value.getLexeme().c_str());
+			return true;
+
+		case SlotValue::Type::String:
+			cv.lexemeValue = CreateString(defEnv, value.getLexeme().c_str());
+			return true;
+
+		case SlotValue::Type::InstanceName:
+			cv.lexemeValue = CreateInstanceName(defEnv, value.getLexeme().c_str());
+			return true;
+
+		case SlotValue::Type::Multifield:{
+			if(nested) return false;
+			const std::vector<SlotValue>& fields = value.getFields();
+			Multifield* mf = CreateMultifield(defEnv, fields.size());
+			for(size_t i = 0; i < fields.size(); ++i){
+				if( !toClipsValue(fields[i], mf->contents[i], true) ) return false;
+			}
+			cv.multifieldValue = mf;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* ** ***************************************************************
+*
+* Fact assertion
+*
+** ** **************************************************************/
+static bool assertTemplateFact(TemplateEntry* entry, const std::vector<Slot>& slots){
+	Deftemplate* deftemplate = entry->deftemplate;
+
+	// Values are validated before creating the fact, as FBPutSlot does
+	std::vector<CLIPSValue> values(deftemplate->numberOfSlots);
+	for(CLIPSValue& v : values) v.voidValue = VoidConstant(defEnv);
+	for(const Slot& s : slots){
+		auto it = entry->slots.find(s.name);
+		if(it == entry->slots.end()) return false;
+		TemplateSlot* slot = it->second.second;
+		CLIPSValue& cv = values[it->second.first];
+		if( !toClipsValue(s.value, cv) ) return false;
+		if( (cv.header->type == MULTIFIELD_TYPE) != (slot->multislot == 1) ) return false;
+		if( (slot->constraints != NULL) &&
+			(ConstraintCheckValue(defEnv, cv.header->type, cv.value, slot->constraints) != NO_VIOLATION) )
+			return false;
+	}
+
+	Fact* fact = CreateFact(deftemplate);
+	for(unsigned short i = 0; i < deftemplate->numberOfSlots; ++i){
+		CLIPSValue& cv = values[i];
+		if(cv.voidValue == VoidConstant(defEnv)) continue;
+		if(cv.header->type == MULTIFIELD_TYPE)
+			fact->theProposition.contents[i].multifieldValue = CopyMultifield(defEnv, cv.multifieldValue);
+		else
+			fact->theProposition.contents[i].value = cv.value;
+	}
+	AssignFactSlotDefaults(fact);
+	return Assert(fact) != NULL;
+}
+
+
+bool assertFact(const std::string& templateName, const std::vector<Slot>& slots){
+	TemplateEntry* entry = findTemplate(templateName);
+	if(!entry) return false;
+
+	// Values created while filling the slots are released on exit
+	// unless the asserted fact holds them, as with AssertString
+	GCBlock gcb;
+	GCBlockStart(defEnv, &gcb);
+	bool success = assertTemplateFact(entry, slots);
+	GCBlockEnd(defEnv, &gcb);
+	return success;
+}
+
+}
@@ -17,8 +17,8 @@ extern "C"{
 
 
 namespace clips{
-	// The default environment
-	extern Environment* defEnv;
+	// The environment selected in the calling thread
+	extern thread_local Environment* defEnv;
 }
 
 
@@ -32,7 +32,7 @@ char* clipsstr(const std::string& s){
 
 
 namespace clips{
-Environment* defEnv = NULL;
+thread_local Environment* defEnv = NULL;
 
 std::map<clips::WatchItem,ClipsWatchItem> watchItems = {
 	{clips::WatchItem::Facts,            ClipsWatchItem::FACTS},
@@ -84,6 +84,24 @@ void initialize(){
 	if(!defEnv)	defEnv = CreateEnvironment();
 }
 
+EnvironmentHandle createEnvironment(){
+	return CreateEnvironment();
+}
+
+bool destroyEnvironment(EnvironmentHandle env){
+	if(!env) return false;
+	if(env == defEnv) defEnv = NULL;
+	return DestroyEnvironment(env);
+}
+
+EnvironmentHandle getEnvironment(){
+	return defEnv;
+}
+
+void setEnvironment(EnvironmentHandle env){
+	defEnv = env;
+}
+
 void rerouteStdin(int argc, char** argv){
 	RerouteStdin(defEnv, argc, argv);
 }
@@ -104,8 +122,40 @@ void setFactListChanged(const bool changed){
 	SetFactListChanged(defEnv, changed);
 }
 
-void assertString(const std::string& s){
-	AssertString( defEnv, clipsstr(s) );
+size_t getFactCount(){
+	return GetNumberOfFacts(defEnv);
+}
+
+size_t getActivationCount(){
+	return GetNumberOfActivations(defEnv);
+}
+
+int64_t getMemoryUsed(){
+	return MemUsed(defEnv);
+}
+
+int64_t binarySaveFacts(std::string& buffer, bool visible){
+	char* data;
+	size_t size;
+	buffer.clear();
+	long count = BinarySaveFactsToBuffer(defEnv, visible ? VISIBLE_SAVE : LOCAL_SAVE, &data, &size);
+	if(count < 0) return -1;
+	buffer.assign(data, size);
+	free(data);
+	return count;
+}
+
+int64_t binaryLoadFacts(const char* data, size_t size){
+	if(!data) return -1;
+	return BinaryLoadFactsFromBuffer(defEnv, data, size);
+}
+
+int64_t binaryLoadFacts(const std::string& buffer){
+	return binaryLoadFacts(buffer.data(), buffer.size());
+}
+
+bool assertString(const std::string& s){
+	return AssertString( defEnv, clipsstr(s) ) != NULL;
 }
 
 
@@ -135,7 +185,9 @@ void printDefrules(
 
 
 bool print(const std::string& ln, const std::string& str){
-	return print( clipsstr(ln), clipsstr(str) );
+	if( !QueryRouters(defEnv, ln.c_str()) ) return false;
+	WriteString(defEnv, ln.c_str(), str.c_str());
+	return true;
 }
 
 
@@ -200,9 +252,13 @@ bool query(const std::string& query, std::string& result){
 
 
 bool query(const std::string& query, std::string& result, int& steps){
-	static QueryRouter& qr = QueryRouter::getInstance();
+	QueryRouter& qr = QueryRouter::getInstance();
 	qr.enable();
-	if( !clips::sendCommand(query, true) ) return false;
+	if( !clips::sendCommand(query, true) ){
+		qr.read();
+		qr.disable();
+		return false;
+	}
 	steps = clips::run();
 	result = qr.read();
 	qr.disable();
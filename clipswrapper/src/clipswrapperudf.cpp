@@ -192,6 +192,22 @@ bool firstArgument(Context& ctx, std::string& out){
 }
 
 
+bool firstArgument(Context& ctx, SlotValue& out){
+	UDFValue uvout;
+	auto ci = dynamic_cast<ContextImpl&>(ctx);
+	if(!UDFFirstArgument(ci, NUMBER_BITS | LEXEME_BITS | INSTANCE_NAME_BIT, &uvout))
+		return false;
+	switch(uvout.header->type){
+		case INTEGER_TYPE:       out = SlotValue( (int64_t)uvout.integerValue->contents ); break;
+		case FLOAT_TYPE:         out = SlotValue( uvout.floatValue->contents ); break;
+		case STRING_TYPE:        out = SlotValue( uvout.lexemeValue->contents, SlotValue::Type::String ); break;
+		case INSTANCE_NAME_TYPE: out = SlotValue( uvout.lexemeValue->contents, SlotValue::Type::InstanceName ); break;
+		default:                 out = SlotValue( uvout.lexemeValue->contents, SlotValue::Type::Symbol ); break;
+	}
+	return true;
+}
+
+
 /* ** *****************************************************************
 *
 * nextArgument overloads
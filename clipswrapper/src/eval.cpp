@@ -0,0 +1,378 @@
+/* ** ***************************************************************
+* eval.cpp
+*
+* Author: Mauricio Matamoros
+*
+* Expression evaluation and fact-set queries with binary encoded
+* results
+*
+** ** **************************************************************/
+
+#include <deque>
+#include <cstring>
+#include <cctype>
+#include "clipsdefenv.h"
+#include "clipswrapper.h"
+#include "valueencoding.h"
+
+extern "C"{
+	#include "clips/clips.h"
+	#include "clips/envrnmnt.h"
+	#include "clips/factqury.h"
+}
+
+/**
+ * Environment data position where the find-facts cursors of each
+ * environment are stored
+ */
+#define FIND_CURSORS_DATA USER_ENVIRONMENT_DATA + 4
+
+namespace clips{
+
+/**
+ * Name of the function used by findFacts to collect matching facts
+ */
+static const char* collectFactFunction = "clipswrapper-collect-fact";
+
+
+/**
+ * A page of facts being collected by findFacts
+ */
+struct FactPage{
+	/**
+	 * The encoded page
+	 */
+	std::string* out;
+	/**
+	 * Maximum number of facts in the page
+	 */
+	size_t size;
+	/**
+	 * Size in bytes past which no more facts are added to the page
+	 */
+	size_t maxBytes;
+	/**
+	 * Number of facts collected
+	 */
+	size_t count;
+	/**
+	 * The last fact collected
+	 */
+	Fact* last;
+	/**
+	 * Whether more facts matched after the page was filled
+	 */
+	bool more;
+};
+
+/**
+ * The page findFacts is collecting in the calling thread.
+ * Environments are bound to a thread, so there is one query at most.
+ */
+static thread_local FactPage* activePage = NULL;
+
+/**
+ * Maximum number of pages that can be resumed from their last fact.
+ * Older cursors are dropped and their queries resume by fact index.
+ */
+static const size_t MaxFindCursors = 64;
+
+/**
+ * The last facts of the pages returned by findFacts, retained so the
+ * next page resumes from them instead of scanning the template again
+ */
+struct FindCursors{
+	std::deque<Fact*> facts;
+};
+
+
+/* ** ***************************************************************
+*
+* Encoding helpers
+*
+** ** **************************************************************/
+template<typename T>
+static inline void append(std::string& out, const T& value){
+	out.append((const char*)&value, sizeof(T));
+}
+
+
+static inline void appendCode(std::string& out, ValueCode code){
+	out.push_back((char)code);
+}
+
+
+static inline void appendLexeme(std::string& out, const char* s, size_t length){
+	append(out, (uint32_t)length);
+	out.append(s, length);
+}
+
+
+static inline void appendLexeme(std::string& out, const CLIPSLexeme* lexeme){
+	appendLexeme(out, lexeme->contents, std::strlen(lexeme->contents));
+}
+
+
+void encodeFact(std::string& out, Fact* fact){
+	appendCode(out, ValueCode::Fact);
+	append(out, (int64_t)fact->factIndex);
+	Deftemplate* deftemplate = fact->whichDeftemplate;
+	appendLexeme(out, deftemplate->header.name);
+
+	const Multifield& slots = fact->theProposition;
+	append(out, (uint32_t)slots.length);
+	if(deftemplate->implied){
+		appendLexeme(out, "", 0);
+		encodeValue(out, slots.contents[0], true);
+		return;
+	}
+	TemplateSlot* slot = deftemplate->slotList;
+	for(size_t i = 0; i < slots.length; ++i, slot = slot->next){
+		appendLexeme(out, slot->slotName);
+		encodeValue(out, slots.contents[i], true);
+	}
+}
+
+
+void encodeFactAddress(std::string& out, Fact* fact){
+	appendCode(out, ValueCode::FactAddress);
+	append(out, (int64_t)fact->factIndex);
+}
+
+
+/*
+Facts referenced from the slots of another fact are encoded by index
+only, so circular references end.
+*/
+void encodeValue(std::string& out, const CLIPSValue& cv, bool inFact){
+	switch(cv.header->type){
+		case INTEGER_TYPE:
+			appendCode(out, ValueCode::Integer);
+			append(out, (int64_t)cv.integerValue->contents);
+			return;
+
+		case FLOAT_TYPE:
+			appendCode(out, ValueCode::Float);
+			append(out, cv.floatValue->contents);
+			return;
+
+		case SYMBOL_TYPE:
+			appendCode(out, ValueCode::Symbol);
+			appendLexeme(out, cv.lexemeValue);
+			return;
+
+		case STRING_TYPE:
+			appendCode(out, ValueCode::String);
+			appendLexeme(out, cv.lexemeValue);
+			return;
+
+		case INSTANCE_NAME_TYPE:
+			appendCode(out, ValueCode::InstanceName);
+			appendLexeme(out, cv.lexemeValue);
+			return;
+
+		case MULTIFIELD_TYPE:{
+			const Multifield* mf = cv.multifieldValue;
+			appendCode(out, ValueCode::Multifield);
+			append(out, (uint32_t)mf->length);
+			for(size_t i = 0; i < mf->length; ++i)
+				encodeValue(out, mf->contents[i], inFact);
+			return;
+		}
+
+		case FACT_ADDRESS_TYPE:
+			if(inFact || cv.factValue->garbage) encodeFactAddress(out, cv.factValue);
+			else encodeFact(out, cv.factValue);
+			return;
+
+		case INSTANCE_ADDRESS_TYPE:
+			appendCode(out, ValueCode::InstanceAddress);
+			appendLexeme(out, cv.instanceValue->name);
+			return;
+
+		case EXTERNAL_ADDRESS_TYPE:
+			appendCode(out, ValueCode::ExternalAddress);
+			return;
+
+		default:
+			appendCode(out, ValueCode::Void);
+			return;
+	}
+}
+
+
+
+/* ** ***************************************************************
+*
+* Fact-set queries
+*
+** ** **************************************************************/
+static void destroyFindCursors(Environment* env){
+	FindCursors** cursors = (FindCursors**)GetEnvironmentData(env, FIND_CURSORS_DATA);
+	if(!cursors || !*cursors) return;
+	// The facts are freed along with the environment
+	delete *cursors;
+	*cursors = NULL;
+}
+
+
+static FindCursors* getFindCursors(){
+	FindCursors** cursors = (FindCursors**)GetEnvironmentData(defEnv, FIND_CURSORS_DATA);
+	if(!cursors){
+		AllocateEnvironmentData(defEnv, FIND_CURSORS_DATA, sizeof(FindCursors*), destroyFindCursors);
+		cursors = (FindCursors**)GetEnvironmentData(defEnv, FIND_CURSORS_DATA);
+		*cursors = new FindCursors();
+	}
+	return *cursors;
+}
+
+
+static void saveCursor(Fact* fact){
+	FindCursors* cursors = getFindCursors();
+	if(cursors->facts.size() >= MaxFindCursors){
+		ReleaseFact(cursors->facts.front());
+		cursors->facts.pop_front();
+	}
+	RetainFact(fact);
+	cursors->facts.push_back(fact);
+}
+
+
+/*
+Gets the fact the page after the given token starts at. The fact the
+previous page ended at is used when still asserted. Otherwise the
+template is scanned (without evaluating the test) for the first fact
+with a greater index. Returns false when no facts are left.
+*/
+static bool findStartFact(Deftemplate* deftemplate, int64_t after, Fact*& start){
+	start = NULL;
+	if(after < 1) return true;
+	FindCursors* cursors = getFindCursors();
+	for(auto it = cursors->facts.begin(); it != cursors->facts.end(); ++it){
+		Fact* fact = *it;
+		if(fact->factIndex != after) continue;
+		cursors->facts.erase(it);
+		ReleaseFact(fact);
+		if( !fact->garbage && (fact->whichDeftemplate == deftemplate) ){
+			start = fact->nextTemplateFact;
+			return start != NULL;
+		}
+		break;
+	}
+	for(start = deftemplate->factList; start && (start->factIndex <= after); start = start->nextTemplateFact);
+	return start != NULL;
+}
+
+
+/*
+Appends the fact to the active page. Returns TRUE when the page is
+already full, so the query action can break out of the loop.
+*/
+static void collectFact(Environment* env, UDFContext* udfc, UDFValue* out){
+	UDFValue arg;
+	out->lexemeValue = FalseSymbol(env);
+	if( !UDFFirstArgument(udfc, FACT_ADDRESS_BIT, &arg) || !activePage ) return;
+	if(activePage->count >= activePage->size){
+		activePage->more = true;
+		out->lexemeValue = TrueSymbol(env);
+		return;
+	}
+	size_t mark = activePage->out->length();
+	encodeFact(*activePage->out, arg.factValue);
+	// A fact past the byte budget is left for the next page, unless
+	// it would be alone in its page
+	if( (activePage->out->length() > activePage->maxBytes) && (activePage->count > 0) ){
+		activePage->out->resize(mark);
+		activePage->more = true;
+		out->lexemeValue = TrueSymbol(env);
+		return;
+	}
+	activePage->last = arg.factValue;
+	++activePage->count;
+}
+
+
+static bool isTemplateName(const std::string& s){
+	if( s.empty() ) return false;
+	for(char c : s){
+		if( std::isspace((unsigned char)c) || (c == '(') || (c == ')') ||
+			(c == '"') || (c == ';') || (c == '?') || (c == '$') || (c == '&') ||
+			(c == '|') || (c == '~') || (c == '<') )
+			return false;
+	}
+	return true;
+}
+
+
+bool findFacts(const std::string& templateName, const std::string& test,
+	size_t pageSize, int64_t& after, std::string& result, size_t maxBytes){
+	result.clear();
+	if( !isTemplateName(templateName) || (pageSize < 1) || (after < 0) || activePage ) return false;
+	if( !FindFunction(defEnv, collectFactFunction) &&
+		(AddUDF(defEnv, collectFactFunction, "b", 1, 1, "f", collectFact, "collectFact", NULL) != AUE_NO_ERROR) )
+		return false;
+
+	// Multifield header. The count is filled in afterwards.
+	appendCode(result, ValueCode::Multifield);
+	append(result, (uint32_t)0);
+
+	// Pages after the first one resume from the fact the previous page
+	// ended at, so the template is traversed once across all pages.
+	Fact* start = NULL;
+	Deftemplate* deftemplate = FindDeftemplate(defEnv, templateName.c_str());
+	if( deftemplate && !findStartFact(deftemplate, after, start) ){
+		after = 0;
+		return true;
+	}
+
+	// The query engine visits the facts of the template in order and
+	// the page is encoded as facts are found, breaking out of the loop
+	// once the page is full.
+	std::string query = "(do-for-all-facts ((?f " + templateName + ")) " + (test.empty() ? "TRUE" : test) +
+		" (if (" + collectFactFunction + " ?f) then (break)))";
+
+	FactPage page = { &result, pageSize, maxBytes, 0, NULL, false };
+	activePage = &page;
+	SetFactQueryStart(defEnv, start);
+	GCBlock gcb;
+	GCBlockStart(defEnv, &gcb);
+	CLIPSValue cv;
+	bool success = Eval(defEnv, query.c_str(), &cv) == EE_NO_ERROR;
+	GCBlockEnd(defEnv, &gcb);
+	SetFactQueryStart(defEnv, NULL);
+	activePage = NULL;
+
+	if(!success){
+		result.clear();
+		return false;
+	}
+	uint32_t count = page.count;
+	result.replace(1, sizeof(count), (const char*)&count, sizeof(count));
+	after = 0;
+	if(page.more){
+		saveCursor(page.last);
+		after = page.last->factIndex;
+	}
+	return true;
+}
+
+
+
+/* ** ***************************************************************
+*
+* Evaluation
+*
+** ** **************************************************************/
+bool eval(const std::string& expression, std::string& result){
+	result.clear();
+	// Keeps the value alive until it is encoded
+	GCBlock gcb;
+	GCBlockStart(defEnv, &gcb);
+	CLIPSValue cv;
+	bool success = Eval(defEnv, expression.c_str(), &cv) == EE_NO_ERROR;
+	if(success) encodeValue(result, cv, false);
+	GCBlockEnd(defEnv, &gcb);
+	return success;
+}
+
+}
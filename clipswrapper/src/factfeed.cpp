@@ -0,0 +1,245 @@
+/* ** ***************************************************************
+* factfeed.cpp
+*
+* Author: Mauricio Matamoros
+*
+* Coalesced fact-change notifications for subscribers
+*
+** ** **************************************************************/
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "factfeed.h"
+#include "clipsdefenv.h"
+#include "valueencoding.h"
+
+extern "C"{
+	#include "clips/envrnmnt.h"
+	#include "clips/factmngr.h"
+}
+
+/**
+ * Environment data position where the FactFeed of each environment
+ * is stored
+ */
+#define FACT_FEED_DATA USER_ENVIRONMENT_DATA + 2
+
+/**
+ * Name under which the fact manager hooks are registered
+ */
+#define FACT_FEED_HOOK "clipswrapper-fact-feed"
+
+namespace clips{
+
+/* ** ***************************************************************
+*
+* FactFeed class members
+*
+** ** **************************************************************/
+FactFeed& FactFeed::getInstance(){
+	// Instantiated on first use and destroyed along with the environment.
+	if(!defEnv) throw std::runtime_error("CLIPS environment not initialized");
+	FactFeed** instance = (FactFeed**)GetEnvironmentData(defEnv, FACT_FEED_DATA);
+	if(!instance){
+		AllocateEnvironmentData(defEnv, FACT_FEED_DATA, sizeof(FactFeed*), &FactFeed::destroyInstance);
+		instance = (FactFeed**)GetEnvironmentData(defEnv, FACT_FEED_DATA);
+		*instance = new FactFeed();
+	}
+	return **instance;
+}
+
+
+void FactFeed::destroyInstance(Environment* env){
+	FactFeed** instance = (FactFeed**)GetEnvironmentData(env, FACT_FEED_DATA);
+	if(!instance || !*instance) return;
+	// Retained facts are released along with the environment
+	delete *instance;
+	*instance = NULL;
+}
+
+
+FactFeed::FactFeed():
+	hooked(false), watchingAll(0), modifying(NULL){}
+
+
+FactFeed::~FactFeed(){}
+
+
+bool FactFeed::subscribe(const std::string& subscriber, const std::string& templateName){
+	if( subscriber.empty() || templateName.empty() ) return false;
+	Subscription& s = subscriptions[subscriber];
+	if(templateName == "*"){
+		if(s.all) return false;
+		s.all = true;
+		++watchingAll;
+	}
+	else{
+		if( std::find(s.templates.begin(), s.templates.end(), templateName) != s.templates.end() )
+			return false;
+		s.templates.push_back(templateName);
+		auto it = std::find_if(watched.begin(), watched.end(),
+			[&](const std::pair<std::string, size_t>& w){ return w.first == templateName; });
+		if(it == watched.end()) watched.push_back( std::make_pair(templateName, 1) );
+		else ++it->second;
+	}
+	hook();
+	return true;
+}
+
+
+void FactFeed::unsubscribe(const std::string& subscriber, const std::string& templateName){
+	auto sit = subscriptions.find(subscriber);
+	if(sit == subscriptions.end()) return;
+	Subscription& s = sit->second;
+
+	if( s.all && (templateName.empty() || (templateName == "*")) ){
+		s.all = false;
+		--watchingAll;
+	}
+	for(auto it = s.templates.begin(); it != s.templates.end(); ){
+		if( !templateName.empty() && (*it != templateName) ){ ++it; continue; }
+		for(auto wit = watched.begin(); wit != watched.end(); ++wit){
+			if(wit->first != *it) continue;
+			if(--wit->second == 0) watched.erase(wit);
+			break;
+		}
+		it = s.templates.erase(it);
+	}
+	if( !s.all && s.templates.empty() ) subscriptions.erase(sit);
+}
+
+
+bool FactFeed::hasChanges() const{
+	return !changes.empty();
+}
+
+
+void FactFeed::flush(const std::function<bool(const std::string& subscriber, const std::string& changes)>& publish){
+	if( changes.empty() ) return;
+
+	// Each change is encoded once, when first reported
+	std::vector<std::string> encoded(changes.size());
+	std::vector<std::string> gone;
+	std::string out;
+	for(const auto& kv : subscriptions){
+		const Subscription& s = kv.second;
+		uint32_t count = 0;
+		out.assign(sizeof(count), 0);
+		for(size_t i = 0; i < changes.size(); ++i){
+			const Change& c = changes[i];
+			if(!c.kind) continue;
+			if( !s.all && (std::find(s.templates.begin(), s.templates.end(), c.templateName) == s.templates.end()) )
+				continue;
+			if( encoded[i].empty() ){
+				encoded[i].push_back((char)c.kind);
+				if(c.kind == (uint8_t)FactChange::Retract) encodeFactAddress(encoded[i], c.fact);
+				else encodeFact(encoded[i], c.fact);
+			}
+			out+= encoded[i];
+			++count;
+		}
+		if(!count) continue;
+		std::memcpy(&out[0], &count, sizeof(count));
+		if( !publish(kv.first, out) ) gone.push_back(kv.first);
+	}
+
+	for(const Change& c : changes)
+		ReleaseFact(c.fact);
+	changes.clear();
+	positions.clear();
+	for(const std::string& subscriber : gone)
+		unsubscribe(subscriber);
+}
+
+
+void FactFeed::hook(){
+	if(hooked) return;
+	hooked =
+		AddAssertFunction(defEnv, FACT_FEED_HOOK, assertCallback, 0, this) &&
+		AddRetractFunction(defEnv, FACT_FEED_HOOK, retractCallback, 0, this) &&
+		AddModifyFunction(defEnv, FACT_FEED_HOOK, modifyCallback, 0, this);
+}
+
+
+bool FactFeed::isWatched(const char* templateName) const{
+	if(watchingAll > 0) return true;
+	for(const auto& w : watched){
+		if(std::strcmp(w.first.c_str(), templateName) == 0) return true;
+	}
+	return false;
+}
+
+
+void FactFeed::record(Fact* f, FactChange kind){
+	const char* templateName = f->whichDeftemplate->header.name->contents;
+	if( !isWatched(templateName) ) return;
+
+	auto it = positions.find(f);
+	if(it == positions.end()){
+		// Kept until flushed so retracted facts can still be reported
+		RetainFact(f);
+		positions[f] = changes.size();
+		changes.push_back( {f, templateName, (uint8_t)kind} );
+		return;
+	}
+
+	Change& c = changes[it->second];
+	switch(kind){
+		case FactChange::Retract:
+			// Asserted and retracted within the same cycle: nothing to report
+			c.kind = (c.kind == (uint8_t)FactChange::Assert) ? 0 : (uint8_t)kind;
+			break;
+
+		case FactChange::Modify:
+			if(c.kind != (uint8_t)FactChange::Assert) c.kind = (uint8_t)kind;
+			break;
+
+		case FactChange::Assert:
+			c.kind = (uint8_t)kind;
+			break;
+	}
+}
+
+
+
+/* ** ***************************************************************
+*
+* Fact manager hooks
+*
+** ** **************************************************************/
+void FactFeed::assertCallback(Environment* env, void* f, void* context){
+	FactFeed* feed = static_cast<FactFeed*>(context);
+	if(f == feed->modifying) return;
+	feed->record(static_cast<Fact*>(f), FactChange::Assert);
+}
+
+
+void FactFeed::retractCallback(Environment* env, void* f, void* context){
+	FactFeed* feed = static_cast<FactFeed*>(context);
+	if(f == feed->modifying) return;
+	feed->record(static_cast<Fact*>(f), FactChange::Retract);
+}
+
+
+/*
+Modifying a fact calls this function with the old fact before
+retracting it and with the new one after asserting it again. The
+retraction and assertion in between are not reported.
+*/
+void FactFeed::modifyCallback(Environment* env, Fact* oldFact, Fact* newFact, void* context){
+	FactFeed* feed = static_cast<FactFeed*>(context);
+	if(oldFact){
+		feed->modifying = oldFact;
+		return;
+	}
+	Fact* modified = feed->modifying;
+	feed->modifying = NULL;
+	if(!newFact) return;
+	// The modified fact was a duplicate of an existing one
+	if(modified && (modified != newFact))
+		feed->record(modified, FactChange::Retract);
+	feed->record(newFact, FactChange::Modify);
+}
+
+}
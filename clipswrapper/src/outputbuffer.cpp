@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cstring>
+#include "outputbuffer.h"
+
+using namespace clips;
+
+OutputBuffer::OutputBuffer(size_t chunkSize, size_t maxSpare):
+	chunkSize(chunkSize ? chunkSize : 1), maxSpare(maxSpare), length(0){}
+
+
+void OutputBuffer::append(const char* s, size_t n){
+	length+= n;
+	while(n > 0){
+		if( chunks.empty() || (chunks.back().size() >= chunkSize) ){
+			if( !spare.empty() ){
+				chunks.push_back( std::move(spare.back()) );
+				spare.pop_back();
+			}
+			else{
+				chunks.emplace_back();
+				chunks.back().reserve(chunkSize);
+			}
+		}
+		std::string& chunk = chunks.back();
+		size_t count = std::min(n, chunkSize - chunk.size());
+		chunk.append(s, count);
+		s+= count;
+		n-= count;
+	}
+}
+
+
+void OutputBuffer::append(const char* s){
+	if(s) append(s, std::strlen(s));
+}
+
+
+size_t OutputBuffer::size() const{
+	return length;
+}
+
+
+bool OutputBuffer::empty() const{
+	return length == 0;
+}
+
+
+std::string OutputBuffer::read(){
+	std::string s;
+	if(chunks.size() == 1)
+		s = std::move(chunks.front());
+	else{
+		s.reserve(length);
+		for(std::string& chunk : chunks){
+			s+= chunk;
+			recycle(chunk);
+		}
+	}
+	chunks.clear();
+	length = 0;
+	return s;
+}
+
+
+void OutputBuffer::clear(){
+	for(std::string& chunk : chunks)
+		recycle(chunk);
+	chunks.clear();
+	length = 0;
+}
+
+
+void OutputBuffer::recycle(std::string& chunk){
+	if(spare.size() >= maxSpare) return;
+	chunk.clear();
+	spare.push_back( std::move(chunk) );
+}
@@ -1,5 +1,18 @@
 #include <cstring>
+#include <stdexcept>
 #include "queryrouter.h"
+#include "clipsdefenv.h"
+
+extern "C"{
+	#include "clips/envrnmnt.h"
+	#include "clips/router.h"
+}
+
+/**
+ * Environment data position where the QueryRouter of each
+ * environment is stored
+ */
+#define QUERY_ROUTER_DATA USER_ENVIRONMENT_DATA + 0
 
 namespace clips{
 /* ** ***************************************************************
@@ -7,9 +20,15 @@ namespace clips{
 * Static prototypes for interface with CLIPS
 *
 ** ** **************************************************************/
-static bool queryFunction(const std::string& logicalName);
-static void writeFunction(const std::string& logicalName, const std::string& str);
-static void exitFunction(int exitCode);
+static void exitFunction(Environment* env, int exitCode, void* context);
+
+/**
+ * Standard CLIPS logical names. Output captured from these names is
+ * also sent to the routers below the QueryRouter.
+ */
+static const char* standardLogicalNames[] = {
+	"stdin", "stdout", "wclips", "wdialog", "wdisplay", "werror", "wwarning", "wtrace"
+};
 
 
 /* ** ***************************************************************
@@ -22,16 +41,31 @@ QueryRouter& QueryRouter::getInstance(
 			const std::string& routerName,
 			clips::RouterPriority priority)
 {
-	// Guaranteed to be destroyed.
-	// Instantiated on first use.
-	static QueryRouter instance(routerName, priority);
-	return instance;
+	// Instantiated on first use and destroyed along with the environment.
+	if(!defEnv) throw std::runtime_error("CLIPS environment not initialized");
+	QueryRouter** instance = (QueryRouter**)GetEnvironmentData(defEnv, QUERY_ROUTER_DATA);
+	if(!instance){
+		AllocateEnvironmentData(defEnv, QUERY_ROUTER_DATA, sizeof(QueryRouter*), &QueryRouter::destroyInstance);
+		instance = (QueryRouter**)GetEnvironmentData(defEnv, QUERY_ROUTER_DATA);
+		*instance = new QueryRouter(routerName, priority);
+	}
+	return **instance;
+}
+
+
+void QueryRouter::destroyInstance(Environment* env){
+	QueryRouter** instance = (QueryRouter**)GetEnvironmentData(env, QUERY_ROUTER_DATA);
+	if(!instance || !*instance) return;
+	// The environment is being torn down along with its routers
+	(*instance)->registered = false;
+	delete *instance;
+	*instance = NULL;
 }
 
 
 QueryRouter::QueryRouter(const std::string& routerName, clips::RouterPriority priority):
 	routerName(routerName), priority(priority),
-	registered(false), enabled(false){}
+	registered(false), enabled(false), self(NULL){}
 
 QueryRouter::~QueryRouter(){
 	unregisterR();
@@ -58,17 +92,35 @@ bool QueryRouter::isEnabled(){
 
 
 bool QueryRouter::hasLogicalName(const std::string& ln){
-	return logicalNames.count(ln) > 0;
+	return findLogicalName(ln.c_str()) != NULL;
+}
+
+bool QueryRouter::hasLogicalName(const char* ln){
+	return findLogicalName(ln) != NULL;
 }
 
 void QueryRouter::addLogicalName(const std::string& ln){
-	if( !hasLogicalName(ln) )
-		logicalNames.insert(ln);
+	if( hasLogicalName(ln) ) return;
+	bool echo = false;
+	for(const char* sln : standardLogicalNames)
+		echo |= (ln == sln);
+	logicalNames.push_back({ln, echo});
 }
 
 void QueryRouter::removeLogicalName(const std::string& ln){
-	if( hasLogicalName(ln) )
-		logicalNames.erase(ln);
+	for(auto it = logicalNames.begin(); it != logicalNames.end(); ++it){
+		if(it->name != ln) continue;
+		logicalNames.erase(it);
+		return;
+	}
+}
+
+
+const QueryRouter::LogicalNameEntry* QueryRouter::findLogicalName(const char* ln) const{
+	for(const LogicalNameEntry& entry : logicalNames){
+		if(std::strcmp(entry.name.c_str(), ln) == 0) return &entry;
+	}
+	return NULL;
 }
 
 
@@ -83,28 +135,29 @@ clips::RouterPriority QueryRouter::getPriority(){
 
 
 std::string QueryRouter::read(){
-	std::string copy(buffer);
-	buffer.clear();
-	return copy;
+	return buffer.read();
 }
 
 
 void QueryRouter::write(const std::string& s){
-	buffer+=s;
+	buffer.append(s.c_str(), s.length());
 }
 
 
 void QueryRouter::registerR(){
 	if(registered) return;
 
-	clips::addRouter(routerName,
-		priority,       // Priority
+	// Registered directly so CLIPS hands this instance back to the
+	// callbacks instead of resolving it on every write
+	registered = AddRouter(defEnv, routerName.c_str(), (int)priority,
 		queryFunction,  // Query function
 		writeFunction,  // Write function
 		NULL,           // Getc function
 		NULL,           // Ungetc function
-		exitFunction    // Exit function
+		exitFunction,   // Exit function
+		this            // Context
 	);
+	self = registered ? FindRouter(defEnv, routerName.c_str()) : NULL;
 }
 
 
@@ -112,6 +165,21 @@ void QueryRouter::unregisterR(){
 	if(!registered) return;
 	clips::deactivateRouter(routerName);
 	clips::deleteRouter(routerName);
+	registered = false;
+	self = NULL;
+}
+
+
+void QueryRouter::echo(const char* ln, const char* str){
+	if(!self) return;
+	// Routers are sorted by priority, so the ones after this router
+	// are exactly those WriteString would query if it were inactive
+	for(::router* r = self->next; r; r = r->next){
+		if( !r->active || !r->writeCallback ) continue;
+		if( !r->queryCallback || !r->queryCallback(defEnv, ln, r->context) ) continue;
+		r->writeCallback(defEnv, ln, str, r->context);
+		return;
+	}
 }
 
 
@@ -123,43 +191,28 @@ void QueryRouter::unregisterR(){
 ** ** **************************************************************/
 
 /*
-We want to recognize any output that is sent to the logical name
-"wtrace" because all tracing information is sent to this logical
-name. The recognizer function for our router is defined below.
+We want to recognize any output that is sent to the logical names
+registered in the router.
 */
-bool queryFunction(const std::string& logicalName){
-	QueryRouter& qr = QueryRouter::getInstance();
-	return qr.hasLogicalName(logicalName);
+bool QueryRouter::queryFunction(Environment* env, const char* logicalName, void* context){
+	return static_cast<QueryRouter*>(context)->hasLogicalName(logicalName);
 }
 
 /*
-We now need to define a function which will print the tracing in-
-formation to our trace file. The print function for our router is
-defined below.
+Captured output is appended to the buffer and, for the standard
+logical names, passed on to the next router that recognizes it.
 */
-void writeFunction(const std::string& logicalName, const std::string& str){
-	static std::set<std::string> clpln = { "stdin", "stdout", "wclips", "wdialog", "wdisplay", "werror", "wwarning", "wtrace" };
-
-	QueryRouter& qr = QueryRouter::getInstance();
-	if(!qr.hasLogicalName(logicalName)) return;
-	if(!qr.isEnabled()){
-		if(clpln.count(logicalName) > 0)
-			clips::print(logicalName, str);
-		return;
-	}
-
-	qr.write(str);
-	if(clpln.count(logicalName) > 0){
-		clips::deactivateRouter(qr.getName());
-		clips::print(logicalName, str);
-		clips::activateRouter(qr.getName());
-	}
+void QueryRouter::writeFunction(Environment* env, const char* logicalName, const char* str, void* context){
+	QueryRouter* qr = static_cast<QueryRouter*>(context);
+	const LogicalNameEntry* entry = qr->findLogicalName(logicalName);
+	if(!entry) return;
+	if(qr->enabled) qr->buffer.append(str);
+	if(entry->echo) qr->echo(logicalName, str);
 }
 
 /*
-When we exit CLIPS the trace file needs to be closed.
-function for our router is defined below.
+Nothing to release on exit.
 */
-void exitFunction(int exitCode){}
+void exitFunction(Environment* env, int exitCode, void* context){}
 
 } // end namespace clips
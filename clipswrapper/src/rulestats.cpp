@@ -0,0 +1,349 @@
+/* ** ***************************************************************
+* rulestats.cpp
+*
+* Author: Mauricio Matamoros
+*
+* Per-rule firing counters and RHS timing
+*
+** ** **************************************************************/
+
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "rulestats.h"
+#include "clipsdefenv.h"
+
+extern "C"{
+	#include "clips/clips.h"
+}
+
+/**
+ * Environment data position where the RuleStats of each environment
+ * is stored
+ */
+#define RULE_STATS_DATA USER_ENVIRONMENT_DATA + 3
+
+/**
+ * Name under which the inference engine hooks are registered
+ */
+#define RULE_STATS_HOOK "clipswrapper-rule-stats"
+
+namespace clips{
+
+/* ** ***************************************************************
+*
+* Time histogram
+*
+** ** **************************************************************/
+/*
+Times are binned in a log-linear histogram: values below 8ns have a bin
+each, and every power of two above is split in four bins, so a bin is
+at most 25% wider than its lower edge. Times of 2^39ns (about nine
+minutes) and longer share the last bins.
+*/
+static const unsigned MaxExponent = 39;
+static const size_t HistogramBuckets = 8 + (MaxExponent - 2) * 4;
+
+static inline
+size_t bucketOf(uint64_t ns){
+	if(ns < 8) return (size_t)ns;
+	unsigned e = 63 - __builtin_clzll(ns);
+	if(e > MaxExponent) return HistogramBuckets - 1;
+	return 8 + (e - 3) * 4 + ((ns >> (e - 2)) & 3);
+}
+
+static inline
+uint64_t upperEdgeOf(size_t bucket){
+	if(bucket < 8) return bucket;
+	unsigned e = (unsigned)(bucket - 8) / 4 + 3;
+	uint64_t sub = (bucket - 8) % 4;
+	return ((4 + sub + 1) << (e - 2)) - 1;
+}
+
+
+/**
+ * Counters of a rule (or of a disjunct of a rule). Entries are attached
+ * to their defrule as user data, so CLIPS releases them (and they
+ * unlink themselves from the statistics) when the defrule is deleted.
+ */
+struct RuleStats::Entry : public ::userData{
+	Entry() : stats(NULL), rule(NULL),
+		fires(0), totalNs(0), maxNs(0), lastSequence(0){
+		for(size_t i = 0; i < HistogramBuckets; ++i) histogram[i] = 0;
+	}
+
+	/**
+	 * The statistics the entry is registered in
+	 */
+	RuleStats* stats;
+	/**
+	 * The defrule
+	 */
+	Defrule* rule;
+	/**
+	 * Number of firings
+	 */
+	std::atomic<uint64_t> fires;
+	/**
+	 * Total RHS time in nanoseconds
+	 */
+	std::atomic<uint64_t> totalNs;
+	/**
+	 * Longest RHS time in nanoseconds
+	 */
+	std::atomic<uint64_t> maxNs;
+	/**
+	 * Sequence number of the last firing
+	 */
+	std::atomic<uint64_t> lastSequence;
+	/**
+	 * RHS time histogram
+	 */
+	std::atomic<uint32_t> histogram[HistogramBuckets];
+};
+
+
+/**
+ * Adds a value to a counter with a single writer. A plain load and
+ * store avoids the locked read-modify-write of fetch_add.
+ */
+template<typename T>
+static inline
+void add_relaxed(std::atomic<T>& counter, T value){
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+/* ** ***************************************************************
+*
+* RuleStats class members
+*
+** ** **************************************************************/
+RuleStats& RuleStats::getInstance(){
+	// Instantiated on first use and destroyed along with the environment.
+	if(!defEnv) throw std::runtime_error("CLIPS environment not initialized");
+	RuleStats** instance = (RuleStats**)GetEnvironmentData(defEnv, RULE_STATS_DATA);
+	if(!instance){
+		AllocateEnvironmentData(defEnv, RULE_STATS_DATA, sizeof(RuleStats*), &RuleStats::destroyInstance);
+		instance = (RuleStats**)GetEnvironmentData(defEnv, RULE_STATS_DATA);
+		*instance = new RuleStats();
+	}
+	return **instance;
+}
+
+
+void RuleStats::destroyInstance(Environment* env){
+	RuleStats** instance = (RuleStats**)GetEnvironmentData(env, RULE_STATS_DATA);
+	if(!instance || !*instance) return;
+	// Entries still attached to defrules must not unlink themselves
+	for(Entry* entry : (*instance)->entries)
+		entry->stats = NULL;
+	delete *instance;
+	*instance = NULL;
+}
+
+
+RuleStats::RuleStats():
+	enabled(false), hooked(false), record(NULL), sequence(0), current(NULL){}
+
+
+RuleStats::~RuleStats(){
+	// The record stays installed in CLIPS until the environment is gone
+	delete record;
+}
+
+
+void RuleStats::enable(){
+	if(!hooked){
+		record = new ::userDataRecord();
+		record->createUserData = createEntry;
+		record->deleteUserData = deleteEntry;
+		InstallUserDataRecord(defEnv, record);
+		hooked =
+			AddBeforeRuleFiresFunction(defEnv, RULE_STATS_HOOK, beforeFiring, 0, this) &&
+			AddAfterRuleFiresFunction(defEnv, RULE_STATS_HOOK, afterFiring, 0, this);
+	}
+	enabled = true;
+}
+
+
+void RuleStats::disable(){
+	enabled = false;
+}
+
+
+bool RuleStats::isEnabled() const{
+	return enabled;
+}
+
+
+void RuleStats::reset(){
+	// The sequence keeps growing so readers can still tell what fired
+	for(Entry* entry : entries){
+		entry->fires.store(0, std::memory_order_relaxed);
+		entry->totalNs.store(0, std::memory_order_relaxed);
+		entry->maxNs.store(0, std::memory_order_relaxed);
+		entry->lastSequence.store(0, std::memory_order_relaxed);
+		for(size_t i = 0; i < HistogramBuckets; ++i)
+			entry->histogram[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+
+uint64_t RuleStats::getSequence() const{
+	return sequence.load(std::memory_order_relaxed);
+}
+
+
+std::vector<RuleStatsRow> RuleStats::getStats(uint64_t since){
+	struct Accumulator{
+		RuleStatsRow row;
+		bool fired;
+		std::vector<uint64_t> histogram;
+	};
+	if(!record && (since > 0)) return std::vector<RuleStatsRow>();
+	// Disjuncts of a rule share its name
+	std::map<std::string, Accumulator> rules;
+
+	auto accumulatorOf = [&](Defrule* rule) -> Accumulator&{
+		std::string name(DefruleModule(rule));
+		name+= "::";
+		name+= DefruleName(rule);
+		Accumulator& acc = rules[name];
+		if( acc.histogram.empty() ){
+			acc.row = RuleStatsRow{name, 0, 0, 0, 0, 0};
+			acc.fired = false;
+			acc.histogram.assign(HistogramBuckets, 0);
+		}
+		return acc;
+	};
+
+	for(Entry* entry : entries){
+		if( !entry->rule || (entry->lastSequence.load(std::memory_order_relaxed) <= since) )
+			continue;
+		Accumulator& acc = accumulatorOf(entry->rule);
+		acc.fired = true;
+		acc.row.fires+= entry->fires.load(std::memory_order_relaxed);
+		acc.row.totalNs+= entry->totalNs.load(std::memory_order_relaxed);
+		acc.row.maxNs = std::max(acc.row.maxNs, (uint64_t)entry->maxNs.load(std::memory_order_relaxed));
+		for(size_t i = 0; i < HistogramBuckets; ++i)
+			acc.histogram[i]+= entry->histogram[i].load(std::memory_order_relaxed);
+	}
+
+	// Activations waiting on the agenda of each module
+	for(Defmodule* module = GetNextDefmodule(defEnv, NULL); module; module = GetNextDefmodule(defEnv, module)){
+		struct defruleModule* item = GetDefruleModuleItem(defEnv, module);
+		if(!item) continue;
+		for(::activation* act = item->agenda; act; act = act->next){
+			if(since > 0){
+				Entry* entry = (Entry*)TestUserData(record->dataID, act->theRule->header.usrData);
+				if( !entry || (entry->lastSequence.load(std::memory_order_relaxed) <= since) ) continue;
+			}
+			++accumulatorOf(act->theRule).row.activations;
+		}
+	}
+
+	std::vector<RuleStatsRow> rows;
+	rows.reserve(rules.size());
+	for(auto& kv : rules){
+		Accumulator& acc = kv.second;
+		if( !acc.fired && (since > 0) ) continue;
+		if(acc.row.fires > 0){
+			uint64_t target = (uint64_t)std::ceil(acc.row.fires * 0.99), seen = 0;
+			for(size_t i = 0; i < HistogramBuckets; ++i){
+				seen+= acc.histogram[i];
+				if(seen < target) continue;
+				acc.row.p99Ns = std::min(upperEdgeOf(i), acc.row.maxNs);
+				break;
+			}
+		}
+		rows.push_back(acc.row);
+	}
+	std::stable_sort(rows.begin(), rows.end(), [](const RuleStatsRow& a, const RuleStatsRow& b){
+		return a.totalNs > b.totalNs;
+	});
+	return rows;
+}
+
+
+std::string RuleStats::toTable(const std::vector<RuleStatsRow>& rows, size_t max){
+	std::string table("rule|fires|activations|total-ns|avg-ns|p99-ns|max-ns");
+	if( (max == 0) || (max > rows.size()) ) max = rows.size();
+	for(size_t i = 0; i < max; ++i){
+		const RuleStatsRow& r = rows[i];
+		table+= '\n';
+		table+= r.name;
+		table+= '|' + std::to_string(r.fires);
+		table+= '|' + std::to_string(r.activations);
+		table+= '|' + std::to_string(r.totalNs);
+		table+= '|' + std::to_string(r.fires ? r.totalNs / r.fires : 0);
+		table+= '|' + std::to_string(r.p99Ns);
+		table+= '|' + std::to_string(r.maxNs);
+	}
+	return table;
+}
+
+
+RuleStats::Entry* RuleStats::getEntry(::activation* act){
+	Entry* entry = (Entry*)FetchUserData(defEnv, record->dataID, &act->theRule->header.usrData);
+	if(!entry->stats){
+		entry->stats = this;
+		entry->rule = act->theRule;
+		entries.insert(entry);
+	}
+	return entry;
+}
+
+
+
+/* ** ***************************************************************
+*
+* User data and inference engine hooks
+*
+** ** **************************************************************/
+void* RuleStats::createEntry(Environment* env){
+	return static_cast<::userData*>(new Entry());
+}
+
+
+void RuleStats::deleteEntry(Environment* env, void* data){
+	Entry* entry = static_cast<Entry*>((::userData*)data);
+	if(entry->stats){
+		entry->stats->entries.erase(entry);
+		if(entry->stats->current == entry) entry->stats->current = NULL;
+	}
+	delete entry;
+}
+
+
+void RuleStats::beforeFiring(Environment* env, ::activation* act, void* context){
+	RuleStats* stats = static_cast<RuleStats*>(context);
+	if(!stats->enabled){
+		stats->current = NULL;
+		return;
+	}
+	stats->current = stats->getEntry(act);
+	stats->start = std::chrono::steady_clock::now();
+}
+
+
+void RuleStats::afterFiring(Environment* env, ::activation* act, void* context){
+	RuleStats* stats = static_cast<RuleStats*>(context);
+	Entry* entry = stats->current;
+	if(!entry) return;
+	stats->current = NULL;
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - stats->start).count();
+
+	add_relaxed<uint64_t>(entry->fires, 1);
+	add_relaxed<uint64_t>(entry->totalNs, ns);
+	if(ns > entry->maxNs.load(std::memory_order_relaxed))
+		entry->maxNs.store(ns, std::memory_order_relaxed);
+	add_relaxed<uint32_t>(entry->histogram[bucketOf(ns)], 1);
+	uint64_t seq = stats->sequence.load(std::memory_order_relaxed) + 1;
+	stats->sequence.store(seq, std::memory_order_relaxed);
+	entry->lastSequence.store(seq, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,65 @@
+#include "slotvalue.h"
+
+using namespace clips;
+
+SlotValue::SlotValue(): type(Type::Integer){
+	number.i = 0;
+}
+
+
+SlotValue::SlotValue(int64_t value): type(Type::Integer){
+	number.i = value;
+}
+
+
+SlotValue::SlotValue(int value): type(Type::Integer){
+	number.i = value;
+}
+
+
+SlotValue::SlotValue(double value): type(Type::Float){
+	number.d = value;
+}
+
+
+SlotValue::SlotValue(const std::string& value, Type type):
+	type(type), lexeme(value){
+	number.i = 0;
+}
+
+
+SlotValue::SlotValue(const char* value, Type type):
+	type(type), lexeme(value){
+	number.i = 0;
+}
+
+
+SlotValue::SlotValue(const std::vector<SlotValue>& values):
+	type(Type::Multifield), fields(values){
+	number.i = 0;
+}
+
+
+SlotValue::Type SlotValue::getType() const{
+	return type;
+}
+
+
+int64_t SlotValue::getInteger() const{
+	return number.i;
+}
+
+
+double SlotValue::getFloat() const{
+	return number.d;
+}
+
+
+const std::string& SlotValue::getLexeme() const{
+	return lexeme;
+}
+
+
+const std::vector<SlotValue>& SlotValue::getFields() const{
+	return fields;
+}
@@ -0,0 +1,66 @@
+/* ** ***************************************************************
+* valueencoding.h
+*
+* Author: Mauricio Matamoros
+*
+* Typed binary encoding of CLIPS values (see clips::eval)
+*
+** ** **************************************************************/
+
+#ifndef __CLIPSWRAPPER_VALUEENCODING_H__
+#define __CLIPSWRAPPER_VALUEENCODING_H__
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+extern "C"{
+	#include "clips/clips.h"
+}
+
+
+namespace clips{
+
+/**
+ * Type codes of encoded values (see clips::eval)
+ */
+enum class ValueCode : uint8_t{
+	Integer         = 0,
+	Float           = 1,
+	Symbol          = 2,
+	String          = 3,
+	InstanceName    = 4,
+	Multifield      = 5,
+	Fact            = 6,
+	FactAddress     = 7,
+	InstanceAddress = 8,
+	Void            = 9,
+	ExternalAddress = 10,
+};
+
+/**
+ * Appends a value to the encoded data
+ * @param out    The encoded data
+ * @param cv     The value
+ * @param inFact Whether the value is stored in a fact slot. Facts
+ *               referenced from slots are encoded by index only.
+ */
+void encodeValue(std::string& out, const CLIPSValue& cv, bool inFact);
+
+/**
+ * Appends a fact with all its slots to the encoded data
+ * @param out  The encoded data
+ * @param fact The fact
+ */
+void encodeFact(std::string& out, Fact* fact);
+
+/**
+ * Appends the index of a fact to the encoded data
+ * @param out  The encoded data
+ * @param fact The fact
+ */
+void encodeFactAddress(std::string& out, Fact* fact);
+
+}
+
+#endif // __CLIPSWRAPPER_VALUEENCODING_H__
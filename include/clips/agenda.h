@@ -78,6 +78,8 @@ typedef enum
 #define MAX_DEFRULE_SALIENCE  10000
 #define MIN_DEFRULE_SALIENCE -10000
 
+#define AGENDA_INDEX_LEVELS 12
+
 /*******************/
 /* DATA STRUCTURES */
 /*******************/
@@ -91,6 +93,7 @@ struct activation
    int randomID;
    struct activation *prev;
    struct activation *next;
+   struct agendaIndexNode *indexNode;
   };
 
 struct salienceGroup
@@ -100,6 +103,7 @@ struct salienceGroup
    struct activation *last;
    struct salienceGroup *next;
    struct salienceGroup *prev;
+   struct agendaIndexNode *index[AGENDA_INDEX_LEVELS];
   };
 
 #include "crstrtgy.h"
@@ -116,6 +120,7 @@ struct agendaData
    bool AgendaChanged;
    SalienceEvaluationType SalienceEvaluation;
    StrategyType Strategy;
+   bool AgendaIndexing;
   };
 
 #define AgendaData(theEnv) ((struct agendaData *) GetEnvironmentData(theEnv,AGENDA_DATA))
@@ -11,7 +11,8 @@
 /*   placed on the agenda based on the current conflict      */
 /*   resolution strategy (depth, breadth, mea, lex,          */
 /*   simplicity, or complexity). Also provides the           */
-/*   set-strategy and get-strategy commands.                 */
+/*   set-strategy and get-strategy commands, and the         */
+/*   set-agenda-indexing and get-agenda-indexing commands.   */
 /*                                                           */
 /* Principal Programmer(s):                                  */
 /*      Gary D. Riley                                        */
@@ -73,12 +74,19 @@ typedef enum
 #include "entities.h"
 
 #define DEFAULT_STRATEGY DEPTH_STRATEGY
+#define DEFAULT_AGENDA_INDEXING false
 
    void                           PlaceActivation(Environment *,Activation **,Activation *,struct salienceGroup *);
+   void                           RemoveActivationIndex(Environment *,Activation *);
+   void                           ReturnActivationIndex(Environment *,Activation *);
    StrategyType                   SetStrategy(Environment *,StrategyType);
    StrategyType                   GetStrategy(Environment *);
+   bool                           SetAgendaIndexing(Environment *,bool);
+   bool                           GetAgendaIndexing(Environment *);
    void                           SetStrategyCommand(Environment *,UDFContext *,UDFValue *);
    void                           GetStrategyCommand(Environment *,UDFContext *,UDFValue *);
+   void                           SetAgendaIndexingCommand(Environment *,UDFContext *,UDFValue *);
+   void                           GetAgendaIndexingCommand(Environment *,UDFContext *,UDFValue *);
 
 #endif /* _H_crstrtgy */
 
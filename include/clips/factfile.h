@@ -46,7 +46,9 @@
    void                           BinaryLoadFactsCommand(Environment *,UDFContext *,UDFValue *);
    long                           BinarySaveFacts(Environment *,const char *,SaveScope);
    long                           BinarySaveFactsDriver(Environment *,const char *,SaveScope,Expression *);
+   long                           BinarySaveFactsToBuffer(Environment *,SaveScope,char **,size_t *);
    long                           BinaryLoadFacts(Environment *,const char *);
+   long                           BinaryLoadFactsFromBuffer(Environment *,const char *,size_t);
 
 #endif /* _H_factfile */
 
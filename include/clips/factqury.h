@@ -91,6 +91,7 @@ struct factQueryData
    FACT_QUERY_CORE *QueryCore;
    FACT_QUERY_STACK *QueryCoreStack;
    bool AbortQuery;
+   Fact *StartFact;
   };
 
 #define FactQueryData(theEnv) ((struct factQueryData *) GetEnvironmentData(theEnv,FACT_QUERY_DATA))
@@ -106,6 +107,7 @@ struct factQueryData
    void                           QueryDoForFact(Environment *,UDFContext *,UDFValue *);
    void                           QueryDoForAllFacts(Environment *,UDFContext *,UDFValue *);
    void                           DelayedQueryDoForAllFacts(Environment *,UDFContext *,UDFValue *);
+   void                           SetFactQueryStart(Environment *,Fact *);
 
 #endif /* FACT_SET_QUERIES */
 
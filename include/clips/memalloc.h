@@ -70,11 +70,51 @@ typedef bool OutOfMemoryFunction(Environment *,size_t);
 #define MEM_TABLE_SIZE 500
 #endif
 
+#ifndef SLAB_SIZE
+#define SLAB_SIZE 16384
+#endif
+
+#ifndef SLAB_MAX_OBJECT_SIZE
+#define SLAB_MAX_OBJECT_SIZE 1024
+#endif
+
+#define SLAB_ALIGNMENT 64
+#define SLAB_GRANULE 8
+#define SLAB_CLASSES ((SLAB_MAX_OBJECT_SIZE / SLAB_GRANULE) + 1)
+
 struct memoryPtr
   {
    struct memoryPtr *next;
   };
 
+/*==========================================================*/
+/* Slabs hold the partial matches, alpha matches and facts  */
+/*   of the pattern and join networks. Each slab is aligned */
+/*   to a cache line and carved into objects of a single   */
+/*   size class. The header takes the first cache line.    */
+/*==========================================================*/
+
+struct memorySlab
+  {
+   struct memorySlab *next;
+   void *block;
+   size_t freeObjects;
+  };
+
+struct slabClass
+  {
+   struct memoryPtr *freeList;
+   struct memorySlab *slabs;
+   size_t objectSize;
+   size_t objectsPerSlab;
+   size_t slabCount;
+   long long liveObjects;
+   long long allocations;
+  };
+
+#define SlabClassOf(theEnv,size) \
+  (&MemoryData(theEnv)->SlabClasses[((size) + SLAB_GRANULE - 1) / SLAB_GRANULE])
+
 #if (MEM_TABLE_SIZE > 0)
 /*
  * Normal memory management case
@@ -113,6 +153,27 @@ struct memoryPtr
      MemoryData(theEnv)->MemoryTable[MemoryData(theEnv)->TempSize] =  MemoryData(theEnv)->TempMemoryPtr) : \
     (genfree(theEnv,struct_ptr,MemoryData(theEnv)->TempSize),(struct memoryPtr *) struct_ptr)))
 
+#define get_slab_mem(theEnv,size) \
+  ((((size) <= SLAB_MAX_OBJECT_SIZE) ? \
+    ((MemoryData(theEnv)->TempSlabClass = SlabClassOf(theEnv,size))->freeList == NULL) : 1) ? \
+   SlabAllocate(theEnv,(size_t) (size)) :\
+   ((MemoryData(theEnv)->TempMemoryPtr = MemoryData(theEnv)->TempSlabClass->freeList),\
+    MemoryData(theEnv)->TempSlabClass->freeList = MemoryData(theEnv)->TempMemoryPtr->next,\
+    MemoryData(theEnv)->TempSlabClass->liveObjects++,\
+    MemoryData(theEnv)->TempSlabClass->allocations++,\
+    ((void *) MemoryData(theEnv)->TempMemoryPtr)))
+
+#define rtn_slab_mem(theEnv,size,ptr) \
+  (MemoryData(theEnv)->TempSize = size, \
+   ((MemoryData(theEnv)->TempSize <= SLAB_MAX_OBJECT_SIZE) ? \
+    (MemoryData(theEnv)->TempSlabClass = SlabClassOf(theEnv,MemoryData(theEnv)->TempSize),\
+     MemoryData(theEnv)->TempMemoryPtr = (struct memoryPtr *) ptr,\
+     MemoryData(theEnv)->TempMemoryPtr->next = MemoryData(theEnv)->TempSlabClass->freeList, \
+     MemoryData(theEnv)->TempSlabClass->freeList = MemoryData(theEnv)->TempMemoryPtr, \
+     MemoryData(theEnv)->TempSlabClass->liveObjects--, \
+     (void) 0) : \
+    genfree(theEnv,ptr,MemoryData(theEnv)->TempSize)))
+
 #define get_mem(theEnv,size) \
   (((size <  MEM_TABLE_SIZE) ? \
     (MemoryData(theEnv)->MemoryTable[size] == NULL) : 1) ? \
@@ -144,12 +205,22 @@ struct memoryPtr
 
 #define rtn_var_struct(theEnv,type,vsize,struct_ptr) (genfree(theEnv,struct_ptr,sizeof(struct type)+vsize))
 
+#define get_slab_mem(theEnv,size) (genalloc(theEnv,(size_t) (size)))
+
+#define rtn_slab_mem(theEnv,size,ptr) (genfree(theEnv,ptr,size))
+
 #define get_mem(theEnv,size) ((struct type *) genalloc(theEnv,(size_t) (size)))
 
 #define rtn_mem(theEnv,size,ptr) (genfree(theEnv,ptr,size))
 
 #endif
 
+#define get_slab_struct(theEnv,type,vsize) \
+  ((struct type *) get_slab_mem(theEnv,sizeof(struct type) + (vsize)))
+
+#define rtn_slab_struct(theEnv,type,vsize,struct_ptr) \
+  rtn_slab_mem(theEnv,sizeof(struct type) + (vsize),struct_ptr)
+
 #define GenCopyMemory(type,cnt,dst,src) \
    memcpy((void *) (dst),(void *) (src),sizeof(type) * (size_t) (cnt))
 
@@ -164,6 +235,8 @@ struct memoryData
    struct memoryPtr *TempMemoryPtr;
    struct memoryPtr **MemoryTable;
    size_t TempSize;
+   struct slabClass *TempSlabClass;
+   struct slabClass SlabClasses[SLAB_CLASSES];
   };
 
 #define MemoryData(theEnv) ((struct memoryData *) GetEnvironmentData(theEnv,MEMORY_DATA))
@@ -184,6 +257,10 @@ struct memoryData
    void                           rm(Environment *,void *,size_t);
    unsigned long                  PoolSize(Environment *);
    unsigned long                  ActualPoolSize(Environment *);
+   void                          *SlabAllocate(Environment *,size_t);
+   long long                      ReleaseSlabs(Environment *);
+   long long                      SlabMemory(Environment *);
+   void                           ListSlabStats(Environment *,const char *);
    bool                           SetConserveMemory(Environment *,bool);
    bool                           GetConserveMemory(Environment *);
    void                           genmemcpy(char *,char *,unsigned long);
@@ -95,7 +95,10 @@
    void                           LengthFunction(Environment *,UDFContext *,UDFValue *);
    void                           ConserveMemCommand(Environment *,UDFContext *,UDFValue *);
    void                           ReleaseMemCommand(Environment *,UDFContext *,UDFValue *);
+   void                           GetAtomTableResizingCommand(Environment *,UDFContext *,UDFValue *);
+   void                           SetAtomTableResizingCommand(Environment *,UDFContext *,UDFValue *);
    void                           MemUsedCommand(Environment *,UDFContext *,UDFValue *);
+   void                           MemStatsCommand(Environment *,UDFContext *,UDFValue *);
    void                           MemRequestsCommand(Environment *,UDFContext *,UDFValue *);
    void                           OptionsCommand(Environment *,UDFContext *,UDFValue *);
    void                           OperatingSystemFunction(Environment *,UDFContext *,UDFValue *);
@@ -88,6 +88,9 @@ typedef struct alphaMemoryHash ALPHA_MEMORY_HASH;
 #endif
 
 #define INITIAL_BETA_HASH_SIZE 17
+#define BETA_MEMORY_REHASH_STEP 4
+#define DEFAULT_BETA_MEMORY_LOAD_FACTOR 2.0
+#define DEFAULT_BETA_MEMORY_MIN_LOAD_FACTOR 0.25
 
 struct betaMemory
   {
@@ -95,6 +98,10 @@ struct betaMemory
    unsigned long count;
    struct partialMatch **beta;
    struct partialMatch **last;
+   unsigned long oldSize;
+   unsigned long migrated;
+   struct partialMatch **oldBeta;
+   struct partialMatch **oldLast;
   };
 
 struct joinLink
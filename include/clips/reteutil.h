@@ -67,6 +67,15 @@
 #define NETWORK_ASSERT  0
 #define NETWORK_RETRACT 1
 
+#define BETA_CHAIN_LENGTH_BINS 6
+
+struct betaMemoryStats
+  {
+   unsigned long usedBuckets;
+   unsigned long longestChain;
+   unsigned long chains[BETA_CHAIN_LENGTH_BINS];
+  };
+
    void                           PrintPartialMatch(Environment *,const char *,struct partialMatch *);
    struct partialMatch           *CopyPartialMatch(Environment *,struct partialMatch *);
    struct partialMatch           *MergePartialMatches(Environment *,struct partialMatch *,struct partialMatch *);
@@ -95,6 +104,10 @@
    void                           TagRuleNetwork(Environment *,unsigned long *,unsigned long *,unsigned long *,unsigned long *);
    bool                           FindEntityInPartialMatch(struct patternEntity *,struct partialMatch *);
    unsigned long                  ComputeRightHashValue(Environment *,struct patternNodeHeader *);
+   unsigned long                  HashJoinValue(unsigned long,UDFValue *);
+   void                           InitBetaMemoryRehash(struct betaMemory *);
+   void                           CompleteBetaMemoryRehash(Environment *,struct betaMemory *);
+   void                           GetBetaMemoryStats(struct betaMemory *,struct betaMemoryStats *);
    void                           UpdateBetaPMLinks(Environment *,struct partialMatch *,struct partialMatch *,struct partialMatch *,
                                                        struct joinNode *,unsigned long,int);
    void                           UnlinkBetaPMFromNodeAndLineage(Environment *,struct joinNode *,struct partialMatch *,int);
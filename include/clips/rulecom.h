@@ -92,8 +92,17 @@ typedef enum
    bool                           SetBetaMemoryResizing(Environment *,bool);
    void                           GetBetaMemoryResizingCommand(Environment *,UDFContext *,UDFValue *);
    void                           SetBetaMemoryResizingCommand(Environment *,UDFContext *,UDFValue *);
+   double                         GetBetaMemoryLoadFactor(Environment *);
+   double                         SetBetaMemoryLoadFactor(Environment *,double);
+   void                           GetBetaMemoryLoadFactorCommand(Environment *,UDFContext *,UDFValue *);
+   void                           SetBetaMemoryLoadFactorCommand(Environment *,UDFContext *,UDFValue *);
+   double                         GetBetaMemoryMinLoadFactor(Environment *);
+   double                         SetBetaMemoryMinLoadFactor(Environment *,double);
+   void                           GetBetaMemoryMinLoadFactorCommand(Environment *,UDFContext *,UDFValue *);
+   void                           SetBetaMemoryMinLoadFactorCommand(Environment *,UDFContext *,UDFValue *);
    void                           Matches(Defrule *,Verbosity,CLIPSValue *);
    void                           JoinActivity(Environment *,Defrule *,int,UDFValue *);
+   void                           BetaMemoryStats(Environment *,Defrule *,UDFValue *);
    void                           DefruleCommands(Environment *);
    void                           MatchesCommand(Environment *,UDFContext *,UDFValue *);
    void                           JoinActivityCommand(Environment *,UDFContext *,UDFValue *);
@@ -105,6 +114,7 @@ typedef enum
    void                           AlphaJoins(Environment *,Defrule *,unsigned short,struct joinInformation *);
    void                           BetaJoins(Environment *,Defrule *,unsigned short,struct joinInformation *);
    void                           JoinActivityResetCommand(Environment *,UDFContext *,UDFValue *);
+   void                           BetaMemoryStatsCommand(Environment *,UDFContext *,UDFValue *);
    void                           GetFocusFunction(Environment *,UDFContext *,UDFValue *);
    Defmodule                     *GetFocus(Environment *);
 #if DEVELOPER
@@ -130,6 +130,8 @@ struct defruleData
    unsigned long long CurrentEntityTimeTag;
    struct alphaMemoryHash **AlphaMemoryTable;
    bool BetaMemoryResizingFlag;
+   double BetaMemoryLoadFactor;
+   double BetaMemoryMinLoadFactor;
    struct joinLink *RightPrimeJoins;
    struct joinLink *LeftPrimeJoins;
 
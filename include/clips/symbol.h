@@ -108,6 +108,20 @@ typedef struct genericHashNode GENERIC_HN;
 #define EXTERNAL_ADDRESS_HASH_SIZE        8191
 #endif
 
+#ifndef ATOM_TABLE_LOAD_FACTOR
+#define ATOM_TABLE_LOAD_FACTOR  1
+#endif
+
+#define ATOM_TABLE_REHASH_STEP  4
+
+/*==========================================================*/
+/* The bucket of an atom holds the low bits of its hash     */
+/*   value, independent of the size of its table. The atom  */
+/*   is stored in the table at bucket % size.               */
+/*==========================================================*/
+
+#define ATOM_HASH_RANGE         (1UL << 29)
+
 /******************************/
 /* genericHashNode STRUCTURE: */
 /******************************/
@@ -122,6 +136,23 @@ struct genericHashNode
    unsigned int bucket : 29;
   };
 
+/*************************************************************/
+/* atomTable STRUCTURE: Size and rehash state of a symbol,   */
+/*   float, integer, bitmap, or external address table. A    */
+/*   table grows by moving a few buckets of the old array on */
+/*   each addition. Buckets of the old array below migrated  */
+/*   have been moved to the new array.                       */
+/*************************************************************/
+struct atomTable
+  {
+   GENERIC_HN **oldTable;
+   unsigned long size;
+   unsigned long initialSize;
+   unsigned long oldSize;
+   unsigned long migrated;
+   unsigned long count;
+  };
+
 /**********************************************************/
 /* EPHEMERON STRUCTURE: Data structure used to keep track */
 /*   of ephemeral symbols, floats, and integers.          */
@@ -170,6 +201,13 @@ struct symbolData
    CLIPSInteger **IntegerTable;
    CLIPSBitMap **BitMapTable;
    CLIPSExternalAddress **ExternalAddressTable;
+   struct atomTable SymbolHash;
+   struct atomTable FloatHash;
+   struct atomTable IntegerHash;
+   struct atomTable BitMapHash;
+   struct atomTable ExternalAddressHash;
+   bool AtomTableResizing;
+   bool AtomIndicesSet;
 #if BLOAD || BLOAD_ONLY || BLOAD_AND_BSAVE || BLOAD_INSTANCES || BSAVE_INSTANCES
    unsigned long NumberOfSymbols;
    unsigned long NumberOfFloats;
@@ -223,6 +261,13 @@ struct symbolData
    void                           SetBitMapTable(Environment *,CLIPSBitMap **);
    CLIPSExternalAddress         **GetExternalAddressTable(Environment *);
    void                           SetExternalAddressTable(Environment *,CLIPSExternalAddress **);
+   unsigned long                  GetSymbolTableSize(Environment *);
+   unsigned long                  GetFloatTableSize(Environment *);
+   unsigned long                  GetIntegerTableSize(Environment *);
+   unsigned long                  GetBitMapTableSize(Environment *);
+   bool                           GetAtomTableResizing(Environment *);
+   bool                           SetAtomTableResizing(Environment *,bool);
+   void                           ShrinkAtomTables(Environment *);
    void                           RefreshSpecialSymbols(Environment *);
    struct symbolMatch            *FindSymbolMatches(Environment *,const char *,unsigned *,size_t *);
    void                           ReturnSymbolMatches(Environment *,struct symbolMatch *);
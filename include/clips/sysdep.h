@@ -122,12 +122,16 @@
    int                         gensystem(Environment *,const char *);
 #endif
    bool                        GenOpenReadBinary(Environment *,const char *,const char *);
+   bool                        GenOpenReadBinaryBuffer(Environment *,const char *,size_t);
+   bool                        GenBinaryBufferShortRead(Environment *);
    void                        GetSeekCurBinary(Environment *,long);
    void                        GetSeekSetBinary(Environment *,long);
    void                        GenTellBinary(Environment *,long *);
    void                        GenCloseBinary(Environment *);
    size_t                      GenReadBinary(Environment *,void *,size_t);
    FILE                       *GenOpen(Environment *,const char *,const char *);
+   FILE                       *GenOpenWriteBuffer(Environment *);
+   bool                        GenCloseWriteBuffer(Environment *,FILE *,char **,size_t *);
    int                         GenClose(Environment *,FILE *);
    int                         GenFlush(Environment *,FILE *);
    void                        GenRewind(Environment *,FILE *);
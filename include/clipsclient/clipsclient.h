@@ -5,15 +5,21 @@
 /** @cond */
 #include <map>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <string>
 #include <iomanip>
-#include <condition_variable>
+#include <functional>
 
 #include <boost/asio.hpp>
 #include <boost/thread/thread.hpp>
 /** @endcond */
 
 #include "reply.h"
+#include "typedfact.h"
+#include "factdelta.h"
+#include "pendingtable.h"
 #include "clipsstatus.h"
 
 class ClipsClient;
@@ -44,13 +50,22 @@ private:
 
 public:
 	/**
-	 * Connects to ClipsServer
+	 * Connects to ClipsServer.
+	 * Upon connection the client negotiates the v2 framing protocol,
+	 * which lifts the 64kB message size limit. The v1 protocol is
+	 * used if the server does not support v2.
 	 * @param  address ClipsServer IPv4 address
 	 * @param  port    ClipsServer port
 	 * @return         true if a connection was established, false otherwise
 	 */
 	bool connect(const std::string& address, uint16_t port);
 
+	/**
+	 * Gets the framing protocol version negotiated with ClipsServer
+	 * @return The protocol version in use
+	 */
+	uint8_t getProtocolVersion() const;
+
 	/**
 	 * Disconnects from ClipsServer
 	 */
@@ -86,6 +101,39 @@ public:
 	 */
 	void assertFact(const std::string& fact);
 
+	/**
+	 * Requests ClipsServer to assert many facts at once with the
+	 * assert-batch command. Facts are packed in as few requests as the
+	 * protocol allows, and all requests are sent before awaiting
+	 * their replies.
+	 * @param  facts The facts to assert
+	 * @return       true if all facts were asserted, false otherwise
+	 * @throws std::length_error if a fact doesn't fit in a single
+	 *         request. No fact is sent in such case.
+	 */
+	bool assertFacts(const std::vector<std::string>& facts);
+
+	/**
+	 * Requests ClipsServer to assert many facts at once with the
+	 * assert-batch command.
+	 * @param  facts   The facts to assert
+	 * @param  results When this method returns contains whether each
+	 *                 fact was asserted
+	 * @return         true if all facts were asserted, false otherwise
+	 * @throws std::length_error if a fact doesn't fit in a single
+	 *         request. No fact is sent in such case.
+	 */
+	bool assertFacts(const std::vector<std::string>& facts, std::vector<bool>& results);
+
+	/**
+	 * Requests ClipsServer to assert a deftemplate fact with typed
+	 * slot values using the assert-typed command, which fills the
+	 * slots directly instead of parsing the fact.
+	 * @param  fact The fact to assert
+	 * @return      true if the fact was asserted, false otherwise
+	 */
+	bool assertFact(const TypedFact& fact);
+
 	/**
 	 * Requests ClipsServer to execute the (retract fact) command
 	 * @param fact The fact to retract
@@ -98,6 +146,14 @@ public:
 	 */
 	bool setPath(const std::string& path);
 
+	/**
+	 * Binds the connection to a named environment of CLIPSServer,
+	 * which is created if it does not exist.
+	 * Facts and commands sent afterwards are handled by that environment.
+	 * @param  name the name of the environment
+	 */
+	bool setEnvironment(const std::string& name);
+
 	/**
 	 * Requests ClipsServer to execute a command.
 	 * A command is any of
@@ -105,6 +161,9 @@ public:
 	 * 		reset    Resets CLIPS
 	 * 		clear    Clears CLIPS KB
 	 * 		raw      Injects the string in CLIPS language contained in args
+	 * 		query    Runs the string in CLIPS language contained in args, capturing its output
+	 * 		eval     Evaluates the expression in args (see eval())
+	 * 		find-facts  Retrieves a page of facts (see findFacts())
 	 * 		path     Sets the working path of CLIPSServer
 	 * 		print    Prints the elements specified in args (any of {facts, rules, agenda})
 	 * 		watch    Toggles the watch set in args (any of {functions, globals, facts, rules})
@@ -126,6 +185,111 @@ public:
 	 */
 	bool query(const std::string& query, std::string& result);
 
+	/**
+	 * Requests ClipsServer to evaluate an expression and reply the
+	 * value it yields in binary form, so no output is printed nor
+	 * parsed. Multifields, fact addresses (with their slots), symbols,
+	 * strings, integers and floats are all kept.
+	 * @param  expression A string containing the expression to evaluate
+	 *                    in CLIPS language
+	 * @param  value      The value yielded by the expression
+	 * @return            true if the expression was evaluated, false
+	 *                    otherwise
+	 */
+	bool eval(const std::string& expression, QueryValue& value);
+
+	/**
+	 * Requests ClipsServer a page of the facts of a deftemplate that
+	 * satisfy a test
+	 * @param  templateName The name of the deftemplate
+	 * @param  test         The query test in CLIPS language. The fact
+	 *                      is bound to ?f, e.g. (> ?f:value 10).
+	 *                      An empty test matches all facts.
+	 * @param  facts        When this method returns contains the facts
+	 *                      in the page as Fact values
+	 * @param  token        The continuation token: zero for the first
+	 *                      page. When this method returns contains the
+	 *                      token for the next page, or zero if there
+	 *                      are no more facts.
+	 * @param  pageSize     Optional. Maximum number of facts per page.
+	 *                      Default: 500
+	 * @return              true if the query was performed, false
+	 *                      otherwise
+	 */
+	bool findFacts(const std::string& templateName, const std::string& test,
+		std::vector<QueryValue>& facts, int64_t& token, size_t pageSize = 500);
+
+	/**
+	 * Requests ClipsServer all the facts of a deftemplate that satisfy
+	 * a test, retrieving them one page at a time
+	 * @param  templateName The name of the deftemplate
+	 * @param  test         The query test in CLIPS language (see above)
+	 * @param  onPage       Function called with each page of facts.
+	 *                      Returning false stops the retrieval.
+	 * @param  pageSize     Optional. Maximum number of facts per page.
+	 *                      Default: 500
+	 * @return              true if all pages were retrieved or onPage
+	 *                      stopped the retrieval, false otherwise
+	 */
+	bool findFacts(const std::string& templateName, const std::string& test,
+		std::function<bool(const std::vector<QueryValue>&)> onPage, size_t pageSize = 500);
+
+	/**
+	 * Requests ClipsServer a snapshot of its facts in the binary
+	 * format of bsave-facts. The snapshot is streamed by the server in
+	 * chunks, so it is not bound to the size of a single message.
+	 * @param  data      When this method returns contains the snapshot
+	 * @param  count     When this method returns contains the number
+	 *                   of facts in the snapshot
+	 * @param  chunkSize Optional. Size of the chunks in bytes. Zero
+	 *                   uses the default of the server (1MiB).
+	 * @return           true if the whole snapshot was received, false
+	 *                   otherwise
+	 */
+	bool snapshot(std::string& data, int64_t& count, uint32_t chunkSize = 0);
+
+	/**
+	 * Requests ClipsServer to load a snapshot taken with snapshot().
+	 * The snapshot is sent in pipelined chunks and loaded once the
+	 * last one arrives. Facts already asserted are kept.
+	 * @param  data  The snapshot
+	 * @param  count When this method returns contains the number of
+	 *               facts loaded
+	 * @return       true if the snapshot was loaded, false otherwise
+	 */
+	bool restore(const std::string& data, int64_t& count);
+
+	/**
+	 * Requests ClipsServer to execute a command without waiting for
+	 * its response. Any number of commands may be in flight at once.
+	 * @param  cmd     The command to execute (see execute())
+	 * @param  args    Optional. The arguments for the command.
+	 * @param  timeout Optional. Time to wait for the response before
+	 *                 giving up on it. Zero waits forever. Default: 0
+	 * @return         A future that receives the reply of ClipsServer,
+	 *                 or NULL if the command could not be sent, timed
+	 *                 out, or the client disconnected
+	 */
+	std::future<ReplyPtr> rpcAsync(const std::string& cmd, const std::string& args = "",
+		std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+	/**
+	 * Requests ClipsServer to execute a command without waiting for
+	 * its response. Any number of commands may be in flight at once.
+	 * @param cmd      The command to execute (see execute())
+	 * @param args     The arguments for the command.
+	 * @param callback Function called once with the reply of
+	 *                 ClipsServer, or NULL if the command could not be
+	 *                 sent, timed out, or the client disconnected.
+	 *                 It is called from the thread that receives the
+	 *                 reply, so it must not block.
+	 * @param timeout  Optional. Time to wait for the response before
+	 *                 giving up on it. Zero waits forever. Default: 0
+	 */
+	void rpcAsync(const std::string& cmd, const std::string& args,
+		std::function<void(const ReplyPtr&)> callback,
+		std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
 	/**
 	 * Sends the given string to CLIPSServer
 	 * @param s The string to send
@@ -144,6 +308,54 @@ public:
 	 */
 	uint32_t getWatches();
 
+	/**
+	 * Requests ClipsServer to push the changes of the facts of a
+	 * deftemplate. Changes made while processing each batch of
+	 * messages are coalesced and delivered to the handlers added with
+	 * addFactsChangedHandler().
+	 * @param  templateName The name of the deftemplate (or of the
+	 *                      relation of ordered facts). * subscribes
+	 *                      to all facts.
+	 * @return              true if the subscription was accepted,
+	 *                      false otherwise
+	 */
+	bool subscribe(const std::string& templateName);
+
+	/**
+	 * Requests ClipsServer to stop pushing fact changes
+	 * @param  templateName Optional. The name of the deftemplate. When
+	 *                      empty, all subscriptions are removed.
+	 *                      Default: empty.
+	 * @return              true if the request was accepted, false
+	 *                      otherwise
+	 */
+	bool unsubscribe(const std::string& templateName = "");
+
+	/**
+	 * Requests ClipsServer to report the statistics of the rules,
+	 * starting to record them if it was not. The table has a header
+	 * line followed by one line per rule with its name, fires,
+	 * activations, and total, average, 99th percentile, and longest
+	 * RHS time in nanoseconds, separated by |
+	 * @param  table When this method returns contains the table
+	 * @param  max   Optional. Maximum number of rules to report, those
+	 *               with the longest total RHS time first. Zero
+	 *               reports all. Default: 0
+	 * @return       true if the statistics were retrieved, false
+	 *               otherwise
+	 */
+	bool ruleStats(std::string& table, size_t max = 0);
+
+	/**
+	 * Requests ClipsServer to push periodically the statistics of the
+	 * rules fired since the previous push. Statistics are delivered to
+	 * the handlers added with addRuleStatsHandler().
+	 * @param  interval Time between pushes, 100ms at least. Zero stops
+	 *                  the pushes.
+	 * @return          true if the request was accepted, false otherwise
+	 */
+	bool streamRuleStats(std::chrono::milliseconds interval);
+
 	/**
 	 * Requests ClipsServer to toggle a watch
 	 * @param  watch Any of {functions, globals, facts, rules}
@@ -158,12 +370,16 @@ public:
 	void addClipsStatusChangedHandler(std::function<void(const ClipsClientPtr&, const ClipsStatusPtr&)> handler);
 	void addConnectedHandler(std::function<void(const ClipsClientPtr&)> handler);
 	void addDisconnectedHandler(std::function<void(const ClipsClientPtr&)> handler);
+	void addFactsChangedHandler(std::function<void(const ClipsClientPtr&, const std::vector<FactDelta>&)> handler);
+	void addRuleStatsHandler(std::function<void(const ClipsClientPtr&, const std::string&)> handler);
 
 #if __GNUC__ > 10
 	void removeMessageReceivedHandler(std::function<void(const ClipsClientPtr&, const std::string&)> handler);
 	void removeClipsStatusChangedHandler(std::function<void(const ClipsClientPtr&, const ClipsStatusPtr&)> handler);
 	void removeConnectedHandler(std::function<void(const ClipsClientPtr&)> handler);
 	void removeDisconnectedHandler(std::function<void(const ClipsClientPtr&)> handler);
+	void removeFactsChangedHandler(std::function<void(const ClipsClientPtr&, const std::vector<FactDelta>&)> handler);
+	void removeRuleStatsHandler(std::function<void(const ClipsClientPtr&, const std::string&)> handler);
 #endif
 
 protected:
@@ -211,6 +427,25 @@ protected:
 	 */
 	void onClipsStatusChanged();
 
+	/**
+	 * Calls handles for fact changes pushed by ClipsServer
+	 * @param changes The encoded changes
+	 */
+	void onFactsChanged(const std::string& changes);
+
+	/**
+	 * Calls handles for rule statistics pushed by ClipsServer
+	 * @param table The statistics table
+	 */
+	void onRuleStats(const std::string& table);
+
+	/**
+	 * Appends a snapshot chunk pushed by ClipsServer to the snapshot
+	 * awaiting it
+	 * @param s The received message
+	 */
+	void onSnapshotChunk(const std::string& s);
+
 private:
 	/**
 	 * Sends the given command to ClipsServer
@@ -220,14 +455,48 @@ private:
 	bool sendCommand(const std::string& command, const std::string& args, uint32_t& cmdId);
 
 	/**
-	 * Awaits until a response arrives from the server
-	 * @param cmdId   The ID of the command that awaits for response
-	 * @param success When this method returns contains a boolean indicating
-	 *                whether the execution on the remote server was successful
-	 * @param result  When this method returns contains the results produced
-	 *                by the rpc call on the remote server
+	 * A command sent to ClipsServer awaiting for its response
+	 */
+	struct PendingCommand{
+		/**
+		 * Receives the response for future-based calls
+		 */
+		std::promise<ReplyPtr> promise;
+		/**
+		 * Receives the response for callback-based calls
+		 */
+		std::function<void(const ReplyPtr&)> callback;
+		/**
+		 * Gives up on the response when it expires, if any
+		 */
+		std::shared_ptr<boost::asio::steady_timer> timer;
+	};
+	typedef std::shared_ptr<PendingCommand> PendingCommandPtr;
+
+	/**
+	 * Registers a request as pending and sends it to ClipsServer.
+	 * If the request can't be sent the command is completed at once.
+	 * @param  rq      The request to send
+	 * @param  pc      The pending command that receives the response
+	 * @param  timeout Time to wait for the response. Zero waits forever.
+	 * @return         true if the request was sent, false otherwise
+	 */
+	bool sendRequest(const Request& rq, const PendingCommandPtr& pc, std::chrono::milliseconds timeout);
+
+	/**
+	 * Removes a command from the pending ones and delivers its response.
+	 * Does nothing if the command is no longer pending.
+	 * @param cmdId The ID of the command
+	 * @param reply The response, or NULL if the command failed
 	 */
-	bool awaitResponse(int cmdId, bool& success, std::string& result);
+	void completeCommand(uint32_t cmdId, const ReplyPtr& reply);
+
+	/**
+	 * Delivers the response of a command to whoever awaits for it
+	 * @param pc    The command
+	 * @param reply The response, or NULL if the command failed
+	 */
+	static void deliverReply(const PendingCommandPtr& pc, const ReplyPtr& reply);
 
 	/**
 	 * Performs a RPC call on CLIPSServer to execute a command and synchronously
@@ -242,6 +511,17 @@ private:
 	bool rpc(const std::string& cmd);
 	bool rpc(const std::string& cmd, const std::string& args);
 
+	/**
+	 * Requests ClipsServer to switch to the given framing protocol
+	 * version. Must be called before any other command is sent.
+	 * If the server doesn't answer within ProtocolTimeout the client
+	 * keeps using protocol v1.
+	 * @param  version The requested protocol version
+	 * @return         true if the server switched to the requested
+	 *                 protocol, false otherwise
+	 */
+	bool negotiateProtocol(uint8_t version);
+
 	/**
 	 * Aborts all RPC request releasing all waiting locks. To be used during disconnection.
 	 */
@@ -253,15 +533,6 @@ private:
 	 */
 	void handleResponseMesage(const std::string& s);
 
-	/**
-	 * Checks whether the response for a given command has arrived.
-	 * For use of a condition variable
-	 * @param  cmdId   The id of the command
-	 * @param  aborted A value indicating whether the call was aborted (e.g. disconnection)
-	 * @return         true if the response has arrived, false otherwise
-	 */
-	bool hasReponseArrived(uint32_t cmdId, bool& aborted);
-
 	/**
 	 * Updates the status based on the info sent by CLIPSServer
 	 * @param ReplyPtr A pointer to the reply object containing the status
@@ -290,25 +561,46 @@ private:
 	boost::asio::streambuf buffer;
 
 	/**
-	 * Stream used to read the buffer
+	 * Framing protocol version used to send requests
 	 */
-	std::istream is;
+	uint8_t protocolVersion;
 
 	/**
-	 * Protection lock for the pendingCommands map
+	 * Framing protocol version used to parse received frames.
+	 * Switches as soon as the server acknowledges the protocol request.
 	 */
-	std::mutex pcmutex;
+	uint8_t readProtocolVersion;
 
 	/**
-	 * Condition variable to notify RPC waiters their response has arrived
+	 * ID of the pending protocol negotiation request
 	 */
-	std::condition_variable pccv;
+	std::atomic<uint32_t> protoCmdId;
 
 	/**
-	 * Stores the ids of commands sent that are awaiting for a response;
-	 * as well as the response when it arrives
+	 * Fragments of a v2 message being reassembled
 	 */
-	std::map<uint32_t, ReplyPtr> pendingCommands;
+	std::string fragments;
+
+	/**
+	 * Serializes writes to the socket from several threads
+	 */
+	std::mutex sendMutex;
+
+	/**
+	 * Stores the commands sent that are awaiting for a response.
+	 * Each one is woken up individually when its response arrives.
+	 */
+	PendingTable<PendingCommandPtr> pendingCommands;
+
+	/**
+	 * Snapshots being received, indexed by the ID of their command
+	 */
+	std::map<uint32_t, std::string> snapshots;
+
+	/**
+	 * Serializes access to the snapshots being received
+	 */
+	std::mutex snapshotsMutex;
 
 	/**
 	 * Stores handler functions for message reception
@@ -330,6 +622,16 @@ private:
 	 */
 	std::vector<std::function<void(const ClipsClientPtr&)>> disconnectedHandlers;
 
+	/**
+	 * Stores handler functions for fact change events
+	 */
+	std::vector<std::function<void(const ClipsClientPtr&, const std::vector<FactDelta>&)>> factsChangedHandlers;
+
+	/**
+	 * Stores handler functions for rule statistics events
+	 */
+	std::vector<std::function<void(const ClipsClientPtr&, const std::string&)>> ruleStatsHandlers;
+
 	/**
 	 * Stores CLIPS status and active watches
 	 */
@@ -0,0 +1,50 @@
+#ifndef __FACT_DELTA_H__
+#define __FACT_DELTA_H__
+#pragma once
+
+/** @cond */
+#include <string>
+#include <vector>
+#include <cstdint>
+/** @endcond */
+
+#include "queryvalue.h"
+
+/**
+ * A change of a fact pushed by ClipsServer to the clients subscribed
+ * to its deftemplate
+ */
+struct FactDelta{
+	/**
+	 * Enumerates the kinds of fact changes.
+	 * Must match clips::FactChange
+	 */
+	enum class Kind : uint8_t{
+		Assert  = 1,
+		Retract = 2,
+		Modify  = 3,
+	};
+
+	/**
+	 * The kind of change
+	 */
+	Kind kind;
+
+	/**
+	 * The fact. Asserted and modified facts are Fact values holding
+	 * their slots; retracted facts are FactAddress values holding
+	 * only their index.
+	 */
+	QueryValue fact;
+
+	/**
+	 * Decodes the changes pushed by ClipsServer
+	 * @param  data   The encoded changes: a uint32 count followed by,
+	 *                for each change, a uint8 kind and the fact
+	 * @param  deltas When this function returns contains the changes
+	 * @return        true if data is well formed, false otherwise
+	 */
+	static bool decode(const std::string& data, std::vector<FactDelta>& deltas);
+};
+
+#endif // __FACT_DELTA_H__
@@ -0,0 +1,188 @@
+/* ** ***************************************************************
+* pendingtable.h
+*
+* Author: Mauricio Matamoros
+*
+* Concurrent table of requests awaiting for a reply
+*
+** ** **************************************************************/
+/** @file pendingtable.h
+ * Implementation of the PendingTable class: a concurrent table
+ * of requests awaiting for a reply, indexed by command id
+ */
+
+#ifndef __PENDING_TABLE_H__
+#define __PENDING_TABLE_H__
+#pragma once
+
+/** @cond */
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+/** @endcond */
+
+
+/**
+ * Implements a concurrent table of values of type T indexed by
+ * command id.
+ * Each id maps to the slot at id modulo the capacity. Slots are
+ * tagged with the full id (its generation) and claimed with a
+ * compare-and-swap, so inserting and taking values is lock-free.
+ * Ids whose slot is still held by a command issued capacity ids
+ * earlier are stored in a mutex-protected overflow map, which is
+ * only looked up while not empty.
+ */
+template <class T>
+class PendingTable
+{
+private:
+	/**
+	 * Slot states stored in the two least significant bits of a tag
+	 */
+	enum : uint64_t{
+		SlotFree    = 0,
+		SlotBusy    = 1,
+		SlotPending = 2,
+		SlotMask    = 3
+	};
+
+	/**
+	 * A slot of the table
+	 */
+	struct Slot{
+		/**
+		 * The id of the last command stored in the slot and the
+		 * state of the slot
+		 */
+		std::atomic<uint64_t> tag;
+		/**
+		 * The value. Only accessed by whoever moved the slot
+		 * to the busy state.
+		 */
+		T value;
+
+		Slot(): tag(SlotFree){}
+	};
+
+	/**
+	 * The slots
+	 */
+	std::unique_ptr<Slot[]> slots;
+	/**
+	 * Maps ids to slots. Capacity is a power of two.
+	 */
+	size_t mask;
+	/**
+	 * Values whose slot was in use when inserted
+	 */
+	std::map<uint32_t, T> overflow;
+	/**
+	 * Number of values in the overflow map
+	 */
+	std::atomic<size_t> overflowCount;
+	/**
+	 * Lock to protect the overflow map
+	 */
+	std::mutex overflowMutex;
+
+
+// Disable copy constructor and assignment op.
+private:
+	PendingTable(PendingTable const& obj) = delete;
+	PendingTable& operator=(PendingTable const&) = delete;
+
+	/**
+	 * Composes the tag of a slot
+	 */
+	static uint64_t makeTag(uint32_t id, uint64_t state){
+		return ((uint64_t)id << 2) | state;
+	}
+
+public:
+	/**
+	 * Creates a new instance of PendingTable
+	 * @param capacity The number of slots, rounded up to a power of
+	 *                 two. More values can be stored in the table,
+	 *                 but only this many are handled lock-free.
+	 */
+	explicit PendingTable(size_t capacity = 4096) : overflowCount(0){
+		size_t size = 1;
+		while(size < capacity) size <<= 1;
+		slots.reset(new Slot[size]);
+		mask = size - 1;
+	}
+
+	/**
+	 * Stores a value for the given id
+	 * @param id    The id of the command. Must not be in the table.
+	 * @param value The value to store
+	 */
+	void insert(uint32_t id, T value){
+		Slot& slot = slots[id & mask];
+		uint64_t tag = slot.tag.load(std::memory_order_relaxed);
+		if( ((tag & SlotMask) == SlotFree) &&
+			slot.tag.compare_exchange_strong(tag, makeTag(id, SlotBusy), std::memory_order_acquire) ){
+			slot.value = std::move(value);
+			slot.tag.store(makeTag(id, SlotPending), std::memory_order_release);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		overflow[id] = std::move(value);
+		++overflowCount;
+	}
+
+	/**
+	 * Removes the value stored for the given id
+	 * @param  id    The id of the command
+	 * @param  value When this method returns contains the removed value
+	 * @return       true if the id was in the table, false otherwise
+	 */
+	bool take(uint32_t id, T& value){
+		Slot& slot = slots[id & mask];
+		uint64_t tag = makeTag(id, SlotPending);
+		if( slot.tag.compare_exchange_strong(tag, makeTag(id, SlotBusy), std::memory_order_acquire) ){
+			value = std::move(slot.value);
+			slot.value = T();
+			slot.tag.store(makeTag(id, SlotFree), std::memory_order_release);
+			return true;
+		}
+
+		if(overflowCount.load() == 0) return false;
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		auto it = overflow.find(id);
+		if( it == overflow.end() ) return false;
+		value = std::move(it->second);
+		overflow.erase(it);
+		--overflowCount;
+		return true;
+	}
+
+	/**
+	 * Removes all values in the table
+	 * @param out Vector where the removed values are appended
+	 */
+	void takeAll(std::vector<T>& out){
+		for(size_t i = 0; i <= mask; ++i){
+			Slot& slot = slots[i];
+			uint64_t tag = slot.tag.load(std::memory_order_relaxed);
+			if( ((tag & SlotMask) != SlotPending) ||
+				!slot.tag.compare_exchange_strong(tag, tag ^ SlotPending ^ SlotBusy, std::memory_order_acquire) )
+				continue;
+			out.push_back( std::move(slot.value) );
+			slot.value = T();
+			slot.tag.store(tag ^ SlotPending, std::memory_order_release);
+		}
+
+		std::lock_guard<std::mutex> lock(overflowMutex);
+		for(auto& kv : overflow)
+			out.push_back( std::move(kv.second) );
+		overflow.clear();
+		overflowCount = 0;
+	}
+};
+
+#endif // __PENDING_TABLE_H__
@@ -0,0 +1,140 @@
+#ifndef __QUERY_VALUE_H__
+#define __QUERY_VALUE_H__
+#pragma once
+
+/** @cond */
+#include <string>
+#include <vector>
+#include <cstdint>
+/** @endcond */
+
+/**
+ * A value yielded by an expression evaluated by ClipsServer with the
+ * eval command, decoded from its typed binary encoding
+ */
+class QueryValue{
+public:
+	/**
+	 * Enumerates the types a value can take.
+	 * Must match the codes used by clips::eval
+	 */
+	enum class Type : uint8_t{
+		Integer         = 0,
+		Float           = 1,
+		Symbol          = 2,
+		String          = 3,
+		InstanceName    = 4,
+		Multifield      = 5,
+		Fact            = 6,
+		FactAddress     = 7,
+		InstanceAddress = 8,
+		Void            = 9,
+		ExternalAddress = 10,
+	};
+
+	/**
+	 * Initializes a new instance of QueryValue holding no value
+	 */
+	QueryValue();
+
+	/**
+	 * Gets the type of the value
+	 */
+	Type getType() const;
+
+	/**
+	 * Gets the integer value. Valid only for Integer values.
+	 */
+	int64_t getInteger() const;
+
+	/**
+	 * Gets the float value. Valid only for Float values.
+	 */
+	double getFloat() const;
+
+	/**
+	 * Gets the lexeme. Valid for Symbol, String, InstanceName, and
+	 * InstanceAddress values. For Fact values gets the name of the
+	 * deftemplate.
+	 */
+	const std::string& getLexeme() const;
+
+	/**
+	 * Gets the index of the fact. Valid only for Fact and FactAddress
+	 * values.
+	 */
+	int64_t getFactIndex() const;
+
+	/**
+	 * Gets the fields of a Multifield value, or the slot values of a
+	 * Fact value
+	 */
+	const std::vector<QueryValue>& getFields() const;
+
+	/**
+	 * Gets the slot names of a Fact value, in the same order as the
+	 * values returned by getFields(). Ordered facts have a single
+	 * slot with an empty name.
+	 */
+	const std::vector<std::string>& getSlotNames() const;
+
+	/**
+	 * Gets the value of a slot of a Fact value
+	 * @param  slot The name of the slot
+	 * @return      The value of the slot or NULL if not found
+	 */
+	const QueryValue* getSlot(const std::string& slot) const;
+
+	/**
+	 * Gets a value indicating whether the value is numeric
+	 */
+	bool isNumber() const;
+
+	/**
+	 * Gets a value indicating whether the value is a Symbol, String,
+	 * or InstanceName
+	 */
+	bool isLexeme() const;
+
+	/**
+	 * Decodes a value encoded by clips::eval
+	 * @param  data  The encoded value
+	 * @param  value When this method returns contains the decoded value
+	 * @return       true if data holds exactly one well formed value,
+	 *               false otherwise
+	 */
+	static bool decode(const std::string& data, QueryValue& value);
+
+	/**
+	 * Decodes a value encoded by clips::eval embedded in other data
+	 * @param  data   The encoded data
+	 * @param  offset The position of the value. When this method
+	 *                returns contains the position following it.
+	 * @param  value  When this method returns contains the decoded value
+	 * @return        true if the value is well formed, false otherwise
+	 */
+	static bool decode(const std::string& data, size_t& offset, QueryValue& value);
+
+private:
+	/**
+	 * Decodes the value starting at offset
+	 * @param  data   The encoded data
+	 * @param  offset The position of the value, updated past it
+	 * @param  value  When this method returns contains the decoded value
+	 * @param  depth  The nesting level of the value
+	 * @return        true if the value is well formed, false otherwise
+	 */
+	static bool decode(const std::string& data, size_t& offset, QueryValue& value, int depth);
+
+private:
+	Type type;
+	union{
+		int64_t i;
+		double  d;
+	} number;
+	std::string lexeme;
+	std::vector<QueryValue> fields;
+	std::vector<std::string> slotNames;
+};
+
+#endif // __QUERY_VALUE_H__
@@ -10,6 +10,7 @@
 /** @endcond */
 
 #include "request.h"
+#include "queryvalue.h"
 
 class Reply;
 typedef std::shared_ptr<Reply> ReplyPtr;
@@ -24,6 +25,14 @@ public:
 	uint32_t    getCommandId() const;
 	bool        getSuccess() const;
 	std::string getResult() const;
+	/**
+	 * Decodes the result of an eval command
+	 * @param  value When this method returns contains the value
+	 *               yielded by the evaluated expression
+	 * @return       true if the result holds a well formed value,
+	 *               false otherwise
+	 */
+	bool getValue(QueryValue& value) const;
 
 	bool matches(const Request& r);
 	bool matches(const RequestPtr& r);
@@ -3,6 +3,7 @@
 #pragma once
 
 /** @cond */
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -27,7 +28,15 @@ public:
 	std::string getCommand() const;
 	std::string getArgs() const;
 
-	std::vector<char> getPayload() const;
+	/**
+	 * Frames the request for transmission
+	 * @param  protocolVersion The framing protocol negotiated with the
+	 *                         server. v1 requests can't exceed 64kB.
+	 *                         v2 requests larger than MaxFragmentSize
+	 *                         are split in several frames. Default: 1
+	 * @return                 The framed request
+	 */
+	std::vector<char> getPayload(uint8_t protocolVersion = 1) const;
 
 private:
 	uint32_t cmdId;
@@ -35,7 +44,16 @@ private:
 	std::string args;
 
 private:
-	static uint32_t lastCommandId;
+	/**
+	 * Last command id assigned. Shared by all threads.
+	 */
+	static std::atomic<uint32_t> lastCommandId;
+
+	/**
+	 * Atomically allocates a command id. Ids are unique among the
+	 * last 2^32 - 1 requests and never equal CommandIdNone.
+	 */
+	static uint32_t nextCommandId();
 
 public:
 	static RequestPtr fromMessage(const std::string& message);
@@ -44,6 +62,16 @@ public:
 public:
 	static const uint32_t CommandIdNone = -1;
 
+	/**
+	 * v2 frame flag indicating the message continues in the next frame
+	 */
+	static const uint8_t FrameFlagMore = 0x01;
+
+	/**
+	 * Largest payload sent in a single v2 frame
+	 */
+	static const uint32_t MaxFragmentSize = 0x10000 - 5;
+
 };
 
 
@@ -0,0 +1,139 @@
+#ifndef __TYPED_FACT_H__
+#define __TYPED_FACT_H__
+#pragma once
+
+/** @cond */
+#include <string>
+#include <vector>
+#include <cstdint>
+/** @endcond */
+
+/**
+ * Builds a deftemplate fact with typed slot values to be asserted by
+ * ClipsServer with the assert-typed command, which fills the slots
+ * directly without parsing any text.
+ * Values are encoded as they are added.
+ */
+class TypedFact{
+public:
+	/**
+	 * Initializes a new instance of TypedFact
+	 * @param templateName The name of the deftemplate of the fact.
+	 *                     Can't exceed 255 bytes.
+	 */
+	TypedFact(const std::string& templateName);
+
+	/**
+	 * Sets the value of an integer slot
+	 * @param  slot  The name of the slot. Can't exceed 255 bytes.
+	 * @param  value The value
+	 * @return       This instance
+	 */
+	TypedFact& put(const std::string& slot, int64_t value);
+	TypedFact& put(const std::string& slot, int value);
+
+	/**
+	 * Sets the value of a float slot
+	 * @param  slot  The name of the slot. Can't exceed 255 bytes.
+	 * @param  value The value
+	 * @return       This instance
+	 */
+	TypedFact& put(const std::string& slot, double value);
+
+	/**
+	 * Sets the value of a symbol slot
+	 * @param  slot  The name of the slot. Can't exceed 255 bytes.
+	 * @param  value The value
+	 * @return       This instance
+	 */
+	TypedFact& putSymbol(const std::string& slot, const std::string& value);
+
+	/**
+	 * Sets the value of a string slot
+	 * @param  slot  The name of the slot. Can't exceed 255 bytes.
+	 * @param  value The value
+	 * @return       This instance
+	 */
+	TypedFact& putString(const std::string& slot, const std::string& value);
+
+	/**
+	 * Sets the value of an instance name slot
+	 * @param  slot  The name of the slot. Can't exceed 255 bytes.
+	 * @param  value The value
+	 * @return       This instance
+	 */
+	TypedFact& putInstanceName(const std::string& slot, const std::string& value);
+
+	/**
+	 * Sets the value of a multislot to a list of symbols
+	 * @param  slot   The name of the slot. Can't exceed 255 bytes.
+	 * @param  values The symbols
+	 * @return        This instance
+	 */
+	TypedFact& putSymbols(const std::string& slot, const std::vector<std::string>& values);
+
+	/**
+	 * Sets the value of a multislot to a list of integers
+	 * @param  slot   The name of the slot. Can't exceed 255 bytes.
+	 * @param  values The integers
+	 * @return        This instance
+	 */
+	TypedFact& putIntegers(const std::string& slot, const std::vector<int64_t>& values);
+
+	/**
+	 * Sets the value of a multislot to a list of floats
+	 * @param  slot   The name of the slot. Can't exceed 255 bytes.
+	 * @param  values The floats
+	 * @return        This instance
+	 */
+	TypedFact& putFloats(const std::string& slot, const std::vector<double>& values);
+
+	/**
+	 * Gets the number of slots set
+	 */
+	size_t getSlotCount() const;
+
+	/**
+	 * Gets the fact encoded as expected by the assert-typed command
+	 */
+	std::string encode() const;
+
+private:
+	/**
+	 * Appends the name of a slot and counts it
+	 * @param slot The name of the slot
+	 * @param type The type of the value that follows
+	 */
+	void beginSlot(const std::string& slot, uint8_t type);
+
+	/**
+	 * Appends a length-prefixed lexeme
+	 */
+	void appendLexeme(const std::string& value);
+
+	/**
+	 * Appends the raw bytes of a value
+	 */
+	template<typename T>
+	void append(const T& value){
+		slots.append((const char*)&value, sizeof(T));
+	}
+
+private:
+	/**
+	 * The name of the deftemplate
+	 */
+	std::string templateName;
+
+	/**
+	 * The number of slots set
+	 */
+	size_t slotCount;
+
+	/**
+	 * The encoded slots
+	 */
+	std::string slots;
+};
+
+#endif // __TYPED_FACT_H__
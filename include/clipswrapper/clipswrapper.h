@@ -26,9 +26,14 @@
 #include <cstdint>
 
 #include "clipswrapperrouter.h"
+
+struct environmentData;
 /** @endcond */
 
+#include "slotvalue.h"
 #include "queryrouter.h"
+#include "factfeed.h"
+#include "rulestats.h"
 #include "udf/udf.h"
 
 
@@ -118,6 +123,11 @@
 
 namespace clips{
 
+/**
+ * Opaque handle to a CLIPS environment
+ */
+typedef ::environmentData* EnvironmentHandle;
+
 
 /* ** ***************************************************************
 *
@@ -172,12 +182,56 @@ const std::string version();
 
 /**
  * Initializes the CLIPS system. Must be called prior to any other
- * CLIPS function call. This function should be called only once.
+ * CLIPS function call. Creates the environment of the calling
+ * thread unless one has already been created or selected.
  *
  * @remark Wrapper for InitializeCLIPS()
  */
 void initialize();
 
+
+/* ** ***************************************************************
+*
+* Environment functions
+*
+** ** **************************************************************/
+
+/**
+ * Creates a new CLIPS environment.
+ * The environment is not selected; use setEnvironment() to make the
+ * wrapper functions operate on it.
+ * @remark  Wrapper for CreateEnvironment
+ * @return  A handle to the new environment, or NULL on failure.
+ */
+EnvironmentHandle createEnvironment();
+
+/**
+ * Destroys a CLIPS environment and releases all its resources.
+ * If the environment is selected in the calling thread it is
+ * deselected as well.
+ * @remark     Wrapper for DestroyEnvironment
+ * @param  env The environment to destroy
+ * @return     true if the environment was successfully destroyed.
+ *             false otherwise
+ */
+bool destroyEnvironment(EnvironmentHandle env);
+
+/**
+ * Gets the environment the wrapper functions operate on in the
+ * calling thread
+ * @return The selected environment, or NULL if none
+ */
+EnvironmentHandle getEnvironment();
+
+/**
+ * Selects the environment the wrapper functions operate on in the
+ * calling thread. Each thread has its own selection, so independent
+ * environments may run concurrently provided each one is used by a
+ * single thread at a time.
+ * @param env The environment to select
+ */
+void setEnvironment(EnvironmentHandle env);
+
 /**
  * Resets the CLIPS environment
  * It is the C equivalent of the CLIPS reset command.
@@ -281,11 +335,29 @@ void printAgenda(
 /**
  * Asserts a fact into the CLIPS fact-list
  * It is the C equivalent of the CLIPS assert-string command
- * @param s A string containing a list of primitive data types
- *          (symbols, strings, integers, floats, and/or instance
- *          names).
+ * @param  s A string containing a list of primitive data types
+ *           (symbols, strings, integers, floats, and/or instance
+ *           names).
+ * @return   true if the fact was asserted, false otherwise
+ */
+bool assertString(const std::string& s);
+
+/**
+ * Asserts a deftemplate fact into the CLIPS fact-list filling its
+ * slots directly with typed values, so no text is parsed.
+ * The deftemplate and the positions of its slots are cached per
+ * environment; the cache entry is dropped when the deftemplate is
+ * deleted or redefined. Slots not given take their default values.
+ * @remark              Works like a FactBuilder (CreateFactBuilder,
+ *                      FBPutSlot, FBAssert) with cached lookups
+ * @param  templateName The name of the deftemplate
+ * @param  slots        The slots to fill
+ * @return              true if the fact was asserted, false if the
+ *                      deftemplate or a slot does not exist, a value
+ *                      violates the slot constraints, or the fact
+ *                      could not be asserted
  */
-void assertString(const std::string& s);
+bool assertFact(const std::string& templateName, const std::vector<Slot>& slots);
 
 /**
  * Queries all active routers until it finds a router that recognizes
@@ -378,6 +450,67 @@ bool query(const std::string& query, std::string& result);
  */
 bool query(const std::string& query, std::string& result, int& steps);
 
+/**
+ * Evaluates an expression and serializes the value it yields in a
+ * compact typed binary encoding, so no output is printed nor parsed.
+ * Values are encoded as a uint8 type followed by (little-endian):
+ *   0 Integer:          int64
+ *   1 Float:            IEEE 754 double
+ *   2 Symbol:           uint32 length and the bytes
+ *   3 String:           uint32 length and the bytes
+ *   4 InstanceName:     uint32 length and the bytes
+ *   5 Multifield:       uint32 count and the values
+ *   6 Fact:             int64 fact index, uint32 length and the
+ *                       deftemplate name, uint32 slot count and, for
+ *                       each slot, uint32 length and the slot name
+ *                       followed by the value. Ordered facts have a
+ *                       single multifield slot with an empty name.
+ *   7 FactAddress:      int64 fact index. Used for facts referenced
+ *                       from slots and for retracted facts.
+ *   8 InstanceAddress:  uint32 length and the instance name
+ *   9 Void:             nothing
+ *  10 ExternalAddress:  nothing
+ * Codes 0 to 5 match clips::SlotValue::Type.
+ * @remark            Wrapper for Eval
+ * @param  expression The expression to evaluate
+ * @param  result     When this function returns, contains the
+ *                    encoded value
+ * @return            true if the expression was evaluated without
+ *                    errors, false otherwise
+ */
+bool eval(const std::string& expression, std::string& result);
+
+/**
+ * Finds the facts of a deftemplate that satisfy a test with the
+ * fact-set query engine (as do-for-all-facts does), encoding one page
+ * of them at a time as they are found. The full result set is never
+ * held in memory.
+ * @param  templateName The name of the deftemplate
+ * @param  test         The query test in CLIPS language. The fact
+ *                      being tested is bound to ?f, e.g.
+ *                      (> ?f:value 10). An empty test matches all
+ *                      facts.
+ * @param  pageSize     Maximum number of facts in the page
+ * @param  after        The continuation token: zero for the first
+ *                      page, or the value returned with the previous
+ *                      page. The page resumes from the fact the
+ *                      previous one ended at, without traversing the
+ *                      template again. When this function returns
+ *                      contains the token for the next page, or zero
+ *                      if there are no more facts.
+ * @param  result       When this function returns, contains the
+ *                      matching facts encoded as a Multifield of Fact
+ *                      values (see eval())
+ * @param  maxBytes     Optional. Size of the encoded page past which
+ *                      no more facts are added. A page holds at least
+ *                      one fact regardless of its size.
+ * @return              true if the query was performed, false if the
+ *                      template name is invalid or the query could not
+ *                      be evaluated
+ */
+bool findFacts(const std::string& templateName, const std::string& test,
+	size_t pageSize, int64_t& after, std::string& result, size_t maxBytes = SIZE_MAX);
+
 
 /**
  * Determines if any changes to the fact list have occurred.
@@ -405,6 +538,65 @@ bool getFactListChanged();
 void setFactListChanged(bool changed);
 
 
+/**
+ * Gets the number of facts in the fact list
+ * @remark Wrapper for GetNumberOfFacts
+ * @return The number of facts
+ */
+size_t getFactCount();
+
+
+/**
+ * Gets the number of activations on the agenda
+ * @remark Wrapper for GetNumberOfActivations
+ * @return The number of activations
+ */
+size_t getActivationCount();
+
+
+/**
+ * Gets the number of bytes of memory currently allocated by CLIPS
+ * @remark Wrapper for MemUsed
+ * @return The number of bytes in use
+ */
+int64_t getMemoryUsed();
+
+
+/**
+ * Saves the facts in the binary format of bsave-facts to a memory
+ * buffer instead of a file
+ * @remark         Wrapper for BinarySaveFactsToBuffer
+ * @param  buffer  When this function returns, contains the saved
+ *                 facts
+ * @param  visible true to save the facts of all the deftemplates
+ *                 visible to the current module, false to save only
+ *                 those of the deftemplates defined in it
+ * @return         The number of facts saved, or -1 on error
+ */
+int64_t binarySaveFacts(std::string& buffer, bool visible = false);
+
+
+/**
+ * Loads facts saved in the binary format of bsave-facts from a
+ * memory buffer instead of a file
+ * @remark      Wrapper for BinaryLoadFactsFromBuffer
+ * @param  data The saved facts
+ * @param  size The size of data in bytes
+ * @return      The number of facts loaded, or -1 on error
+ */
+int64_t binaryLoadFacts(const char* data, size_t size);
+
+
+/**
+ * Loads facts saved in the binary format of bsave-facts from a
+ * memory buffer instead of a file
+ * @remark        Wrapper for BinaryLoadFactsFromBuffer
+ * @param  buffer The saved facts
+ * @return        The number of facts loaded, or -1 on error
+ */
+int64_t binaryLoadFacts(const std::string& buffer);
+
+
 
 /* ** ***************************************************************
 *
@@ -0,0 +1,203 @@
+/* ** ***************************************************************
+* factfeed.h
+*
+* Author: Mauricio Matamoros
+*
+* Coalesced fact-change notifications for subscribers
+*
+** ** **************************************************************/
+/** @file factfeed.h
+ * Definition of the FactFeed class: records the facts asserted,
+ * retracted, and modified in an environment and reports the net
+ * changes to the subscribers of their deftemplates
+ */
+
+#ifndef __CLIPSWRAPPER_FACTFEED_H__
+#define __CLIPSWRAPPER_FACTFEED_H__
+#pragma once
+
+/** @cond */
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+struct environmentData;
+struct fact;
+/** @endcond */
+
+namespace clips{
+
+/**
+ * Enumerates the kinds of fact changes reported by FactFeed
+ */
+enum class FactChange : uint8_t{
+	Assert  = 1,
+	Retract = 2,
+	Modify  = 3,
+};
+
+
+/**
+ * Records fact changes in the environment through the assert, retract
+ * and modify hooks of the fact manager, and reports them to the
+ * subscribers of the deftemplates involved.
+ * Changes are coalesced until flushed: a fact asserted and retracted
+ * in between is not reported, a fact asserted and modified is reported
+ * as asserted, and a fact modified many times is reported once. Facts
+ * are encoded when flushed, so their latest values are reported.
+ */
+class FactFeed{
+// Singleton element access
+public:
+	/**
+	 * Returns the instance of FactFeed of the environment selected in
+	 * the calling thread, creating it if necessary.
+	 * Each environment has its own feed, released along with it.
+	 * @return A unique feed (singleton per environment)
+	 */
+	static FactFeed& getInstance();
+
+// Disable copy constructor and copy assignation
+	FactFeed(const FactFeed&)        = delete;
+	void operator=(const FactFeed&) = delete;
+
+// Make constructor private for Singleton
+private:
+	FactFeed();
+
+	/**
+	 * Releases the feed of an environment being destroyed
+	 * @param env The environment being destroyed
+	 */
+	static void destroyInstance(::environmentData* env);
+
+public:
+	~FactFeed();
+
+public:
+	/**
+	 * Subscribes to the changes of the facts of a deftemplate
+	 * @param  subscriber   The subscriber
+	 * @param  templateName The name of the deftemplate (or of the
+	 *                      relation of ordered facts). * subscribes to
+	 *                      all facts.
+	 * @return              true if the subscription was added, false
+	 *                      if it already existed
+	 */
+	bool subscribe(const std::string& subscriber, const std::string& templateName);
+
+	/**
+	 * Removes a subscription
+	 * @param subscriber   The subscriber
+	 * @param templateName Optional. The name of the deftemplate. When
+	 *                     empty, all subscriptions of the subscriber
+	 *                     are removed. Default: empty.
+	 */
+	void unsubscribe(const std::string& subscriber, const std::string& templateName = "");
+
+	/**
+	 * Gets a value indicating whether there are changes to report
+	 */
+	bool hasChanges() const;
+
+	/**
+	 * Reports the changes recorded since the last flush and clears them.
+	 * The changes of each subscriber are encoded (little-endian) as a
+	 * uint32 count followed by, for each change, a uint8 FactChange and
+	 * the fact encoded as a Fact value (Assert, Modify) or as a
+	 * FactAddress value (Retract). See clips::eval.
+	 * @param publish Function called once per subscriber with changes.
+	 *                Returning false removes all the subscriptions of
+	 *                the subscriber (e.g. when it disconnected).
+	 */
+	void flush(const std::function<bool(const std::string& subscriber, const std::string& changes)>& publish);
+
+private:
+	/**
+	 * A recorded change
+	 */
+	struct Change{
+		/**
+		 * The fact, retained until flushed
+		 */
+		::fact* fact;
+		/**
+		 * The name of the deftemplate of the fact
+		 */
+		std::string templateName;
+		/**
+		 * The net change, zero if the change cancelled out
+		 */
+		uint8_t kind;
+	};
+
+	/**
+	 * The deftemplates a subscriber is interested in
+	 */
+	struct Subscription{
+		/**
+		 * Whether the subscriber gets all changes
+		 */
+		bool all;
+		/**
+		 * The deftemplates
+		 */
+		std::vector<std::string> templates;
+	};
+
+	/**
+	 * Installs the fact manager hooks
+	 */
+	void hook();
+
+	/**
+	 * Checks whether any subscriber is interested in a deftemplate
+	 */
+	bool isWatched(const char* templateName) const;
+
+	/**
+	 * Records a change of a fact, coalescing it with the one already
+	 * recorded for the same fact, if any
+	 */
+	void record(::fact* f, FactChange kind);
+
+	static void assertCallback(::environmentData* env, void* f, void* context);
+	static void retractCallback(::environmentData* env, void* f, void* context);
+	static void modifyCallback(::environmentData* env, ::fact* oldFact, ::fact* newFact, void* context);
+
+private:
+	bool hooked;
+	/**
+	 * Subscriptions indexed by subscriber
+	 */
+	std::unordered_map<std::string, Subscription> subscriptions;
+	/**
+	 * Number of subscriptions per deftemplate. Only a handful of
+	 * deftemplates are ever watched, so a flat vector is scanned
+	 * faster than hashing each name.
+	 */
+	std::vector<std::pair<std::string, size_t>> watched;
+	/**
+	 * Number of subscribers to all facts
+	 */
+	size_t watchingAll;
+	/**
+	 * Recorded changes, in the order facts first changed
+	 */
+	std::vector<Change> changes;
+	/**
+	 * Position of the change of each fact in changes
+	 */
+	std::unordered_map<::fact*, size_t> positions;
+	/**
+	 * The fact being modified. Modifying a fact retracts and asserts
+	 * it again, which must not be reported.
+	 */
+	::fact* modifying;
+};
+
+}
+
+#endif // __CLIPSWRAPPER_FACTFEED_H__
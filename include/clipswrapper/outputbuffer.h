@@ -0,0 +1,98 @@
+/* ** ***************************************************************
+* outputbuffer.h
+*
+* Author: Mauricio Matamoros
+*
+* Reusable chunked buffer for captured CLIPS output
+*
+** ** **************************************************************/
+/** @file outputbuffer.h
+ * Definition of the OutputBuffer class: an append-only buffer made of
+ * fixed-size chunks that are recycled between reads
+ */
+
+#ifndef __CLIPSWRAPPER_OUTPUTBUFFER_H__
+#define __CLIPSWRAPPER_OUTPUTBUFFER_H__
+#pragma once
+
+/** @cond */
+#include <string>
+#include <vector>
+/** @endcond */
+
+namespace clips{
+
+/**
+ * Implements an append-only buffer made of fixed-size chunks.
+ * Appending never moves the data already stored, and the chunks
+ * released by read() are kept for reuse.
+ */
+class OutputBuffer{
+public:
+	/**
+	 * Initializes a new instance of OutputBuffer
+	 * @param chunkSize Optional. The size in bytes of each chunk.
+	 *                  Default: 4096
+	 * @param maxSpare  Optional. The maximum number of released chunks
+	 *                  kept for reuse. Default: 16
+	 */
+	OutputBuffer(size_t chunkSize = 4096, size_t maxSpare = 16);
+
+	/**
+	 * Appends data to the buffer
+	 * @param s      The data to append
+	 * @param length The number of bytes to append
+	 */
+	void append(const char* s, size_t length);
+
+	/**
+	 * Appends a null-terminated string to the buffer
+	 * @param s The string to append
+	 */
+	void append(const char* s);
+
+	/**
+	 * Gets the number of bytes stored in the buffer
+	 */
+	size_t size() const;
+
+	/**
+	 * Gets a value indicating whether the buffer is empty
+	 */
+	bool empty() const;
+
+	/**
+	 * Retrieves all data in the buffer and clears it.
+	 * Data held in a single chunk is moved out without copying.
+	 * @return The data stored in the buffer
+	 */
+	std::string read();
+
+	/**
+	 * Discards all data in the buffer
+	 */
+	void clear();
+
+private:
+	/**
+	 * Moves a chunk to the spare list or frees it if the list is full
+	 */
+	void recycle(std::string& chunk);
+
+private:
+	size_t chunkSize;
+	size_t maxSpare;
+	size_t length;
+	/**
+	 * Chunks in use. Data is appended to the last one.
+	 */
+	std::vector<std::string> chunks;
+	/**
+	 * Released chunks kept for reuse
+	 */
+	std::vector<std::string> spare;
+};
+
+}
+
+#endif // __CLIPSWRAPPER_OUTPUTBUFFER_H__
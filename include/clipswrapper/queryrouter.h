@@ -12,9 +12,14 @@
 #define __QUERYROUTER_H__
 #pragma once
 
-#include <set>
 #include <string>
+#include <vector>
 #include "clipswrapper.h"
+#include "outputbuffer.h"
+
+/** @cond */
+struct router;
+/** @endcond */
 
 namespace clips{
 
@@ -22,10 +27,12 @@ class QueryRouter{
 // Singleton element access
 public:
 	/**
-	 * Returns the unique instance of QueryRouter, creating it if necessary
+	 * Returns the instance of QueryRouter of the environment selected in
+	 * the calling thread, creating it if necessary.
+	 * Each environment has its own router, released along with it.
 	 * @param  routerName The name to be assigned to the router
 	 * @param  priority   The priority to be assigned to the router
-	 * @return            A unique router (singleton)
+	 * @return            A unique router (singleton per environment)
 	 */
 	static QueryRouter& getInstance(
 		const std::string& routerName = "query",
@@ -40,6 +47,12 @@ private:
 	QueryRouter(const std::string& routerName,
 		clips::RouterPriority priority);
 
+	/**
+	 * Releases the router of an environment being destroyed
+	 * @param env The environment being destroyed
+	 */
+	static void destroyInstance(::environmentData* env);
+
 
 
 public:
@@ -76,6 +89,11 @@ public:
 	 */
 	bool hasLogicalName(const std::string& ln);
 
+	/**
+	 * Checks whether the provided logical is captured/supported by this router
+	 */
+	bool hasLogicalName(const char* ln);
+
 	/**
 	 * Add a logical names to the set being captured by this router
 	 */
@@ -88,7 +106,8 @@ public:
 
 	/**
 	 * Returns the data in the buffer.
-	 * The buffer is cleared afterwards.
+	 * The buffer is cleared afterwards, and its contents are moved
+	 * out rather than copied whenever possible.
 	 * @return The string contained in the internal buffer
 	 */
 	std::string read();
@@ -100,6 +119,21 @@ public:
 	void write(const std::string& s);
 
 private:
+	/**
+	 * A logical name captured by the router
+	 */
+	struct LogicalNameEntry{
+		/**
+		 * The logical name
+		 */
+		std::string name;
+		/**
+		 * Whether captured output is also sent to the routers below
+		 * (true for the standard CLIPS logical names)
+		 */
+		bool echo;
+	};
+
 	/**
 	 * Registers the router with CLIPS
 	 */
@@ -109,13 +143,49 @@ private:
 	 */
 	void unregisterR();
 
+	/**
+	 * Finds a captured logical name
+	 * @param  ln The logical name
+	 * @return    The entry of the logical name or NULL if not captured
+	 */
+	const LogicalNameEntry* findLogicalName(const char* ln) const;
+
+	/**
+	 * Sends output to the first active router after this one that
+	 * recognizes the logical name, as WriteString would do if this
+	 * router were inactive, without deactivating it.
+	 * @param ln  The logical name
+	 * @param str The output
+	 */
+	void echo(const char* ln, const char* str);
+
+	/**
+	 * Router query callback
+	 */
+	static bool queryFunction(::environmentData* env, const char* ln, void* context);
+	/**
+	 * Router write callback
+	 */
+	static void writeFunction(::environmentData* env, const char* ln, const char* str, void* context);
+
 private:
 	std::string routerName;
 	clips::RouterPriority priority;
 	bool registered;
 	bool enabled;
-	std::set<std::string> logicalNames;
-	std::string buffer;
+	/**
+	 * Captured logical names. Only a handful are ever captured,
+	 * so a flat vector is scanned faster than a tree.
+	 */
+	std::vector<LogicalNameEntry> logicalNames;
+	/**
+	 * Captured output
+	 */
+	OutputBuffer buffer;
+	/**
+	 * The router as registered in the environment's router list
+	 */
+	::router* self;
 };
 
 } // end namespace clips
@@ -0,0 +1,200 @@
+/* ** ***************************************************************
+* rulestats.h
+*
+* Author: Mauricio Matamoros
+*
+* Per-rule firing counters and RHS timing
+*
+** ** **************************************************************/
+/** @file rulestats.h
+ * Definition of the RuleStats class: instruments rule firings to
+ * count them and measure the time spent executing each rule's RHS
+ */
+
+#ifndef __CLIPSWRAPPER_RULESTATS_H__
+#define __CLIPSWRAPPER_RULESTATS_H__
+#pragma once
+
+/** @cond */
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_set>
+
+struct environmentData;
+struct activation;
+struct userDataRecord;
+/** @endcond */
+
+namespace clips{
+
+/**
+ * Statistics of a rule
+ */
+struct RuleStatsRow{
+	/**
+	 * The name of the rule, qualified with its module
+	 */
+	std::string name;
+	/**
+	 * Number of times the rule fired
+	 */
+	uint64_t fires;
+	/**
+	 * Number of activations of the rule currently on the agenda
+	 */
+	uint64_t activations;
+	/**
+	 * Total time spent executing the RHS, in nanoseconds
+	 */
+	uint64_t totalNs;
+	/**
+	 * 99th percentile of the RHS execution time, in nanoseconds.
+	 * Taken from a histogram, so it is rounded up by 25% at most.
+	 */
+	uint64_t p99Ns;
+	/**
+	 * Longest RHS execution time, in nanoseconds
+	 */
+	uint64_t maxNs;
+};
+
+
+/**
+ * Instruments rule firings with the before and after rule fires
+ * hooks of the inference engine, counting the firings of each rule
+ * and measuring the time spent in its RHS.
+ * Counters are attached to the rules (and dropped along with them) and
+ * kept in atomics written only by the thread running the environment,
+ * so recording a firing takes no locks. Statistics are collected by
+ * walking the rules and the agenda, so they must be retrieved from the
+ * thread running the environment as well.
+ */
+class RuleStats{
+// Singleton element access
+public:
+	/**
+	 * Returns the instance of RuleStats of the environment selected in
+	 * the calling thread, creating it if necessary.
+	 * Each environment has its own statistics, released along with it.
+	 * @return The statistics (singleton per environment)
+	 */
+	static RuleStats& getInstance();
+
+// Disable copy constructor and copy assignation
+	RuleStats(const RuleStats&)      = delete;
+	void operator=(const RuleStats&) = delete;
+
+// Make constructor private for Singleton
+private:
+	RuleStats();
+
+	/**
+	 * Releases the statistics of an environment being destroyed
+	 * @param env The environment being destroyed
+	 */
+	static void destroyInstance(::environmentData* env);
+
+public:
+	~RuleStats();
+
+public:
+	/**
+	 * Starts recording rule firings
+	 */
+	void enable();
+
+	/**
+	 * Stops recording rule firings. Statistics are kept.
+	 */
+	void disable();
+
+	/**
+	 * Gets a value indicating whether rule firings are being recorded
+	 */
+	bool isEnabled() const;
+
+	/**
+	 * Clears the statistics of all rules
+	 */
+	void reset();
+
+	/**
+	 * Gets the number of rule firings recorded so far. Used to
+	 * retrieve only the rules fired after a given point.
+	 */
+	uint64_t getSequence() const;
+
+	/**
+	 * Gets the statistics of the rules, sorted by total RHS time in
+	 * descending order. Disjuncts of a rule are merged.
+	 * @param  since Optional. Only rules fired after this sequence
+	 *               number (see getSequence()) are reported.
+	 *               Default: 0 (all the rules that ever fired or have
+	 *               activations)
+	 * @return       The statistics
+	 */
+	std::vector<RuleStatsRow> getStats(uint64_t since = 0);
+
+	/**
+	 * Formats statistics as a table with a header line and one line
+	 * per rule with the fields separated by |
+	 * @param  rows The statistics
+	 * @param  max  Optional. Maximum number of rules to include.
+	 *              Default: 0 (all)
+	 * @return      The table
+	 */
+	static std::string toTable(const std::vector<RuleStatsRow>& rows, size_t max = 0);
+
+public:
+	/** @cond */
+	struct Entry;
+	/** @endcond */
+
+private:
+	/**
+	 * Gets the entry of the rule of an activation, creating it if needed
+	 */
+	Entry* getEntry(::activation* act);
+
+	static void* createEntry(::environmentData* env);
+	static void deleteEntry(::environmentData* env, void* data);
+	static void beforeFiring(::environmentData* env, ::activation* act, void* context);
+	static void afterFiring(::environmentData* env, ::activation* act, void* context);
+
+private:
+	/**
+	 * Whether firings are recorded
+	 */
+	bool enabled;
+	/**
+	 * Whether the engine hooks are installed
+	 */
+	bool hooked;
+	/**
+	 * The user data record used to attach entries to rules
+	 */
+	::userDataRecord* record;
+	/**
+	 * Number of firings recorded
+	 */
+	std::atomic<uint64_t> sequence;
+	/**
+	 * Entries of all the rules
+	 */
+	std::unordered_set<Entry*> entries;
+	/**
+	 * The entry of the rule being fired
+	 */
+	Entry* current;
+	/**
+	 * When the rule being fired started
+	 */
+	std::chrono::steady_clock::time_point start;
+};
+
+}
+
+#endif // __CLIPSWRAPPER_RULESTATS_H__
@@ -0,0 +1,144 @@
+/* ** ***************************************************************
+* slotvalue.h
+*
+* Author: Mauricio Matamoros
+*
+* Typed values used to fill deftemplate slots
+*
+** ** **************************************************************/
+/** @file slotvalue.h
+ * Definition of the SlotValue class: a typed value to be stored in a
+ * deftemplate slot without going through the CLIPS parser
+ */
+
+#ifndef __CLIPSWRAPPER_SLOTVALUE_H__
+#define __CLIPSWRAPPER_SLOTVALUE_H__
+#pragma once
+
+/** @cond */
+#include <string>
+#include <vector>
+#include <cstdint>
+/** @endcond */
+
+namespace clips{
+
+/**
+ * Represents a typed value to be stored in a deftemplate slot
+ */
+class SlotValue{
+public:
+	/**
+	 * Enumerates the types a slot value can take
+	 */
+	enum class Type : uint8_t{
+		Integer      = 0,
+		Float        = 1,
+		Symbol       = 2,
+		String       = 3,
+		InstanceName = 4,
+		Multifield   = 5,
+	};
+
+	/**
+	 * Initializes a new instance of SlotValue holding the integer 0
+	 */
+	SlotValue();
+
+	/**
+	 * Initializes a new instance of SlotValue holding an integer
+	 * @param value The value
+	 */
+	SlotValue(int64_t value);
+
+	/**
+	 * Initializes a new instance of SlotValue holding an integer
+	 * @param value The value
+	 */
+	SlotValue(int value);
+
+	/**
+	 * Initializes a new instance of SlotValue holding a float
+	 * @param value The value
+	 */
+	SlotValue(double value);
+
+	/**
+	 * Initializes a new instance of SlotValue holding a symbol,
+	 * string, or instance name
+	 * @param value The value
+	 * @param type  Optional. Specifies how CLIPS should interpret the
+	 *              contents of the string. Default is Symbol.
+	 */
+	SlotValue(const std::string& value, Type type=Type::Symbol);
+
+	/**
+	 * Initializes a new instance of SlotValue holding a symbol,
+	 * string, or instance name
+	 * @param value The value
+	 * @param type  Optional. Specifies how CLIPS should interpret the
+	 *              contents of the string. Default is Symbol.
+	 */
+	SlotValue(const char* value, Type type=Type::Symbol);
+
+	/**
+	 * Initializes a new instance of SlotValue holding a multifield
+	 * @param values The fields of the multifield. Nested multifields
+	 *               are not supported by CLIPS.
+	 */
+	SlotValue(const std::vector<SlotValue>& values);
+
+	/**
+	 * Gets the type of the value
+	 */
+	Type getType() const;
+
+	/**
+	 * Gets the integer value. Valid only for Integer values.
+	 */
+	int64_t getInteger() const;
+
+	/**
+	 * Gets the float value. Valid only for Float values.
+	 */
+	double getFloat() const;
+
+	/**
+	 * Gets the lexeme. Valid only for Symbol, String, and
+	 * InstanceName values.
+	 */
+	const std::string& getLexeme() const;
+
+	/**
+	 * Gets the fields of the value. Valid only for Multifield values.
+	 */
+	const std::vector<SlotValue>& getFields() const;
+
+private:
+	Type type;
+	union{
+		int64_t i;
+		double  d;
+	} number;
+	std::string lexeme;
+	std::vector<SlotValue> fields;
+};
+
+
+/**
+ * Pairs a deftemplate slot name with the value to store in it
+ */
+struct Slot{
+	/**
+	 * The name of the slot
+	 */
+	std::string name;
+	/**
+	 * The value of the slot
+	 */
+	SlotValue value;
+};
+
+}
+
+#endif // __CLIPSWRAPPER_SLOTVALUE_H__
@@ -16,6 +16,7 @@
 #include <functional>
 
 #include "type.h"
+#include "../slotvalue.h"
 
 namespace clips{ namespace udf{
 
@@ -142,6 +143,16 @@ bool firstArgument(Context& ctx, int8_t& out);
  */
 bool firstArgument(Context& ctx, std::string& out);
 
+/**
+ * Retrieves the first argument passed to the User Defined Function,
+ * whichever its type
+ * @param ctx      The execution context provided by CLIPS that contains the arguments
+ * @param out      When this function returns contains the retrieved value iif this
+ *                 was successfully retrieved and is a number or a lexeme.
+ * @return         true if the argument was successfully retrieved and is a number or a lexeme; false otherwise
+ */
+bool firstArgument(Context& ctx, SlotValue& out);
+
 /**
  * Retrieves the argument following the previously retrieved argument (either from firstArgument,
  * nextArgument, or nthArgument) passed to the User Defined Function
@@ -0,0 +1,139 @@
+/** @file main.cpp
+* @author Mauricio Matamoros
+*
+* Benchmark of the placement of activations on the agenda with and
+* without agenda indexing, for the strategies that support it.
+*
+* Each rule matches a control fact (go) and one fact of its own kind.
+* The facts are asserted first and the control fact last, so the
+* activations of each rule must be merged with those of the rules
+* already placed, which is the worst case for a linear search.
+* The order of the agenda is checksummed to verify both placements agree.
+*
+* Usage: agendabench [facts_per_rule] [rules]
+*
+*/
+
+/** @cond */
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+/** @endcond */
+
+extern "C"{
+	#include "clips/clips.h"
+}
+
+/**
+ * The result of a run
+ */
+struct Result{
+	unsigned long activations;
+	double placeSeconds;
+	double runSeconds;
+	uint64_t checksum;
+};
+
+
+/**
+ * Computes the FNV-1a hash of the agenda order: the rule and timetag
+ * of each activation
+ */
+static uint64_t checksum(Environment* env){
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](const void* data, size_t length){
+		const unsigned char* p = (const unsigned char*)data;
+		for(size_t i = 0; i < length; ++i){ hash ^= p[i]; hash *= 1099511628211ULL; }
+	};
+	for(Activation* act = GetNextActivation(env, NULL); act; act = GetNextActivation(env, act)){
+		const char* name = ActivationRuleName(act);
+		add(name, strlen(name));
+		add(&act->timetag, sizeof(act->timetag));
+	}
+	return hash;
+}
+
+
+/**
+ * Floods the agenda of a new environment and measures the time taken
+ * to place the activations and to fire them
+ */
+static Result flood(StrategyType strategy, bool indexing, size_t facts, size_t rules){
+	Result r{0, 0, 0, 0};
+	Environment* env = CreateEnvironment();
+	Eval(env, "(seed 1)", NULL);
+	SetStrategy(env, strategy);
+	SetAgendaIndexing(env, indexing);
+
+	// Rules get different complexities through redundant tests
+	for(size_t i = 0; i < rules; ++i){
+		std::string rule = "(defrule r" + std::to_string(i) + " (go) (f" + std::to_string(i) + " ?x)";
+		for(size_t t = 0; t < i % 3; ++t) rule+= " (test (> ?x -1))";
+		rule+= " =>)";
+		Build(env, rule.c_str());
+	}
+	std::vector<Fact*> first;
+	for(size_t n = 0; n < facts; ++n)
+		for(size_t i = 0; i < rules; ++i){
+			Fact* f = AssertString(env, ("(f" + std::to_string(i) + " " + std::to_string(n) + ")").c_str());
+			if(i == 0) first.push_back(f);
+		}
+
+	auto start = std::chrono::steady_clock::now();
+	AssertString(env, "(go)");
+	auto placed = std::chrono::steady_clock::now();
+	r.activations = GetNumberOfActivations(env);
+	r.checksum = checksum(env);
+
+	// Activations are removed from the middle of the agenda, and the
+	// new ones are placed among the remaining
+	for(size_t n = 0; n < first.size(); n+= 3)
+		Retract(first[n]);
+	for(size_t n = facts; n < facts + facts / 10; ++n)
+		AssertString(env, ("(f" + std::to_string(n % rules) + " " + std::to_string(n) + ")").c_str());
+	r.checksum^= checksum(env);
+	auto fire = std::chrono::steady_clock::now();
+	Run(env, -1);
+	auto end = std::chrono::steady_clock::now();
+
+	r.placeSeconds = std::chrono::duration<double>(placed - start).count();
+	r.runSeconds = std::chrono::duration<double>(end - fire).count();
+	DestroyEnvironment(env);
+	return r;
+}
+
+
+static void print(const char* name, const char* mode, const Result& r, const char* order){
+	printf("%-10s %-7s activations=%-7lu place %9.2f ms %8.1f ns/act  run %8.2f ms  order %016llx %s\n",
+		name, mode, r.activations, r.placeSeconds * 1e3, r.placeSeconds * 1e9 / r.activations,
+		r.runSeconds * 1e3, (unsigned long long)r.checksum, order);
+}
+
+
+int main(int argc, char** argv){
+	size_t facts = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 5000;
+	size_t rules = (argc > 2) ? std::strtoul(argv[2], NULL, 10) : 4;
+	const struct { const char* name; StrategyType strategy; } strategies[] = {
+		{"lex",        LEX_STRATEGY},
+		{"mea",        MEA_STRATEGY},
+		{"complexity", COMPLEXITY_STRATEGY},
+		{"simplicity", SIMPLICITY_STRATEGY},
+		{"random",     RANDOM_STRATEGY},
+	};
+
+	printf("Agenda flood (%lu rules, %lu facts per rule)\n", rules, facts);
+	int mismatches = 0;
+	for(const auto& s : strategies){
+		Result linear = flood(s.strategy, false, facts, rules);
+		Result indexed = flood(s.strategy, true, facts, rules);
+		bool same = (linear.checksum == indexed.checksum) && (linear.activations == indexed.activations);
+		if(!same) ++mismatches;
+		print(s.name, "linear", linear, "");
+		print(s.name, "indexed", indexed, same ? "(same)" : "(MISMATCH)");
+	}
+	return mismatches ? 1 : 0;
+}
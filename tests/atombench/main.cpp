@@ -0,0 +1,101 @@
+/** @file main.cpp
+* @author Mauricio Matamoros
+*
+* Benchmark of the symbol, float and integer tables with and without
+* resizing.
+*
+* Facts carrying high-cardinality atoms (unique ids, timestamps,
+* strings and readings) are asserted, so every fact adds atoms to the
+* tables. The atoms are then looked up again. Both configurations must
+* hold the same facts.
+*
+* Usage: atombench [facts]
+*
+*/
+
+/** @cond */
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <cstdlib>
+#include <cstdint>
+/** @endcond */
+
+extern "C"{
+	#include "clips/clips.h"
+}
+
+/**
+ * The result of a run
+ */
+struct Result{
+	long long facts;
+	double assertSeconds;
+	double lookupSeconds;
+	unsigned long symbols;
+	unsigned long integers;
+	unsigned long floats;
+	size_t found;
+};
+
+
+/**
+ * Asserts the facts in a new environment and measures the time taken,
+ * then the time taken to find their atoms again
+ */
+static Result fill(bool resizing, size_t facts){
+	Result r{0, 0, 0, 0, 0, 0, 0};
+	Environment* env = CreateEnvironment();
+	SetAtomTableResizing(env, resizing);
+	Build(env, "(deftemplate event (slot id) (slot ts) (slot source) (slot reading))");
+	Reset(env);
+
+	const long long epoch = 1700000000000LL;
+	auto start = std::chrono::steady_clock::now();
+	for(size_t n = 0; n < facts; ++n){
+		std::string id = std::to_string(n);
+		AssertString(env, ("(event (id " + id + ") (ts " + std::to_string(epoch + (long long)n * 13) +
+			") (source \"sensor-" + id + "\") (reading " + id + ".25))").c_str());
+	}
+	auto end = std::chrono::steady_clock::now();
+	r.assertSeconds = std::chrono::duration<double>(end - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for(size_t n = 0; n < facts; ++n){
+		std::string source = "sensor-" + std::to_string(n);
+		if( FindSymbolHN(env, source.c_str(), STRING_BIT) && FindLongHN(env, epoch + (long long)n * 13) )
+			++r.found;
+	}
+	end = std::chrono::steady_clock::now();
+	r.lookupSeconds = std::chrono::duration<double>(end - start).count();
+
+	CLIPSValue count;
+	Eval(env, "(length$ (get-fact-list))", &count);
+	r.facts = count.integerValue->contents;
+	r.symbols = GetSymbolTableSize(env);
+	r.integers = GetIntegerTableSize(env);
+	r.floats = GetFloatTableSize(env);
+	DestroyEnvironment(env);
+	return r;
+}
+
+
+int main(int argc, char** argv){
+	size_t facts = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 200000;
+	const struct { const char* name; bool resizing; } configs[] = {
+		{"fixed",    false},
+		{"resizing", true},
+	};
+
+	printf("Atom tables (%lu facts)\n", facts);
+	int mismatches = 0;
+	for(size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i){
+		Result r = fill(configs[i].resizing, facts);
+		bool same = ((size_t)r.facts == facts) && (r.found == facts);
+		if(!same) ++mismatches;
+		printf("%-9s assert %9.2f ms  lookup %8.2f ms  symbols %8lu  integers %8lu  floats %8lu %s\n",
+			configs[i].name, r.assertSeconds * 1e3, r.lookupSeconds * 1e3,
+			r.symbols, r.integers, r.floats, same ? "(ok)" : "(MISMATCH)");
+	}
+	return mismatches ? 1 : 0;
+}
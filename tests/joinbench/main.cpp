@@ -0,0 +1,136 @@
+/** @file main.cpp
+* @author Mauricio Matamoros
+*
+* Benchmark of the beta memory hash tables of the join network under
+* different load factors.
+*
+* A rule joins three patterns on two keys. Facts are asserted, half of
+* them retracted and more asserted, so the beta memories grow, shrink
+* and grow again while being rehashed. The order of the agenda is
+* checksummed to verify every configuration produces the same
+* activations in the same order.
+*
+* Usage: joinbench [facts] [keys]
+*
+*/
+
+/** @cond */
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+/** @endcond */
+
+extern "C"{
+	#include "clips/clips.h"
+}
+
+/**
+ * The result of a run
+ */
+struct Result{
+	unsigned long activations;
+	double seconds;
+	long long buckets;
+	uint64_t checksum;
+};
+
+
+/**
+ * Computes the FNV-1a hash of the agenda order: the timetag of each
+ * activation
+ */
+static uint64_t checksum(Environment* env){
+	uint64_t hash = 14695981039346656037ULL;
+	for(Activation* act = GetNextActivation(env, NULL); act; act = GetNextActivation(env, act)){
+		const unsigned char* p = (const unsigned char*)&act->timetag;
+		for(size_t i = 0; i < sizeof(act->timetag); ++i){ hash ^= p[i]; hash *= 1099511628211ULL; }
+	}
+	return hash;
+}
+
+
+/**
+ * Router that discards the output sent to STDOUT
+ */
+static bool queryDiscard(Environment*, const char* logicalName, void*){
+	return strcmp(logicalName, STDOUT) == 0;
+}
+static void writeDiscard(Environment*, const char*, const char*, void*){}
+
+
+/**
+ * Fills the join network of a new environment and measures the time
+ * taken to match the facts
+ */
+static Result fill(bool resizing, double loadFactor, double minLoadFactor, size_t facts, size_t keys){
+	Result r{0, 0, 0, 0};
+	Environment* env = CreateEnvironment();
+	SetBetaMemoryResizing(env, resizing);
+	SetBetaMemoryMinLoadFactor(env, 0);
+	SetBetaMemoryLoadFactor(env, loadFactor);
+	SetBetaMemoryMinLoadFactor(env, minLoadFactor);
+
+	Build(env, "(deftemplate a (slot k) (slot s))");
+	Build(env, "(deftemplate b (slot k) (slot s) (slot v))");
+	Build(env, "(defrule j (a (k ?k) (s ?s)) (b (k ?k) (s ?s) (v ?v)) (a (k ?v) (s ?s)) =>)");
+	Reset(env);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Fact*> asserted;
+	auto assertFacts = [&](size_t from, size_t to){
+		for(size_t n = from; n < to; ++n){
+			std::string k = std::to_string((n * 7919) % keys), s = "s" + std::to_string(n % 3);
+			asserted.push_back( AssertString(env, ("(a (k " + k + ") (s " + s + "))").c_str()) );
+			AssertString(env, ("(b (k " + k + ") (s " + s + ") (v " + std::to_string(n % keys) + "))").c_str());
+		}
+	};
+	assertFacts(0, facts);
+	for(size_t n = 0; n < asserted.size(); n+= 2)
+		Retract(asserted[n]);
+	assertFacts(facts, facts + facts / 2);
+	auto end = std::chrono::steady_clock::now();
+
+	r.seconds = std::chrono::duration<double>(end - start).count();
+	r.activations = GetNumberOfActivations(env);
+	r.checksum = checksum(env);
+
+	// The listing of beta-memory-stats is discarded, only the totals are kept
+	CLIPSValue stats;
+	AddRouter(env, "discard", 100, queryDiscard, writeDiscard, NULL, NULL, NULL, NULL);
+	Eval(env, "(beta-memory-stats j)", &stats);
+	DeleteRouter(env, "discard");
+	if(stats.header->type == MULTIFIELD_TYPE)
+		r.buckets = stats.multifieldValue->contents[0].integerValue->contents;
+	DestroyEnvironment(env);
+	return r;
+}
+
+
+int main(int argc, char** argv){
+	size_t facts = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 50000;
+	size_t keys = (argc > 2) ? std::strtoul(argv[2], NULL, 10) : 20000;
+	const struct { const char* name; bool resizing; double loadFactor; double minLoadFactor; } configs[] = {
+		{"no resizing", false, 2.0,  0.25},
+		{"load 11",     true,  11.0, 0.0},
+		{"load 2",      true,  2.0,  0.25},
+		{"load 0.5",    true,  0.5,  0.1},
+	};
+
+	printf("Join fill (%lu facts, %lu keys)\n", facts, keys);
+	int mismatches = 0;
+	Result first{};
+	for(size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i){
+		Result r = fill(configs[i].resizing, configs[i].loadFactor, configs[i].minLoadFactor, facts, keys);
+		if(i == 0) first = r;
+		bool same = (r.checksum == first.checksum) && (r.activations == first.activations);
+		if(!same) ++mismatches;
+		printf("%-12s activations=%-8lu %9.2f ms  buckets %8lld  order %016llx %s\n",
+			configs[i].name, r.activations, r.seconds * 1e3, r.buckets,
+			(unsigned long long)r.checksum, same ? "(same)" : "(MISMATCH)");
+	}
+	return mismatches ? 1 : 0;
+}
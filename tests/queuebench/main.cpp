@@ -0,0 +1,156 @@
+/** @file main.cpp
+* @author Mauricio Matamoros
+*
+* Microbenchmark of the queues that hand received messages over to the
+* CLIPS thread: sync_queue (mutex and condition variable) against
+* mpsc_queue (lock-free).
+*
+* Usage: queuebench [max_producers] [messages_per_producer] [wakeup_rounds]
+*
+*/
+
+/** @cond */
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+/** @endcond */
+
+#include "src/sync_queue.h"
+#include "src/mpsc_queue.h"
+
+/**
+ * The queues carry shared pointers, as the server does
+ */
+typedef std::shared_ptr<size_t> message;
+
+/**
+ * The result of a run
+ */
+struct Result{
+	double seconds;
+	double produceSeconds;
+	size_t batches;
+	size_t received;
+};
+
+
+/**
+ * Runs producers that enqueue messages as fast as they can while a
+ * single consumer drains the queue in batches. Messages are allocated
+ * beforehand so only the queue operations are measured.
+ * @param produce A function that enqueues a message
+ * @param consume A function that waits for messages and moves them
+ *                to a vector, returning their number
+ */
+template<typename Produce, typename Consume>
+static Result throughput(size_t producers, size_t count, Produce produce, Consume consume){
+	Result r{0, 0, 0, 0};
+	size_t expected = producers * count;
+	std::vector<std::vector<message>> messages(producers);
+	for(size_t p = 0; p < producers; ++p)
+		for(size_t i = 0; i < count; ++i)
+			messages[p].push_back( std::make_shared<size_t>(p * count + i) );
+	std::vector<double> produceSeconds(producers, 0);
+	std::vector<message> batch;
+	batch.reserve(expected);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for(size_t p = 0; p < producers; ++p){
+		threads.emplace_back([&, p](){
+			auto begin = std::chrono::steady_clock::now();
+			for(message& m : messages[p])
+				produce( std::move(m) );
+			produceSeconds[p] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		});
+	}
+	while(r.received < expected){
+		r.received+= consume(batch);
+		++r.batches;
+	}
+	auto end = std::chrono::steady_clock::now();
+	for(std::thread& t : threads) t.join();
+
+	r.seconds = std::chrono::duration<double>(end - start).count();
+	for(double s : produceSeconds) r.produceSeconds+= s;
+	return r;
+}
+
+
+/**
+ * Measures the round trip of a single message to a consumer that
+ * sleeps on the queue, which acknowledges it through an atomic flag.
+ * @return The mean round trip in nanoseconds
+ */
+template<typename Produce, typename Consume>
+static double wakeup(size_t rounds, Produce produce, Consume consume){
+	std::atomic<size_t> acknowledged(0);
+	std::thread consumer([&](){
+		std::vector<message> batch;
+		for(size_t seen = 0; seen < rounds; ){
+			batch.clear();
+			seen+= consume(batch);
+			acknowledged.store(seen);
+		}
+	});
+	message m = std::make_shared<size_t>(0);
+	auto start = std::chrono::steady_clock::now();
+	for(size_t i = 1; i <= rounds; ++i){
+		produce(m);
+		while(acknowledged.load() < i) std::this_thread::yield();
+	}
+	auto end = std::chrono::steady_clock::now();
+	consumer.join();
+	return std::chrono::duration<double, std::nano>(end - start).count() / rounds;
+}
+
+
+static void print(const char* name, size_t producers, const Result& r){
+	printf("%-11s producers=%-2lu %7.1f ns/msg %6.2f Mmsg/s  produce %6.1f ns/msg  %9.1f msgs/batch\n",
+		name, producers, r.seconds * 1e9 / r.received, r.received / r.seconds / 1e6,
+		r.produceSeconds * 1e9 / r.received, (double)r.received / r.batches);
+}
+
+
+int main(int argc, char** argv){
+	size_t maxProducers = (argc > 1) ? std::strtoul(argv[1], NULL, 10) : 4;
+	size_t count = (argc > 2) ? std::strtoul(argv[2], NULL, 10) : 1000000;
+	size_t rounds = (argc > 3) ? std::strtoul(argv[3], NULL, 10) : 20000;
+	const std::chrono::microseconds timeout(1000);
+
+	printf("Throughput (%lu messages per producer)\n", count);
+	for(size_t producers = 1; producers <= maxProducers; producers*= 2){
+		{
+			sync_queue<message> q;
+			print("sync_queue", producers, throughput(producers, count,
+				[&q](message m){ q.produce(m); },
+				[&q, &timeout](std::vector<message>& out){ return q.timedConsumeAll(out, timeout); }));
+		}
+		{
+			mpsc_queue<message> q;
+			print("mpsc_queue", producers, throughput(producers, count,
+				[&q](message m){ q.produce(std::move(m)); },
+				[&q, &timeout](std::vector<message>& out){ return q.timedConsume(out, SIZE_MAX, timeout); }));
+		}
+	}
+
+	printf("\nWake-up round trip (%lu rounds)\n", rounds);
+	{
+		sync_queue<message> q;
+		printf("%-11s %9.1f ns\n", "sync_queue", wakeup(rounds,
+			[&q](const message& m){ q.produce(m); },
+			[&q](std::vector<message>& out){ return q.consumeAll(out); }));
+	}
+	{
+		mpsc_queue<message> q;
+		printf("%-11s %9.1f ns\n", "mpsc_queue", wakeup(rounds,
+			[&q](const message& m){ q.produce(m); },
+			[&q](std::vector<message>& out){ return q.consume(out, SIZE_MAX); }));
+	}
+	return 0;
+}
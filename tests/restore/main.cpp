@@ -0,0 +1,84 @@
+/** @file main.cpp
+*
+* Checks that a restore refused for being too large doesn't prevent
+* later restores. Requires a running ClipsServer.
+*
+*/
+
+/** @cond */
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+/** @endcond */
+
+#include "clipsclient/clipsclient.h"
+
+/* ** ********************************************************
+* Prototypes
+* *** *******************************************************/
+int main(int argc, char **argv);
+static int check(bool condition, const char* what);
+
+
+/* ** ********************************************************
+* Main (program anchor)
+* *** *******************************************************/
+/**
+ * Program anchor
+ * @param  argc The number of arguments to the program
+ * @param  argv The arguments passed to the program: port (5000)
+ * @return      The program exit code
+ */
+int main(int argc, char **argv){
+	uint16_t port = (argc > 1) ? std::atoi(argv[1]) : 5000;
+	ClipsClientPtr client = ClipsClient::create();
+	if(!client->connect("127.0.0.1", port)){
+		fprintf(stderr, "Could not connect to CLIPS on 127.0.0.1:%u.\n", port);
+		return -1;
+	}
+	printf("Running restore test (protocol v%u)\n", client->getProtocolVersion());
+
+	std::vector<std::string> facts;
+	for(size_t i = 0; i < 1000; ++i)
+		facts.push_back("(restore-test " + std::to_string(i) + ")");
+	int failures = 0;
+	failures+= check(client->assertFacts(facts), "assert facts");
+
+	std::string data;
+	int64_t count, restored;
+	failures+= check(client->snapshot(data, count) && (count >= (int64_t)facts.size()), "take snapshot");
+
+	// Larger than the 1GiB a session can buffer. The refused chunk is
+	// larger than the snapshot so a leftover in the accounting of the
+	// server doesn't wrap back to an acceptable total.
+	std::string oversized(((size_t)1 << 30) + ((size_t)1 << 20), '\0');
+	failures+= check(!client->restore(oversized, restored), "refuse oversized restore");
+	oversized.clear();
+	oversized.shrink_to_fit();
+
+	// Refused chunks must not be left accounted in the total of the server
+	for(size_t i = 0; i < 3; ++i){
+		bool success = client->restore(data, restored) && (restored == count);
+		failures+= check(success, "restore snapshot");
+	}
+
+	client->disconnect();
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+	return failures ? 1 : 0;
+}
+
+
+/* ** ********************************************************
+* Function definitions
+* *** *******************************************************/
+/**
+ * Reports the outcome of a check
+ * @param  condition The result of the check
+ * @param  what      Description of the check
+ * @return           Zero if the check passed, one otherwise
+ */
+static int check(bool condition, const char* what){
+	printf("%-28s %s\n", what, condition ? "ok" : "FAILED");
+	return condition ? 0 : 1;
+}